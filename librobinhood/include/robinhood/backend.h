@@ -29,6 +29,7 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
@@ -256,8 +257,9 @@ enum rbh_info {
     RBH_INFO_MOUNTPOINT             = 0x00000020U,
     RBH_INFO_SIZE                   = 0x00000040U,
     RBH_INFO_COMMAND_BACKEND        = 0x00000080U,
+    RBH_INFO_INDEX_SIZES            = 0x00000100U,
     // Skipping fsevents source for now, must improve info first
-    RBH_INFO_ALL                    = 0x000000f7U
+    RBH_INFO_ALL                    = 0x000001f7U
 };
 
 /**
@@ -385,6 +387,49 @@ enum rbh_generic_backend_option {
      * type: bool
      */
     RBH_GBO_GC,
+    /** Let a backend assume that the entries it is updated with are new
+     *
+     * Backends that support this option may then store new entries in a
+     * single write rather than merging their fsevents into what they already
+     * hold. They only accept to be set in this mode while empty, and fail with
+     * EEXIST otherwise.
+     *
+     * type: bool
+     */
+    RBH_GBO_FRESH_LOAD,
+    /** Create the indexes a backend relies on to answer queries efficiently
+     *
+     * Setting this option to true builds any missing index, which may take a
+     * while on a large backend. Indexes that already exist are left untouched.
+     *
+     * type: bool
+     */
+    RBH_GBO_INDEXES,
+    /** What the last update of a backend did to the entries it stores
+     *
+     * Backends that support this option report the counts of their last call
+     * to rbh_backend_update(), whether it succeeded or not: a failed update
+     * may still have applied some of its fsevents. This option is read-only.
+     *
+     * type: struct rbh_update_stats
+     */
+    RBH_GBO_UPDATE_STATS,
+};
+
+/**
+ * Counts of the last update of a backend, cf. RBH_GBO_UPDATE_STATS
+ */
+struct rbh_update_stats {
+    /** number of entries inserted */
+    int64_t inserted;
+    /** number of entries matched by an update */
+    int64_t matched;
+    /** number of entries inserted by an update */
+    int64_t upserted;
+    /** number of entries deleted */
+    int64_t removed;
+    /** number of operations the backend rejected */
+    size_t write_errors;
 };
 
 /**
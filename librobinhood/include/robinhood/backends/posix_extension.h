@@ -91,6 +91,8 @@ struct posix_backend {
     char *root;
     int statx_sync_type;
     const struct rbh_posix_extension **enrichers;
+    /* Number of threads used by the "parallel" iterator */
+    size_t nb_threads;
 };
 
 struct posix_branch_backend {
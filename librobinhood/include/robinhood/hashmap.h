@@ -17,7 +17,10 @@
  * equality-testing and a hash method for the keys, as well as a bound on how
  * many elements the hashmap should be able to contain.
  *
- * Note: the current implementation does not allow for automatic resizing.
+ * Hashmaps created with rbh_hashmap_new() never grow: rbh_hashmap_set() fails
+ * once every slot is used. If you do not know beforehand how many elements
+ * will be stored, use rbh_hashmap_new_resizable() instead: \p count is then
+ * only a hint, and the hashmap transparently grows as elements are inserted.
  *
  * Example: create a hashmap that can store 4 elements addressed by string keys
  *
@@ -154,6 +157,26 @@ struct rbh_hashmap *
 rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
                 size_t (*hash)(const void *key), size_t count);
 
+/**
+ * Create a hashmap that grows on demand
+ *
+ * @param equals    a function to compare keys
+ * @param hash      a function to hash keys
+ * @param count     the number of elements the hashmap is expected to hold
+ *
+ * @return          a pointer to a newly allocated hashmap on success, NULL on
+ *                  error and errno is set appropriately
+ *
+ * @error EINVAL    \p count is zero or any of \p equals or \p hash is NULL
+ * @error ENOMEM    there was not enough memory available
+ *
+ * The hashmap is sized so that \p count elements fit without having to grow.
+ * Past that, it doubles in size whenever it gets too crowded.
+ */
+struct rbh_hashmap *
+rbh_hashmap_new_resizable(bool (*equals)(const void *first, const void *second),
+                          size_t (*hash)(const void *key), size_t count);
+
 /**
  * Associate a key to a value in a hashmap
  *
@@ -163,7 +186,9 @@ rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
  *
  * @return          0 on success, -1 on error and errno is set appropriately
  *
- * @error ENOBUFS   there is no more slots available in \p hashmap
+ * @error ENOBUFS   there is no more slots available in \p hashmap (this never
+ *                  happens with hashmaps created with
+ *                  rbh_hashmap_new_resizable())
  *
  * \p key must remain valid until it is pop-ed or the hashmap is destroyed.
  */
@@ -30,11 +30,19 @@ struct rbh_fsevents_metadata {
     size_t worker_count;
     struct timespec time_spent_read_and_dedup;
     struct timespec time_spent_enrich_and_update;
+    /* Time spent waiting for the source to read changelogs, included in
+     * time_spent_read_and_dedup
+     */
+    struct timespec time_spent_waiting_changelogs;
     size_t changelog_read;
     int64_t start_index;
     size_t enrich_skip_count;
     size_t deduplicated_event_amount;
     size_t event_amount;
+    /* Number of times an entry was held back when flushing a batch */
+    size_t held_entry_amount;
+    /* Maximum number of entries held back at once */
+    size_t held_entry_peak;
 };
 
 struct rbh_find_metadata {
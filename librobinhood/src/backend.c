@@ -38,6 +38,9 @@ rbh_generic_backend_get_option(struct rbh_backend *backend, unsigned int option,
         errno = ENOTSUP;
         return -1;
     case RBH_GBO_GC:
+    case RBH_GBO_FRESH_LOAD:
+    case RBH_GBO_INDEXES:
+    case RBH_GBO_UPDATE_STATS:
         if (backend->ops->get_option == NULL) {
             errno = ENOTSUP;
             return -1;
@@ -59,9 +62,12 @@ rbh_generic_backend_set_option(struct rbh_backend *backend, unsigned int option,
 {
     switch (option) {
     case RBH_GBO_DEPRECATED:
+    case RBH_GBO_UPDATE_STATS: /* read-only */
         errno = ENOTSUP;
         return -1;
     case RBH_GBO_GC:
+    case RBH_GBO_FRESH_LOAD:
+    case RBH_GBO_INDEXES:
         if (backend->ops->set_option == NULL) {
             errno = ENOTSUP;
             return -1;
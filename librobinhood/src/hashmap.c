@@ -20,9 +20,25 @@
 #include "robinhood/hashmap.h"
 #include "robinhood/utils.h"
 
+/* Robin hood hashing with linear probing
+ *
+ * Every item stores the (mixed) hash of its key, which is used both to compute
+ * how far an item is from its ideal slot (its "probe distance") without
+ * calling the user-provided hash function again, and to skip calls to
+ * `equals()' for keys that cannot possibly match.
+ *
+ * On insertion, an item that is further from its ideal slot than the one it
+ * probes steals the slot, and the displaced item keeps probing. This keeps
+ * probe sequences short and lets lookups stop as soon as they meet an item
+ * closer to its ideal slot than the key they are looking for.
+ *
+ * ref: https://cs.uwaterloo.ca/research/tr/1986/CS-86-14.pdf
+ */
+
 struct rbh_hashmap_item {
     const void *key;
     const void *value;
+    size_t hash;
 };
 
 struct rbh_hashmap {
@@ -30,11 +46,52 @@ struct rbh_hashmap {
     bool (*equals)(const void *first, const void *second);
     struct rbh_hashmap_item *items;
     size_t count;
+    size_t size;
+    bool resizable;
 };
 
-struct rbh_hashmap *
-rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
-                size_t (*hash)(const void *key), size_t count)
+/* Resizable hashmaps grow whenever inserting an element would make them more
+ * than HASHMAP_MAX_LOAD_NUM / HASHMAP_MAX_LOAD_DEN full...
+ */
+#define HASHMAP_MAX_LOAD_NUM 7
+#define HASHMAP_MAX_LOAD_DEN 8
+/* ... or when an insertion ends up further than HASHMAP_MAX_PROBE slots away
+ * from its ideal position (as long as the hashmap is at least half full, so
+ * that a poor hash function does not make us grow forever).
+ */
+#define HASHMAP_MAX_PROBE 32
+#define HASHMAP_MIN_COUNT 8
+
+/* Murmur3 64 bits finalizer
+ *
+ * User-provided hash functions are often weak in their lower bits (djb2 for
+ * instance), which is all a power of two sized table looks at.
+ */
+static inline size_t __attribute__((const))
+hash_mix(size_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdLLU;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53LLU;
+    k ^= k >> 33;
+    return k;
+}
+
+static size_t
+hashmap_count_for(size_t elements)
+{
+    size_t count = HASHMAP_MIN_COUNT;
+
+    while (count / HASHMAP_MAX_LOAD_DEN * HASHMAP_MAX_LOAD_NUM < elements)
+        count *= 2;
+
+    return count;
+}
+
+static struct rbh_hashmap *
+hashmap_new(bool (*equals)(const void *first, const void *second),
+            size_t (*hash)(const void *key), size_t count, bool resizable)
 {
     struct rbh_hashmap *hashmap;
 
@@ -43,6 +100,9 @@ rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
         return NULL;
     }
 
+    if (resizable)
+        count = hashmap_count_for(count);
+
     hashmap = xmalloc(sizeof(*hashmap));
     hashmap->items = xreallocarray(NULL, count, sizeof(*hashmap->items));
 
@@ -52,60 +112,180 @@ rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
         hashmap->items[i].key = NULL;
 
     hashmap->count = count;
+    hashmap->size = 0;
+    hashmap->resizable = resizable;
     return hashmap;
 }
 
+struct rbh_hashmap *
+rbh_hashmap_new(bool (*equals)(const void *first, const void *second),
+                size_t (*hash)(const void *key), size_t count)
+{
+    return hashmap_new(equals, hash, count, false);
+}
+
+struct rbh_hashmap *
+rbh_hashmap_new_resizable(bool (*equals)(const void *first, const void *second),
+                          size_t (*hash)(const void *key), size_t count)
+{
+    return hashmap_new(equals, hash, count, true);
+}
+
+static size_t __attribute__((pure))
+hashmap_ideal_slot(const struct rbh_hashmap *hashmap, size_t hash)
+{
+    /* Resizable hashmaps always have a power of two number of slots */
+    if (hashmap->resizable)
+        return hash & (hashmap->count - 1);
+    return hash % hashmap->count;
+}
+
+static inline size_t __attribute__((pure))
+hashmap_next_slot(const struct rbh_hashmap *hashmap, size_t index)
+{
+    return index + 1 == hashmap->count ? 0 : index + 1;
+}
+
+/* How far the item at `index' is from its ideal slot */
 static size_t __attribute__((pure))
-_hashmap_key2slot(struct rbh_hashmap *hashmap, const void *key)
+hashmap_probe_distance(const struct rbh_hashmap *hashmap, size_t index)
 {
-    return hashmap->hash(key) % hashmap->count;
+    size_t ideal = hashmap_ideal_slot(hashmap, hashmap->items[index].hash);
+
+    return index >= ideal ? index - ideal : index + hashmap->count - ideal;
 }
 
-/* Basic open addressing implementation */
 static struct rbh_hashmap_item *
-hashmap_key2slot(struct rbh_hashmap *hashmap, const void *key)
+hashmap_lookup(struct rbh_hashmap *hashmap, const void *key, size_t hash)
 {
-    size_t index = _hashmap_key2slot(hashmap, key);
+    size_t index = hashmap_ideal_slot(hashmap, hash);
+
+    for (size_t distance = 0; distance < hashmap->count; distance++) {
+        struct rbh_hashmap_item *item = &hashmap->items[index];
 
-    for (size_t i = index; i < hashmap->count; i++) {
-        struct rbh_hashmap_item *item = &hashmap->items[i];
+        /* Had `key' been in the hashmap, it would have been inserted here */
+        if (item->key == NULL ||
+            hashmap_probe_distance(hashmap, index) < distance)
+            return NULL;
 
-        if (item->key == NULL || hashmap->equals(item->key, key))
+        if (item->hash == hash && hashmap->equals(item->key, key))
             return item;
+
+        index = hashmap_next_slot(hashmap, index);
     }
 
-    for (size_t i = 0; i < index; i++) {
-        struct rbh_hashmap_item *item = &hashmap->items[i];
+    return NULL;
+}
 
-        if (item->key == NULL || hashmap->equals(item->key, key))
-            return item;
+/* Insert an item that is known not to be in the hashmap yet
+ *
+ * Returns the longest probe distance this insertion required. There must be
+ * at least one empty slot in \p hashmap.
+ */
+static size_t
+hashmap_insert(struct rbh_hashmap *hashmap, struct rbh_hashmap_item item)
+{
+    size_t index = hashmap_ideal_slot(hashmap, item.hash);
+    size_t longest = 0;
+    size_t distance = 0;
+
+    while (true) {
+        struct rbh_hashmap_item *slot = &hashmap->items[index];
+        size_t slot_distance;
+
+        if (distance > longest)
+            longest = distance;
+
+        if (slot->key == NULL) {
+            *slot = item;
+            hashmap->size++;
+            return longest;
+        }
+
+        slot_distance = hashmap_probe_distance(hashmap, index);
+        if (slot_distance < distance) {
+            /* Take from the rich, give to the poor */
+            struct rbh_hashmap_item tmp = *slot;
+
+            *slot = item;
+            item = tmp;
+            distance = slot_distance;
+        }
+
+        index = hashmap_next_slot(hashmap, index);
+        distance++;
     }
+}
 
-    return NULL;
+static void
+hashmap_grow(struct rbh_hashmap *hashmap)
+{
+    struct rbh_hashmap_item *items = hashmap->items;
+    size_t count = hashmap->count;
+
+    hashmap->count *= 2;
+    hashmap->items = xreallocarray(NULL, hashmap->count,
+                                   sizeof(*hashmap->items));
+    for (size_t i = 0; i < hashmap->count; i++)
+        hashmap->items[i].key = NULL;
+
+    /* Stored hashes spare us calls to the user-provided hash function */
+    hashmap->size = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].key != NULL)
+            hashmap_insert(hashmap, items[i]);
+    }
+
+    free(items);
+}
+
+static bool __attribute__((pure))
+hashmap_is_overloaded(const struct rbh_hashmap *hashmap, size_t size)
+{
+    return size * HASHMAP_MAX_LOAD_DEN > hashmap->count * HASHMAP_MAX_LOAD_NUM;
 }
 
 int
 rbh_hashmap_set(struct rbh_hashmap *hashmap, const void *key, const void *value)
 {
-    struct rbh_hashmap_item *item;
+    struct rbh_hashmap_item item = {
+        .key = key,
+        .value = value,
+        .hash = hash_mix(hashmap->hash(key)),
+    };
+    struct rbh_hashmap_item *match;
+    size_t distance;
+
+    match = hashmap_lookup(hashmap, key, item.hash);
+    if (match != NULL) {
+        match->key = key;
+        match->value = value;
+        return 0;
+    }
 
-    item = hashmap_key2slot(hashmap, key);
-    if (item == NULL) {
+    if (hashmap->resizable) {
+        if (hashmap_is_overloaded(hashmap, hashmap->size + 1))
+            hashmap_grow(hashmap);
+    } else if (hashmap->size == hashmap->count) {
         errno = ENOBUFS;
         return -1;
     }
 
-    item->key = key;
-    item->value = value;
+    distance = hashmap_insert(hashmap, item);
+    if (hashmap->resizable && distance > HASHMAP_MAX_PROBE
+     && hashmap->size * 2 >= hashmap->count)
+        hashmap_grow(hashmap);
+
     return 0;
 }
 
 const void *
 rbh_hashmap_get(struct rbh_hashmap *hashmap, const void *key)
 {
-    struct rbh_hashmap_item *match = hashmap_key2slot(hashmap, key);
+    struct rbh_hashmap_item *match;
 
-    if (match == NULL || match->key == NULL) {
+    match = hashmap_lookup(hashmap, key, hash_mix(hashmap->hash(key)));
+    if (match == NULL) {
         errno = ENOENT;
         return NULL;
     }
@@ -113,142 +293,68 @@ rbh_hashmap_get(struct rbh_hashmap *hashmap, const void *key)
     return match->value;
 }
 
-/* Here, "is_between" means: if we traverse an array starting at index `low`,
- * wrap around once we reach the end, and stop at `high`, do we encounter
- * `index`?
- */
-static bool __attribute__((pure))
-is_between(size_t index, size_t low, size_t high)
-{
-    return low <= high ? low <= index && index <= high
-                       : low <= index || index <= high;
-}
-
 /* Since we use open-addressing with linear probing, we can't just empty a slot
- * and be done with it. We have to maintain the invariant, which means
- * traversing the array looking for a cell that would be better placed in the
- * slot we are emptying, and move the first one we find. We can stop at the
- * first empty cell we encounter.
- *
- * Of course, if we have to move a cell, it just frees another slot, and we have
- * to enforce the invariant again.
- *
- * To the question:
- *     When would a cell be better placed in a slot we are emptying?
+ * and be done with it: the items stored after it may have probed past it, and
+ * a lookup for them would stop at the empty slot.
  *
- * The answer is:
- *     Iff the ideal position for the cell is "before" the slot we are emptying.
- *
- * I personally find it hard to grasp what "before" means when we reach the end
- * of the array and have to wrap around. I prefer the following definition:
- *
- * A cell should be moved when the slot we empty is "between" the cell's ideal
- * position and its current position:
+ * Robin hood hashing makes this easy to fix: every item that directly follows
+ * the slot we are emptying and that is not in its ideal slot is shifted back
+ * by one. We stop at the first empty slot or at the first item that already is
+ * in its ideal slot.
  *
  * Example:
  *
- *                   the slot we are emptying
- *                   v
- *     ---------------------------------
- *     | x |   | i | e | x | x | c |   |
- *     ---------------------------------
- *               ^               ^
- *               |               the cell we are considering
- *               |
- *               the cell's ideal position
- *
- *     We indeed have i < e < c
- *
- * Real-world example:
- *
- *     Assuming a filled hashmap, where keys are chars, and the hash algorithm
- *     is: hash(x) -> x - 'A'
+ *     Assuming a hashmap where keys are chars, and the hash algorithm is:
+ *     hash(x) -> x - 'A'
  *
  *       0   1   2   3   4   5   6   7
  *     ---------------------------------
- *     | A | B | K | D | C | E | F | G |  <-- keys
- *     ---------------------------------
- *     |...|...|...|...|...|...|...|...|  <-- values (not relevant here)
- *     ---------------------------------
- *
- *     If we pop 'D', and do nothing else:
- *
- *       0   1   2   3   4   5   6   7
- *     ---------------------------------
- *     | A | B | K |   | C | E | F | G |
- *     ---------------------------------
- *
- *     We can't find 'C' anymore:
- *
- *     hash('C') -> 2
- *     items[2] -> 'K'   # not a match => keep looking
- *     items[3] -> NULL  # empty slot  => stop looking
- *
- *     We have to move 'C' back:
- *
- *       0   1   2   3   4   5   6   7
+ *     | A | B | C | K | D | E | G |   |  <-- keys
  *     ---------------------------------
- *     | A | B | K | C |   | E | F | G |
+ *     | 0 | 0 | 0 | 1 | 1 | 1 | 0 |   |  <-- probe distances
  *     ---------------------------------
  *
- *     And then 'E':
+ *     If we pop 'C', 'K', 'D' and 'E' are shifted back, and we stop at 'G':
  *
  *       0   1   2   3   4   5   6   7
  *     ---------------------------------
- *     | A | B | K | C | E |   | F | G |
- *     ---------------------------------
- *
- *     And then 'F', and then 'G', until finally:
- *
- *       0   1   2   3   4   5   6   7
+ *     | A | B | K | D | E |   | G |   |
  *     ---------------------------------
- *     | A | B | K | C | E | F | G |   |
+ *     | 0 | 0 | 0 | 0 | 0 |   | 0 |   |
  *     ---------------------------------
  *
- *     Order is restored. =)
+ * Which also means that this never leaves "tombstones" behind.
  *
- * ref: https://en.wikipedia.org/wiki/Linear_probing#Deletion
+ * ref: https://codecapsule.com/2013/11/17/robin-hood-hashing-backward-shift-deletion/
  */
 static void
 hashmap_pop(struct rbh_hashmap *hashmap, struct rbh_hashmap_item *item)
 {
     size_t index = item - hashmap->items;
 
-    for (size_t i = index + 1; i < hashmap->count; i++) {
-        struct rbh_hashmap_item *next = &hashmap->items[i];
+    for (size_t i = 1; i < hashmap->count; i++) {
+        size_t next = hashmap_next_slot(hashmap, index);
 
-        if (next->key == NULL)
-            goto out;
+        if (hashmap->items[next].key == NULL ||
+            hashmap_probe_distance(hashmap, next) == 0)
+            break;
 
-        if (is_between(index, _hashmap_key2slot(hashmap, next->key), i)) {
-            *item = *next;
-            return hashmap_pop(hashmap, next);
-        }
-    }
-
-    for (size_t i = 0; i < index; i++) {
-        struct rbh_hashmap_item *next = &hashmap->items[i];
-
-        if (next->key == NULL)
-            goto out;
-
-        if (is_between(index, _hashmap_key2slot(hashmap, next->key), i)) {
-            *item = *next;
-            return hashmap_pop(hashmap, next);
-        }
+        hashmap->items[index] = hashmap->items[next];
+        index = next;
     }
 
-out:
-    item->key = NULL;
+    hashmap->items[index].key = NULL;
+    hashmap->size--;
 }
 
 const void *
 rbh_hashmap_pop(struct rbh_hashmap *hashmap, const void *key)
 {
-    struct rbh_hashmap_item *match = hashmap_key2slot(hashmap, key);
+    struct rbh_hashmap_item *match;
     const void *value;
 
-    if (match == NULL || match->key == NULL) {
+    match = hashmap_lookup(hashmap, key, hash_mix(hashmap->hash(key)));
+    if (match == NULL) {
         errno = ENOENT;
         return NULL;
     }
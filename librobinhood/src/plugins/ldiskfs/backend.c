@@ -5,6 +5,10 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include <unistd.h>
+
+#include <robinhood/config.h>
+
 #include "internals.h"
 
 static const struct rbh_backend_operations LDISKFS_BACKEND_OPS = {
@@ -19,6 +23,74 @@ static const struct rbh_backend LDISKFS_BACKEND = {
     .ops  = &LDISKFS_BACKEND_OPS,
 };
 
+#define LDISKFS_SCAN_THREADS "scan_threads"
+#define LDISKFS_INODE_BUFFER_BLOCKS "inode_buffer_blocks"
+#define LDISKFS_STREAM_OST "stream_ost"
+
+static int32_t
+get_scan_threads()
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+    long online;
+
+    rc = rbh_config_find("ldiskfs/"LDISKFS_SCAN_THREADS, &value,
+                         RBH_VT_INT32);
+    if (rc == KPR_ERROR)
+        return -1;
+
+    if (rc == KPR_FOUND && value.int32 > 0)
+        return value.int32;
+
+    if (rc == KPR_FOUND && value.int32 < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? online : 1;
+}
+
+static int32_t
+get_inode_buffer_blocks(ext2_filsys fs)
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find("ldiskfs/"LDISKFS_INODE_BUFFER_BLOCKS, &value,
+                         RBH_VT_INT32);
+    if (rc == KPR_ERROR)
+        return -1;
+
+    if (rc == KPR_NOT_FOUND || value.int32 == 0)
+        /* read a whole inode table at once */
+        return fs->inode_blocks_per_group;
+
+    if (value.int32 < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return value.int32;
+}
+
+static int
+get_stream_ost()
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find("ldiskfs/"LDISKFS_STREAM_OST, &value,
+                         RBH_VT_BOOLEAN);
+    if (rc == KPR_ERROR)
+        return -1;
+
+    if (rc == KPR_NOT_FOUND)
+        value.boolean = false;
+
+    return value.boolean;
+}
+
 struct rbh_backend *
 rbh_ldiskfs_backend_new(const struct rbh_backend_plugin *self,
                         const struct rbh_uri *uri,
@@ -26,7 +98,10 @@ rbh_ldiskfs_backend_new(const struct rbh_backend_plugin *self,
                         bool read_only)
 {
     struct ldiskfs_backend *ldiskfs;
+    int32_t buffer_blocks;
     char *io_opts = NULL;
+    int32_t threads;
+    int stream_ost;
     errcode_t rc;
 
     ldiskfs = xcalloc(1, sizeof(*ldiskfs));
@@ -42,11 +117,28 @@ rbh_ldiskfs_backend_new(const struct rbh_backend_plugin *self,
         return NULL;
     }
 
-    ldiskfs->dcache = rbh_dcache_new();
+    threads = get_scan_threads();
+    buffer_blocks = get_inode_buffer_blocks(ldiskfs->fs);
+    stream_ost = get_stream_ost();
+    if (threads == -1 || buffer_blocks == -1 || stream_ost == -1) {
+        int save_errno = errno;
+
+        ext2fs_close(ldiskfs->fs);
+        free(ldiskfs);
+        errno = save_errno;
+        return NULL;
+    }
+    ldiskfs->scan_threads = threads;
+    ldiskfs->inode_buffer_blocks = buffer_blocks;
+    ldiskfs->stream_ost = stream_ost;
+    ldiskfs->device = xstrdup(uri->fsname);
+
+    ldiskfs->dcache = rbh_dcache_new(ldiskfs->fs);
     if (!ldiskfs->dcache) {
         int save_errno = errno;
 
         ext2fs_close(ldiskfs->fs);
+        free(ldiskfs->device);
         free(ldiskfs);
         errno = save_errno;
         return NULL;
@@ -62,6 +154,7 @@ ldiskfs_backend_destroy(void *backend)
 
     rbh_dcache_destroy(ldiskfs->dcache);
     ext2fs_close(ldiskfs->fs);
+    free(ldiskfs->device);
     free(ldiskfs);
 }
 
@@ -10,26 +10,59 @@
 
 #include <assert.h>
 
-struct rbh_dentry *
-rbh_dentry_new(ext2_ino_t ino)
-{
-    struct rbh_dentry *dentry;
+/* Names are at most EXT2_NAME_LEN bytes long, this is much larger to limit the
+ * number of allocations.
+ */
+#define NAMES_CHUNK_SIZE (1 << 20)
 
-    dentry = xcalloc(sizeof(*dentry), 1);
-    dentry->ino = ino;
-    dentry->parents = g_queue_new();
-    return dentry;
+#define ext2fs_inode_includes(size, field)              \
+    ((size) >= (sizeof(((struct ext2_inode_large *)0)->field) + \
+            offsetof(struct ext2_inode_large, field)))
+
+static inline time_t decode_extra_sec(time_t seconds,
+                    __u32 extra __attribute__((unused)))
+{
+#if (SIZEOF_TIME_T > 4)
+    if (extra & EXT4_EPOCH_MASK)
+        seconds += ((time_t)(extra & EXT4_EPOCH_MASK) << 32);
+#endif
+    return seconds;
 }
 
-struct rbh_dcache *rbh_dcache_new(void)
+#define ext2fs_inode_actual_size(inode)                       \
+    ((size_t)(EXT2_GOOD_OLD_INODE_SIZE +                      \
+          (sizeof(*inode) > EXT2_GOOD_OLD_INODE_SIZE ?            \
+           ((struct ext2_inode_large *)(inode))->i_extra_isize : 0)))
+
+#ifndef ext2fs_inode_xtime_get
+#define ext2fs_inode_xtime_get(inode, field)                                         \
+    (ext2fs_inode_includes(ext2fs_inode_actual_size(inode), field ## _extra) ?       \
+         decode_extra_sec((inode)->field,                                          \
+                            ((struct ext2_inode_large *)(inode))->field ## _extra) : \
+        (time_t)(inode)->field)
+#endif
+
+#define inode_blocks(inode) \
+    ((unsigned long long)inode->osd2.linux2.l_i_blocks_hi << 32) | \
+    inode->i_blocks
+
+struct rbh_dcache *rbh_dcache_new(ext2_filsys fs)
 {
     struct rbh_dcache *dcache;
     int save_errno;
 
     dcache = xmalloc(sizeof(*dcache));
-    dcache->dentries = g_hash_table_new(g_int_hash, g_int_equal);
-    if (!dcache->dentries) {
+    dcache->group_count = fs->group_desc_count;
+    dcache->inodes_per_group = fs->super->s_inodes_per_group;
+    dcache->groups = xcalloc(dcache->group_count, sizeof(*dcache->groups));
+    dcache->count = 0;
+    dcache->links = g_array_new(false, false, sizeof(struct rbh_dcache_link));
+
+    dcache->names = rbh_sstack_new(NAMES_CHUNK_SIZE);
+    if (!dcache->names) {
         save_errno = errno;
+        g_array_free(dcache->links, true);
+        free(dcache->groups);
         free(dcache);
         errno = save_errno;
         return NULL;
@@ -40,97 +73,185 @@ struct rbh_dcache *rbh_dcache_new(void)
 
 void rbh_dcache_destroy(struct rbh_dcache *dcache)
 {
-    g_hash_table_destroy(dcache->dentries);
+    for (dgrp_t i = 0; i < dcache->group_count; i++)
+        free(dcache->groups[i]);
+    free(dcache->groups);
+    g_array_free(dcache->links, true);
+    rbh_sstack_destroy(dcache->names);
     free(dcache);
 }
 
-struct rbh_dentry *
-rbh_dcache_find(struct rbh_dcache *dcache, ext2_ino_t ino)
+static struct rbh_dentry *
+dcache_slot(struct rbh_dcache *dcache, ext2_ino_t ino, bool create)
 {
-    return g_hash_table_lookup(dcache->dentries, &ino);
-}
+    dgrp_t group = (ino - 1) / dcache->inodes_per_group;
 
-struct rbh_dentry *
-rbh_dcache_find_or_create(struct rbh_dcache *dcache, ext2_ino_t ino)
-{
-    struct rbh_dentry *dentry;
+    if (ino == 0 || group >= dcache->group_count)
+        return NULL;
 
-    dentry = g_hash_table_lookup(dcache->dentries, &ino);
-    if (!dentry) {
-        dentry = rbh_dentry_new(ino);
-        if (!dentry)
+    if (!dcache->groups[group]) {
+        if (!create)
             return NULL;
 
-        g_hash_table_insert(dcache->dentries, &dentry->ino, dentry);
+        dcache->groups[group] = xcalloc(dcache->inodes_per_group,
+                                        sizeof(struct rbh_dentry));
     }
 
-    assert(dentry->ino == ino);
+    return &dcache->groups[group][(ino - 1) % dcache->inodes_per_group];
+}
+
+struct rbh_dentry *
+rbh_dcache_find(struct rbh_dcache *dcache, ext2_ino_t ino)
+{
+    struct rbh_dentry *dentry = dcache_slot(dcache, ino, false);
+
+    if (!dentry || dentry->mode == 0)
+        return NULL;
 
     return dentry;
 }
 
-static gint
-glist_name_cmp(gconstpointer a, gconstpointer b)
+void
+rbh_dentry_fill(struct rbh_dentry *dentry, struct ext2_inode_large *inode)
+{
+    dentry->size = EXT2_I_SIZE(inode);
+    dentry->blocks = inode_blocks(inode);
+    dentry->atime = ext2fs_inode_xtime_get(inode, i_atime);
+    dentry->mtime = ext2fs_inode_xtime_get(inode, i_mtime);
+    dentry->ctime = ext2fs_inode_xtime_get(inode, i_ctime);
+    dentry->uid = inode_uid(*inode);
+    dentry->gid = inode_gid(*inode);
+    dentry->projid = inode_projid(*inode);
+    dentry->mode = inode->i_mode;
+    dentry->nlink = inode->i_links_count;
+}
+
+struct rbh_dentry *
+rbh_dcache_fill(struct rbh_dcache *dcache, ext2_ino_t ino,
+                struct ext2_inode_large *inode)
 {
-    const struct rbh_dentry *dentry = a;
-    const char *name = b;
+    struct rbh_dentry *dentry = dcache_slot(dcache, ino, true);
+
+    assert(dentry);
+    rbh_dentry_fill(dentry, inode);
 
-    return strncmp(dentry->name, name, dentry->namelen);
+    return dentry;
 }
 
-static struct rbh_dentry *
-rbh_dir_lookup(struct rbh_dentry *parent, const char *name)
+bool
+rbh_dcache_link(struct rbh_dcache *dcache, ext2_ino_t parent, ext2_ino_t ino,
+                const char *name, size_t namelen)
 {
-    GList *child;
+    struct rbh_dentry *directory = rbh_dcache_find(dcache, parent);
+    struct rbh_dentry *dentry = rbh_dcache_find(dcache, ino);
+    struct rbh_dcache_link link;
+    char *copy;
 
-    if (!LINUX_S_ISDIR(parent->inode->i_mode)) {
-        errno = ENOTDIR;
-        return NULL;
+    if (!directory || !dentry) {
+        errno = ENOENT;
+        return false;
     }
 
-    child = g_list_find_custom(parent->children, name, glist_name_cmp);
-    if (!child) {
-        errno = ENOENT;
-        return NULL;
+    copy = RBH_SSTACK_PUSH(dcache->names, NULL, namelen + 1);
+    memcpy(copy, name, namelen);
+    copy[namelen] = '\0';
+
+    if (!dentry->name) {
+        dentry->name = copy;
+        dentry->parent = parent;
+        dentry->next_sibling = directory->first_child;
+        directory->first_child = ino;
+        return true;
     }
 
-    return child->data;
+    link.name = copy;
+    link.ino = ino;
+    link.next = directory->links;
+    g_array_append_val(dcache->links, link);
+    directory->links = dcache->links->len;
+
+    return true;
 }
 
-struct rbh_dentry *
-rbh_dcache_lookup(struct rbh_dcache *dcache, ext2_ino_t ino, const char *name)
+void
+rbh_dcache_foreach_child(struct rbh_dcache *dcache, ext2_ino_t parent,
+                         rbh_dcache_cb_t cb, void *udata)
 {
-    struct rbh_dentry *dentry;
+    struct rbh_dentry *directory = rbh_dcache_find(dcache, parent);
+    struct rbh_dlink child = {
+        .parent = parent,
+    };
+    uint32_t index;
 
-    dentry = rbh_dcache_find(dcache, ino);
-    if (!dentry) {
-        errno = ENOENT;
-        return NULL;
+    if (!directory)
+        return;
+
+    child.ino = directory->first_child;
+    while (child.ino) {
+        struct rbh_dentry *dentry = rbh_dcache_find(dcache, child.ino);
+
+        child.name = dentry->name;
+        cb(&child, udata);
+        child.ino = dentry->next_sibling;
     }
 
-    return rbh_dir_lookup(dentry, name);
+    index = directory->links;
+    while (index) {
+        struct rbh_dcache_link *link;
+
+        link = &g_array_index(dcache->links, struct rbh_dcache_link,
+                              index - 1);
+        child.ino = link->ino;
+        child.name = link->name;
+        cb(&child, udata);
+        index = link->next;
+    }
 }
 
-struct iter_data {
-    rbh_dcache_cb_t cb;
-    void *udata;
+struct lookup_data {
+    const char *name;
+    struct rbh_dlink *link;
+    bool found;
 };
 
-static void glib_foreach_cb(gpointer ino, gpointer dentry, gpointer udata)
+static void
+lookup_cb(const struct rbh_dlink *link, void *udata)
 {
-    struct iter_data *data = udata;
-
-    (void) ino;
+    struct lookup_data *data = udata;
 
-    data->cb(dentry, data->udata);
+    if (!data->found && !strcmp(link->name, data->name)) {
+        *data->link = *link;
+        data->found = true;
+    }
 }
 
-void
-rbh_dcache_foreach(struct rbh_dcache *dcache, rbh_dcache_cb_t cb, void *udata)
+bool
+rbh_dcache_lookup(struct rbh_dcache *dcache, ext2_ino_t ino, const char *name,
+                  struct rbh_dlink *link)
 {
-    struct iter_data data = {
-        .udata = udata,
-        .cb = cb,
+    struct rbh_dentry *dentry;
+    struct lookup_data data = {
+        .name = name,
+        .link = link,
+        .found = false,
     };
-    g_hash_table_foreach(dcache->dentries, glib_foreach_cb, &data);
+
+    dentry = rbh_dcache_find(dcache, ino);
+    if (!dentry) {
+        errno = ENOENT;
+        return false;
+    }
+
+    if (!LINUX_S_ISDIR(dentry->mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+
+    rbh_dcache_foreach_child(dcache, ino, lookup_cb, &data);
+    if (!data.found) {
+        errno = ENOENT;
+        return false;
+    }
+
+    return true;
 }
@@ -17,57 +17,121 @@
 #include <robinhood/id.h>
 #include "internals.h"
 
-struct rbh_dcache {
-    GHashTable *dentries;
-};
+/* The dcache holds one fixed-size record per inode of the target, in arrays
+ * indexed by inode number. There is one array per block group, only allocated
+ * once an inode of the group is found in use.
+ *
+ * Memory footprint per inode in use (measured on 1M inodes on x86_64):
+ *   - a dentry allocated on its own, indexed in a GHashTable, with a copy of
+ *     the raw inode, a GQueue of parents and a GList of children (what this
+ *     cache used to be): about 280 bytes plus the size of an inode, that is
+ *     540 bytes for 256-byte inodes and 1300 bytes for the 1024-byte inodes
+ *     of a Lustre MDT;
+ *   - a record: sizeof(struct rbh_dentry), that is 96 bytes, plus the name and
+ *     its terminating null byte, and the records of the unused inodes that
+ *     share a block group with it.
+ */
 
-struct rbh_dentry_xattr {
-    char *name;
-    void *value;
-    size_t value_len;
+/* The inode fields needed to build an fsentry, and the primary link of the
+ * inode: its first name in its first parent directory.
+ *
+ * The other links of the inode, if it has any, are stored in the side table
+ * of the dcache, and chained from the record of the directory they are in.
+ */
+struct rbh_dentry {
+    /* Points into the string pool of the dcache, NULL until linked */
+    const char *name;
+    uint64_t size;
+    uint64_t blocks;
+    int64_t atime;
+    int64_t mtime;
+    int64_t ctime;
+    /* Only set once an fsentry was built from the inode */
+    struct lu_fid fid;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t projid;
+    ext2_ino_t parent;
+    /* Children of a directory, linked through their next_sibling */
+    ext2_ino_t first_child;
+    ext2_ino_t next_sibling;
+    /* 1 + the index of the first link in the side table whose parent is this
+     * directory, 0 if there is none
+     */
+    uint32_t links;
+    /* 0 if the inode is not in use */
+    uint16_t mode;
+    uint16_t nlink;
 };
 
-// We store each parent of a dentry with the corresponding name of the dentry.
-// That allows us to avoid a bug where all hardlinks of the same inode
-// are displayed like they are at the same place.
-struct rbh_parent_pair {
+/* A link other than the primary one, stored in the side table */
+struct rbh_dcache_link {
     const char *name;
-    struct rbh_dentry *parent;
+    ext2_ino_t ino;
+    /* Same as rbh_dentry.links, for the next link in the same directory */
+    uint32_t next;
 };
 
-struct rbh_dentry {
+/* An inode as seen from one of its parents */
+struct rbh_dlink {
     ext2_ino_t ino;
-    struct ext2_inode *inode;
+    ext2_ino_t parent;
     const char *name;
-    size_t namelen;
-    struct rbh_dentry *parent;
-    struct lu_fid fid;
-    GList *children;
-    GQueue *parents; // rbh_parent_pair queue
-    GList *xattrs;
 };
 
-struct rbh_dentry *
-rbh_dentry_new(ext2_ino_t ino);
+struct rbh_dcache {
+    /* Records of each block group, indexed by group and inode number */
+    struct rbh_dentry **groups;
+    dgrp_t group_count;
+    ext2_ino_t inodes_per_group;
+    /* Number of records in use */
+    size_t count;
+    /* Names of the inodes */
+    struct rbh_sstack *names;
+    /* Links other than the primary ones (struct rbh_dcache_link) */
+    GArray *links;
+};
 
 struct rbh_dcache *
-rbh_dcache_new(void);
+rbh_dcache_new(ext2_filsys fs);
 
 void
 rbh_dcache_destroy(struct rbh_dcache *dcache);
 
+/* Return the record of inode \p ino, NULL if it is not in use */
 struct rbh_dentry *
 rbh_dcache_find(struct rbh_dcache *dcache, ext2_ino_t ino);
 
+/* Fill \p dentry with the fields of \p inode it keeps */
+void
+rbh_dentry_fill(struct rbh_dentry *dentry, struct ext2_inode_large *inode);
+
+/* Return the record of inode \p ino, which is marked in use by filling it.
+ *
+ * Records of different block groups can be filled concurrently.
+ */
 struct rbh_dentry *
-rbh_dcache_find_or_create(struct rbh_dcache *dcache, ext2_ino_t ino);
+rbh_dcache_fill(struct rbh_dcache *dcache, ext2_ino_t ino,
+                struct ext2_inode_large *inode);
 
-typedef void (*rbh_dcache_cb_t)(struct rbh_fsentry *fsentry, void *udata);
+/* Add the entry \p name of inode \p ino to directory \p parent.
+ *
+ * Returns false if either inode is not in use, with errno set to ENOENT.
+ */
+bool
+rbh_dcache_link(struct rbh_dcache *dcache, ext2_ino_t parent, ext2_ino_t ino,
+                const char *name, size_t namelen);
 
+typedef void (*rbh_dcache_cb_t)(const struct rbh_dlink *link, void *udata);
+
+/* Call \p cb for each entry of directory \p parent */
 void
-rbh_dcache_foreach(struct rbh_dcache *dcache, rbh_dcache_cb_t cb, void *udata);
+rbh_dcache_foreach_child(struct rbh_dcache *dcache, ext2_ino_t parent,
+                         rbh_dcache_cb_t cb, void *udata);
 
-struct rbh_dentry *
-rbh_dcache_lookup(struct rbh_dcache *dcache, ext2_ino_t ino, const char *name);
+/* Find the entry \p name of directory \p ino, and store it in \p link */
+bool
+rbh_dcache_lookup(struct rbh_dcache *dcache, ext2_ino_t ino, const char *name,
+                  struct rbh_dlink *link);
 
 #endif
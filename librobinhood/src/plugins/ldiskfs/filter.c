@@ -14,142 +14,183 @@
 static bool
 is_dir(struct rbh_dentry *dentry)
 {
-    return LINUX_S_ISDIR(dentry->inode->i_mode);
+    return LINUX_S_ISDIR(dentry->mode);
 }
 
-#define ext2fs_inode_includes(size, field)              \
-    ((size) >= (sizeof(((struct ext2_inode_large *)0)->field) + \
-            offsetof(struct ext2_inode_large, field)))
+/* The path of an entry, ending with a '/' for directories.
+ *
+ * The path of a directory is shared by the tasks of its entries, which only
+ * append their name to it: each of them holds a reference on it, released once
+ * the entry is emitted.
+ */
+struct ldiskfs_path {
+    size_t refcount;
+    size_t length;
+    char data[];
+};
 
-static inline time_t decode_extra_sec(time_t seconds,
-                    __u32 extra __attribute__((unused)))
-{
-#if (SIZEOF_TIME_T > 4)
-    if (extra & EXT4_EPOCH_MASK)
-        seconds += ((time_t)(extra & EXT4_EPOCH_MASK) << 32);
-#endif
-    return seconds;
-}
+struct ldiskfs_task {
+    struct rbh_dlink link;
+    /* Path of the parent, NULL if the entry's path is "/" */
+    struct ldiskfs_path *parent;
+};
 
-#define ext2fs_inode_actual_size(inode)                       \
-    ((size_t)(EXT2_GOOD_OLD_INODE_SIZE +                      \
-          (sizeof(*inode) > EXT2_GOOD_OLD_INODE_SIZE ?            \
-           ((struct ext2_inode_large *)(inode))->i_extra_isize : 0)))
+static struct ldiskfs_path *
+path_new(const struct ldiskfs_path *parent, const char *name, bool is_dir)
+{
+    size_t namelen = name ? strlen(name) : 0;
+    struct ldiskfs_path *path;
+    size_t length;
+
+    if (!parent) {
+        path = xmalloc(sizeof(*path) + 2);
+        path->refcount = 1;
+        path->length = 1;
+        path->data[0] = '/';
+        path->data[1] = '\0';
+        return path;
+    }
 
-#ifndef ext2fs_inode_xtime_get
-#define ext2fs_inode_xtime_get(inode, field)                                         \
-    (ext2fs_inode_includes(ext2fs_inode_actual_size(inode), field ## _extra) ?       \
-         decode_extra_sec((inode)->field,                                          \
-                            ((struct ext2_inode_large *)(inode))->field ## _extra) : \
-        (time_t)(inode)->field)
-#endif
+    length = parent->length + namelen + (is_dir ? 1 : 0);
+    path = xmalloc(sizeof(*path) + length + 1);
+    path->refcount = 1;
+    path->length = length;
+    memcpy(path->data, parent->data, parent->length);
+    memcpy(path->data + parent->length, name, namelen);
+    if (is_dir)
+        path->data[length - 1] = '/';
+    path->data[length] = '\0';
 
-#define inode_blocks(inode) \
-    ((unsigned long long)inode->osd2.linux2.l_i_blocks_hi << 32) | \
-    inode->i_blocks
+    return path;
+}
 
-static void
-fifo_push(struct ldiskfs_iter *iter, struct rbh_dentry *dentry)
+static struct ldiskfs_path *
+path_get(struct ldiskfs_path *path)
 {
-    if (dentry)
-        g_queue_push_tail(iter->tasks, dentry);
+    path->refcount++;
+    return path;
 }
 
-static struct rbh_dentry *
-fifo_pop(struct ldiskfs_iter *iter)
+static void
+path_put(struct ldiskfs_path *path)
 {
-    return g_queue_pop_tail(iter->tasks);
+    if (path && --path->refcount == 0)
+        free(path);
 }
 
 static void
-fifo_push_child_entries(struct ldiskfs_iter *iter,
-                        struct rbh_dentry *dentry)
+fifo_push(struct ldiskfs_iter *iter, const struct rbh_dlink *link,
+          struct ldiskfs_path *parent)
 {
-    GList *elem = dentry->children;
-    while (elem) {
-        /*
-         * skip ROOT/.lustre directory on mdt0
-         * We do not want to iterate over this directory because it is not
-         * present in the lustre file arborescence
-         *
-         * Only mdt0 has iter->root set so we do not have to check the index of
-         * the mdt
-         */
-        if (!iter->is_mdt || (dentry != iter->root) ||
-            (strncmp(((struct rbh_dentry *)elem->data)->name, ".lustre", 8)))
-            fifo_push(iter, elem->data);
-        elem = elem->next;
-    }
-}
+    struct ldiskfs_task task = {
+        .link = *link,
+        .parent = parent ? path_get(parent) : NULL,
+    };
 
-static const struct rbh_id ROOT_ID = {
-    .data = NULL,
-    .size = 0,
-};
+    g_array_append_val(iter->tasks, task);
+}
 
-static ssize_t
-build_path(struct rbh_dentry *dentry, struct rbh_dentry *root,
-           struct rbh_dentry *remote_parent_dir, char **path, size_t len)
+static bool
+fifo_pop(struct ldiskfs_iter *iter, struct ldiskfs_task *task)
 {
-    ssize_t offset;
-
-    if (dentry->ino == EXT2_ROOT_INO || dentry == root ||
-        dentry == remote_parent_dir) {
-        len += 2; /* '/\0' */
-        *path = malloc(len);
-        if (!*path)
-            return -1;
-
-        (*path)[0] = '/';
-        (*path)[1] = '\0';
-        return 1;
-    }
-
-    if (!dentry->parent)
-        return 0;
+    if (iter->tasks->len == 0)
+        return false;
 
-    len += dentry->namelen + (is_dir(dentry) ? 1 : 0);
-    offset = build_path(dentry->parent, root, remote_parent_dir, path, len);
-    if (offset == -1)
-        return -1;
+    *task = g_array_index(iter->tasks, struct ldiskfs_task,
+                          iter->tasks->len - 1);
+    g_array_set_size(iter->tasks, iter->tasks->len - 1);
+    return true;
+}
 
-    memcpy((*path) + offset, dentry->name, dentry->namelen);
-    offset += dentry->namelen;
-    if (is_dir(dentry))
-        (*path)[offset++] = '/';
-    (*path)[offset] = '\0';
+struct push_data {
+    struct ldiskfs_iter *iter;
+    struct ldiskfs_path *path;
+};
 
-    return offset;
+static void
+fifo_push_child_cb(const struct rbh_dlink *link, void *udata)
+{
+    struct push_data *data = udata;
+    struct ldiskfs_iter *iter = data->iter;
+
+    /*
+     * skip ROOT/.lustre directory on mdt0
+     * We do not want to iterate over this directory because it is not
+     * present in the lustre file arborescence
+     *
+     * Only mdt0 has iter->root set so we do not have to check the index of
+     * the mdt
+     */
+    if (!iter->is_mdt || (link->parent != iter->root) ||
+        strcmp(link->name, ".lustre"))
+        fifo_push(iter, link, data->path);
 }
 
-static char *
-dentry_path(struct rbh_dentry *dentry, struct rbh_dentry *root,
-            struct rbh_dentry *remote_parent_dir)
+static void
+fifo_push_child_entries(struct ldiskfs_iter *iter, ext2_ino_t ino,
+                        struct ldiskfs_path *path)
 {
-    ssize_t offset;
-    char *path;
+    struct push_data data = {
+        .iter = iter,
+        .path = path,
+    };
 
-    offset = build_path(dentry, root, remote_parent_dir, &path, 0);
-    if (offset == -1)
-        return NULL;
+    rbh_dcache_foreach_child(iter->dcache, ino, fifo_push_child_cb, &data);
+}
 
-    return path;
+static const struct rbh_id ROOT_ID = {
+    .data = NULL,
+    .size = 0,
+};
+
+static void
+statx_from_dentry(const struct rbh_dentry *dentry, ext2_ino_t ino, __u64 size,
+                  __u64 blocks, struct rbh_statx *statx)
+{
+    statx->stx_mask = RBH_STATX_ATIME_SEC | RBH_STATX_CTIME_SEC |
+        RBH_STATX_MTIME_SEC | RBH_STATX_INO | RBH_STATX_BLOCKS |
+        RBH_STATX_SIZE | RBH_STATX_MODE | RBH_STATX_UID | RBH_STATX_GID;
+    /* statx->stx_blksize; */
+    /* statx->stx_attributes; */
+    statx->stx_nlink = dentry->nlink;
+    statx->stx_uid = dentry->uid;
+    statx->stx_gid = dentry->gid;
+    statx->stx_mode = dentry->mode;
+    statx->stx_ino = ino;
+    statx->stx_size = size;
+    statx->stx_blocks = blocks;
+    /* statx->stx_attributes_mask; */
+    statx->stx_atime.tv_sec = dentry->atime;
+    statx->stx_atime.tv_nsec = 0;
+    statx->stx_mtime.tv_sec = dentry->mtime;
+    statx->stx_mtime.tv_nsec = 0;
+    statx->stx_ctime.tv_sec = dentry->ctime;
+    statx->stx_ctime.tv_nsec = 0;
+    statx->stx_btime.tv_sec = 0;
+    statx->stx_btime.tv_nsec = 0;
+    /* statx->stx_rdev_major; */
+    /* statx->stx_rdev_minor; */
+    /* statx->stx_dev_major; */
+    /* statx->stx_dev_minor; */
+    /* statx->stx_mnt_id; */
 }
 
 static struct rbh_fsentry *
-fsentry_from_dentry(struct rbh_dentry *dentry, struct rbh_dentry *root,
-                    struct rbh_dentry *remote_parent_dir,ext2_filsys fs,
-                    struct rbh_sstack *sstack, bool is_mdt,
-                    bool skip_error,
-                    const struct rbh_posix_extension *lustre_extension)
+fsentry_from_dentry(struct ldiskfs_iter *iter, const struct rbh_dlink *link,
+                    const char *entry_path)
 {
-    struct ext2_inode_large *inode = (struct ext2_inode_large *)dentry->inode;
+    const struct rbh_posix_extension *lustre_extension =
+        iter->lustre_extension;
+    struct rbh_dentry *dentry = rbh_dcache_find(iter->dcache, link->ino);
+    bool skip_error = iter->options->skip_error;
+    struct rbh_sstack *sstack = iter->sstack;
     struct rbh_value_map ns_xattrs = {0};
-    struct rbh_parent_pair *parent_pair;
-    __u64 blocks = inode_blocks(inode);
     struct rbh_value_map inode_xattrs;
-    __u64 size = EXT2_I_SIZE(inode);
     const struct rbh_id *parent_id;
+    struct rbh_dentry *parent;
+    bool is_mdt = iter->is_mdt;
+    __u64 blocks = dentry->blocks;
+    __u64 size = dentry->size;
     struct rbh_value path_value = {
         .type = RBH_VT_STRING,
     };
@@ -157,20 +198,17 @@ fsentry_from_dentry(struct rbh_dentry *dentry, struct rbh_dentry *root,
         .key = "path",
         .value = &path_value,
     };
-    struct rbh_fsentry *fsentry;
     struct lu_fid parent_fid;
     struct rbh_statx statx;
     struct entry_info info;
     char *error_message;
     struct lu_fid fid;
     struct rbh_id *id;
-    int save_errno;
     // lustre enricher needs a file descriptor to work
     int fd = -1;
     int rc;
 
-    rc = get_xattrs_from_inode(fs, inode, &inode_xattrs,
-                               dentry->ino, sstack);
+    rc = get_xattrs_from_inode(iter->fs, &inode_xattrs, link->ino, sstack);
 
     if (!rc)
         goto out;
@@ -192,9 +230,9 @@ fsentry_from_dentry(struct rbh_dentry *dentry, struct rbh_dentry *root,
         error_message = "Retrieval of FID of file '%s' using extended attributes failed. "
                     "Are you sure this is a healthy ldiskfs filesystem ?\n";
         if (skip_error) {
-            fprintf(stderr, error_message, dentry->name);
+            fprintf(stderr, error_message, link->name);
         } else {
-            rbh_backend_error_printf(error_message, dentry->name);
+            rbh_backend_error_printf(error_message, link->name);
             goto out;
         }
     }
@@ -203,53 +241,22 @@ fsentry_from_dentry(struct rbh_dentry *dentry, struct rbh_dentry *root,
 
     id = rbh_id_from_lu_fid(&dentry->fid);
 
-    parent_id = dentry->parent ?
-        rbh_id_from_lu_fid(&dentry->parent->fid) :
-        &ROOT_ID;
-
-
-    parent_pair = g_queue_pop_head(dentry->parents);
-    dentry->parent = parent_pair->parent;
-    dentry->name = parent_pair->name;
+    parent = rbh_dcache_find(iter->dcache, link->parent);
+    parent_id = parent ? rbh_id_from_lu_fid(&parent->fid) : &ROOT_ID;
 
     if(is_mdt)
         get_size_and_blocks_from_xattrs(&size, &blocks, &inode_xattrs);
 
     fill_uint32_pair(
-        "project_id", inode_projid(*inode),
+        "project_id", dentry->projid,
         (struct rbh_value_pair *)&inode_xattrs.pairs[inode_xattrs.count++],
         sstack);
 
-    statx.stx_mask = RBH_STATX_ATIME_SEC | RBH_STATX_CTIME_SEC |
-        RBH_STATX_MTIME_SEC | RBH_STATX_INO | RBH_STATX_BLOCKS |
-        RBH_STATX_SIZE | RBH_STATX_MODE | RBH_STATX_UID | RBH_STATX_GID;
-    /* statx.stx_blksize; */
-    /* statx.stx_attributes; */
-    statx.stx_nlink = inode->i_links_count;
-    statx.stx_uid = inode_uid(*inode);
-    statx.stx_gid = inode_gid(*inode);
-    statx.stx_mode = inode->i_mode;
-    statx.stx_ino = dentry->ino;
-    statx.stx_size = size;
-    statx.stx_blocks = blocks;
-    /* statx.stx_attributes_mask; */
-    statx.stx_atime.tv_sec = ext2fs_inode_xtime_get(inode, i_atime);
-    statx.stx_atime.tv_nsec = 0;
-    statx.stx_mtime.tv_sec = ext2fs_inode_xtime_get(inode, i_mtime);
-    statx.stx_mtime.tv_nsec = 0;
-    statx.stx_ctime.tv_sec = ext2fs_inode_xtime_get(inode, i_ctime);
-    statx.stx_ctime.tv_nsec = 0;
-    statx.stx_btime.tv_sec = 0;
-    statx.stx_btime.tv_nsec = 0;
-    /* statx.stx_rdev_major; */
-    /* statx.stx_rdev_minor; */
-    /* statx.stx_dev_major; */
-    /* statx.stx_dev_minor; */
-    /* statx.stx_mnt_id; */
+    statx_from_dentry(dentry, link->ino, size, blocks, &statx);
 
     ns_xattrs.count = 1;
     ns_xattrs.pairs = &path;
-    path_value.string = dentry_path(dentry, root, remote_parent_dir);
+    path_value.string = entry_path;
 
     info.fd = &fd;
     info.inode_xattrs = (struct rbh_value_pair *)inode_xattrs.pairs;
@@ -284,17 +291,8 @@ fsentry_from_dentry(struct rbh_dentry *dentry, struct rbh_dentry *root,
         }
     }
 
-    fsentry = rbh_fsentry_new(id, parent_id, dentry->name,  &statx, &ns_xattrs,
-                              &inode_xattrs, NULL);
-
-    save_errno = errno;
-    if (g_queue_is_empty(dentry->parents))
-        g_queue_free(dentry->parents);
-    free((char *)path_value.string);
-    free(parent_pair);
-    errno = save_errno;
-
-    return fsentry;
+    return rbh_fsentry_new(id, parent_id, link->name,  &statx, &ns_xattrs,
+                           &inode_xattrs, NULL);
 
 out:
     return NULL;
@@ -304,22 +302,39 @@ static void *
 ldiskfs_iter_next(void *iterator)
 {
     struct ldiskfs_iter *iter = iterator;
+    struct rbh_fsentry *fsentry;
+    struct ldiskfs_path *path;
     struct rbh_dentry *dentry;
+    struct ldiskfs_task task;
+    ext2_ino_t ino;
+    int save_errno;
 
     rbh_sstack_clear(iter->sstack);
 
-    dentry = fifo_pop(iter);
-    if (!dentry) {
+    if (!fifo_pop(iter, &task)) {
         errno = ENODATA;
         return NULL;
     }
 
+    ino = task.link.ino;
+    dentry = rbh_dcache_find(iter->dcache, ino);
+    if (ino == EXT2_ROOT_INO || ino == iter->root ||
+        ino == iter->remote_parent_dir)
+        path = path_new(NULL, NULL, true);
+    else
+        path = path_new(task.parent, task.link.name, is_dir(dentry));
+    path_put(task.parent);
+
     if (is_dir(dentry))
-        fifo_push_child_entries(iter, dentry);
+        fifo_push_child_entries(iter, ino, path);
 
-    return fsentry_from_dentry(dentry, iter->root, iter->remote_parent_dir,
-                               iter->fs, iter->sstack, iter->is_mdt,
-                               iter->options->skip_error, iter->lustre_extension);
+    fsentry = fsentry_from_dentry(iter, &task.link, path->data);
+
+    save_errno = errno;
+    path_put(path);
+    errno = save_errno;
+
+    return fsentry;
 }
 
 static void
@@ -327,7 +342,13 @@ ldiskfs_iter_destroy(void *iterator)
 {
     struct ldiskfs_iter *iter = iterator;
 
-    g_queue_free(iter->tasks);
+    if (iter->iscan)
+        ext2fs_close_inode_scan(iter->iscan);
+    free(iter->inode);
+
+    for (guint i = 0; i < iter->tasks->len; i++)
+        path_put(g_array_index(iter->tasks, struct ldiskfs_task, i).parent);
+    g_array_free(iter->tasks, true);
 
     rbh_sstack_destroy(iter->sstack);
 
@@ -346,26 +367,33 @@ static const struct rbh_mut_iterator LDISKFS_ITER = {
 static bool
 setup_mdt_iterator(struct ldiskfs_backend *ldiskfs, struct ldiskfs_iter *iter)
 {
+    struct ldiskfs_path *path;
+    struct rbh_dlink link;
+
     if (iter->target_index == 0) {
         // Only the MDT0 has a 'ROOT' directory
-        iter->root = rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO, "ROOT");
-        if (!(iter->root && S_ISDIR(iter->root->inode->i_mode))) {
+        if (!(rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO, "ROOT",
+                                &link) &&
+              is_dir(rbh_dcache_find(ldiskfs->dcache, link.ino)))) {
             rbh_backend_error_printf("MDT0000 must have the 'ROOT' directory");
             return false;
         }
 
-        fifo_push(iter, iter->root);
+        iter->root = link.ino;
+        fifo_push(iter, &link, NULL);
     }
 
-    iter->remote_parent_dir = rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO,
-                                                "REMOTE_PARENT_DIR");
-    if (!(iter->remote_parent_dir &&
-          S_ISDIR(iter->remote_parent_dir->inode->i_mode))) {
+    if (!(rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO,
+                            "REMOTE_PARENT_DIR", &link) &&
+          is_dir(rbh_dcache_find(ldiskfs->dcache, link.ino)))) {
         rbh_backend_error_printf("Disk was identified as an MDT target but doesn't have a 'REMOTE_PARENT_DIR' directory");
         return false;
     }
 
-    fifo_push_child_entries(iter, iter->remote_parent_dir);
+    iter->remote_parent_dir = link.ino;
+    path = path_new(NULL, NULL, true);
+    fifo_push_child_entries(iter, iter->remote_parent_dir, path);
+    path_put(path);
 
     return true;
 }
@@ -373,13 +401,157 @@ setup_mdt_iterator(struct ldiskfs_backend *ldiskfs, struct ldiskfs_iter *iter)
 static bool
 setup_ost_iterator(struct ldiskfs_backend *ldiskfs, struct ldiskfs_iter *iter)
 {
-    iter->root = rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO, "O");
-    if (!(iter->root && S_ISDIR(iter->root->inode->i_mode))) {
+    struct rbh_dlink link;
+
+    if (!(rbh_dcache_lookup(ldiskfs->dcache, EXT2_ROOT_INO, "O", &link) &&
+          is_dir(rbh_dcache_find(ldiskfs->dcache, link.ino)))) {
         rbh_backend_error_printf("Disk was identified as an OST target but doesn't have a 'O' directory");
         return false;
     }
 
-    fifo_push(iter, iter->root);
+    iter->root = link.ino;
+    fifo_push(iter, &link, NULL);
+
+    return true;
+}
+
+/* Build the fsentry of an OST object from its inode alone: objects are only
+ * tied to the file they belong to on the MDT, by the parent fid stored in their
+ * "trusted.fid" extended attribute, so they are emitted without a parent, a
+ * name or a path.
+ *
+ * Returns NULL with errno set to ENOENT if the inode has no fid, that is if it
+ * is not a Lustre object.
+ */
+static struct rbh_fsentry *
+fsentry_from_object(struct ldiskfs_iter *iter, ext2_ino_t ino,
+                    const struct rbh_dentry *dentry)
+{
+    struct rbh_sstack *sstack = iter->sstack;
+    struct rbh_value_map inode_xattrs;
+    struct rbh_fsentry *fsentry;
+    struct lu_fid parent_fid;
+    struct rbh_statx statx;
+    struct lu_fid fid;
+    struct rbh_id *id;
+    int save_errno;
+
+    if (!get_xattrs_from_inode(iter->fs, &inode_xattrs, ino, sstack))
+        return NULL;
+
+    if (!get_fid_from_xattrs(&inode_xattrs, &fid)) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (get_parent_fid_from_xattrs(&inode_xattrs, &parent_fid))
+        fill_binary_pair("parent_fid", &parent_fid, sizeof(struct lu_fid),
+                         (struct rbh_value_pair *)
+                         &inode_xattrs.pairs[inode_xattrs.count++], sstack);
+
+    fill_binary_pair("fid", &fid, sizeof(struct lu_fid),
+                     (struct rbh_value_pair *)
+                     &inode_xattrs.pairs[inode_xattrs.count++], sstack);
+
+    get_hsm_from_xattrs(&inode_xattrs, sstack);
+
+    fill_uint32_pair(
+        "project_id", dentry->projid,
+        (struct rbh_value_pair *)&inode_xattrs.pairs[inode_xattrs.count++],
+        sstack);
+
+    statx_from_dentry(dentry, ino, dentry->size, dentry->blocks, &statx);
+
+    id = rbh_id_from_lu_fid(&fid);
+    fsentry = rbh_fsentry_new(id, NULL, NULL, &statx, NULL, &inode_xattrs,
+                              NULL);
+    save_errno = errno;
+    free(id);
+    errno = save_errno;
+
+    return fsentry;
+}
+
+/* Read the inode tables in order, and emit every regular file that is a Lustre
+ * object as soon as its inode is read: the only memory used is the inode
+ * bitmap and the scan buffer.
+ */
+static void *
+ldiskfs_stream_next(void *iterator)
+{
+    struct ldiskfs_iter *iter = iterator;
+
+    rbh_sstack_clear(iter->sstack);
+
+    while (true) {
+        struct rbh_fsentry *fsentry;
+        struct rbh_dentry dentry;
+        errcode_t rc;
+        ext2_ino_t ino;
+
+        rc = ext2fs_get_next_inode_full(iter->iscan, &ino,
+                                        EXT2_INODE(iter->inode),
+                                        iter->inode_size);
+        if (rc) {
+            ldiskfs_error("failed to read the next inode: %s",
+                          error_message(rc));
+            return NULL;
+        }
+
+        if (ino == 0) {
+            errno = ENODATA;
+            return NULL;
+        }
+
+        if (ino < EXT2_GOOD_OLD_FIRST_INO)
+            /* skip reserved inodes */
+            continue;
+
+        if (!ext2fs_test_inode_bitmap2(iter->fs->inode_map, ino))
+            /* skip deleted inodes */
+            continue;
+
+        if (!LINUX_S_ISREG(iter->inode->i_mode))
+            /* objects are regular files, the rest is the O/ hierarchy */
+            continue;
+
+        rbh_dentry_fill(&dentry, iter->inode);
+        fsentry = fsentry_from_object(iter, ino, &dentry);
+        if (fsentry || errno != ENOENT)
+            return fsentry;
+    }
+}
+
+static const struct rbh_mut_iterator_operations LDISKFS_STREAM_ITER_OPS = {
+    .next    = ldiskfs_stream_next,
+    .destroy = ldiskfs_iter_destroy,
+};
+
+static const struct rbh_mut_iterator LDISKFS_STREAM_ITER = {
+    .ops = &LDISKFS_STREAM_ITER_OPS,
+};
+
+static bool
+setup_ost_stream(struct ldiskfs_backend *ldiskfs, struct ldiskfs_iter *iter)
+{
+    size_t inode_size = EXT2_INODE_SIZE(ldiskfs->fs->super);
+    errcode_t rc;
+
+    rc = ext2fs_read_inode_bitmap(ldiskfs->fs);
+    if (rc)
+        return ldiskfs_error("failed to read inode bitmap: %s",
+                             error_message(rc));
+
+    rc = ext2fs_open_inode_scan(ldiskfs->fs, ldiskfs->inode_buffer_blocks,
+                                &iter->iscan);
+    if (rc)
+        return ldiskfs_error("failed to init inode scan: %s",
+                             error_message(rc));
+
+    iter->inode_size = inode_size;
+    iter->inode = xcalloc(1, inode_size > sizeof(*iter->inode) ?
+                             inode_size : sizeof(*iter->inode));
+    iter->iter = LDISKFS_STREAM_ITER;
 
     return true;
 }
@@ -397,11 +569,20 @@ ldiskfs_iter_new(struct ldiskfs_backend *ldiskfs,
     if (!set_target_type_and_index(ldiskfs->fs, iter))
         goto free_iter;
 
-    iter->tasks = g_queue_new();
+    iter->tasks = g_array_new(false, false, sizeof(struct ldiskfs_task));
     iter->options = options;
     iter->fs = ldiskfs->fs;
-
-    if (iter->is_mdt)
+    iter->dcache = ldiskfs->dcache;
+    iter->root = 0;
+    iter->remote_parent_dir = 0;
+    iter->iscan = NULL;
+    iter->inode = NULL;
+
+    if (!iter->is_mdt && ldiskfs->stream_ost)
+        rc = setup_ost_stream(ldiskfs, iter);
+    else if (!scan_target(ldiskfs))
+        rc = false;
+    else if (iter->is_mdt)
         rc = setup_mdt_iterator(ldiskfs, iter);
     else
         rc = setup_ost_iterator(ldiskfs, iter);
@@ -445,9 +626,6 @@ ldiskfs_backend_filter(void *backend, const struct rbh_filter *filter,
     struct ldiskfs_backend *ldiskfs = backend;
     struct ldiskfs_iter *iter;
 
-    if (!scan_target(ldiskfs))
-        return NULL;
-
     iter = ldiskfs_iter_new(ldiskfs, options);
     if (!iter)
         return NULL;
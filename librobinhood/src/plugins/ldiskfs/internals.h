@@ -41,7 +41,14 @@
 struct ldiskfs_backend {
     struct rbh_backend backend;
     ext2_filsys fs;
-    ext2_inode_scan iscan;
+    /** path to the device, for the scanning threads to open it */
+    char *device;
+    /** number of threads scanning the inode tables */
+    size_t scan_threads;
+    /** size in blocks of the inode scan buffer of each thread */
+    int inode_buffer_blocks;
+    /** emit OST objects straight from the inode scan, without the dcache */
+    bool stream_ost;
     struct rbh_dcache *dcache;
 };
 
@@ -50,13 +57,18 @@ struct ldiskfs_iter {
     struct rbh_sstack *sstack;
     bool is_mdt;
     uint32_t target_index;
-    struct rbh_dentry *root;
-    struct rbh_dentry *remote_parent_dir;
-    struct rbh_dentry *current;
+    /* Inode numbers of the directories whose path is "/" */
+    ext2_ino_t root;
+    ext2_ino_t remote_parent_dir;
     const struct rbh_filter_options *options;
     ext2_filsys fs;
-    GQueue *tasks;
-    GList *current_dir;
+    struct rbh_dcache *dcache;
+    /* Entries left to emit, used as a stack */
+    GArray *tasks;
+    /* Only used to stream OST objects */
+    ext2_inode_scan iscan;
+    struct ext2_inode_large *inode;
+    size_t inode_size;
     const struct rbh_backend_plugin *posix_plugin;
     const struct rbh_posix_extension *lustre_extension;
 };
@@ -80,9 +92,8 @@ bool
 set_target_type_and_index(ext2_filsys fs, struct ldiskfs_iter *iter);
 
 int
-get_xattrs_from_inode(ext2_filsys fs, struct ext2_inode_large *inode,
-                      struct rbh_value_map *xattrs, ext2_ino_t ino,
-                      struct rbh_sstack *sstack);
+get_xattrs_from_inode(ext2_filsys fs, struct rbh_value_map *xattrs,
+                      ext2_ino_t ino, struct rbh_sstack *sstack);
 
 /*
  * Gets the lustre fid of a file from the value of the trusted.lma
@@ -5,18 +5,9 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
-#include "internals.h"
-
-static struct ext2_inode *
-dup_inode(struct ext2_inode *src, size_t inode_size)
-{
-    struct ext2_inode *dst;
+#include <pthread.h>
 
-    dst = xmalloc(inode_size);
-    memcpy(dst, src, inode_size);
-
-    return dst;
-}
+#include "internals.h"
 
 static int
 scan_dir_cb(ext2_filsys fs,
@@ -40,55 +31,292 @@ scan_dir_cb(ext2_filsys fs,
     return 0;
 }
 
-static bool
-add_dir_blocks(struct ldiskfs_backend *ldiskfs,
-               ext2_ino_t ino,
-               struct ext2_inode *inode,
-               size_t inode_size)
-{
-    struct rbh_dentry *dentry;
-    errcode_t rc;
-    char *buf;
+/* Inodes are scanned by batches of this many block groups, which are handed
+ * out to the scanning threads as they become available.
+ */
+#define SCAN_BATCH_GROUPS 16
 
-    dentry = rbh_dcache_find_or_create(ldiskfs->dcache, ino);
-    dentry->inode = dup_inode(inode, inode_size);
+struct inode_scan {
+    struct ldiskfs_backend *backend;
+    size_t inode_size;
 
-    /* TODO this could be moved to the ldiskfs_backend struct to do a single
-     * allocation
-     */
-    /* ext2fs_block_iterate3 can read indirect, double-indirect and triple-indirect
-     * blocks during the iteration over the directory's blocks. It therefore needs
-     * 3 blocks of size blocksize.
+    /* Protects next_group and the inode bitmap of backend->fs */
+    pthread_mutex_t lock;
+    dgrp_t next_group;
+    bool stop;
+};
+
+struct scan_worker {
+    struct inode_scan *scan;
+    pthread_t thread;
+    /* Each thread reads the device through its own handle, and records the
+     * directory blocks it finds in that handle's dblist.
      */
-    buf = xmalloc(ldiskfs->fs->blocksize * 3);
+    ext2_filsys fs;
+    /* Number of inodes added to the dcache */
+    size_t count;
+    /* Inode bitmap of the current batch */
+    char *bitmap;
+    char error[sizeof(rbh_backend_error)];
+    bool failed;
+};
 
-    rc = ext2fs_block_iterate3(ldiskfs->fs, ino, 0, buf, scan_dir_cb, &ino);
-    if (rc) {
-        free(buf);
+static bool
+add_dir_blocks(ext2_filsys fs, ext2_ino_t ino, char *buf)
+{
+    errcode_t rc;
+
+    rc = ext2fs_block_iterate3(fs, ino, 0, buf, scan_dir_cb, &ino);
+    if (rc)
         return ldiskfs_error(
             "failed to iterate through directory blocks of '%d': %s",
             ino, error_message(rc)
         );
+
+    return true;
+}
+
+/* Reserve the next batch of groups to scan, and copy the part of the inode
+ * bitmap that covers it: bitmaps cannot be safely read by several threads at
+ * once.
+ *
+ * Returns 1 if a batch was reserved, 0 if there is none left and -1 on error.
+ */
+static int
+next_batch(struct scan_worker *worker, dgrp_t *first, dgrp_t *last)
+{
+    struct inode_scan *scan = worker->scan;
+    ext2_filsys fs = scan->backend->fs;
+    errcode_t rc = 0;
+    bool found;
+
+    pthread_mutex_lock(&scan->lock);
+    found = !scan->stop && scan->next_group < fs->group_desc_count;
+    if (found) {
+        *first = scan->next_group;
+        *last = *first + SCAN_BATCH_GROUPS;
+        if (*last > fs->group_desc_count)
+            *last = fs->group_desc_count;
+        scan->next_group = *last;
+
+        rc = ext2fs_get_inode_bitmap_range2(
+            fs->inode_map, (__u64)*first * fs->super->s_inodes_per_group + 1,
+            (size_t)(*last - *first) * fs->super->s_inodes_per_group,
+            worker->bitmap
+            );
     }
+    pthread_mutex_unlock(&scan->lock);
+
+    if (rc) {
+        ldiskfs_error("failed to read inode bitmap: %s", error_message(rc));
+        return -1;
+    }
+
+    return found ? 1 : 0;
+}
+
+static bool
+scan_batch(struct scan_worker *worker, ext2_inode_scan iscan, dgrp_t first,
+           dgrp_t last, struct ext2_inode_large *inode, char *buf)
+{
+    struct rbh_dcache *dcache = worker->scan->backend->dcache;
+    ext2_ino_t inodes_per_group = worker->fs->super->s_inodes_per_group;
+    ext2_ino_t first_ino = first * inodes_per_group + 1;
+    ext2_ino_t last_ino = last * inodes_per_group;
+    size_t inode_size = worker->scan->inode_size;
+    ext2_ino_t ino;
+    errcode_t rc;
+
+    rc = ext2fs_inode_scan_goto_blockgroup(iscan, first);
+    if (rc)
+        return ldiskfs_error("failed to seek to group %u: %s", first,
+                             error_message(rc));
+
+    while (!ext2fs_get_next_inode_full(iscan, &ino, EXT2_INODE(inode),
+                                       inode_size)) {
+        if (ino == 0 || ino > last_ino)
+            break;
+
+        if (ino < EXT2_GOOD_OLD_FIRST_INO && ino != EXT2_ROOT_INO)
+            /* skip reserved inodes except the root */
+            continue;
+
+        if (!ext2fs_test_bit(ino - first_ino, worker->bitmap))
+            /* skip deleted inodes */
+            continue;
+
+        if (LINUX_S_ISDIR(inode->i_mode) &&
+            !add_dir_blocks(worker->fs, ino, buf))
+            return false;
+
+        /* Batches do not share block groups, and neither do the records of
+         * their inodes.
+         */
+        rbh_dcache_fill(dcache, ino, inode);
+        worker->count++;
+    }
+
+    return true;
+}
+
+static bool
+scan_groups(struct scan_worker *worker)
+{
+    struct ldiskfs_backend *backend = worker->scan->backend;
+    struct ext2_inode_large *inode;
+    ext2_inode_scan iscan;
+    dgrp_t first, last;
+    errcode_t rc;
+    bool ok = true;
+    char *buf;
+    int found = 0;
+
+    rc = ext2fs_init_dblist(worker->fs, NULL);
+    if (rc)
+        return ldiskfs_error("failed to init directory block list: %s",
+                             error_message(rc));
+
+    rc = ext2fs_open_inode_scan(worker->fs, backend->inode_buffer_blocks,
+                                &iscan);
+    if (rc)
+        return ldiskfs_error("failed to init inode scan: %s",
+                             error_message(rc));
+
+    /* The extra fields of large inodes are only read if the inode is large
+     * enough, but never past the end of struct ext2_inode_large.
+     */
+    inode = xcalloc(1, worker->scan->inode_size > sizeof(*inode) ?
+                       worker->scan->inode_size : sizeof(*inode));
+    /* ext2fs_block_iterate3 can read indirect, double-indirect and
+     * triple-indirect blocks during the iteration over the directory's blocks.
+     * It therefore needs 3 blocks of size blocksize.
+     */
+    buf = xmalloc(worker->fs->blocksize * 3);
+
+    while (ok && (found = next_batch(worker, &first, &last)) > 0)
+        ok = scan_batch(worker, iscan, first, last, inode, buf);
+    if (found < 0)
+        ok = false;
 
     free(buf);
+    free(inode);
+    ext2fs_close_inode_scan(iscan);
+
+    return ok;
+}
+
+static void *
+scan_worker_run(void *data)
+{
+    struct scan_worker *worker = data;
+    struct inode_scan *scan = worker->scan;
+
+    if (scan_groups(worker))
+        return NULL;
+
+    /* rbh_backend_error is thread-local */
+    memcpy(worker->error, rbh_backend_error, sizeof(worker->error));
+    worker->failed = true;
+
+    pthread_mutex_lock(&scan->lock);
+    scan->stop = true;
+    pthread_mutex_unlock(&scan->lock);
+
+    return NULL;
+}
+
+static bool
+scan_worker_init(struct scan_worker *worker, struct inode_scan *scan)
+{
+    ext2_filsys fs = scan->backend->fs;
+    errcode_t rc;
+
+    worker->scan = scan;
+    rc = ext2fs_open2(scan->backend->device, NULL, EXT2_FLAG_SOFTSUPP_FEATURES,
+                      0, 0, unix_io_manager, &worker->fs);
+    if (rc)
+        return ldiskfs_error("failed to open device '%s': %s",
+                             scan->backend->device, error_message(rc));
+
+    worker->count = 0;
+    worker->bitmap = xmalloc(
+        ((size_t)SCAN_BATCH_GROUPS * fs->super->s_inodes_per_group + 7) / 8
+        );
 
     return true;
 }
 
+static int
+merge_dir_block(ext2_filsys fs, struct ext2_db_entry2 *db_info, void *udata)
+{
+    ext2_dblist dblist = udata;
+
+    (void) fs;
+
+    if (ext2fs_add_dir_block2(dblist, db_info->ino, db_info->blk,
+                              db_info->blockcnt))
+        return DBLIST_ABORT;
+
+    return 0;
+}
+
+/* Add the directory blocks a thread found to the dblist of the backend */
+static bool
+scan_worker_merge(struct scan_worker *worker, struct ldiskfs_backend *backend)
+{
+    errcode_t rc;
+
+    backend->dcache->count += worker->count;
+
+    rc = ext2fs_dblist_iterate2(worker->fs->dblist, merge_dir_block,
+                                backend->fs->dblist);
+    if (rc)
+        return ldiskfs_error("failed to merge directory block lists: %s",
+                             error_message(rc));
+
+    return true;
+}
+
+static void
+scan_worker_fini(struct scan_worker *worker)
+{
+    free(worker->bitmap);
+    ext2fs_close(worker->fs);
+}
+
+static size_t
+scan_thread_count(struct ldiskfs_backend *backend)
+{
+    size_t batches = (backend->fs->group_desc_count + SCAN_BATCH_GROUPS - 1) /
+        SCAN_BATCH_GROUPS;
+    size_t count = backend->scan_threads;
+
+    return count < batches ? count : batches;
+}
 
-/* Scan all the inodes from all the groups and fetch inline xattrs (xattrs
- * stored alongside the inode). Inodes containing external xattrs are kept in
- * memory to read them later.
+/* Scan all the inodes from all the groups, and record what is needed to build
+ * their fsentries in the dcache. Extended attributes are read later, when the
+ * fsentries are built.
+ *
+ * Block groups are scanned concurrently by backend->scan_threads threads. Each
+ * of them has its own handle on the device, with its own inode scan buffer of
+ * backend->inode_buffer_blocks blocks, and fills the records of the groups it
+ * scans directly.
  */
 static bool
 scan_inodes(struct ldiskfs_backend *backend)
 {
-    struct rbh_dentry *dentry;
-    struct ext2_inode *inode;
-    size_t inode_size;
-    ext2_ino_t ino;
+    struct inode_scan scan = {
+        .backend = backend,
+        .inode_size = EXT2_INODE_SIZE(backend->fs->super),
+        .next_group = 0,
+        .stop = false,
+    };
+    struct scan_worker *workers;
+    size_t started = 0;
+    size_t count;
     errcode_t rc;
+    bool ok;
 
     rc = ext2fs_read_inode_bitmap(backend->fs);
     if (rc)
@@ -100,68 +328,67 @@ scan_inodes(struct ldiskfs_backend *backend)
         return ldiskfs_error("failed to init directory block list: %s",
                              error_message(rc));
 
-    rc = ext2fs_open_inode_scan(backend->fs,
-                                backend->fs->inode_blocks_per_group,
-                                &backend->iscan);
-    if (rc)
-        return ldiskfs_error("failed to init inode scan: %s",
-                             error_message(rc));
+    count = scan_thread_count(backend);
+    workers = xcalloc(count, sizeof(*workers));
+    pthread_mutex_init(&scan.lock, NULL);
 
-    inode_size = EXT2_INODE_SIZE(backend->fs->super);
-    inode = malloc(inode_size);
-    if (!inode)
-        return false;
+    ok = true;
+    for (; started < count; started++) {
+        if (!scan_worker_init(&workers[started], &scan)) {
+            ok = false;
+            break;
+        }
 
-    while (!ext2fs_get_next_inode_full(backend->iscan, &ino, inode,
-                                       inode_size)) {
-        if (ino == 0)
+        rc = pthread_create(&workers[started].thread, NULL, scan_worker_run,
+                            &workers[started]);
+        if (rc) {
+            scan_worker_fini(&workers[started]);
+            ldiskfs_error("failed to start scanning thread: %s",
+                          strerror(rc));
+            ok = false;
             break;
+        }
+    }
 
-        if (ino < EXT2_GOOD_OLD_FIRST_INO && ino != EXT2_ROOT_INO)
-            /* skip reserved inodes except the root */
-            continue;
+    if (!ok) {
+        pthread_mutex_lock(&scan.lock);
+        scan.stop = true;
+        pthread_mutex_unlock(&scan.lock);
+    }
 
-        if (!ext2fs_fast_test_inode_bitmap2(backend->fs->inode_map, ino))
-            /* skip deleted inodes */
-            continue;
+    for (size_t i = 0; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
 
-        if (LINUX_S_ISDIR(inode->i_mode)) {
-            if (!add_dir_blocks(backend, ino, inode, inode_size))
-                return false;
-        } else {
-            dentry = rbh_dcache_find_or_create(backend->dcache, ino);
-            dentry->inode = dup_inode(inode, inode_size);
+    for (size_t i = 0; i < started; i++) {
+        if (ok && workers[i].failed) {
+            rbh_backend_error_printf("%s", workers[i].error);
+            ok = false;
         }
-    }
 
-    free(inode);
-    ext2fs_close_inode_scan(backend->iscan);
-
-    return true;
-}
+        if (ok)
+            ok = scan_worker_merge(&workers[i], backend);
 
-static void
-link_dentry(struct rbh_dentry *parent, struct rbh_dentry *child)
-{
-    struct rbh_parent_pair *pair = xmalloc(sizeof(pair));
+        scan_worker_fini(&workers[i]);
+    }
 
-    pair->name = child->name;
-    pair->parent = parent;
+    pthread_mutex_destroy(&scan.lock);
+    free(workers);
 
-    child->parent = parent;
-    g_queue_push_tail(child->parents, pair);
-    parent->children = g_list_prepend(parent->children, child);
+    return ok;
 }
 
+struct dentries_scan {
+    struct rbh_dcache *dcache;
+    bool failed;
+};
+
 static int
 dblist_iter_cb(ext2_ino_t parent_ino, int entry,
                struct ext2_dir_entry *dentry,
                int offset, int blocksize,
                char *buf, void *private)
 {
-    struct rbh_dcache *dcache = private;
-    struct rbh_dentry *cached_dentry;
-    struct rbh_dentry *parent;
+    struct dentries_scan *scan = private;
     int namelen;
 
     (void) entry;
@@ -173,19 +400,17 @@ dblist_iter_cb(ext2_ino_t parent_ino, int entry,
         return 0;
 
     namelen = ext2fs_dirent_name_len(dentry);
-    if ((namelen == 2 && !strcmp(dentry->name, "..")) ||
-        (namelen == 1 && !strcmp(dentry->name, ".")))
+    if ((namelen == 2 && !strncmp(dentry->name, "..", 2)) ||
+        (namelen == 1 && !strncmp(dentry->name, ".", 1)))
         return 0;
 
-    parent = rbh_dcache_find(dcache, parent_ino);
-    cached_dentry = rbh_dcache_find(dcache, dentry->inode);
-
-    assert(parent && cached_dentry);
-
-    cached_dentry->name = strndup(dentry->name, namelen);
-    cached_dentry->namelen = namelen;
-
-    link_dentry(parent, cached_dentry);
+    if (!rbh_dcache_link(scan->dcache, parent_ino, dentry->inode,
+                         dentry->name, namelen)) {
+        ldiskfs_error("entry '%.*s' of directory %u refers to unused inode %u",
+                      namelen, dentry->name, parent_ino, dentry->inode);
+        scan->failed = true;
+        return DIRENT_ABORT;
+    }
 
     return 0;
 }
@@ -193,18 +418,22 @@ dblist_iter_cb(ext2_ino_t parent_ino, int entry,
 static bool
 scan_dentries(struct ldiskfs_backend *backend)
 {
+    struct dentries_scan scan = {
+        .dcache = backend->dcache,
+        .failed = false,
+    };
     errcode_t rc;
 
     rc = ext2fs_dblist_dir_iterate(backend->fs->dblist,
                                    DIRENT_FLAG_INCLUDE_EMPTY,
                                    NULL,
                                    dblist_iter_cb,
-                                   backend->dcache);
+                                   &scan);
     if (rc)
         return ldiskfs_error("failed to scan through directory block list: %s",
                              error_message(rc));
 
-    return true;
+    return !scan.failed;
 }
 
 bool
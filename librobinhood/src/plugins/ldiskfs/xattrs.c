@@ -85,9 +85,8 @@ rbh_get_xattrs(char *_name, char *value,size_t value_len, void *_data)
 }
 
 int
-get_xattrs_from_inode(ext2_filsys fs, struct ext2_inode_large *inode,
-                      struct rbh_value_map *xattrs, ext2_ino_t ino,
-                      struct rbh_sstack *sstack)
+get_xattrs_from_inode(ext2_filsys fs, struct rbh_value_map *xattrs,
+                      ext2_ino_t ino, struct rbh_sstack *sstack)
 {
     struct ext2_xattr_handle *handle;
     struct rbh_value_pair *pairs;
@@ -178,51 +178,108 @@ out_einval:
     return false;
 }
 
+/* Fsentries are decoded without copying any of their fields out of the BSON
+ * document they come from. Instead, the document itself is copied at the end of
+ * the memory allocated for the fsentry, and the decoded fields point into it.
+ *
+ * The memory of an fsentry is laid out as follows:
+ *
+ *     struct rbh_fsentry | symlink | struct rbh_statx | document | scratch
+ *
+ * where `scratch' holds the rbh_value_pairs and rbh_values of xattrs. As there
+ * is no telling how much of it is needed before the document is decoded, its
+ * size is first estimated from the size of the document, and doubled until it
+ * is enough.
+ *
+ * The whole fsentry is a single allocation, which the caller may free(3) as any
+ * other fsentry.
+ */
+
+static size_t
+bson_symlink_length(const bson_t *bson)
+{
+    bson_iter_t iter;
+    uint32_t length;
+
+    if (!bson_iter_init_find(&iter, bson, MFF_SYMLINK)
+     || !BSON_ITER_HOLDS_UTF8(&iter))
+        return 0;
+
+    bson_iter_utf8(&iter, &length);
+    return length + 1;
+}
+
 static struct rbh_fsentry *
-fsentry_almost_clone(const struct rbh_fsentry *fsentry, const char *symlink)
+fsentry_decode(const bson_t *bson, size_t symlink_length, size_t scratch_size)
 {
-    struct {
-        bool id:1;
-        bool parent:1;
-        bool name:1;
-        bool statx:1;
-        bool namespace_xattrs:1;
-        bool inode_xattrs:1;
-    } has = {
-        .id = fsentry->mask & RBH_FP_ID,
-        .parent = fsentry->mask & RBH_FP_PARENT_ID,
-        .name = fsentry->mask & RBH_FP_NAME,
-        .statx = fsentry->mask & RBH_FP_STATX,
-        .namespace_xattrs = fsentry->mask & RBH_FP_NAMESPACE_XATTRS,
-        .inode_xattrs = fsentry->mask & RBH_FP_INODE_XATTRS,
-    };
-
-    return rbh_fsentry_new(has.id ? &fsentry->id : NULL,
-                           has.parent ? &fsentry->parent_id : NULL,
-                           has.name ? fsentry->name : NULL,
-                           has.statx ? fsentry->statx : NULL,
-                           has.namespace_xattrs ? &fsentry->xattrs.ns : NULL,
-                           has.inode_xattrs ? &fsentry->xattrs.inode : NULL,
-                           symlink);
+    struct rbh_fsentry *fsentry;
+    struct rbh_statx *statxbuf;
+    const char *symlink;
+    size_t statx_offset;
+    bson_iter_t iter;
+    size_t offset;
+    bson_t copy;
+    uint8_t *raw;
+    char *data;
+
+    statx_offset = sizealign(sizeof(*fsentry) + symlink_length,
+                             alignof(*statxbuf));
+    offset = statx_offset + sizeof(*statxbuf);
+
+    fsentry = xmalloc(offset + bson->len + scratch_size);
+    memset(fsentry, 0, sizeof(*fsentry));
+    statxbuf = (struct rbh_statx *)((char *)fsentry + statx_offset);
+
+    raw = (uint8_t *)fsentry + offset;
+    memcpy(raw, bson_get_data(bson), bson->len);
+    data = (char *)raw + bson->len;
+
+    if (!bson_init_static(&copy, raw, bson->len)
+     || !bson_iter_init(&iter, &copy)) {
+        errno = EINVAL;
+        goto out_free;
+    }
+
+    if (!bson_iter_fsentry(&iter, fsentry, statxbuf, &symlink, &data,
+                           &scratch_size)) {
+        /* Only ENOBUFS tells the caller to try again with more scratch */
+        if (errno == 0)
+            errno = EINVAL;
+        goto out_free;
+    }
+
+    if (symlink) {
+        if ((fsentry->mask & RBH_FP_STATX)
+         && (statxbuf->stx_mask & RBH_STATX_TYPE)
+         && !S_ISLNK(statxbuf->stx_mode)) {
+            errno = EINVAL;
+            goto out_free;
+        }
+
+        memcpy(fsentry->symlink, symlink, symlink_length);
+        fsentry->mask |= RBH_FP_SYMLINK;
+    }
+
+    return fsentry;
+
+out_free:
+    free(fsentry);
+    return NULL;
 }
 
 struct rbh_fsentry *
-fsentry_from_bson(bson_iter_t *iter)
+fsentry_from_bson(const bson_t *bson)
 {
-    struct rbh_fsentry fsentry;
-    struct rbh_statx statxbuf;
-    const char *symlink;
-    char tmp[4096]; /* TODO: figure out a better size than the arbitrary 4096 */
-    size_t bufsize = sizeof(tmp);
-    char *buffer = tmp;
-
-    if (!bson_iter_fsentry(iter, &fsentry, &statxbuf, &symlink, &buffer,
-                           &bufsize))
-        /* FIXME: while it is nice to try to parse most fsentries without
-         *        allocating any memory using the "on stack" buffer `tmp', there
-         *        should be a fallback for when that fails.
-         */
-        return NULL;
-
-    return fsentry_almost_clone(&fsentry, symlink);
+    size_t symlink_length = bson_symlink_length(bson);
+    size_t scratch_size = 2 * bson->len;
+    struct rbh_fsentry *fsentry;
+
+    do {
+        /* For a stale ENOBUFS not to be mistaken for a lack of scratch */
+        errno = 0;
+        fsentry = fsentry_decode(bson, symlink_length, scratch_size);
+        scratch_size *= 2;
+    } while (fsentry == NULL && errno == ENOBUFS);
+
+    return fsentry;
 }
@@ -10,8 +10,11 @@
 #endif
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "robinhood/fsevent.h"
+#include "robinhood/utils.h"
 
 #include "mongo.h"
 
@@ -229,3 +232,177 @@ bson_update_from_fsevent(const struct rbh_fsevent *fsevent)
         return NULL;
     }
 }
+
+/*----------------------------------------------------------------------------*
+ |                       bson_document_from_fsevents()                        |
+ *----------------------------------------------------------------------------*/
+
+/* Xattr names are split on their dots too (eg. "trusted.lov.foo") */
+#define UNFLATTEN_DEPTH_MAX 16
+
+/* Update operators reach into subdocuments with dotted keys (eg.
+ * "statx.atime.sec"), whereas a document to insert must nest them.
+ *
+ * Keys that share a prefix must be contiguous in \p flat.
+ */
+static bool
+bson_append_unflattened(bson_t *bson, const bson_t *flat)
+{
+    struct {
+        const char *name;
+        size_t length;
+    } open[UNFLATTEN_DEPTH_MAX];
+    bson_t documents[UNFLATTEN_DEPTH_MAX];
+    size_t depth = 0;
+    bson_iter_t iter;
+
+#define parent(depth) ((depth) == 0 ? bson : &documents[(depth) - 1])
+
+    if (!bson_iter_init(&iter, flat))
+        return false;
+
+    while (bson_iter_next(&iter)) {
+        const char *key = bson_iter_key(&iter);
+        size_t common = 0;
+        const char *dot;
+
+        /* Keep the subdocuments this key shares with the previous one open */
+        while (common < depth) {
+            size_t length = open[common].length;
+
+            if (strncmp(key, open[common].name, length) || key[length] != '.')
+                break;
+            key += length + 1;
+            common++;
+        }
+
+        while (depth > common) {
+            depth--;
+            if (!bson_append_document_end(parent(depth), &documents[depth]))
+                return false;
+        }
+
+        while ((dot = strchr(key, '.')) != NULL) {
+            if (depth == UNFLATTEN_DEPTH_MAX)
+                return false;
+
+            open[depth].name = key;
+            open[depth].length = dot - key;
+            if (!bson_append_document_begin(parent(depth), key, dot - key,
+                                            &documents[depth]))
+                return false;
+            depth++;
+            key = dot + 1;
+        }
+
+        if (!bson_append_iter(parent(depth), key, -1, &iter))
+            return false;
+    }
+
+    while (depth > 0) {
+        depth--;
+        if (!bson_append_document_end(parent(depth), &documents[depth]))
+            return false;
+    }
+
+#undef parent
+    return true;
+}
+
+static int
+xattr_cmp(const void *first, const void *second)
+{
+    const struct rbh_value_pair *const *a = first;
+    const struct rbh_value_pair *const *b = second;
+
+    return strcmp((*a)->key, (*b)->key);
+}
+
+/* Inode xattrs come with the operation to apply them with (cf.
+ * bson_append_xattrs()), on a new document, only their values matter.
+ *
+ * Updates set "xattrs.<name>", so that an xattr named "user.a" ends up in
+ * a "user" subdocument. A new document must be laid out the same way, for
+ * filters on "xattrs.user.a" to match it.
+ */
+static bool
+bson_append_xattrs_values(bson_t *bson, const char *key,
+                          const struct rbh_value_map *xattrs)
+{
+    const struct rbh_value_pair **pairs;
+    bson_t document;
+    bool success = false;
+    bson_t flat;
+
+    /* Xattrs that share a prefix must be contiguous to be unflattened */
+    pairs = xmalloc(xattrs->count * sizeof(*pairs));
+    for (size_t i = 0; i < xattrs->count; i++)
+        pairs[i] = &xattrs->pairs[i];
+    qsort(pairs, xattrs->count, sizeof(*pairs), xattr_cmp);
+
+    bson_init(&flat);
+    for (size_t i = 0; i < xattrs->count; i++) {
+        const struct rbh_value_map *op_map = &pairs[i]->value->map;
+
+        assert(op_map->count == 1);
+
+        switch (op_map->pairs->key[0]) {
+        case 's':
+        case 'i':
+            if (!BSON_APPEND_RBH_VALUE(&flat, pairs[i]->key,
+                                       op_map->pairs->value))
+                goto out;
+            break;
+        case 'u':
+            break;
+        default:
+            goto out;
+        }
+    }
+
+    success = BSON_APPEND_DOCUMENT_BEGIN(bson, key, &document)
+           && bson_append_unflattened(&document, &flat)
+           && bson_append_document_end(bson, &document);
+
+out:
+    bson_destroy(&flat);
+    free(pairs);
+    return success;
+}
+
+bson_t *
+bson_document_from_fsevents(const struct rbh_fsevent *upsert,
+                            const struct rbh_fsevent *link)
+{
+    bson_t *document = bson_new();
+    bson_t namespace;
+    bson_t statx;
+    bson_t subdoc;
+
+    assert(upsert->type == RBH_FET_UPSERT && upsert->upsert.statx);
+    assert(link->type == RBH_FET_LINK);
+
+    bson_init(&statx);
+    if (BSON_APPEND_RBH_ID(document, MFF_ID, &upsert->id)
+     && BSON_APPEND_STATX(&statx, MFF_STATX, upsert->upsert.statx)
+     && bson_append_unflattened(document, &statx)
+     && (upsert->upsert.symlink == NULL
+      || BSON_APPEND_UTF8(document, MFF_SYMLINK, upsert->upsert.symlink))
+     && (upsert->xattrs.count == 0
+      || bson_append_xattrs_values(document, MFF_XATTRS, &upsert->xattrs))
+     && BSON_APPEND_ARRAY_BEGIN(document, MFF_NAMESPACE, &namespace)
+     && BSON_APPEND_DOCUMENT_BEGIN(&namespace, "0", &subdoc)
+     && BSON_APPEND_RBH_ID(&subdoc, MFF_PARENT_ID, link->link.parent_id)
+     && BSON_APPEND_UTF8(&subdoc, MFF_NAME, link->link.name)
+     && BSON_APPEND_RBH_VALUE_MAP(&subdoc, MFF_XATTRS, &link->xattrs)
+     && bson_append_document_end(&namespace, &subdoc)
+     && bson_append_array_end(document, &namespace)) {
+        bson_destroy(&statx);
+        return document;
+    }
+
+    bson_destroy(&statx);
+    bson_destroy(document);
+    errno = ENOBUFS;
+    return NULL;
+}
@@ -0,0 +1,144 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "mongo.h"
+
+/*----------------------------------------------------------------------------*
+ |                                  indexes                                   |
+ *----------------------------------------------------------------------------*/
+
+#define NS_FIELD(field) MFF_NAMESPACE "." field
+#define STATX_FIELD(field) MFF_STATX "." field
+
+/* The indexes are named after the ones mongo would generate on its own, so
+ * that creating them does not conflict with indexes an administrator may
+ * already have created by hand.
+ */
+static const struct mongo_index {
+    const char *name;
+    const char *field;
+    /* Only index the documents where `field' exists */
+    bool partial;
+} MONGO_INDEXES[] = {
+    /* Used to list the children of a directory when walking a branch */
+    { NS_FIELD(MFF_PARENT_ID) "_1", NS_FIELD(MFF_PARENT_ID), false },
+    { NS_FIELD(MFF_NAME) "_1", NS_FIELD(MFF_NAME), false },
+    { NS_FIELD(MFF_XATTRS) ".path_1", NS_FIELD(MFF_XATTRS) ".path", false },
+    { STATX_FIELD(MFF_STATX_TYPE) "_1", STATX_FIELD(MFF_STATX_TYPE), false },
+    { STATX_FIELD(MFF_STATX_SIZE) "_1", STATX_FIELD(MFF_STATX_SIZE), false },
+    { STATX_FIELD(MFF_STATX_UID) "_1", STATX_FIELD(MFF_STATX_UID), false },
+    {
+        STATX_FIELD(MFF_STATX_MTIME) "." MFF_STATX_TIMESTAMP_SEC "_1",
+        STATX_FIELD(MFF_STATX_MTIME) "." MFF_STATX_TIMESTAMP_SEC,
+        false
+    },
+    /* Only entries partially unlinked by rbh-fsevents have a rm_time */
+    {
+        NS_FIELD(MFF_XATTRS) ".rm_time_1",
+        NS_FIELD(MFF_XATTRS) ".rm_time",
+        true
+    },
+};
+
+static bool
+bson_append_index(bson_t *bson, const char *key, size_t key_length,
+                  const struct mongo_index *index)
+{
+    bson_t document;
+    bson_t subdoc;
+
+    if (!bson_append_document_begin(bson, key, key_length, &document))
+        return false;
+
+    if (!(BSON_APPEND_DOCUMENT_BEGIN(&document, "key", &subdoc)
+       && BSON_APPEND_INT32(&subdoc, index->field, 1)
+       && bson_append_document_end(&document, &subdoc)
+       && BSON_APPEND_UTF8(&document, "name", index->name)))
+        return false;
+
+    if (index->partial) {
+        bson_t exists;
+
+        if (!(BSON_APPEND_DOCUMENT_BEGIN(&document, "partialFilterExpression",
+                                         &subdoc)
+           && BSON_APPEND_DOCUMENT_BEGIN(&subdoc, index->field, &exists)
+           && BSON_APPEND_BOOL(&exists, "$exists", true)
+           && bson_append_document_end(&subdoc, &exists)
+           && bson_append_document_end(&document, &subdoc)))
+            return false;
+    }
+
+    return bson_append_document_end(bson, &document);
+}
+
+static bson_t *
+bson_from_indexes(const struct mongo_index *indexes, size_t count)
+{
+    bson_t *command;
+    bson_t array;
+
+    command = bson_new();
+    if (!(BSON_APPEND_UTF8(command, "createIndexes", "entries")
+       && BSON_APPEND_ARRAY_BEGIN(command, "indexes", &array)))
+        goto out_bson_destroy;
+
+    for (size_t i = 0; i < count; i++) {
+        char key[16];
+        int length;
+
+        length = snprintf(key, sizeof(key), "%zu", i);
+        if (!bson_append_index(&array, key, length, &indexes[i]))
+            goto out_bson_destroy;
+    }
+
+    if (!bson_append_array_end(command, &array))
+        goto out_bson_destroy;
+
+    return command;
+
+out_bson_destroy:
+    bson_destroy(command);
+    errno = ENOBUFS;
+    return NULL;
+}
+
+int
+mongo_create_indexes(struct mongo_backend *mongo)
+{
+    bson_error_t error;
+    bson_t *command;
+    bson_t reply;
+    bool success;
+
+    command = bson_from_indexes(MONGO_INDEXES,
+                                sizeof(MONGO_INDEXES) / sizeof(*MONGO_INDEXES));
+    if (command == NULL)
+        return -1;
+
+    /* Creating an index that already exists with the same specification is a
+     * no-op, which makes this safe to call on every initialization.
+     */
+    success = mongoc_collection_command_simple(mongo->entries, command, NULL,
+                                               &reply, &error);
+    bson_destroy(command);
+    bson_destroy(&reply);
+    if (!success) {
+        snprintf(rbh_backend_error, sizeof(rbh_backend_error), "mongoc: %s",
+                 error.message);
+        errno = RBH_BACKEND_ERROR;
+        return -1;
+    }
+
+    return 0;
+}
@@ -176,6 +176,50 @@ out:
     return 1;
 }
 
+static int
+get_collection_index_sizes(const struct mongo_backend *mongo,
+                           struct rbh_value_pair *pair)
+{
+    struct rbh_value *value;
+    char _buffer[4096];
+    bson_error_t error;
+    bson_iter_t iter;
+    bson_t *command;
+    size_t bufsize;
+    char *buffer;
+    bson_t reply;
+    int rc = -1;
+
+    buffer = _buffer;
+    bufsize = sizeof(_buffer);
+    value = RBH_SSTACK_PUSH(info_sstack, NULL, sizeof(*value));
+
+    command = BCON_NEW("collStats", BCON_UTF8("entries"));
+
+    if (!mongoc_collection_command_simple(mongo->entries, command, NULL,
+                                          &reply, &error))
+        goto out;
+
+    /* indexSizes is a document mapping each index name to its size in bytes */
+    if (!bson_iter_init_find(&iter, &reply, "indexSizes") ||
+        !BSON_ITER_HOLDS_DOCUMENT(&iter) ||
+        !bson_iter_rbh_value(&iter, value, &buffer, &bufsize))
+        goto out;
+
+    pair->key = "index_sizes";
+    pair->value = value_clone(value);
+    rc = 0;
+
+out:
+    bson_destroy(command);
+    bson_destroy(&reply);
+
+    if (rc)
+        fprintf(stderr, "indexSizes not available\n");
+
+    return rc;
+}
+
 static int
 get_collection_last_sync_start_date(const struct mongo_backend *mongo,
                                     struct rbh_value_pair *pair)
@@ -306,6 +350,11 @@ mongo_backend_get_info(void *backend, int info_flags)
             goto out;
     }
 
+    if (info_flags & RBH_INFO_INDEX_SIZES) {
+        if (get_collection_index_sizes(mongo, &pairs[idx++]))
+            goto out;
+    }
+
     map_value->pairs = pairs;
     map_value->count = idx;
 
@@ -10,6 +10,8 @@
 #endif
 
 #include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 /* This backend uses libmongoc, from the "mongo-c-driver" project to interact
@@ -21,6 +23,7 @@
 #include <miniyaml.h>
 
 #include "robinhood/backends/mongo.h"
+#include "robinhood/fsevent.h"
 #include "robinhood/sstack.h"
 #include "robinhood/uri.h"
 #include "robinhood/utils.h"
@@ -317,7 +320,7 @@ entry_from_bson(const bson_t *bson)
     case FT_MAP:
         return map_from_bson(&iter);
     case FT_FSENTRY:
-        return fsentry_from_bson(&iter);
+        return fsentry_from_bson(bson);
     }
 
 out:
@@ -468,6 +471,19 @@ _mongoc_bulk_operation_update_one(mongoc_bulk_operation_t *bulk,
 #endif
 }
 
+static bool
+_mongoc_bulk_operation_insert(mongoc_bulk_operation_t *bulk,
+                              const bson_t *document)
+{
+#if MONGOC_CHECK_VERSION(1, 7, 0)
+    /* TODO: handle errors */
+    return mongoc_bulk_operation_insert_with_opts(bulk, document, NULL, NULL);
+#else
+    mongoc_bulk_operation_insert(bulk, document);
+    return true;
+#endif
+}
+
 static bool
 _mongoc_bulk_operation_remove_one(mongoc_bulk_operation_t *bulk,
                                   const bson_t *selector)
@@ -608,19 +624,84 @@ mongo_bulk_init_from_fsevents(mongoc_bulk_operation_t *bulk,
     return count;
 }
 
+/* Add the counts of the reply of a bulk operation to \p stats */
+static void
+update_stats_add(struct rbh_update_stats *stats, const bson_t *reply)
+{
+    bson_iter_t errors;
+    bson_iter_t iter;
+    int64_t value;
+
+    if (bson_iter_find_int64(reply, "nInserted", &value))
+        stats->inserted += value;
+    if (bson_iter_find_int64(reply, "nMatched", &value))
+        stats->matched += value;
+    if (bson_iter_find_int64(reply, "nUpserted", &value))
+        stats->upserted += value;
+    if (bson_iter_find_int64(reply, "nRemoved", &value))
+        stats->removed += value;
+
+    if (bson_iter_init_find(&iter, reply, "writeErrors")
+     && BSON_ITER_HOLDS_ARRAY(&iter) && bson_iter_recurse(&iter, &errors))
+        stats->write_errors += bson_iter_count(&errors);
+}
+
+/* The counts of \p reply are added to \p stats. On failure, \p reply is left
+ * initialized for the caller to inspect and destroy
+ */
+static int
+mongo_bulk_execute(mongoc_bulk_operation_t *bulk, bson_t *reply,
+                   struct rbh_update_stats *stats)
+{
+    bson_error_t error;
+    int errnum;
+
+    if (mongoc_bulk_operation_execute(bulk, reply, &error)) {
+        update_stats_add(stats, reply);
+        bson_destroy(reply);
+        return 0;
+    }
+
+    update_stats_add(stats, reply);
+    errnum = RBH_BACKEND_ERROR;
+    snprintf(rbh_backend_error, sizeof(rbh_backend_error), "mongoc: %s",
+             error.message);
+#if MONGOC_CHECK_VERSION(1, 11, 0)
+    if (mongoc_error_has_label(reply, "TransientTransactionError"))
+        errnum = EAGAIN;
+#endif
+    errno = errnum;
+    return -1;
+}
+
+static ssize_t
+mongo_fresh_load_update(struct mongo_backend *mongo,
+                        struct rbh_iterator *fsevents);
+
+static ssize_t
+mongo_parallel_update(struct mongo_backend *mongo,
+                      struct rbh_iterator *fsevents);
+
 static ssize_t
 mongo_backend_update(void *backend, struct rbh_iterator *fsevents)
 {
     struct mongo_backend *mongo = backend;
     mongoc_bulk_operation_t *bulk;
-    bson_error_t error;
     ssize_t count;
     bson_t reply;
-    uint32_t rc;
+    int rc;
+
+    memset(&mongo->update_stats, 0, sizeof(mongo->update_stats));
 
     if (fsevents == NULL)
         return 0;
 
+    if (mongo->fresh_load)
+        return mongo_fresh_load_update(mongo, fsevents);
+
+    if (mongo->bulk_writers > 1)
+        return mongo_parallel_update(mongo, fsevents);
+
     bulk = _mongoc_collection_create_bulk_operation(mongo->entries, false,
                                                     NULL);
     if (bulk == NULL) {
@@ -645,24 +726,556 @@ mongo_backend_update(void *backend, struct rbh_iterator *fsevents)
         return count;
     }
 
-    rc = mongoc_bulk_operation_execute(bulk, &reply, &error);
+    rc = mongo_bulk_execute(bulk, &reply, &mongo->update_stats);
     mongoc_bulk_operation_destroy(bulk);
-    if (!rc) {
-        int errnum = RBH_BACKEND_ERROR;
+    if (rc) {
+        int save_errno = errno;
+
+        bson_destroy(&reply);
+        errno = save_errno;
+        return -1;
+    }
+
+    return count;
+}
+
+        /*------------------------------------------------------------*
+         |                         fresh load                         |
+         *------------------------------------------------------------*/
+
+/* When the backend started empty (cf. RBH_GBO_FRESH_LOAD), entries described
+ * by an upsert and a link are inserted as complete documents, which spares the
+ * server a lookup for every fsevent. Any other fsevent goes through the regular
+ * update path, after the insertions.
+ *
+ * An insertion fails with a duplicate key error if the entry was already
+ * inserted (a hardlink, a concurrent synchronization, ...). The fsevents of
+ * such entries are then applied as regular updates.
+ */
+
+#define MONGO_DUPLICATE_KEY_ERROR 11000
+
+struct fresh_load {
+    mongoc_bulk_operation_t *inserts;
+    mongoc_bulk_operation_t *updates;
+    size_t update_count;
+
+    /* The fsevents of the entry being read */
+    struct rbh_fsevent **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+
+    /* The upsert and the link of each insertion, in order */
+    struct rbh_fsevent **inserted;
+    size_t insert_count;
+    size_t inserted_capacity;
+};
+
+static void
+fresh_load_push(struct fresh_load *load, const struct rbh_fsevent *fsevent)
+{
+    if (load->pending_count == load->pending_capacity) {
+        load->pending_capacity = load->pending_capacity * 2 ? : 4;
+        load->pending = xreallocarray(load->pending, load->pending_capacity,
+                                      sizeof(*load->pending));
+    }
+
+    load->pending[load->pending_count++] = rbh_fsevent_clone(fsevent);
+}
+
+static bool
+fresh_load_is_complete(struct rbh_fsevent **fsevents, size_t count)
+{
+    return count == 2
+        && fsevents[0]->type == RBH_FET_UPSERT
+        && fsevents[0]->upsert.statx != NULL
+        && fsevents[1]->type == RBH_FET_LINK;
+}
+
+static int
+fresh_load_insert(struct fresh_load *load)
+{
+    bson_t *document;
+    bool success;
+
+    document = bson_document_from_fsevents(load->pending[0], load->pending[1]);
+    if (document == NULL)
+        return -1;
+
+    success = _mongoc_bulk_operation_insert(load->inserts, document);
+    bson_destroy(document);
+    if (!success) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (2 * load->insert_count == load->inserted_capacity) {
+        load->inserted_capacity = load->inserted_capacity * 2 ? : 256;
+        load->inserted = xreallocarray(load->inserted,
+                                       load->inserted_capacity,
+                                       sizeof(*load->inserted));
+    }
+
+    load->inserted[2 * load->insert_count] = load->pending[0];
+    load->inserted[2 * load->insert_count + 1] = load->pending[1];
+    load->insert_count++;
+    load->pending_count = 0;
+    return 0;
+}
+
+/* Move the pending fsevents to the right bulk operation */
+static int
+fresh_load_flush(struct fresh_load *load)
+{
+    int rc = 0;
+
+    if (load->pending_count == 0)
+        return 0;
+
+    if (fresh_load_is_complete(load->pending, load->pending_count))
+        return fresh_load_insert(load);
+
+    for (size_t i = 0; i < load->pending_count; i++) {
+        if (rc == 0 && !mongo_bulk_append_fsevent(load->updates,
+                                                  load->pending[i]))
+            rc = -1;
+        else if (rc == 0)
+            load->update_count++;
+        free(load->pending[i]);
+    }
+    load->pending_count = 0;
+
+    return rc;
+}
+
+static bool
+bson_iter_find_int64(const bson_t *bson, const char *key, int64_t *value)
+{
+    bson_iter_t iter;
 
+    if (!bson_iter_init_find(&iter, bson, key))
+        return false;
+
+    *value = bson_iter_as_int64(&iter);
+    return true;
+}
+
+/* Queue the fsevents of the entries that could not be inserted because they
+ * already exist as regular updates.
+ *
+ * Returns -1 if any other error occurred.
+ */
+static int
+fresh_load_retry_duplicates(struct fresh_load *load, const bson_t *reply)
+{
+    bson_iter_t iter;
+    bson_iter_t errors;
+
+    if (bson_iter_init_find(&iter, reply, "writeConcernErrors")
+     && BSON_ITER_HOLDS_ARRAY(&iter) && bson_iter_recurse(&iter, &errors)
+     && bson_iter_next(&errors))
+        return -1;
+
+    if (!bson_iter_init_find(&iter, reply, "writeErrors")
+     || !BSON_ITER_HOLDS_ARRAY(&iter) || !bson_iter_recurse(&iter, &errors))
+        return -1;
+
+    while (bson_iter_next(&errors)) {
+        const uint8_t *data;
+        int64_t index;
+        int64_t code;
+        uint32_t size;
+        bson_t error;
+
+        if (!BSON_ITER_HOLDS_DOCUMENT(&errors))
+            return -1;
+
+        bson_iter_document(&errors, &size, &data);
+        if (!bson_init_static(&error, data, size)
+         || !bson_iter_find_int64(&error, "code", &code)
+         || !bson_iter_find_int64(&error, "index", &index))
+            return -1;
+
+        if (code != MONGO_DUPLICATE_KEY_ERROR || index < 0 ||
+            (size_t)index >= load->insert_count)
+            return -1;
+
+        for (size_t i = 0; i < 2; i++) {
+            if (!mongo_bulk_append_fsevent(load->updates,
+                                           load->inserted[2 * index + i]))
+                return -1;
+            load->update_count++;
+        }
+    }
+
+    return 0;
+}
+
+static void
+fresh_load_fini(struct fresh_load *load)
+{
+    for (size_t i = 0; i < load->pending_count; i++)
+        free(load->pending[i]);
+    free(load->pending);
+
+    for (size_t i = 0; i < 2 * load->insert_count; i++)
+        free(load->inserted[i]);
+    free(load->inserted);
+
+    if (load->inserts)
+        mongoc_bulk_operation_destroy(load->inserts);
+    if (load->updates)
+        mongoc_bulk_operation_destroy(load->updates);
+}
+
+static ssize_t
+mongo_fresh_load_update(struct mongo_backend *mongo,
+                        struct rbh_iterator *fsevents)
+{
+    struct fresh_load load = { 0 };
+    int save_errno = errno;
+    ssize_t count = 0;
+    bson_t reply;
+
+    load.inserts = _mongoc_collection_create_bulk_operation(mongo->entries,
+                                                            false, NULL);
+    load.updates = _mongoc_collection_create_bulk_operation(mongo->entries,
+                                                            false, NULL);
+    if (load.inserts == NULL || load.updates == NULL) {
+        /* cf. mongo_backend_update() */
+        errno = ENOMEM;
+        goto out;
+    }
+
+    do {
+        const struct rbh_fsevent *fsevent;
+
+        errno = 0;
+        fsevent = rbh_iter_next(fsevents);
+        if (fsevent == NULL) {
+            if (errno == ENODATA)
+                break;
+            goto out;
+        }
+
+        if (load.pending_count > 0 &&
+            !rbh_id_equal(&fsevent->id, &load.pending[0]->id) &&
+            fresh_load_flush(&load))
+            goto out;
+
+        fresh_load_push(&load, fsevent);
+        count++;
+    } while (true);
+
+    if (fresh_load_flush(&load))
+        goto out;
+
+    /* Insert new entries first, updates may refer to them */
+    if (load.insert_count > 0 &&
+        mongo_bulk_execute(load.inserts, &reply, &mongo->update_stats)) {
+        int rc = fresh_load_retry_duplicates(&load, &reply);
+
+        bson_destroy(&reply);
+        if (rc)
+            goto out;
+
+        /* Duplicates are retried as updates, they are no error */
+        mongo->update_stats.write_errors = 0;
+    }
+
+    if (load.update_count > 0 &&
+        mongo_bulk_execute(load.updates, &reply, &mongo->update_stats)) {
+        bson_destroy(&reply);
+        goto out;
+    }
+
+    fresh_load_fini(&load);
+    errno = save_errno;
+    return count;
+
+out:
+    save_errno = errno;
+    fresh_load_fini(&load);
+    errno = save_errno;
+    return -1;
+}
+
+static int
+mongo_entries_are_empty(struct mongo_backend *mongo)
+{
+    bson_t *opts = BCON_NEW("limit", BCON_INT64(1),
+                            "projection", "{", MFF_ID, BCON_BOOL(true), "}");
+    mongoc_cursor_t *cursor;
+    bson_t filter = BSON_INITIALIZER;
+    bson_error_t error;
+    const bson_t *doc;
+    int rc;
+
+    cursor = mongoc_collection_find_with_opts(mongo->entries, &filter, opts,
+                                              NULL);
+    bson_destroy(opts);
+    if (cursor == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    rc = !mongoc_cursor_next(cursor, &doc);
+    if (rc && mongoc_cursor_error(cursor, &error)) {
         snprintf(rbh_backend_error, sizeof(rbh_backend_error), "mongoc: %s",
                  error.message);
+        errno = RBH_BACKEND_ERROR;
+        rc = -1;
+    }
+    mongoc_cursor_destroy(cursor);
+
+    return rc;
+}
+
+        /*------------------------------------------------------------*
+         |                      parallel update                       |
+         *------------------------------------------------------------*/
+
+/* When mongo/bulk_writers is set to K > 1, an update is split into K bulk
+ * operations which are executed concurrently, each on its own connection taken
+ * from a pool. Fsevents are dispatched according to a hash of their ID: every
+ * fsevent of a given entry ends up in the same bulk operation, in the order it
+ * was read.
+ *
+ * Fresh loads (cf. RBH_GBO_FRESH_LOAD) still go through a single connection.
+ */
+
+struct bulk_writer {
+    mongoc_client_t *client;
+    mongoc_collection_t *entries;
+    mongoc_bulk_operation_t *bulk;
+    size_t count;
+    pthread_t thread;
+    bool threaded;
+
+    /* Set once the bulk operation is executed */
+    bool success;
+    bson_error_t error;
+    bson_t reply;
+};
+
+/* FNV-1a, so that every byte of the ID weighs on the writer it is sent to */
+static size_t
+fsevent_writer(const struct rbh_fsevent *fsevent, size_t writer_count)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < fsevent->id.size; i++) {
+        hash ^= (unsigned char)fsevent->id.data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash % writer_count;
+}
+
+static mongoc_client_pool_t *
+mongo_client_pool_new(struct mongo_backend *mongo)
+{
+    mongoc_client_pool_t *pool;
+
+    pool = mongoc_client_pool_new(mongoc_client_get_uri(mongo->client));
+    if (pool == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+#if MONGOC_CHECK_VERSION(1, 4, 0)
+    if (!mongoc_client_pool_set_error_api(pool, MONGOC_ERROR_API_VERSION_2)) {
+        /* Should never happen */
+        mongoc_client_pool_destroy(pool);
+        errno = EINVAL;
+        return NULL;
+    }
+#endif
+    mongoc_client_pool_max_size(pool, mongo->bulk_writers);
+
+    return pool;
+}
+
+static int
+bulk_writers_init(struct mongo_backend *mongo, struct bulk_writer *writers)
+{
+    const char *db;
+
+    if (mongo->pool == NULL) {
+        mongo->pool = mongo_client_pool_new(mongo);
+        if (mongo->pool == NULL)
+            return -1;
+    }
+
+    db = mongoc_uri_get_database(mongoc_client_get_uri(mongo->client));
+
+    for (size_t i = 0; i < mongo->bulk_writers; i++) {
+        struct bulk_writer *writer = &writers[i];
+
+        writer->client = mongoc_client_pool_pop(mongo->pool);
+        writer->entries = mongoc_client_get_collection(writer->client, db,
+                                                       "entries");
+        if (writer->entries == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        writer->bulk = _mongoc_collection_create_bulk_operation(writer->entries,
+                                                                false, NULL);
+        if (writer->bulk == NULL) {
+            /* cf. mongo_backend_update() */
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void
+bulk_writers_fini(struct mongo_backend *mongo, struct bulk_writer *writers)
+{
+    for (size_t i = 0; i < mongo->bulk_writers; i++) {
+        struct bulk_writer *writer = &writers[i];
+
+        if (writer->bulk)
+            mongoc_bulk_operation_destroy(writer->bulk);
+        if (writer->entries)
+            mongoc_collection_destroy(writer->entries);
+        if (writer->client)
+            mongoc_client_pool_push(mongo->pool, writer->client);
+    }
+}
+
+static void *
+bulk_writer_execute(void *data)
+{
+    struct bulk_writer *writer = data;
+
+    writer->success = mongoc_bulk_operation_execute(writer->bulk,
+                                                    &writer->reply,
+                                                    &writer->error);
+    return NULL;
+}
+
+/* Wait for every bulk operation to complete, and aggregate their results */
+static int
+bulk_writers_join(struct mongo_backend *mongo, struct bulk_writer *writers)
+{
+    struct rbh_update_stats *stats = &mongo->update_stats;
+    const struct bulk_writer *failed = NULL;
+    size_t failures = 0;
+    int errnum;
+
+    for (size_t i = 0; i < mongo->bulk_writers; i++) {
+        struct bulk_writer *writer = &writers[i];
+
+        if (writer->count == 0)
+            continue;
+
+        if (writer->threaded)
+            pthread_join(writer->thread, NULL);
+
+        update_stats_add(stats, &writer->reply);
+        if (!writer->success) {
+            if (failed == NULL)
+                failed = writer;
+            failures++;
+        }
+    }
+
+    if (failed == NULL) {
+        for (size_t i = 0; i < mongo->bulk_writers; i++)
+            if (writers[i].count > 0)
+                bson_destroy(&writers[i].reply);
+        return 0;
+    }
+
+    errnum = RBH_BACKEND_ERROR;
+    snprintf(rbh_backend_error, sizeof(rbh_backend_error),
+             "mongoc: %s (%zu/%zu bulk writers failed, %zu write errors, "
+             "%" PRId64 " inserted, %" PRId64 " matched, %" PRId64 " upserted, "
+             "%" PRId64 " removed)",
+             failed->error.message, failures, mongo->bulk_writers,
+             stats->write_errors, stats->inserted, stats->matched,
+             stats->upserted, stats->removed);
+
+    for (size_t i = 0; i < mongo->bulk_writers; i++) {
+        if (writers[i].count == 0)
+            continue;
+
 #if MONGOC_CHECK_VERSION(1, 11, 0)
-        if (mongoc_error_has_label(&reply, "TransientTransactionError"))
+        if (!writers[i].success &&
+            mongoc_error_has_label(&writers[i].reply,
+                                   "TransientTransactionError"))
             errnum = EAGAIN;
 #endif
-        bson_destroy(&reply);
-        errno = errnum;
-        return -1;
+        bson_destroy(&writers[i].reply);
     }
-    bson_destroy(&reply);
 
+    errno = errnum;
+    return -1;
+}
+
+static ssize_t
+mongo_parallel_update(struct mongo_backend *mongo,
+                      struct rbh_iterator *fsevents)
+{
+    struct bulk_writer *writers;
+    int save_errno = errno;
+    ssize_t count = 0;
+
+    writers = xcalloc(mongo->bulk_writers, sizeof(*writers));
+    if (bulk_writers_init(mongo, writers))
+        goto out;
+
+    do {
+        const struct rbh_fsevent *fsevent;
+        struct bulk_writer *writer;
+
+        errno = 0;
+        fsevent = rbh_iter_next(fsevents);
+        if (fsevent == NULL) {
+            if (errno == ENODATA)
+                break;
+            goto out;
+        }
+
+        writer = &writers[fsevent_writer(fsevent, mongo->bulk_writers)];
+        if (!mongo_bulk_append_fsevent(writer->bulk, fsevent))
+            goto out;
+        writer->count++;
+        count++;
+    } while (true);
+
+    for (size_t i = 0; i < mongo->bulk_writers; i++) {
+        struct bulk_writer *writer = &writers[i];
+
+        /* Executing an empty bulk operation is an error for mongoc */
+        if (writer->count == 0)
+            continue;
+
+        /* Fall back on executing the bulk operation from this thread */
+        writer->threaded = pthread_create(&writer->thread, NULL,
+                                          bulk_writer_execute, writer) == 0;
+        if (!writer->threaded)
+            bulk_writer_execute(writer);
+    }
+
+    if (bulk_writers_join(mongo, writers))
+        goto out;
+
+    bulk_writers_fini(mongo, writers);
+    free(writers);
+    errno = save_errno;
     return count;
+
+out:
+    save_errno = errno;
+    bulk_writers_fini(mongo, writers);
+    free(writers);
+    errno = save_errno;
+    return -1;
 }
 
     /*--------------------------------------------------------------------*
@@ -1024,6 +1637,8 @@ mongo_backend_destroy(void *backend)
     mongoc_collection_destroy(mongo->entries);
     mongoc_collection_destroy(mongo->info);
     mongoc_collection_destroy(mongo->log);
+    if (mongo->pool)
+        mongoc_client_pool_destroy(mongo->pool);
     mongoc_client_destroy(mongo->client);
     free(mongo);
 }
@@ -1177,6 +1792,34 @@ mongo_get_gc_option(struct mongo_backend *mongo, void *data, size_t *data_size)
     return 0;
 }
 
+static int
+mongo_get_fresh_load_option(struct mongo_backend *mongo, void *data,
+                            size_t *data_size)
+{
+    if (*data_size < sizeof(mongo->fresh_load)) {
+        *data_size = sizeof(mongo->fresh_load);
+        errno = EOVERFLOW;
+        return -1;
+    }
+    memcpy(data, &mongo->fresh_load, sizeof(mongo->fresh_load));
+    *data_size = sizeof(mongo->fresh_load);
+    return 0;
+}
+
+static int
+mongo_get_update_stats_option(struct mongo_backend *mongo, void *data,
+                              size_t *data_size)
+{
+    if (*data_size < sizeof(mongo->update_stats)) {
+        *data_size = sizeof(mongo->update_stats);
+        errno = EOVERFLOW;
+        return -1;
+    }
+    memcpy(data, &mongo->update_stats, sizeof(mongo->update_stats));
+    *data_size = sizeof(mongo->update_stats);
+    return 0;
+}
+
 static int
 mongo_get_option(void *backend, unsigned int option, void *data,
                  size_t *data_size)
@@ -1186,6 +1829,10 @@ mongo_get_option(void *backend, unsigned int option, void *data,
     switch (option) {
     case RBH_GBO_GC:
         return mongo_get_gc_option(mongo, data, data_size);
+    case RBH_GBO_FRESH_LOAD:
+        return mongo_get_fresh_load_option(mongo, data, data_size);
+    case RBH_GBO_UPDATE_STATS:
+        return mongo_get_update_stats_option(mongo, data, data_size);
     }
 
     errno = ENOPROTOOPT;
@@ -1212,6 +1859,48 @@ mongo_set_gc_option(struct mongo_backend *mongo, const void *data,
     return 0;
 }
 
+static int
+mongo_set_fresh_load_option(struct mongo_backend *mongo, const void *data,
+                            size_t data_size)
+{
+    bool fresh_load;
+    int empty;
+
+    if (data_size != sizeof(fresh_load)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&fresh_load, data, sizeof(fresh_load));
+
+    if (fresh_load) {
+        empty = mongo_entries_are_empty(mongo);
+        if (empty < 0)
+            return -1;
+        if (!empty) {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    mongo->fresh_load = fresh_load;
+    return 0;
+}
+
+static int
+mongo_set_indexes_option(struct mongo_backend *mongo, const void *data,
+                         size_t data_size)
+{
+    bool indexes;
+
+    if (data_size != sizeof(indexes)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&indexes, data, sizeof(indexes));
+
+    return indexes ? mongo_create_indexes(mongo) : 0;
+}
+
 static int
 mongo_set_option(void *backend, unsigned int option, const void *data,
                  size_t data_size)
@@ -1221,6 +1910,10 @@ mongo_set_option(void *backend, unsigned int option, const void *data,
     switch (option) {
     case RBH_GBO_GC:
         return mongo_set_gc_option(mongo, data, data_size);
+    case RBH_GBO_FRESH_LOAD:
+        return mongo_set_fresh_load_option(mongo, data, data_size);
+    case RBH_GBO_INDEXES:
+        return mongo_set_indexes_option(mongo, data, data_size);
     }
 
     errno = ENOPROTOOPT;
@@ -1366,6 +2059,10 @@ mongo_backend_init_from_uri(struct mongo_backend *mongo,
         errno = ENOMEM;
         return -1;
     }
+
+    mongo->pool = NULL;
+    mongo->bulk_writers = 1;
+    memset(&mongo->update_stats, 0, sizeof(mongo->update_stats));
     return 0;
 }
 
@@ -1394,6 +2091,8 @@ mongo_backend_branch(void *backend, const struct rbh_id *id, const char *path)
 
     rbh_id_copy(&branch->id, id, &data, &data_size);
     branch->mongo.backend = MONGO_BRANCH_BACKEND;
+    branch->mongo.fresh_load = false;
+    branch->mongo.bulk_writers = mongo->bulk_writers;
 
     return &branch->mongo.backend;
 }
@@ -1414,6 +2113,8 @@ static const struct rbh_backend MONGO_BACKEND = {
 
 #define MONGODB_ADDRESS_KEY "address"
 #define MONGODB_CURSOR_TIMEOUT "cursor_timeout"
+#define MONGODB_CREATE_INDEXES "create_indexes"
+#define MONGODB_BULK_WRITERS "bulk_writers"
 
 static const char *
 get_mongo_addr()
@@ -1447,6 +2148,44 @@ get_cursor_timeout()
     return value.int32;
 }
 
+static int
+get_create_indexes()
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find("mongo/"MONGODB_CREATE_INDEXES, &value,
+                         RBH_VT_BOOLEAN);
+    if (rc == KPR_ERROR)
+        return -1;
+
+    if (rc == KPR_NOT_FOUND)
+        value.boolean = false;
+
+    return value.boolean;
+}
+
+static int32_t
+get_bulk_writers()
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find("mongo/"MONGODB_BULK_WRITERS, &value, RBH_VT_INT32);
+    if (rc == KPR_ERROR)
+        return -1;
+
+    if (rc == KPR_NOT_FOUND)
+        value.int32 = 1;
+
+    if (value.int32 < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return value.int32;
+}
+
 static int
 mongo_backend_init(struct mongo_backend *mongo, const struct rbh_uri *uri)
 {
@@ -1521,11 +2260,25 @@ rbh_mongo_backend_new(const struct rbh_backend_plugin *self,
                       bool read_only)
 {
     struct mongo_backend *mongo;
+    int32_t bulk_writers;
+    int create_indexes;
 
     mongo = xmalloc(sizeof(*mongo));
 
     rbh_config_load(config);
 
+    create_indexes = get_create_indexes();
+    if (create_indexes == -1) {
+        free(mongo);
+        return NULL;
+    }
+
+    bulk_writers = get_bulk_writers();
+    if (bulk_writers == -1) {
+        free(mongo);
+        return NULL;
+    }
+
     if (mongo_backend_init(mongo, uri)) {
         int save_errno = errno;
 
@@ -1535,6 +2288,16 @@ rbh_mongo_backend_new(const struct rbh_backend_plugin *self,
     }
 
     mongo->backend = MONGO_BACKEND;
+    mongo->fresh_load = false;
+    mongo->bulk_writers = bulk_writers;
+
+    if (create_indexes && !read_only && mongo_create_indexes(mongo)) {
+        int save_errno = errno;
+
+        mongo_backend_destroy(mongo);
+        errno = save_errno;
+        return NULL;
+    }
 
     return &mongo->backend;
 }
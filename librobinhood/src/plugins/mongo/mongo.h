@@ -28,6 +28,13 @@ struct mongo_backend {
     mongoc_collection_t *entries;
     mongoc_collection_t *info;
     mongoc_collection_t *log;
+    bool fresh_load;
+    /* Number of concurrent bulk operations an update is split into */
+    size_t bulk_writers;
+    /* Connections used by the bulk writers, created on first use */
+    mongoc_client_pool_t *pool;
+    /* Counts of the last update, cf. RBH_GBO_UPDATE_STATS */
+    struct rbh_update_stats update_stats;
 };
 
 /*----------------------------------------------------------------------------*
@@ -239,7 +246,7 @@ bson_iter_namespace(bson_iter_t *iter, struct rbh_fsentry *fsentry,
      *--------------------------------------------------------------------*/
 
 struct rbh_fsentry *
-fsentry_from_bson(bson_iter_t *iter);
+fsentry_from_bson(const bson_t *bson);
 
 bool
 bson_iter_rbh_value(bson_iter_t *iter, struct rbh_value *value,
@@ -327,6 +334,13 @@ bson_append_aggregate_projection_stage(bson_t *bson, const char *key,
 bson_t *
 bson_update_from_fsevent(const struct rbh_fsevent *fsevent);
 
+/* Build the complete document of an entry from the upsert and the link that
+ * describe it
+ */
+bson_t *
+bson_document_from_fsevents(const struct rbh_fsevent *upsert,
+                            const struct rbh_fsevent *link);
+
     /*--------------------------------------------------------------------*
      |                               value                                |
      *--------------------------------------------------------------------*/
@@ -348,6 +362,9 @@ bson_append_rbh_value_map(bson_t *bson, const char *key, size_t key_length,
 struct rbh_value_map *
 mongo_backend_get_info(void *backend, int info_flags);
 
+int
+mongo_create_indexes(struct mongo_backend *mongo);
+
 int
 mongo_backend_insert_log(void *backend, const char *command,
                          const struct rbh_value_map *map);
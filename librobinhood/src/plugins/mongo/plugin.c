@@ -28,5 +28,5 @@ const struct rbh_backend_plugin RBH_BACKEND_PLUGIN_SYMBOL(MONGO) = {
     .capabilities = RBH_FILTER_OPS | RBH_SYNC_OPS | RBH_UPDATE_OPS |
                     RBH_BRANCH_OPS,
     .info = RBH_INFO_AVG_OBJ_SIZE | RBH_INFO_BACKEND_SOURCE | RBH_INFO_COUNT |
-            RBH_INFO_SIZE,
+            RBH_INFO_SIZE | RBH_INFO_INDEX_SIZES,
 };
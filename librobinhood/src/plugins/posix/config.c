@@ -15,6 +15,34 @@
 
 #include "robinhood/backends/posix_extension.h"
 
+#include "posix_internals.h"
+
+static int
+rbh_posix_backend_load_threads(struct posix_backend *posix, const char *type)
+{
+    enum key_parse_result rc;
+    struct rbh_value value;
+
+    rc = rbh_config_find_backend(type, "threads", &value, RBH_VT_INT32);
+    switch (rc) {
+    case KPR_FOUND:
+        if (value.int32 < 0) {
+            rbh_backend_error_printf("'backends/%s/threads' must not be negative",
+                                     type);
+            errno = EINVAL;
+            return -1;
+        }
+        posix->nb_threads = value.int32;
+        return 0;
+    case KPR_NOT_FOUND:
+        return 0;
+    default:
+        rbh_backend_error_printf("failed to retrieve 'backends/%s/threads': %s",
+                                 type, strerror(errno));
+        return -1;
+    }
+}
+
 static int
 rbh_posix_backend_load_iterator(const struct rbh_backend_plugin *self,
                                 void *backend, const char *iterator,
@@ -26,6 +54,11 @@ rbh_posix_backend_load_iterator(const struct rbh_backend_plugin *self,
     if (!strcmp(iterator, "fts"))
         return 0;
 
+    if (!strcmp(iterator, "parallel")) {
+        posix->iter_new = parallel_iter_new;
+        return rbh_posix_backend_load_threads(posix, type);
+    }
+
     extension = rbh_posix_load_extension(&self->plugin, iterator);
     if (!extension) {
         rbh_backend_error_printf("failed to load iterator '%s' for backend '%s'",
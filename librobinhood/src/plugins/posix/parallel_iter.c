@@ -0,0 +1,734 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <robinhood/backends/posix_extension.h>
+#include <robinhood/fsentry.h>
+#include <robinhood/statx.h>
+#include <robinhood/utils.h>
+
+#include "posix_internals.h"
+
+/* Parallel POSIX iterator
+ *
+ * A pool of threads share the directories left to explore. Each thread owns a
+ * deque of directories: it pushes the subdirectories it discovers at the tail
+ * of its own deque and pops from there as well (depth first, which keeps the
+ * deques short). Once its deque is empty, it steals directories from the head
+ * of the other threads' deques (the oldest ones, which are the most likely to
+ * hold large subtrees).
+ *
+ * A thread lists a directory entirely before moving on to the next one, which
+ * means it knows the number of children of the directory once done with it.
+ *
+ * Fsentries are handed to the consumer of the iterator through a bounded
+ * queue, so that threads cannot get too far ahead of it.
+ */
+
+#define PARALLEL_QUEUE_SIZE (1 << 12)
+
+struct parallel_dir {
+    char *path;
+    struct rbh_id *id;
+};
+
+struct parallel_deque {
+    pthread_mutex_t lock;
+    struct parallel_dir *dirs;
+    size_t capacity;
+    size_t head;
+    size_t count;
+};
+
+struct parallel_iterator;
+
+struct parallel_worker {
+    struct parallel_iterator *iter;
+    struct parallel_deque deque;
+    struct rbh_sstack *sstack;
+    pthread_t thread;
+};
+
+struct parallel_iterator {
+    struct posix_iterator posix;
+    struct rbh_metadata *metadata;
+    bool is_branch;
+
+    struct parallel_worker *workers;
+    size_t nb_workers;
+    size_t nb_started;
+    /* Device of the root, to avoid crossing filesystem boundaries */
+    uint32_t dev_major;
+    uint32_t dev_minor;
+
+    /* Protects everything below */
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t pending; /* directories either queued or being listed */
+    size_t queued; /* directories waiting in a deque */
+    bool stop;
+    int error;
+
+    struct rbh_fsentry **fsentries;
+    size_t head;
+    size_t count;
+};
+
+static const struct rbh_id ROOT_PARENT_ID = {
+    .data = NULL,
+    .size = 0,
+};
+
+    /*--------------------------------------------------------------------*
+     |                               deque                                |
+     *--------------------------------------------------------------------*/
+
+static void
+deque_init(struct parallel_deque *deque)
+{
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = 1 << 6;
+    deque->dirs = xmalloc(deque->capacity * sizeof(*deque->dirs));
+    deque->head = 0;
+    deque->count = 0;
+}
+
+static void
+deque_fini(struct parallel_deque *deque)
+{
+    for (size_t i = 0; i < deque->count; i++) {
+        struct parallel_dir *dir;
+
+        dir = &deque->dirs[(deque->head + i) % deque->capacity];
+        free(dir->path);
+        free(dir->id);
+    }
+
+    free(deque->dirs);
+    pthread_mutex_destroy(&deque->lock);
+}
+
+/* \p queued is incremented before \p dir can be stolen, for it never to be
+ * decremented first
+ */
+static void
+deque_push_tail(struct parallel_deque *deque, const struct parallel_dir *dir,
+                pthread_mutex_t *lock, size_t *queued)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        struct parallel_dir *dirs;
+
+        dirs = xreallocarray(NULL, deque->capacity * 2, sizeof(*dirs));
+        for (size_t i = 0; i < deque->count; i++)
+            dirs[i] = deque->dirs[(deque->head + i) % deque->capacity];
+
+        free(deque->dirs);
+        deque->dirs = dirs;
+        deque->capacity *= 2;
+        deque->head = 0;
+    }
+
+    deque->dirs[(deque->head + deque->count) % deque->capacity] = *dir;
+    deque->count++;
+
+    pthread_mutex_lock(lock);
+    (*queued)++;
+    pthread_mutex_unlock(lock);
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool
+deque_pop_tail(struct parallel_deque *deque, struct parallel_dir *dir)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        *dir = deque->dirs[(deque->head + deque->count) % deque->capacity];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+static bool
+deque_steal_head(struct parallel_deque *deque, struct parallel_dir *dir,
+                 bool wait)
+{
+    bool found = false;
+
+    /* Unless told to, do not wait on a busy victim, there probably are others
+     */
+    if (wait)
+        pthread_mutex_lock(&deque->lock);
+    else if (pthread_mutex_trylock(&deque->lock))
+        return false;
+
+    if (deque->count > 0) {
+        *dir = deque->dirs[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+    /*--------------------------------------------------------------------*
+     |                            coordination                            |
+     *--------------------------------------------------------------------*/
+
+/* Record the first fatal error and make every thread stop */
+static void
+parallel_iter_fail(struct parallel_iterator *iter, int error)
+{
+    pthread_mutex_lock(&iter->lock);
+    if (iter->error == 0)
+        iter->error = error;
+    iter->stop = true;
+    pthread_cond_broadcast(&iter->work_available);
+    pthread_cond_broadcast(&iter->not_empty);
+    pthread_cond_broadcast(&iter->not_full);
+    pthread_mutex_unlock(&iter->lock);
+}
+
+static void
+parallel_iter_queue_dir(struct parallel_worker *worker,
+                        const struct parallel_dir *dir)
+{
+    struct parallel_iterator *iter = worker->iter;
+
+    /* Account for the directory before it can be listed, and done with */
+    pthread_mutex_lock(&iter->lock);
+    iter->pending++;
+    pthread_mutex_unlock(&iter->lock);
+
+    /* Only count it as queued once thieves can find it */
+    deque_push_tail(&worker->deque, dir, &iter->lock, &iter->queued);
+
+    pthread_mutex_lock(&iter->lock);
+    pthread_cond_signal(&iter->work_available);
+    pthread_mutex_unlock(&iter->lock);
+}
+
+static void
+parallel_iter_dir_done(struct parallel_iterator *iter)
+{
+    pthread_mutex_lock(&iter->lock);
+    if (--iter->pending == 0) {
+        /* The whole tree was walked */
+        pthread_cond_broadcast(&iter->work_available);
+        pthread_cond_broadcast(&iter->not_empty);
+    }
+    pthread_mutex_unlock(&iter->lock);
+}
+
+static bool
+parallel_iter_take_dir(struct parallel_worker *worker, struct parallel_dir *dir)
+{
+    struct parallel_iterator *iter = worker->iter;
+    size_t self = worker - iter->workers;
+    bool wait = false;
+
+    while (true) {
+        bool found = deque_pop_tail(&worker->deque, dir);
+
+        for (size_t i = 1; !found && i < iter->nb_workers; i++) {
+            size_t victim = (self + i) % iter->nb_workers;
+
+            found = deque_steal_head(&iter->workers[victim].deque, dir, wait);
+        }
+
+        pthread_mutex_lock(&iter->lock);
+        if (found) {
+            iter->queued--;
+            pthread_mutex_unlock(&iter->lock);
+            return true;
+        }
+
+        while (!iter->stop && iter->pending > 0 && iter->queued == 0)
+            pthread_cond_wait(&iter->work_available, &iter->lock);
+
+        if (iter->stop || iter->pending == 0) {
+            pthread_mutex_unlock(&iter->lock);
+            return false;
+        }
+        pthread_mutex_unlock(&iter->lock);
+
+        /* Some directory is queued, rather than spin on busy deques, wait for
+         * them to be free
+         */
+        wait = true;
+    }
+}
+
+static void
+parallel_iter_emit(struct parallel_iterator *iter, struct rbh_fsentry *fsentry)
+{
+    pthread_mutex_lock(&iter->lock);
+    while (iter->count == PARALLEL_QUEUE_SIZE && !iter->stop)
+        pthread_cond_wait(&iter->not_full, &iter->lock);
+
+    if (iter->stop) {
+        pthread_mutex_unlock(&iter->lock);
+        free(fsentry);
+        return;
+    }
+
+    iter->fsentries[(iter->head + iter->count) % PARALLEL_QUEUE_SIZE] = fsentry;
+    iter->count++;
+    pthread_cond_signal(&iter->not_empty);
+    pthread_mutex_unlock(&iter->lock);
+}
+
+    /*--------------------------------------------------------------------*
+     |                              workers                               |
+     *--------------------------------------------------------------------*/
+
+static char *
+path_join(const char *parent, const char *name)
+{
+    size_t length = strlen(parent);
+    char *path;
+
+    if (asprintf(&path, "%s%s%s", parent,
+                 length > 0 && parent[length - 1] == '/' ? "" : "/",
+                 name) < 0)
+        return NULL;
+
+    return path;
+}
+
+static void
+parallel_iter_skipped(struct parallel_iterator *iter, const char *path)
+{
+    if (iter->metadata)
+        __atomic_add_fetch(&iter->metadata->sync_md.skipped_entries, 1,
+                           __ATOMIC_RELAXED);
+    fprintf(stderr, "Synchronization of '%s' skipped\n", path);
+}
+
+static bool
+is_same_device(struct parallel_iterator *iter, const struct rbh_statx *statx)
+{
+    return statx->stx_dev_major == iter->dev_major &&
+           statx->stx_dev_minor == iter->dev_minor;
+}
+
+/* Convert one entry of a directory, and queue it if it is a directory itself
+ *
+ * Returns 1 if the entry was converted, 0 if it was skipped and -1 on fatal
+ * error.
+ */
+static int
+parallel_iter_convert(struct parallel_worker *worker,
+                      const struct parallel_dir *parent, char *name)
+{
+    struct parallel_iterator *iter = worker->iter;
+    struct rbh_value path_value = {
+        .type = RBH_VT_STRING,
+    };
+    struct fsentry_id_pair pair;
+    struct parallel_dir dir;
+    bool descend;
+    char *path;
+
+    path = path_join(parent->path, name);
+    if (path == NULL)
+        return -1;
+
+    path_value.string = path + iter->posix.prefix_len;
+    if (!fsentry_from_any(&pair, &path_value, path, NULL, parent->id, name,
+                          iter->posix.statx_sync_type,
+                          iter->posix.enrichers)) {
+        int save_errno = errno;
+
+        if ((save_errno == ENOENT || save_errno == ESTALE) &&
+            iter->posix.skip_error) {
+            /* The entry moved from under our feet */
+            parallel_iter_skipped(iter, path);
+            free(path);
+            return 0;
+        }
+
+        free(path);
+        errno = save_errno;
+        return -1;
+    }
+
+    if (iter->metadata)
+        __atomic_add_fetch(&iter->metadata->sync_md.converted_entries, 1,
+                           __ATOMIC_RELAXED);
+
+    /* The fsentry belongs to the consumer once emitted */
+    descend = S_ISDIR(pair.fsentry->statx->stx_mode) &&
+              is_same_device(iter, pair.fsentry->statx);
+
+    /* The directory has to be emitted before anyone can list it, otherwise
+     * its number of children could reach the consumer before the directory
+     * itself.
+     */
+    parallel_iter_emit(iter, pair.fsentry);
+
+    if (!descend) {
+        free(pair.id);
+        free(path);
+        return 1;
+    }
+
+    dir.path = path;
+    dir.id = pair.id;
+    parallel_iter_queue_dir(worker, &dir);
+
+    return 1;
+}
+
+static void
+parallel_iter_list(struct parallel_worker *worker,
+                   const struct parallel_dir *dir)
+{
+    struct parallel_iterator *iter = worker->iter;
+    struct rbh_fsentry *fsentry;
+    struct dirent *dirent;
+    int children = 0;
+    DIR *dirp;
+
+    dirp = opendir(dir->path);
+    if (dirp == NULL) {
+        int save_errno = errno;
+
+        fprintf(stderr, "Failed to read directory '%s': %s (%d)\n",
+                dir->path, strerror(save_errno), save_errno);
+        if (iter->posix.skip_error)
+            parallel_iter_skipped(iter, dir->path);
+        else
+            parallel_iter_fail(iter, save_errno);
+        return;
+    }
+
+    while (true) {
+        int rc;
+
+        errno = 0;
+        dirent = readdir(dirp);
+        if (dirent == NULL) {
+            if (errno == 0)
+                break;
+
+            int save_errno = errno;
+
+            fprintf(stderr, "Failed to read directory '%s': %s (%d)\n",
+                    dir->path, strerror(save_errno), save_errno);
+            if (iter->posix.skip_error) {
+                parallel_iter_skipped(iter, dir->path);
+                goto out_closedir;
+            }
+            parallel_iter_fail(iter, save_errno);
+            goto out_closedir;
+        }
+
+        if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
+            continue;
+
+        if (__atomic_load_n(&iter->stop, __ATOMIC_RELAXED))
+            goto out_closedir;
+
+        rc = parallel_iter_convert(worker, dir, dirent->d_name);
+        if (rc < 0) {
+            parallel_iter_fail(iter, errno);
+            goto out_closedir;
+        }
+        children += rc;
+    }
+
+    fsentry = build_fsentry_nb_children(dir->id, children,
+                                        iter->posix.start_time, true,
+                                        worker->sstack);
+    rbh_sstack_clear(worker->sstack);
+    if (fsentry == NULL) {
+        if (iter->posix.skip_error)
+            fprintf(stderr, "Update of number of children of '%s' skipped\n",
+                    dir->path);
+        else
+            parallel_iter_fail(iter, errno);
+        goto out_closedir;
+    }
+
+    parallel_iter_emit(iter, fsentry);
+
+out_closedir:
+    closedir(dirp);
+}
+
+static void *
+parallel_iter_worker(void *arg)
+{
+    struct parallel_worker *worker = arg;
+    struct parallel_dir dir;
+
+    while (parallel_iter_take_dir(worker, &dir)) {
+        parallel_iter_list(worker, &dir);
+        free(dir.path);
+        free(dir.id);
+        parallel_iter_dir_done(worker->iter);
+    }
+
+    return NULL;
+}
+
+    /*--------------------------------------------------------------------*
+     |                              iterator                              |
+     *--------------------------------------------------------------------*/
+
+static void *
+parallel_iter_next(void *iterator)
+{
+    struct parallel_iterator *iter = iterator;
+    struct rbh_fsentry *fsentry;
+    int error;
+
+    pthread_mutex_lock(&iter->lock);
+    while (iter->count == 0 && iter->pending > 0 && !iter->stop)
+        pthread_cond_wait(&iter->not_empty, &iter->lock);
+
+    if (iter->count > 0) {
+        fsentry = iter->fsentries[iter->head];
+        iter->head = (iter->head + 1) % PARALLEL_QUEUE_SIZE;
+        iter->count--;
+        pthread_cond_signal(&iter->not_full);
+        pthread_mutex_unlock(&iter->lock);
+        return fsentry;
+    }
+
+    error = iter->error;
+    pthread_mutex_unlock(&iter->lock);
+
+    errno = error ? : ENODATA;
+    return NULL;
+}
+
+static void
+parallel_iter_destroy(void *iterator)
+{
+    struct parallel_iterator *iter = iterator;
+
+    pthread_mutex_lock(&iter->lock);
+    iter->stop = true;
+    pthread_cond_broadcast(&iter->work_available);
+    pthread_cond_broadcast(&iter->not_full);
+    pthread_mutex_unlock(&iter->lock);
+
+    for (size_t i = 0; i < iter->nb_started; i++)
+        pthread_join(iter->workers[i].thread, NULL);
+
+    for (size_t i = 0; i < iter->count; i++)
+        free(iter->fsentries[(iter->head + i) % PARALLEL_QUEUE_SIZE]);
+
+    for (size_t i = 0; i < iter->nb_workers; i++) {
+        deque_fini(&iter->workers[i].deque);
+        rbh_sstack_destroy(iter->workers[i].sstack);
+    }
+
+    pthread_cond_destroy(&iter->work_available);
+    pthread_cond_destroy(&iter->not_empty);
+    pthread_cond_destroy(&iter->not_full);
+    pthread_mutex_destroy(&iter->lock);
+    free(iter->workers);
+    free(iter->fsentries);
+    free(iter->posix.path);
+    free(iter);
+}
+
+static const struct rbh_mut_iterator_operations PARALLEL_ITER_OPS = {
+    .next = parallel_iter_next,
+    .destroy = parallel_iter_destroy,
+};
+
+static const struct rbh_mut_iterator PARALLEL_ITER = {
+    .ops = &PARALLEL_ITER_OPS,
+};
+
+struct rbh_mut_iterator *
+parallel_iter_new(struct rbh_metadata *metadata, const char *root,
+                  const char *entry, int statx_sync_type)
+{
+    struct parallel_iterator *iter;
+    int save_errno;
+
+    iter = xcalloc(1, sizeof(*iter));
+
+    if (posix_iterator_setup(&iter->posix, root, entry, statx_sync_type)) {
+        save_errno = errno;
+        free(iter);
+        errno = save_errno;
+        return NULL;
+    }
+
+    iter->posix.start_time = time(NULL);
+    iter->posix.iterator = PARALLEL_ITER;
+    iter->metadata = metadata;
+    iter->is_branch = (entry != NULL);
+
+    pthread_mutex_init(&iter->lock, NULL);
+    pthread_cond_init(&iter->work_available, NULL);
+    pthread_cond_init(&iter->not_empty, NULL);
+    pthread_cond_init(&iter->not_full, NULL);
+    iter->fsentries = xmalloc(PARALLEL_QUEUE_SIZE * sizeof(*iter->fsentries));
+
+    return (struct rbh_mut_iterator *)iter;
+}
+
+/* Convert the root of the iteration on the caller's thread
+ *
+ * Returns the root's ID if it is a directory that needs to be listed, NULL
+ * otherwise (with errno set to 0 if the root is not a directory).
+ */
+static struct rbh_id *
+parallel_iter_root(struct parallel_iterator *iter)
+{
+    struct rbh_value path_value = {
+        .type = RBH_VT_STRING,
+    };
+    struct rbh_id *parent_id = NULL;
+    struct fsentry_id_pair pair;
+    char *name = "";
+    char *path_dup = NULL;
+    int save_errno;
+    bool success;
+
+    if (iter->is_branch) {
+        /* Give the branch point its real parent and name */
+        char *parent;
+        int fd;
+
+        path_dup = xstrdup(iter->posix.path);
+        name = strrchr(path_dup, '/') ? strrchr(path_dup, '/') + 1 : path_dup;
+        parent = dirname(xstrdup(iter->posix.path));
+
+        fd = openat(AT_FDCWD, parent, O_RDONLY | O_CLOEXEC);
+        save_errno = errno;
+        free(parent);
+        if (fd < 0) {
+            free(path_dup);
+            errno = save_errno;
+            return NULL;
+        }
+
+        parent_id = id_from_fd(fd, RBH_BI_POSIX);
+        save_errno = errno;
+        close(fd);
+        if (parent_id == NULL) {
+            free(path_dup);
+            errno = save_errno;
+            return NULL;
+        }
+        path_value.string = iter->posix.path + iter->posix.prefix_len;
+    } else {
+        path_value.string = "/";
+    }
+
+    success = fsentry_from_any(&pair, &path_value, iter->posix.path, NULL,
+                               parent_id ? : (struct rbh_id *)&ROOT_PARENT_ID,
+                               name, iter->posix.statx_sync_type,
+                               iter->posix.enrichers);
+    save_errno = errno;
+    free(parent_id);
+    free(path_dup);
+    if (!success) {
+        errno = save_errno;
+        return NULL;
+    }
+
+    if (iter->metadata)
+        iter->metadata->sync_md.converted_entries++;
+
+    iter->dev_major = pair.fsentry->statx->stx_dev_major;
+    iter->dev_minor = pair.fsentry->statx->stx_dev_minor;
+    if (S_ISDIR(pair.fsentry->statx->stx_mode)) {
+        iter->fsentries[iter->count++] = pair.fsentry;
+        return pair.id;
+    }
+
+    iter->fsentries[iter->count++] = pair.fsentry;
+    free(pair.id);
+    errno = 0;
+    return NULL;
+}
+
+int
+parallel_iter_start(struct posix_iterator *_iter, size_t nb_threads)
+{
+    struct parallel_iterator *iter = (struct parallel_iterator *)_iter;
+    struct parallel_dir root;
+
+    if (nb_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nb_threads = online > 0 ? online : 1;
+    }
+
+    iter->nb_workers = nb_threads;
+    iter->workers = xcalloc(nb_threads, sizeof(*iter->workers));
+    for (size_t i = 0; i < nb_threads; i++) {
+        iter->workers[i].iter = iter;
+        iter->workers[i].sstack = rbh_sstack_new(1 << 10);
+        deque_init(&iter->workers[i].deque);
+    }
+
+    root.id = parallel_iter_root(iter);
+    if (root.id == NULL)
+        return errno ? -1 : 0;
+
+    root.path = xstrdup(iter->posix.path);
+    iter->pending = 1;
+    deque_push_tail(&iter->workers[0].deque, &root, &iter->lock, &iter->queued);
+
+    for (size_t i = 0; i < nb_threads; i++) {
+        int rc;
+
+        rc = pthread_create(&iter->workers[i].thread, NULL,
+                            parallel_iter_worker, &iter->workers[i]);
+        if (rc) {
+            /* Make do with the threads we already have, if any */
+            if (i > 0)
+                break;
+            errno = rc;
+            return -1;
+        }
+        iter->nb_started++;
+    }
+
+    return 0;
+}
+
+bool
+rbh_posix_iter_is_parallel(struct posix_iterator *iter)
+{
+    return iter->iterator.ops == &PARALLEL_ITER_OPS;
+}
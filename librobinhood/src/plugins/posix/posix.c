@@ -744,6 +744,7 @@ posix_backend_filter(
     struct posix_backend *posix = backend;
     struct posix_iterator *posix_iter;
     char full_path[PATH_MAX];
+    iter_new_t iter_new;
     char root[PATH_MAX];
     int save_errno;
 
@@ -783,10 +784,15 @@ posix_backend_filter(
         }
     }
 
+    iter_new = posix->iter_new;
+    if (options->one && iter_new == parallel_iter_new)
+        /* There is nothing to parallelize when fetching a single entry */
+        iter_new = fts_iter_new;
+
     posix_iter = (struct posix_iterator *)
-                  posix->iter_new(metadata, options->one ? root : posix->root,
-                                  options->one ? full_path + strlen(root) : NULL,
-                                  posix->statx_sync_type);
+                  iter_new(metadata, options->one ? root : posix->root,
+                           options->one ? full_path + strlen(root) : NULL,
+                           posix->statx_sync_type);
     if (posix_iter == NULL)
         return NULL;
 
@@ -803,6 +809,10 @@ posix_backend_filter(
         /* This should never happen */
         goto out_destroy_iter;
 
+    if (rbh_posix_iter_is_parallel(posix_iter) &&
+        parallel_iter_start(posix_iter, posix->nb_threads) == -1)
+        goto out_destroy_iter;
+
     return &posix_iter->iterator;
 
 out_destroy_iter:
@@ -932,9 +942,20 @@ posix_branch_backend_filter(
     posix_iter = (struct posix_iterator *)
                   branch->posix.iter_new(metadata, root, path + strlen(root),
                                          branch->posix.statx_sync_type);
+    if (posix_iter == NULL)
+        goto out;
+
     posix_iter->skip_error = options->skip_error;
     posix_iter->enrichers = branch->posix.enrichers;
 
+    if (rbh_posix_iter_is_parallel(posix_iter) &&
+        parallel_iter_start(posix_iter, branch->posix.nb_threads) == -1) {
+        save_errno = errno;
+        rbh_mut_iter_destroy(&posix_iter->iterator);
+        errno = save_errno;
+        posix_iter = NULL;
+    }
+
 out:
     save_errno = errno;
     free(path);
@@ -1036,6 +1057,7 @@ posix_backend_branch(void *backend, const struct rbh_id *id, const char *path)
         branch->posix.enrichers = NULL;
 
     branch->posix.statx_sync_type = posix->statx_sync_type;
+    branch->posix.nb_threads = posix->nb_threads;
 
     return &branch->posix.backend;
 }
@@ -26,6 +26,27 @@ fts_iter_root_setup(struct posix_iterator *_iter);
 bool
 rbh_posix_iter_is_fts(struct posix_iterator *iter);
 
+struct rbh_mut_iterator *
+parallel_iter_new(struct rbh_metadata *metadata, const char *root,
+                  const char *entry, int statx_sync_type);
+
+/**
+ * Convert the root of a parallel iterator and start its threads
+ *
+ * @param iter          the iterator to start
+ * @param nb_threads    the number of threads to walk the tree with, 0 means
+ *                      one per online CPU
+ *
+ * @return              0 on success, -1 on error and errno is set appropriately
+ *
+ * This must be called once the enrichers and `skip_error' of \p iter are set.
+ */
+int
+parallel_iter_start(struct posix_iterator *iter, size_t nb_threads);
+
+bool
+rbh_posix_iter_is_parallel(struct posix_iterator *iter);
+
 
 int
 rbh_posix_backend_load_extensions(const struct rbh_backend_plugin *self,
@@ -7,19 +7,27 @@
 
 #include "internals.h"
 
-#define backend_filter sqlite_backend_filter
-#include "../../generic_branch.c"
-
 struct sqlite_backend_branch {
     struct sqlite_backend sqlite;
     struct rbh_id id;
 };
 
+static struct rbh_mut_iterator *
+sqlite_branch_backend_filter(void *backend, const struct rbh_filter *filter,
+                             const struct rbh_filter_options *options,
+                             const struct rbh_filter_output *output,
+                             struct rbh_metadata *metadata)
+{
+    struct sqlite_backend_branch *branch = backend;
+
+    return sqlite_branch_filter(&branch->sqlite, &branch->id, filter, options);
+}
+
 static const struct rbh_backend_operations SQLITE_BRANCH_BACKEND_OPS = {
     .branch          = sqlite_backend_branch,
     .root            = sqlite_branch_root,
     .update          = sqlite_backend_update,
-    .filter          = generic_branch_backend_filter,
+    .filter          = sqlite_branch_backend_filter,
     .insert_metadata = sqlite_backend_insert_metadata,
     .get_info        = sqlite_backend_get_info,
     .get_logs        = sqlite_backend_get_logs,
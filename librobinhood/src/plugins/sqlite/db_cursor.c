@@ -42,6 +42,14 @@
  * sqlite_cursor_exec(&cursor);
  *
  * // no need to call fini(), exec() does the cleanup for us
+ *
+ * // statements run over and over again can be kept prepared in a cache,
+ * // keyed by whatever their text depends on
+ * if (!sqlite_cursor_reuse_query(&cursor, &statements, &key))
+ *     sqlite_setup_cached_query(&cursor, &statements, &key, query);
+ *
+ * // exec() resets cached statements instead of finalizing them, they are
+ * // finalized by sqlite_statements_clear()
  */
 
 bool
@@ -71,16 +79,162 @@ sqlite_setup_query(struct sqlite_cursor *cursor, const char *query)
     cursor->index = 1;
     /* column starts at 0 */
     cursor->col = 0;
+    cursor->cached = false;
+
+    return true;
+}
+
+/* Past this many statements, the cache is emptied rather than grown. This
+ * should only happen if updates set a lot of different statx masks.
+ */
+#define SQLITE_STATEMENTS_MAX 256
+
+static bool
+statement_key_equals(const void *first, const void *second)
+{
+    const struct sqlite_statement_key *x = first;
+    const struct sqlite_statement_key *y = second;
+
+    if (x->kind != y->kind || x->mask != y->mask)
+        return false;
+
+    if (x->shape == NULL || y->shape == NULL)
+        return x->shape == y->shape;
+
+    return strcmp(x->shape, y->shape) == 0;
+}
+
+static size_t
+statement_key_hash(const void *data)
+{
+    const struct sqlite_statement_key *key = data;
+    size_t hash = 5381;
+
+    hash = hash * 33 + key->kind;
+    hash = hash * 33 + key->mask;
+    if (key->shape)
+        for (const char *c = key->shape; *c; c++)
+            hash = hash * 33 + (unsigned char)*c;
+
+    return hash;
+}
+
+void
+sqlite_statements_clear(struct sqlite_statements *statements)
+{
+    struct sqlite_statement *statement = statements->list;
+
+    while (statement) {
+        struct sqlite_statement *next = statement->next;
+
+        sqlite3_finalize(statement->stmt);
+        free((char *)statement->key.shape);
+        free(statement);
+        statement = next;
+    }
+
+    if (statements->map)
+        rbh_hashmap_destroy(statements->map);
+
+    statements->map = NULL;
+    statements->list = NULL;
+    statements->count = 0;
+}
+
+static void
+use_statement(struct sqlite_cursor *cursor, sqlite3_stmt *stmt)
+{
+    cursor->stmt = stmt;
+    cursor->index = 1;
+    cursor->col = 0;
+    cursor->cached = true;
+}
+
+bool
+sqlite_cursor_reuse_query(struct sqlite_cursor *cursor,
+                          struct sqlite_statements *statements,
+                          const struct sqlite_statement_key *key)
+{
+    const struct sqlite_statement *statement;
+
+    if (statements->map == NULL)
+        return false;
+
+    statement = rbh_hashmap_get(statements->map, key);
+    if (statement == NULL)
+        return false;
+
+    /* The statement may have been left half bound by a failed update */
+    sqlite3_reset(statement->stmt);
+    sqlite3_clear_bindings(statement->stmt);
+    use_statement(cursor, statement->stmt);
 
     return true;
 }
 
+bool
+sqlite_setup_cached_query(struct sqlite_cursor *cursor,
+                          struct sqlite_statements *statements,
+                          const struct sqlite_statement_key *key,
+                          const char *query)
+{
+    struct sqlite_statement *statement;
+    int save_errno;
+
+    if (statements->count >= SQLITE_STATEMENTS_MAX)
+        sqlite_statements_clear(statements);
+
+    if (statements->map == NULL) {
+        statements->map = rbh_hashmap_new_resizable(statement_key_equals,
+                                                    statement_key_hash, 32);
+        if (statements->map == NULL)
+            return sqlite_fail("failed to create statement cache: %s",
+                               strerror(errno));
+    }
+
+    statement = calloc(1, sizeof(*statement));
+    if (statement == NULL)
+        return sqlite_fail("failed to allocate statement");
+
+    statement->key = *key;
+    if (key->shape) {
+        statement->key.shape = strdup(key->shape);
+        if (statement->key.shape == NULL) {
+            free(statement);
+            return sqlite_fail("failed to allocate statement");
+        }
+    }
+
+    if (!sqlite_setup_query(cursor, query))
+        goto out_free;
+
+    if (rbh_hashmap_set(statements->map, &statement->key, statement)) {
+        save_errno = errno;
+        sqlite3_finalize(cursor->stmt);
+        errno = save_errno;
+        sqlite_fail("failed to cache statement: %s", strerror(errno));
+        goto out_free;
+    }
+
+    statement->stmt = cursor->stmt;
+    statement->next = statements->list;
+    statements->list = statement;
+    statements->count++;
+    use_statement(cursor, statement->stmt);
+
+    return true;
+
+out_free:
+    free((char *)statement->key.shape);
+    free(statement);
+    return false;
+}
+
 bool
 sqlite_cursor_trans_begin(struct sqlite_cursor *cursor)
 {
     char *err;
 
-    sqlite3_exec(cursor->db, "PRAGMA synchronous = OFF", NULL, NULL, &err);
     sqlite3_exec(cursor->db, "begin transaction", NULL, NULL, &err);
     return true;
 }
@@ -98,7 +252,8 @@ bool
 sqlite_cursor_fini(struct sqlite_cursor *cursor)
 {
     rbh_sstack_destroy(cursor->sstack);
-    sqlite3_finalize(cursor->stmt);
+    if (!cursor->cached)
+        sqlite3_finalize(cursor->stmt);
     return true;
 }
 
@@ -108,10 +263,17 @@ sqlite_cursor_exec(struct sqlite_cursor *cursor)
     int rc;
 
     rc = sqlite3_step(cursor->stmt);
-    if (rc != SQLITE_OK && rc != SQLITE_DONE)
-        return sqlite_db_fail(cursor->db, "failed to run sqlite statement");
-
-    sqlite3_finalize(cursor->stmt);
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        sqlite_db_fail(cursor->db, "failed to run sqlite statement");
+        if (cursor->cached)
+            sqlite3_reset(cursor->stmt);
+        return false;
+    }
+
+    if (cursor->cached)
+        sqlite3_reset(cursor->stmt);
+    else
+        sqlite3_finalize(cursor->stmt);
 
     return true;
 }
@@ -248,3 +410,52 @@ sqlite_cursor_get_id(struct sqlite_cursor *cursor, struct rbh_id *dst)
 
     return true;
 }
+
+const char *
+sqlite_cursor_get_name(struct sqlite_cursor *cursor)
+{
+    return sqlite3_column_name(cursor->stmt, cursor->col);
+}
+
+bool
+sqlite_cursor_get_value(struct sqlite_cursor *cursor, struct rbh_value *value)
+{
+    int col = cursor->col++;
+    void *data;
+
+    switch (sqlite3_column_type(cursor->stmt, col)) {
+    case SQLITE_INTEGER:
+        value->type = RBH_VT_INT64;
+        value->int64 = sqlite3_column_int64(cursor->stmt, col);
+        return true;
+    case SQLITE_FLOAT:
+        value->type = RBH_VT_DOUBLE;
+        value->float64 = sqlite3_column_double(cursor->stmt, col);
+        return true;
+    case SQLITE_TEXT:
+        value->type = RBH_VT_STRING;
+        value->string = sqlite_cursor_strdup(
+            cursor, (const char *)sqlite3_column_text(cursor->stmt, col)
+            );
+        if (!value->string)
+            return sqlite_fail("failed to allocate buffer");
+        return true;
+    case SQLITE_BLOB:
+        value->type = RBH_VT_BINARY;
+        value->binary.size = sqlite3_column_bytes(cursor->stmt, col);
+        data = sqlite_cursor_alloc(cursor, value->binary.size);
+        if (!data)
+            return sqlite_fail("failed to allocate buffer");
+
+        memcpy(data, sqlite3_column_blob(cursor->stmt, col),
+               value->binary.size);
+        value->binary.data = data;
+        return true;
+    case SQLITE_NULL:
+        value->type = RBH_VT_NULL;
+        return true;
+    }
+
+    return sqlite_fail("unexpected type for column '%s'",
+                       sqlite3_column_name(cursor->stmt, col));
+}
@@ -413,6 +413,59 @@ field2str(const struct rbh_filter_field *field)
     return NULL;
 }
 
+/* The xattrs the schema exposes as (indexed) generated columns */
+static const struct {
+    enum rbh_fsentry_property fsentry;
+    const char *xattr;
+    const char *column;
+} XATTR_COLUMNS[] = {
+    { RBH_FP_NAMESPACE_XATTRS, "path",      "ns.path" },
+    { RBH_FP_INODE_XATTRS,     "fid",       "entries.fid" },
+    { RBH_FP_INODE_XATTRS,     "hsm_state", "entries.hsm_state" },
+};
+
+static const char *
+xattr2column(const struct rbh_filter_field *field)
+{
+    if (field->fsentry != RBH_FP_NAMESPACE_XATTRS &&
+        field->fsentry != RBH_FP_INODE_XATTRS)
+        return NULL;
+
+    for (size_t i = 0; i < sizeof(XATTR_COLUMNS) / sizeof(*XATTR_COLUMNS);
+         i++) {
+        if (XATTR_COLUMNS[i].fsentry == field->fsentry &&
+            strcmp(XATTR_COLUMNS[i].xattr, field->xattr) == 0)
+            return XATTR_COLUMNS[i].column;
+    }
+
+    return NULL;
+}
+
+/* Return the generated column a comparison on an xattr can be made against
+ * directly (rather than through the json functions), NULL if there is none.
+ *
+ * Generated columns hold the scalar value of their xattr, which is what
+ * json_each() would have iterated on, except for sequences and maps. "in"
+ * filters are left to json_each() as they bind a single value per xattr.
+ */
+static const char *
+filter2column(const struct rbh_filter *filter)
+{
+    if (filter->op == RBH_FOP_IN)
+        return NULL;
+
+    switch (filter->compare.value.type) {
+    case RBH_VT_SEQUENCE:
+    case RBH_VT_MAP:
+    case RBH_VT_NULL:
+        return NULL;
+    default:
+        break;
+    }
+
+    return xattr2column(&filter->compare.field);
+}
+
 static bool
 in_array_filter(struct sqlite_filter_where *where,
                 const struct rbh_filter *filter)
@@ -440,6 +493,7 @@ comparison_filter2sql(const struct rbh_filter *filter,
                       size_t depth, bool negate, const char *_field)
 {
     const char *field = field2str(&filter->compare.field);
+    const char *column = _field ? NULL : filter2column(filter);
     bool res = false;
     const char *op;
 
@@ -454,8 +508,10 @@ comparison_filter2sql(const struct rbh_filter *filter,
     case RBH_FOP_BITS_ALL_CLEAR:
     case RBH_FOP_BITS_ANY_CLEAR:
         op = filter2op(filter, negate);
-        if (filter->compare.field.fsentry == RBH_FP_INODE_XATTRS ||
-            filter->compare.field.fsentry == RBH_FP_NAMESPACE_XATTRS) {
+        if (column) {
+            res = sfw_clause_format(where, op, column);
+        } else if (filter->compare.field.fsentry == RBH_FP_INODE_XATTRS ||
+                   filter->compare.field.fsentry == RBH_FP_NAMESPACE_XATTRS) {
             char fmt[64];
             int len;
 
@@ -491,6 +547,16 @@ comparison_filter2sql(const struct rbh_filter *filter,
         if (_field)
             field = _field;
 
+        if (column) {
+            if (negate)
+                res = sfw_clause_format(where, "%s is null or not %s regexp ?",
+                                        column, column);
+            else
+                res = sfw_clause_format(where, "%s is not null and %s regexp ?",
+                                        column, column);
+            break;
+        }
+
         switch (filter->compare.field.fsentry) {
             case RBH_FP_NAME:
             case RBH_FP_SYMLINK:
@@ -541,7 +607,10 @@ comparison_filter2sql(const struct rbh_filter *filter,
         if (_field)
             field = _field;
 
-        if (!negate)
+        if (column)
+            res = sfw_clause_format(where, "%s is %snull", column,
+                                    negate ? "" : "not ");
+        else if (!negate)
             res = sfw_clause_format(where, "json_extract(%s, ?) is not null",
                                     field);
         else
@@ -740,10 +809,6 @@ filter2where_clause(const struct rbh_filter *filter,
     return true;
 }
 
-static bool
-bind_filter_values(struct sqlite_cursor *cursor,
-                   const struct rbh_filter *filter);
-
 static bool
 bind_sequence(struct sqlite_cursor *cursor, const struct rbh_value *values,
               size_t count)
@@ -864,6 +929,13 @@ bind_comparison_values(struct sqlite_cursor *cursor,
 {
     char *xattr;
 
+    if (filter2column(filter)) {
+        if (filter->op == RBH_FOP_EXISTS)
+            return true;
+
+        return bind_value(cursor, &filter->compare.value, true);
+    }
+
     switch (filter->op) {
     case RBH_FOP_REGEX:
         if (filter->compare.field.fsentry == RBH_FP_INODE_XATTRS ||
@@ -955,7 +1027,7 @@ bind_array_values(struct sqlite_cursor *cursor, const struct rbh_filter *filter)
     return true;
 }
 
-static bool
+bool
 bind_filter_values(struct sqlite_cursor *cursor,
                    const struct rbh_filter *filter)
 {
@@ -971,12 +1043,17 @@ bind_filter_values(struct sqlite_cursor *cursor,
         abort();
 }
 
-static const char *
-sort_field2str(const struct rbh_filter_field *field)
+const char *
+field2expression(const struct rbh_filter_field *field)
 {
     static char str[512] = {0};
+    const char *column;
     int len;
 
+    column = xattr2column(field);
+    if (column)
+        return column;
+
     switch (field->fsentry) {
     case RBH_FP_ID:
         return "entries.id";
@@ -1025,7 +1102,9 @@ options2sql(const struct rbh_filter_options *options,
             return false;
 
         for (size_t i = 0; i < options->sort.count; i++) {
-            const char *field = sort_field2str(&options->sort.items[i].field);
+            const char *field;
+
+            field = field2expression(&options->sort.items[i].field);
 
             if (!sqo_sort_format(query_options, " %s %s",
                                  field,
@@ -1038,8 +1117,31 @@ options2sql(const struct rbh_filter_options *options,
     return true;
 }
 
+/* The namespace entries of a branch, computed by sqlite itself in a single
+ * query rather than one level of directories at a time: the root of the branch
+ * and the children of every directory below it.
+ *
+ * The cross joins force sqlite to walk the tree from the root down, using the
+ * index on ns.parent_id, instead of scanning whole tables.
+ */
+static const char BRANCH_CTE[] =
+    "with recursive branch(id) as ("
+    "    values(?)"
+    "    union"
+    "    select ns.id from branch"
+    "    cross join ns on ns.parent_id = branch.id"
+    "    cross join entries on ns.id = entries.id"
+    "    where entries.type = %d"
+    "), branch_ns(rowid) as ("
+    "    select rowid from ns where id = ?"
+    "    union all"
+    "    select ns.rowid from branch"
+    "    cross join ns on ns.parent_id = branch.id"
+    ") ";
+
 static bool
 sqlite_statement_from_filter(struct sqlite_iterator *iter,
+                             const struct rbh_id *branch,
                              const struct rbh_filter *filter,
                              const struct rbh_filter_options *options)
 {
@@ -1053,10 +1155,11 @@ sqlite_statement_from_filter(struct sqlite_iterator *iter,
         "mtime_sec, mtime_nsec, "
         "rdev_major, rdev_minor, "
         "dev_major, dev_minor, mnt_id, "
-        "entries.xattrs, ns.xattrs, symlink "
-        "from entries join ns on entries.id = ns.id";
+        "entries.xattrs, ns.xattrs, symlink ";
+    const char *from = "from entries join ns on entries.id = ns.id";
     struct sqlite_query_options query_options = {0};
     struct sqlite_filter_where where = {0};
+    char cte[sizeof(BRANCH_CTE) + 16];
     char *full_query = NULL;
     int save_errno;
     int rc;
@@ -1070,7 +1173,15 @@ sqlite_statement_from_filter(struct sqlite_iterator *iter,
     if (!options2sql(options, &query_options))
         return false;
 
-    rc = asprintf(&full_query, "%s%s%s%s%s", query,
+    cte[0] = '\0';
+    if (branch) {
+        snprintf(cte, sizeof(cte), BRANCH_CTE, S_IFDIR);
+        from = "from branch_ns "
+               "cross join ns on ns.rowid = branch_ns.rowid "
+               "cross join entries on entries.id = ns.id";
+    }
+
+    rc = asprintf(&full_query, "%s%s%s%s%s%s%s", cte, query, from,
                   where.clause_len > 0 ? where.clause : "",
                   options->sort.count > 0 ? query_options.sort : "",
                   options->limit > 0 ? query_options.limit : "",
@@ -1083,6 +1194,12 @@ sqlite_statement_from_filter(struct sqlite_iterator *iter,
     if (!sqlite_setup_query(&iter->cursor, full_query))
         goto free_query;
 
+    if (branch) {
+        if (!(sqlite_cursor_bind_id(&iter->cursor, branch) &&
+              sqlite_cursor_bind_id(&iter->cursor, branch)))
+            goto free_query;
+    }
+
     if (where.clause_len > 0) {
         if (!bind_filter_values(&iter->cursor, filter))
             goto free_query;
@@ -1108,20 +1225,19 @@ free_query:
     return false;
 }
 
-struct rbh_mut_iterator *
-sqlite_backend_filter(void *backend, const struct rbh_filter *filter,
-                      const struct rbh_filter_options *options,
-                      const struct rbh_filter_output *output,
-                      struct rbh_metadata *metadata)
+static struct rbh_mut_iterator *
+sqlite_filter_iterator_new(struct sqlite_backend *sqlite,
+                           const struct rbh_id *branch,
+                           const struct rbh_filter *filter,
+                           const struct rbh_filter_options *options)
 {
     struct sqlite_iterator *iter = sqlite_iterator_new();
-    struct sqlite_backend *sqlite = backend;
 
     if (!iter)
         return NULL;
 
     sqlite_cursor_setup(sqlite, &iter->cursor);
-    if (!sqlite_statement_from_filter(iter, filter, options)) {
+    if (!sqlite_statement_from_filter(iter, branch, filter, options)) {
         int save_errno = errno;
         sqlite_iter_destroy(iter);
         errno = save_errno;
@@ -1131,6 +1247,23 @@ sqlite_backend_filter(void *backend, const struct rbh_filter *filter,
     return &iter->iter;
 }
 
+struct rbh_mut_iterator *
+sqlite_backend_filter(void *backend, const struct rbh_filter *filter,
+                      const struct rbh_filter_options *options,
+                      const struct rbh_filter_output *output,
+                      struct rbh_metadata *metadata)
+{
+    return sqlite_filter_iterator_new(backend, NULL, filter, options);
+}
+
+struct rbh_mut_iterator *
+sqlite_branch_filter(struct sqlite_backend *sqlite, const struct rbh_id *root,
+                     const struct rbh_filter *filter,
+                     const struct rbh_filter_options *options)
+{
+    return sqlite_filter_iterator_new(sqlite, root, filter, options);
+}
+
 static const struct rbh_filter ROOT_FILTER = {
     .op = RBH_FOP_EQUAL,
     .compare = {
@@ -22,6 +22,7 @@
 
 #include <robinhood/statx.h>
 #include <robinhood/backends/sqlite.h>
+#include <robinhood/hashmap.h>
 #include <robinhood/utils.h>
 #include <robinhood/sstack.h>
 
@@ -49,9 +50,42 @@ struct sqlite_cursor {
      * row
      */
     int col;
+    /** stmt belongs to a statement cache, it is reset instead of finalized */
+    bool cached;
     struct rbh_sstack *sstack;
 };
 
+/**
+ * Identify a prepared statement in a statement cache
+ */
+struct sqlite_statement_key {
+    /** what the statement does, defined by the user of the cache */
+    int kind;
+    /** statx mask of the values the statement writes, if any */
+    uint32_t mask;
+    /** anything else the text of the statement depends on (e.g. the names of
+     * the xattrs it updates), may be NULL
+     */
+    const char *shape;
+};
+
+struct sqlite_statement {
+    struct sqlite_statement_key key;
+    sqlite3_stmt *stmt;
+    struct sqlite_statement *next;
+};
+
+/**
+ * Prepared statements that are kept across queries to avoid parsing and
+ * planning the same SQL over and over again
+ */
+struct sqlite_statements {
+    struct rbh_hashmap *map;
+    /** every statement in map, to finalize them */
+    struct sqlite_statement *list;
+    size_t count;
+};
+
 struct sqlite_backend {
     struct rbh_backend backend;
     struct sqlite_cursor cursor;
@@ -60,6 +94,8 @@ struct sqlite_backend {
     sqlite3 *db;
     struct rbh_sstack *sstack;
     uint64_t version;
+    /** statements reused by each call to update() */
+    struct sqlite_statements statements;
 };
 
 struct sqlite_iterator {
@@ -96,12 +132,31 @@ bool
 options2sql(const struct rbh_filter_options *options,
             struct sqlite_query_options *query_options);
 
+/* Bind the values of the parameters of the where clause built from `filter' */
+bool
+bind_filter_values(struct sqlite_cursor *cursor,
+                   const struct rbh_filter *filter);
+
+/* SQL expression of the value of a field, the result may be overwritten by the
+ * next call.
+ */
+const char *
+field2expression(const struct rbh_filter_field *field);
+
 struct rbh_mut_iterator *
 sqlite_backend_filter(void *backend, const struct rbh_filter *filter,
                       const struct rbh_filter_options *options,
                       const struct rbh_filter_output *output,
                       struct rbh_metadata *metadata);
 
+/* Same as sqlite_backend_filter() but only for `root' and the entries below
+ * it, which are all fetched by a single recursive query.
+ */
+struct rbh_mut_iterator *
+sqlite_branch_filter(struct sqlite_backend *sqlite, const struct rbh_id *root,
+                     const struct rbh_filter *filter,
+                     const struct rbh_filter_options *options);
+
 struct rbh_mut_iterator *
 sqlite_backend_report(void *backend, const struct rbh_filter *filter,
                       const struct rbh_group_fields *group,
@@ -156,6 +211,27 @@ sqlite_cursor_fini(struct sqlite_cursor *cursor);
 bool
 sqlite_setup_query(struct sqlite_cursor *cursor, const char *query);
 
+/* Reset and reuse the statement stored under `key' in `statements'.
+ *
+ * Returns false without setting an error if there is no such statement.
+ */
+bool
+sqlite_cursor_reuse_query(struct sqlite_cursor *cursor,
+                          struct sqlite_statements *statements,
+                          const struct sqlite_statement_key *key);
+
+/* Same as sqlite_setup_query() but the statement is stored in `statements'
+ * under `key' so that it can be reused by sqlite_cursor_reuse_query().
+ */
+bool
+sqlite_setup_cached_query(struct sqlite_cursor *cursor,
+                          struct sqlite_statements *statements,
+                          const struct sqlite_statement_key *key,
+                          const char *query);
+
+void
+sqlite_statements_clear(struct sqlite_statements *statements);
+
 bool
 sqlite_cursor_trans_begin(struct sqlite_cursor *cursor);
 
@@ -201,6 +277,14 @@ sqlite_cursor_bind_binary(struct sqlite_cursor *cursor,
 bool
 sqlite_cursor_get_id(struct sqlite_cursor *cursor, struct rbh_id *dst);
 
+/* Name of the column the next get() will read */
+const char *
+sqlite_cursor_get_name(struct sqlite_cursor *cursor);
+
+/* Read a column whose type is only known at runtime */
+bool
+sqlite_cursor_get_value(struct sqlite_cursor *cursor, struct rbh_value *value);
+
 const char *
 sqlite_xattr2json(const struct rbh_value_map *xattrs,
                   struct rbh_sstack *sstack);
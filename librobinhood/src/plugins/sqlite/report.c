@@ -5,26 +5,542 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include <inttypes.h>
+
 #include "internals.h"
 
+/* A report is computed by a single query:
+ *
+ * select <id fields>, <accumulators>
+ * from entries join ns on entries.id = ns.id
+ * where (<filter>) and <id field> is not null...
+ * group by <id fields>
+ *
+ * A report without id fields is grouped on a constant: an aggregate over no
+ * entry then yields no row, like the mongo backend, rather than a single row of
+ * zeroes and nulls.
+ *
+ * Range fields are grouped on the index of the range their value falls in
+ * (cf. range2sql()), which is converted back to its boundaries when reading the
+ * results.
+ */
+
+/* The statx fields that rbh_fsentry_new() (and the mongo backend) store on 32
+ * bits. rbh-report expects file types to be int32 values for instance.
+ */
+#define RBH_STATX_INT32 (RBH_STATX_TYPE | RBH_STATX_MODE | RBH_STATX_NLINK | \
+                         RBH_STATX_UID | RBH_STATX_GID | RBH_STATX_BLKSIZE | \
+                         RBH_STATX_ATIME_NSEC | RBH_STATX_BTIME_NSEC |       \
+                         RBH_STATX_CTIME_NSEC | RBH_STATX_MTIME_NSEC |       \
+                         RBH_STATX_RDEV_MAJOR | RBH_STATX_RDEV_MINOR |       \
+                         RBH_STATX_DEV_MAJOR | RBH_STATX_DEV_MINOR)
+
+struct sqlite_report_iterator {
+    struct rbh_mut_iterator iter;
+    struct sqlite_cursor cursor;
+    /** set to true the first time we reach the end of the rows. */
+    bool done;
+    /** copy of the id fields of the group */
+    struct rbh_range_field *id_fields;
+    size_t id_count;
+    size_t output_count;
+};
+
+/*----------------------------------------------------------------------------*
+ |                                   query                                    |
+ *----------------------------------------------------------------------------*/
+
+/* The value of a range field is replaced by the index of its range, values
+ * lower than the first boundary are counted in the first range like mongo's
+ * $switch does:
+ *
+ * case
+ *     when size <= b1 then 0
+ *     when size <= b2 then 1
+ *     ...
+ *     else n - 1
+ * end
+ */
+static void
+range2sql(FILE *query, const struct rbh_range_field *field,
+          const char *expression)
+{
+    if (field->boundaries_count == 1) {
+        fprintf(query, "0");
+        return;
+    }
+
+    fprintf(query, "case");
+    for (size_t i = 0; i < field->boundaries_count - 1; i++)
+        fprintf(query, " when %s <= %" PRId64 " then %zu", expression,
+                field->boundaries[i + 1], i);
+    fprintf(query, " else %zu end", field->boundaries_count - 1);
+}
+
+static bool
+accumulator2sql(FILE *query, const struct rbh_accumulator_field *field)
+{
+    const char *expression;
+    const char *function;
+
+    switch (field->accumulator) {
+    case FA_COUNT:
+        fprintf(query, "count(*)");
+        return true;
+    case FA_AVG:
+        function = "avg";
+        break;
+    case FA_MAX:
+        function = "max";
+        break;
+    case FA_MIN:
+        function = "min";
+        break;
+    case FA_SUM:
+        function = "sum";
+        break;
+    default:
+        return sqlite_fail("unsupported accumulator '%d'", field->accumulator);
+    }
+
+    expression = field2expression(&field->field);
+    if (!expression)
+        return sqlite_fail("unsupported field in report output");
+
+    fprintf(query, "%s(%s)", function, expression);
+    return true;
+}
+
+static bool
+select2sql(FILE *query, const struct rbh_group_fields *group,
+           const struct rbh_filter_output *output)
+{
+    const char *separator = "";
+
+    fprintf(query, "select ");
+
+    for (size_t i = 0; i < group->id_count; i++) {
+        const struct rbh_range_field *field = &group->id_fields[i];
+        const char *expression = field2expression(&field->field);
+
+        if (!expression)
+            return sqlite_fail("unsupported field in report group");
+
+        fprintf(query, "%s", separator);
+        if (field->boundaries_count > 0)
+            range2sql(query, field, expression);
+        else
+            fprintf(query, "%s", expression);
+        separator = ", ";
+    }
+
+    for (size_t i = 0; i < output->output_fields.count; i++) {
+        fprintf(query, "%s", separator);
+        if (!accumulator2sql(query, &output->output_fields.fields[i]))
+            return false;
+        separator = ", ";
+    }
+
+    fprintf(query, " from entries join ns on entries.id = ns.id");
+    return true;
+}
+
+/* Like the mongo backend, only group the entries which have all the id fields
+ * set.
+ */
+static void
+where2sql(FILE *query, const struct sqlite_filter_where *where,
+          const struct rbh_group_fields *group)
+{
+    const char *separator = " where ";
+
+    if (where->clause_len > 0) {
+        fprintf(query, " where (%s)", where->clause + strlen(" where "));
+        separator = " and ";
+    }
+
+    for (size_t i = 0; i < group->id_count; i++) {
+        fprintf(query, "%s%s is not null", separator,
+                field2expression(&group->id_fields[i].field));
+        separator = " and ";
+    }
+}
+
+static void
+group2sql(FILE *query, const struct rbh_group_fields *group)
+{
+    if (group->id_count == 0) {
+        fprintf(query, " group by null");
+        return;
+    }
+
+    fprintf(query, " group by 1");
+    for (size_t i = 1; i < group->id_count; i++)
+        fprintf(query, ", %zu", i + 1);
+}
+
+/* Sorting on the ID of the entries means sorting on the ID of the groups */
+static bool
+sort2sql(FILE *query, const struct rbh_filter_options *options,
+         const struct rbh_group_fields *group)
+{
+    const char *separator = " order by ";
+
+    for (size_t i = 0; i < options->sort.count; i++) {
+        const struct rbh_filter_sort *item = &options->sort.items[i];
+        const char *order = item->ascending ? "asc" : "desc";
+        const char *expression;
+
+        if (item->field.fsentry == RBH_FP_ID) {
+            for (size_t j = 0; j < group->id_count; j++) {
+                fprintf(query, "%s%zu %s", separator, j + 1, order);
+                separator = ", ";
+            }
+            continue;
+        }
+
+        expression = field2expression(&item->field);
+        if (!expression)
+            return sqlite_fail("unsupported sort field in report");
+
+        fprintf(query, "%s%s %s", separator, expression, order);
+        separator = ", ";
+    }
+
+    return true;
+}
+
+static void
+limit2sql(FILE *query, const struct rbh_filter_options *options)
+{
+    /* sqlite only accepts an offset after a limit, -1 means no limit */
+    if (options->limit > 0)
+        fprintf(query, " limit %zu", options->limit);
+    else if (options->skip > 0)
+        fprintf(query, " limit -1");
+
+    if (options->skip > 0)
+        fprintf(query, " offset %zu", options->skip);
+}
+
+static char *
+report2sql(const struct sqlite_filter_where *where,
+           const struct rbh_group_fields *group,
+           const struct rbh_filter_options *options,
+           const struct rbh_filter_output *output)
+{
+    char *query = NULL;
+    int save_errno;
+    FILE *stream;
+    size_t size;
+
+    stream = open_memstream(&query, &size);
+    if (!stream)
+        return NULL;
+
+    if (!select2sql(stream, group, output))
+        goto out_close;
+
+    where2sql(stream, where, group);
+    group2sql(stream, group);
+
+    if (!sort2sql(stream, options, group))
+        goto out_close;
+
+    limit2sql(stream, options);
+
+    if (ferror(stream)) {
+        errno = ENOMEM;
+        goto out_close;
+    }
+
+    if (fclose(stream)) {
+        free(query);
+        return NULL;
+    }
+
+    return query;
+
+out_close:
+    save_errno = errno;
+    fclose(stream);
+    free(query);
+    errno = save_errno;
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                  iterator                                  |
+ *----------------------------------------------------------------------------*/
+
+static bool
+range_value(struct sqlite_cursor *cursor, const struct rbh_range_field *field,
+            struct rbh_value *value)
+{
+    struct rbh_value *bounds;
+    int64_t index;
+
+    index = sqlite_cursor_get_int64(cursor);
+    if (index < 0 || index >= field->boundaries_count)
+        return sqlite_fail("invalid range index '%" PRId64 "'", index);
+
+    bounds = sqlite_cursor_alloc(cursor, 2 * sizeof(*bounds));
+    if (!bounds)
+        return sqlite_fail("failed to allocate buffer");
+
+    bounds[0].type = RBH_VT_INT64;
+    bounds[0].int64 = field->boundaries[index];
+    if (index == field->boundaries_count - 1) {
+        bounds[1].type = RBH_VT_STRING;
+        bounds[1].string = "+inf";
+    } else {
+        bounds[1].type = RBH_VT_INT64;
+        bounds[1].int64 = field->boundaries[index + 1];
+    }
+
+    value->type = RBH_VT_SEQUENCE;
+    value->sequence.values = bounds;
+    value->sequence.count = 2;
+    return true;
+}
+
+static bool
+id_value(struct sqlite_cursor *cursor, const struct rbh_range_field *field,
+         struct rbh_value *value)
+{
+    if (field->boundaries_count > 0)
+        return range_value(cursor, field, value);
+
+    if (!sqlite_cursor_get_value(cursor, value))
+        return false;
+
+    if (value->type == RBH_VT_INT64 && field->field.fsentry == RBH_FP_STATX &&
+        field->field.statx & RBH_STATX_INT32) {
+        int64_t int64 = value->int64;
+
+        value->type = RBH_VT_INT32;
+        value->int32 = int64;
+    }
+
+    return true;
+}
+
+static struct rbh_value_pair *
+read_pairs(struct sqlite_report_iterator *iter, size_t count, bool ids)
+{
+    struct sqlite_cursor *cursor = &iter->cursor;
+    struct rbh_value_pair *pairs;
+    struct rbh_value *values;
+
+    pairs = sqlite_cursor_alloc(cursor, count * sizeof(*pairs));
+    values = sqlite_cursor_alloc(cursor, count * sizeof(*values));
+    if (!pairs || !values) {
+        sqlite_fail("failed to allocate buffer");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        pairs[i].key = sqlite_cursor_strdup(cursor,
+                                            sqlite_cursor_get_name(cursor));
+        if (!pairs[i].key) {
+            sqlite_fail("failed to allocate buffer");
+            return NULL;
+        }
+
+        if (!(ids ? id_value(cursor, &iter->id_fields[i], &values[i]) :
+                    sqlite_cursor_get_value(cursor, &values[i])))
+            return NULL;
+
+        pairs[i].value = &values[i];
+    }
+
+    return pairs;
+}
+
+/* The result has the same layout as the mongo backend's:
+ * { "id": { <id fields> }, "content": { <accumulators> } }
+ * where "id" is omitted when not grouping on any field.
+ */
+static void *
+sqlite_report_iter_next(void *iterator)
+{
+    struct sqlite_report_iterator *iter = iterator;
+    struct sqlite_cursor *cursor = &iter->cursor;
+    struct rbh_value_pair *content_pairs;
+    struct rbh_value_pair *id_pairs;
+    struct rbh_value_map *result;
+    struct rbh_value_pair *pairs;
+    struct rbh_value *maps;
+    size_t count;
+
+    sqlite_cursor_free(cursor);
+
+    if (iter->done) {
+        errno = ENODATA;
+        return NULL;
+    }
+
+    if (!sqlite_cursor_step(cursor))
+        return NULL;
+
+    if (errno == 0) {
+        /* cf. sqlite_iter_next() */
+        errno = ENODATA;
+        iter->done = true;
+        return NULL;
+    }
+
+    id_pairs = iter->id_count > 0 ? read_pairs(iter, iter->id_count, true) :
+                                    NULL;
+    if (iter->id_count > 0 && !id_pairs)
+        return NULL;
+
+    content_pairs = read_pairs(iter, iter->output_count, false);
+    if (!content_pairs)
+        return NULL;
+
+    count = iter->id_count > 0 ? 2 : 1;
+    result = sqlite_cursor_alloc(cursor, sizeof(*result));
+    pairs = sqlite_cursor_alloc(cursor, count * sizeof(*pairs));
+    maps = sqlite_cursor_alloc(cursor, count * sizeof(*maps));
+    if (!result || !pairs || !maps) {
+        sqlite_fail("failed to allocate buffer");
+        return NULL;
+    }
+
+    if (iter->id_count > 0) {
+        maps[0].type = RBH_VT_MAP;
+        maps[0].map.pairs = id_pairs;
+        maps[0].map.count = iter->id_count;
+        pairs[0].key = "id";
+        pairs[0].value = &maps[0];
+    }
+
+    maps[count - 1].type = RBH_VT_MAP;
+    maps[count - 1].map.pairs = content_pairs;
+    maps[count - 1].map.count = iter->output_count;
+    pairs[count - 1].key = "content";
+    pairs[count - 1].value = &maps[count - 1];
+
+    result->pairs = pairs;
+    result->count = count;
+
+    return result;
+}
+
+static void
+sqlite_report_iter_destroy(void *iterator)
+{
+    struct sqlite_report_iterator *iter = iterator;
+
+    if (iter->cursor.stmt)
+        sqlite_cursor_fini(&iter->cursor);
+    else
+        rbh_sstack_destroy(iter->cursor.sstack);
+
+    for (size_t i = 0; i < iter->id_count; i++)
+        free(iter->id_fields[i].boundaries);
+    free(iter->id_fields);
+    free(iter);
+}
+
+static const struct rbh_mut_iterator_operations SQLITE_REPORT_ITER_OPS = {
+    .next    = sqlite_report_iter_next,
+    .destroy = sqlite_report_iter_destroy,
+};
+
+static const struct rbh_mut_iterator SQLITE_REPORT_ITER = {
+    .ops = &SQLITE_REPORT_ITER_OPS,
+};
+
+/* The group may not outlive the call to sqlite_backend_report(), keep a copy
+ * of the boundaries needed to decode the ranges.
+ */
+static struct sqlite_report_iterator *
+sqlite_report_iterator_new(struct sqlite_backend *sqlite,
+                           const struct rbh_group_fields *group,
+                           const struct rbh_filter_output *output)
+{
+    struct sqlite_report_iterator *iter;
+
+    iter = xcalloc(1, sizeof(*iter));
+    iter->iter = SQLITE_REPORT_ITER;
+    iter->output_count = output->output_fields.count;
+    iter->id_count = group->id_count;
+    iter->id_fields = xcalloc(group->id_count, sizeof(*iter->id_fields));
+
+    for (size_t i = 0; i < group->id_count; i++) {
+        const struct rbh_range_field *field = &group->id_fields[i];
+        int64_t *boundaries = NULL;
+
+        if (field->boundaries_count > 0) {
+            boundaries = xmalloc(field->boundaries_count *
+                                 sizeof(*boundaries));
+            memcpy(boundaries, field->boundaries,
+                   field->boundaries_count * sizeof(*boundaries));
+        }
+
+        iter->id_fields[i] = *field;
+        iter->id_fields[i].boundaries = boundaries;
+    }
+
+    sqlite_cursor_setup(sqlite, &iter->cursor);
+    return iter;
+}
+
 struct rbh_mut_iterator *
 sqlite_backend_report(void *backend, const struct rbh_filter *filter,
                       const struct rbh_group_fields *group,
                       const struct rbh_filter_options *options,
                       const struct rbh_filter_output *output)
 {
-    struct sqlite_query_options query_options = {0};
     struct sqlite_filter_where where = {0};
+    struct sqlite_report_iterator *iter;
+    struct sqlite_backend *sqlite = backend;
+    char *query;
+    int save_errno;
 
     if (rbh_filter_validate(filter))
         return NULL;
 
+    if (output->type != RBH_FOT_VALUES) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (group->id_count == 0 && output->output_fields.count == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
     if (!filter2where_clause(filter, &where))
-        return false;
+        return NULL;
 
-    if (!options2sql(options, &query_options))
-        return false;
+    query = report2sql(&where, group, options, output);
+    if (!query)
+        return NULL;
+
+    iter = sqlite_report_iterator_new(sqlite, group, output);
+    if (!sqlite_setup_query(&iter->cursor, query))
+        goto out_destroy_iter;
+
+    if (where.clause_len > 0 && !bind_filter_values(&iter->cursor, filter))
+        goto out_destroy_iter;
+
+    if (options->verbose)
+        printf("%s\n", sqlite3_expanded_sql(iter->cursor.stmt));
+
+    free(query);
+
+    /* Like the mongo backend, a dry run returns an empty iterator */
+    iter->done = options->dry_run;
+    return &iter->iter;
+
+out_destroy_iter:
+    save_errno = errno;
+    sqlite_report_iter_destroy(iter);
+    free(query);
+    errno = save_errno;
 
-    errno = ENODATA;
     return NULL;
 }
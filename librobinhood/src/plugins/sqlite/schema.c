@@ -5,6 +5,11 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include <stdarg.h>
+#include <strings.h>
+
+#include <robinhood/config.h>
+
 #include "internals.h"
 
 static const char *RBH_SQLITE_SCHEMA_CODE =
@@ -71,6 +76,36 @@ static const char *RBH_SQLITE_SCHEMA_CODE =
 "    end        INT"
 ");";
 
+/* Version 1.1 adds secondary indexes on the columns filters use the most, and
+ * exposes the xattrs that are frequently filtered on as generated columns so
+ * that they can be indexed too.
+ *
+ * Generated columns are virtual: they are computed from the json xattrs and
+ * only take space in their index. As "alter table" can add them to an existing
+ * table, the same code creates a new database and upgrades a 1.0 one.
+ *
+ * Lustre's "ost" xattr is a sequence and cannot be indexed this way.
+ */
+static const char *RBH_SQLITE_SCHEMA_1_1_CODE =
+"alter table ns add column path TEXT"
+"    as (json_extract(xattrs, '$.path')) virtual;"
+"alter table entries add column fid TEXT" // hexadecimal, like any binary xattr
+"    as (json_extract(xattrs, '$.fid')) virtual;"
+"alter table entries add column hsm_state INT"
+"    as (json_extract(xattrs, '$.hsm_state')) virtual;"
+"create index ns_parent_id on ns(parent_id);"
+"create index ns_name on ns(name);"
+"create index ns_path on ns(path);"
+"create index entries_type on entries(type);"
+"create index entries_uid on entries(uid);"
+"create index entries_gid on entries(gid);"
+"create index entries_size on entries(size);"
+"create index entries_atime on entries(atime_sec);"
+"create index entries_ctime on entries(ctime_sec);"
+"create index entries_mtime on entries(mtime_sec);"
+"create index entries_fid on entries(fid);"
+"create index entries_hsm_state on entries(hsm_state);";
+
 static uint64_t
 build_version(void)
 {
@@ -79,6 +114,66 @@ build_version(void)
                RBH_SQLITE_BACKEND_RELEASE);
 }
 
+static bool
+set_version(struct sqlite_backend *sqlite)
+{
+    const char *query =
+        "insert into info (id, major, minor, release) "
+        "values (1, ?, ?, ?) on conflict(id) do "
+        "update set major=excluded.major, minor=excluded.minor, "
+        "release=excluded.release";
+    struct sqlite_cursor cursor;
+
+    sqlite->version = RBH_SQLITE_BACKEND_VERSION;
+
+    return sqlite_cursor_setup(sqlite, &cursor) &&
+        sqlite_setup_query(&cursor, query) &&
+        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_MAJOR) &&
+        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_MINOR) &&
+        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_RELEASE) &&
+        sqlite_cursor_exec(&cursor);
+}
+
+static bool
+upgrade_schema(struct sqlite_backend *sqlite, int64_t major, int64_t minor)
+{
+    int rc;
+
+    if (sqlite->read_only)
+        return sqlite_fail("'%s' uses schema %ld.%ld, open it in read/write "
+                           "mode once to upgrade it to %d.%d", sqlite->path,
+                           major, minor, RBH_SQLITE_BACKEND_MAJOR,
+                           RBH_SQLITE_BACKEND_MINOR);
+
+    rc = sqlite3_exec(sqlite->db, "begin transaction", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        return sqlite_db_fail(sqlite->db, "failed to upgrade '%s'",
+                              sqlite->path);
+
+    /* Minor versions only add to the schema, apply the steps it is missing */
+    if (minor < 1) {
+        rc = sqlite3_exec(sqlite->db, RBH_SQLITE_SCHEMA_1_1_CODE, NULL, NULL,
+                          NULL);
+        if (rc != SQLITE_OK)
+            goto rollback;
+    }
+
+    if (!set_version(sqlite))
+        goto rollback;
+
+    rc = sqlite3_exec(sqlite->db, "commit", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        goto rollback;
+
+    return true;
+
+rollback:
+    sqlite_db_fail(sqlite->db, "failed to upgrade '%s' from %ld.%ld",
+                   sqlite->path, major, minor);
+    sqlite3_exec(sqlite->db, "rollback", NULL, NULL, NULL);
+    return false;
+}
+
 static bool
 get_version(struct sqlite_backend *sqlite)
 {
@@ -92,7 +187,9 @@ get_version(struct sqlite_backend *sqlite)
     if (!(sqlite_cursor_setup(sqlite, &cursor) &&
           sqlite_setup_query(&cursor, query) &&
           sqlite_cursor_step(&cursor)))
-        return false;
+        return sqlite_db_fail(sqlite->db,
+                              "failed to retrieve version from db '%s'",
+                              sqlite->path);
 
     major = sqlite_cursor_get_int64(&cursor);
     minor = sqlite_cursor_get_int64(&cursor);
@@ -104,6 +201,9 @@ get_version(struct sqlite_backend *sqlite)
     sqlite->version =
         ((major << RPV_MAJOR_SHIFT) + (minor << RPV_MINOR_SHIFT) + release);
 
+    if (major == RBH_SQLITE_BACKEND_MAJOR && minor < RBH_SQLITE_BACKEND_MINOR)
+        return upgrade_schema(sqlite, major, minor);
+
     if (build_version() != sqlite->version)
         return sqlite_fail("version mismatch. Build version %lu != DB version %lu",
                            build_version(), sqlite->version);
@@ -111,32 +211,15 @@ get_version(struct sqlite_backend *sqlite)
     return true;
 }
 
-static bool
-set_version(struct sqlite_backend *sqlite)
-{
-    const char *query =
-        "insert into info (id, major, minor, release) "
-        "values (1, ?, ?, ?) on conflict(id) do "
-        "update set major=excluded.major, minor=excluded.minor, "
-        "release=excluded.release";
-    struct sqlite_cursor cursor;
-
-    sqlite->version = RBH_SQLITE_BACKEND_VERSION;
-
-    return sqlite_cursor_setup(sqlite, &cursor) &&
-        sqlite_setup_query(&cursor, query) &&
-        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_MAJOR) &&
-        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_MINOR) &&
-        sqlite_cursor_bind_int64(&cursor, RBH_SQLITE_BACKEND_RELEASE) &&
-        sqlite_cursor_exec(&cursor);
-}
-
 static bool
 setup_schema(struct sqlite_backend *sqlite)
 {
     int rc;
 
     rc = sqlite3_exec(sqlite->db, RBH_SQLITE_SCHEMA_CODE, NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(sqlite->db, RBH_SQLITE_SCHEMA_1_1_CODE, NULL, NULL,
+                          NULL);
     if (rc != SQLITE_OK)
         return sqlite_db_fail(sqlite->db,
                               "Failed to create schema of '%s'",
@@ -194,6 +277,113 @@ load_modules(sqlite3 *db)
     return true;
 }
 
+#define SQLITE_JOURNAL_MODE "journal_mode"
+#define SQLITE_SYNCHRONOUS "synchronous"
+#define SQLITE_CACHE_SIZE "cache_size"
+
+static const char * const JOURNAL_MODES[] = {
+    "delete", "truncate", "persist", "memory", "wal", "off", NULL
+};
+
+static const char * const SYNCHRONOUS_LEVELS[] = {
+    "off", "normal", "full", "extra", NULL
+};
+
+/* Settings are interpolated in the pragmas, only accept the values sqlite
+ * knows about.
+ */
+static bool
+get_setting(const char *key, const char * const *values, const char *fallback,
+            const char **setting)
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find(key, &value, RBH_VT_STRING);
+    if (rc == KPR_ERROR)
+        return sqlite_fail("failed to read '%s' from the configuration", key);
+
+    if (rc == KPR_NOT_FOUND) {
+        *setting = fallback;
+        return true;
+    }
+
+    for (const char * const *v = values; *v; v++) {
+        if (strcasecmp(value.string, *v) == 0) {
+            *setting = *v;
+            return true;
+        }
+    }
+
+    errno = EINVAL;
+    return sqlite_fail("invalid value '%s' for '%s'", value.string, key);
+}
+
+static bool
+get_cache_size(int32_t *cache_size)
+{
+    struct rbh_value value = { 0 };
+    enum key_parse_result rc;
+
+    rc = rbh_config_find("sqlite/"SQLITE_CACHE_SIZE, &value, RBH_VT_INT32);
+    if (rc == KPR_ERROR)
+        return sqlite_fail("failed to read '%s' from the configuration",
+                           "sqlite/"SQLITE_CACHE_SIZE);
+
+    /* Negative sizes are in KiB, use 64MiB of page cache by default */
+    *cache_size = rc == KPR_FOUND ? value.int32 : -65536;
+    return true;
+}
+
+static bool
+exec_pragma(sqlite3 *db, const char *fmt, ...)
+{
+    char pragma[64];
+    va_list args;
+    int rc;
+
+    va_start(args, fmt);
+    vsnprintf(pragma, sizeof(pragma), fmt, args);
+    va_end(args);
+
+    rc = sqlite3_exec(db, pragma, NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        return sqlite_db_fail(db, "failed to run '%s'", pragma);
+
+    return true;
+}
+
+/* Updates are written in WAL mode by default: readers do not block the writer
+ * anymore and each commit only appends to the log instead of rewriting pages
+ * in the database, which makes `synchronous = normal' safe to use.
+ */
+static bool
+setup_pragmas(struct sqlite_backend *sqlite)
+{
+    const char *journal_mode;
+    const char *synchronous;
+    int32_t cache_size;
+
+    if (!(get_setting("sqlite/"SQLITE_JOURNAL_MODE, JOURNAL_MODES, "wal",
+                      &journal_mode) &&
+          get_setting("sqlite/"SQLITE_SYNCHRONOUS, SYNCHRONOUS_LEVELS,
+                      "normal", &synchronous) &&
+          get_cache_size(&cache_size)))
+        return false;
+
+    if (!exec_pragma(sqlite->db, "PRAGMA cache_size = %d", cache_size))
+        return false;
+
+    if (sqlite->read_only)
+        return true;
+
+    /* The journal mode is stored in the database, it has to be set once and
+     * for all by a writer.
+     */
+    return exec_pragma(sqlite->db, "PRAGMA journal_mode = %s", journal_mode) &&
+        exec_pragma(sqlite->db, "PRAGMA synchronous = %s", synchronous);
+}
+
 bool
 sqlite_backend_open(struct sqlite_backend *sqlite,
                     const char *path,
@@ -202,6 +392,8 @@ sqlite_backend_open(struct sqlite_backend *sqlite,
     int mode = read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
     int rc;
 
+    sqlite->statements = (struct sqlite_statements){ 0 };
+    sqlite->cursor.sstack = NULL;
     sqlite->read_only = read_only;
     rc = sqlite3_open_v2(path, &sqlite->db, mode, NULL);
     if (rc == SQLITE_OK)
@@ -221,14 +413,15 @@ sqlite_backend_open(struct sqlite_backend *sqlite,
 
 ok:
     if (!sqlite->version) {
-        if (!get_version(sqlite))
-            return sqlite_db_fail(sqlite->db,
-                                  "failed to retrieve version from db '%s'",
-                                  path);
+        if (!get_version(sqlite)) {
+            sqlite3_close_v2(sqlite->db);
+            return false;
+        }
     }
 
     if (!(load_modules(sqlite->db) &&
-          setup_custom_functions(sqlite->db))) {
+          setup_custom_functions(sqlite->db) &&
+          setup_pragmas(sqlite))) {
         sqlite3_close_v2(sqlite->db);
         return false;
     }
@@ -243,5 +436,8 @@ ok:
 void
 sqlite_backend_close(struct sqlite_backend *sqlite)
 {
+    sqlite_statements_clear(&sqlite->statements);
+    if (sqlite->cursor.sstack)
+        rbh_sstack_destroy(sqlite->cursor.sstack);
     sqlite3_close_v2(sqlite->db);
 }
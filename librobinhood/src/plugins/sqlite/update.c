@@ -119,6 +119,32 @@ static const struct statx_attr entries_attributes[] = {
     [EA_MNT_ID]     = { "mnt_id",     "mnt_id=excluded.mnt_id",         bind_uint64 },
 };
 
+/* Statements run by update(), they are prepared once and then reused */
+enum update_statement {
+    US_UPSERT,
+    US_INC_XATTRS,
+    US_LINK,
+    US_UNLINK,
+    US_UNLINK_ROOT,
+    US_NS_XATTR,
+    US_XATTR,
+    US_DELETE_ENTRY,
+    US_DELETE_NS,
+    US_PARTIAL_UNLINK,
+};
+
+static bool
+setup_update_query(struct sqlite_backend *sqlite, enum update_statement kind,
+                   const char *query)
+{
+    const struct sqlite_statement_key key = { .kind = kind };
+
+    return sqlite_cursor_reuse_query(&sqlite->cursor, &sqlite->statements,
+                                     &key) ||
+        sqlite_setup_cached_query(&sqlite->cursor, &sqlite->statements, &key,
+                                  query);
+}
+
 static const size_t base_size =
     sizeof("insert into entries (id, mask, ) values (?, ?, ) on conflict(id) do update set mask=excluded.mask;");
 
@@ -373,137 +399,198 @@ build_upsert_query(const struct rbh_fsevent *fsevent)
     return query;
 }
 
+static const char *
+xattr_operator(const struct rbh_value_pair *xattr)
+{
+    const struct rbh_value_map *operator_map = &xattr->value->map;
+
+    assert(operator_map->count == 1);
+    return operator_map->pairs->key;
+}
+
+/* The text of the statement only depends on the names of the incremented
+ * xattrs. Each name is prefixed with its length so that no two lists of names
+ * share the same shape.
+ */
 static bool
-inc_xattrs(struct sqlite_backend *sqlite, const struct rbh_id *id,
-           const struct rbh_value_map *xattrs)
+inc_xattrs_shape(const struct rbh_value_map *xattrs, char *shape, size_t size)
+{
+    size_t shape_len = 0;
+
+    shape[0] = '\0';
+    for (size_t i = 0; i < xattrs->count; i++) {
+        const char *xattr = xattrs->pairs[i].key;
+        int len;
+
+        if (strcmp(xattr_operator(&xattrs->pairs[i]), "inc"))
+            continue;
+
+        len = snprintf(shape + shape_len, size - shape_len, "%zu:%s",
+                       strlen(xattr), xattr);
+        if (len < 0 || (size_t)len >= size - shape_len)
+            return sqlite_fail("snprintf: truncated string, buffer too small");
+
+        shape_len += len;
+    }
+
+    return true;
+}
+
+static bool
+setup_inc_xattrs_query(struct sqlite_backend *sqlite,
+                       const struct sqlite_statement_key *key,
+                       const struct rbh_value_map *xattrs)
 {
-    struct sqlite_cursor *cursor = &sqlite->cursor;
-    const char *operator;
     size_t buff_len = 0;
+    bool add_coma = false;
     char buffer[4096];
-    size_t len;
+    int len;
 
-    len = sprintf(buffer, "UPDATE entries set xattrs = json_set(xattrs, ");
+    len = snprintf(buffer, sizeof(buffer),
+                   "UPDATE entries set xattrs = json_set(xattrs, ");
     buff_len += len;
 
-    /* Build the query */
-    for (int i = 0; i < xattrs->count; i++) {
-        const struct rbh_value_map *operator_map = &xattrs->pairs[i].value->map;
+    for (size_t i = 0; i < xattrs->count; i++) {
         const char *xattr = xattrs->pairs[i].key;
-        bool add_coma = false;
-
-        assert(operator_map->count == 1);
-        operator = operator_map->pairs->key;
 
-        if (strcmp(operator, "inc"))
+        if (strcmp(xattr_operator(&xattrs->pairs[i]), "inc"))
             continue;
 
-        len = sprintf(buffer + buff_len,
-                      "%s'$.%s', COALESCE(json_extract(xattrs, '$.%s'), 0) + ?",
-                      add_coma ? "," : "",xattr, xattr);
-        if (len > (sizeof(buffer) - buff_len))
+        len = snprintf(buffer + buff_len, sizeof(buffer) - buff_len,
+                       "%s'$.%s', "
+                       "COALESCE(json_extract(xattrs, '$.%s'), 0) + ?",
+                       add_coma ? "," : "", xattr, xattr);
+        if (len < 0 || (size_t)len >= sizeof(buffer) - buff_len)
             return sqlite_fail("sprintf: truncated string, buffer too small");
 
         buff_len += len;
         add_coma = true;
     }
 
-    if (buff_len == len)
-        return true;
+    len = snprintf(buffer + buff_len, sizeof(buffer) - buff_len,
+                   ") where id = ?");
+    if (len < 0 || (size_t)len >= sizeof(buffer) - buff_len)
+        return sqlite_fail("sprintf: truncated string, buffer too small");
 
-    len = sprintf(buffer + buff_len, ") where id = ?");
-    if (len > (sizeof(buffer) - buff_len))
-            return sqlite_fail("sprintf: truncated string, buffer too small");
+    return sqlite_setup_cached_query(&sqlite->cursor, &sqlite->statements, key,
+                                     buffer);
+}
 
-    buff_len += len;
-    buffer[buff_len] = '\0';
+static bool
+inc_xattrs(struct sqlite_backend *sqlite, const struct rbh_id *id,
+           const struct rbh_value_map *xattrs)
+{
+    struct sqlite_statement_key key = { .kind = US_INC_XATTRS };
+    struct sqlite_cursor *cursor = &sqlite->cursor;
+    char shape[4096];
+
+    if (!inc_xattrs_shape(xattrs, shape, sizeof(shape)))
+        return false;
+
+    if (shape[0] == '\0')
+        /* nothing to increment */
+        return true;
+
+    key.shape = shape;
+    if (!sqlite_cursor_reuse_query(cursor, &sqlite->statements, &key) &&
+        !setup_inc_xattrs_query(sqlite, &key, xattrs))
+        return false;
 
     /* Bind the value */
-    sqlite_setup_query(cursor, buffer);
-    for (int i = 0; i < xattrs->count; i++) {
+    for (size_t i = 0; i < xattrs->count; i++) {
         const struct rbh_value_map *operator_map = &xattrs->pairs[i].value->map;
 
-        operator = operator_map->pairs->key;
-
-        if (strcmp(operator, "inc"))
+        if (strcmp(xattr_operator(&xattrs->pairs[i]), "inc"))
             continue;
 
         if (!bind_value(cursor, operator_map->pairs->value, false))
-            sqlite_fail("failed to bind value for '%s'", xattrs->pairs[i].key);
+            return sqlite_fail("failed to bind value for '%s'",
+                               xattrs->pairs[i].key);
     }
 
     return sqlite_cursor_bind_id(cursor, id) && sqlite_cursor_exec(cursor);
 }
 
+static bool
+setup_upsert_query(struct sqlite_backend *sqlite,
+                   const struct rbh_fsevent *fsevent)
+{
+    const struct sqlite_statement_key key = {
+        .kind = US_UPSERT,
+        .mask = upsert_statx_mask(fsevent),
+        .shape = fsevent->upsert.symlink ? "symlink" : NULL,
+    };
+    const char *insert;
+    int save_errno;
+    bool res;
+
+    if (sqlite_cursor_reuse_query(&sqlite->cursor, &sqlite->statements, &key))
+        return true;
+
+    insert = build_upsert_query(fsevent);
+    if (!insert)
+        return false;
+
+    res = sqlite_setup_cached_query(&sqlite->cursor, &sqlite->statements,
+                                    &key, insert);
+    save_errno = errno;
+    free((void *)insert);
+    errno = save_errno;
+
+    return res;
+}
+
 static bool
 sqlite_process_upsert(struct sqlite_backend *sqlite,
                       const struct rbh_fsevent *fsevent)
 {
-    const char *insert = build_upsert_query(fsevent);
     struct sqlite_cursor *cursor = &sqlite->cursor;
     const char *symlink = fsevent->upsert.symlink;
     bool has_xattrs = fsevent_has_xattrs(fsevent);
     uint32_t mask = upsert_statx_mask(fsevent);
     const struct rbh_id *id = &fsevent->id;
-    int save_errno;
-    bool res;
     int i;
 
-    if (!insert)
-        return false;
-
-    if (!(sqlite_setup_query(cursor, insert) &&
+    if (!(setup_upsert_query(sqlite, fsevent) &&
           sqlite_cursor_bind_id(cursor, id)))
-        goto free_insert;
+        return false;
 
     if (mask != 0 && !sqlite_cursor_bind_int64(cursor, mask))
-        goto free_insert;
+        return false;
 
     foreach_bit_set(mask, i) {
         const struct statx_attr *attr = bit2ea(i);
         uint32_t field = bit2mask(i);
 
-        res = attr->prepare_statement(cursor, statx_field(fsevent, field));
-        if (!res)
-            goto free_insert;
+        if (!attr->prepare_statement(cursor, statx_field(fsevent, field)))
+            return false;
     }
     if (has_xattrs) {
         const char *xattrs;
 
         xattrs = sqlite_xattr2json(&fsevent->xattrs, cursor->sstack);
         if (!xattrs)
-            goto free_insert;
+            return false;
 
-        res = sqlite_cursor_bind_string(cursor, xattrs);
-        if (!res)
-            goto free_insert;
+        if (!sqlite_cursor_bind_string(cursor, xattrs))
+            return false;
     } else {
         if (!sqlite_cursor_bind_string(cursor, "{}"))
             /* always try to insert empty object otherwise json_patch won't
              * merge xattrs on subsequent upserts if entries.xattrs is an empty
              * string.
              */
-            goto free_insert;
+            return false;
     }
     if (symlink) {
         if (!sqlite_cursor_bind_string(cursor, symlink))
-            goto free_insert;
+            return false;
     }
 
     if (!sqlite_cursor_exec(cursor))
-        goto free_insert;
-
-    inc_xattrs(sqlite, &fsevent->id, &fsevent->xattrs);
-
-    free((void *)insert);
-    return true;
-
-free_insert:
-    save_errno = errno;
-    free((void *)insert);
-    errno = save_errno;
+        return false;
 
-    return false;
+    return inc_xattrs(sqlite, &fsevent->id, &fsevent->xattrs);
 }
 
 static const char *
@@ -533,7 +620,10 @@ sqlite_process_unlink(struct sqlite_backend *sqlite,
             "delete from ns where id = ? and parent_id is NULL and name = ?";
     struct sqlite_cursor *cursor = &sqlite->cursor;
 
-    return sqlite_setup_query(cursor, query) &&
+    return setup_update_query(sqlite,
+                              fsevent->link.parent_id->size > 0 ?
+                                  US_UNLINK : US_UNLINK_ROOT,
+                              query) &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         (fsevent->link.parent_id->size > 0 ?
             sqlite_cursor_bind_id(cursor, fsevent->link.parent_id) :
@@ -568,7 +658,7 @@ sqlite_process_link(struct sqlite_backend *sqlite,
         return false;
     }
 
-    res = sqlite_setup_query(cursor, query) &&
+    res = setup_update_query(sqlite, US_LINK, query) &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_bind_id(cursor, fsevent->link.parent_id) &&
         sqlite_cursor_bind_string(cursor, fsevent->link.name) &&
@@ -594,7 +684,7 @@ sqlite_process_ns_xattr(struct sqlite_backend *sqlite,
     if (!xattrs)
         return false;
 
-    return sqlite_setup_query(cursor, query) &&
+    return setup_update_query(sqlite, US_NS_XATTR, query) &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_bind_id(cursor, fsevent->ns.parent_id) &&
         sqlite_cursor_bind_string(cursor, fsevent->ns.name) &&
@@ -617,7 +707,7 @@ sqlite_process_xattr(struct sqlite_backend *sqlite,
     if (!xattrs)
         return false;
 
-    return sqlite_setup_query(cursor, query) &&
+    return setup_update_query(sqlite, US_XATTR, query) &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_bind_string(cursor, xattrs) &&
         sqlite_cursor_exec(cursor) &&
@@ -633,11 +723,13 @@ sqlite_process_delete(struct sqlite_backend *sqlite,
 {
     struct sqlite_cursor *cursor = &sqlite->cursor;
 
-    return sqlite_setup_query(cursor, "delete from entries where id = ?") &&
+    return setup_update_query(sqlite, US_DELETE_ENTRY,
+                              "delete from entries where id = ?") &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_exec(cursor) &&
 
-        sqlite_setup_query(cursor, "delete from ns where id = ?") &&
+        setup_update_query(sqlite, US_DELETE_NS,
+                           "delete from ns where id = ?") &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_exec(cursor);
 }
@@ -653,7 +745,7 @@ sqlite_process_partial_unlink(struct sqlite_backend *sqlite,
         "    'path', json_extract(xattrs, '$.path')"
         ") where id = ?";
 
-    return sqlite_setup_query(cursor, query) &&
+    return setup_update_query(sqlite, US_PARTIAL_UNLINK, query) &&
         sqlite_cursor_bind_int64(cursor, fsevent->rm_time) &&
         sqlite_cursor_bind_id(cursor, &fsevent->id) &&
         sqlite_cursor_exec(cursor);
@@ -692,7 +784,11 @@ sqlite_backend_update(void *backend, struct rbh_iterator *fsevents)
     if (!fsevents)
         return 0;
 
-    sqlite_cursor_setup(sqlite, &sqlite->cursor);
+    /* The cursor is kept from one update to the next, like the statements
+     * it runs.
+     */
+    if (!sqlite->cursor.sstack)
+        sqlite_cursor_setup(sqlite, &sqlite->cursor);
     sqlite_cursor_free(&sqlite->cursor);
 
     sqlite_cursor_trans_begin(&sqlite->cursor);
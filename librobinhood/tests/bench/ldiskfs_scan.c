@@ -0,0 +1,185 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+/* Measure how long the ldiskfs backend takes to scan the inode tables and
+ * directories of a device, depending on the number of scanning threads, and
+ * how much memory the scan uses per inode (the dcache, and the list of
+ * directory blocks).
+ *
+ * Unless an image is given, one is generated with mke2fs from a temporary
+ * directory filled with ENTRY_COUNT empty files (by directories of 64). It
+ * does not need to be a Lustre target since only the scan is measured.
+ *
+ * The image is scanned once to warm up the page cache, then with 1, 2, 4, ...
+ * threads up to the number of online CPUs.
+ *
+ * Usage: ldiskfs_scan [ENTRY_COUNT [IMAGE]]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "internals.h"
+
+static void
+populate(const char *root, size_t count)
+{
+    char path[PATH_MAX];
+
+    for (size_t i = 0; i < count; i++) {
+        int fd;
+
+        if (i % 64 == 0) {
+            snprintf(path, sizeof(path), "%s/dir-%zu", root, i / 64);
+            if (mkdir(path, 0755))
+                error(EXIT_FAILURE, errno, "mkdir: %s", path);
+        }
+
+        snprintf(path, sizeof(path), "%s/dir-%zu/file-%zu", root, i / 64, i);
+        fd = creat(path, 0644);
+        if (fd < 0)
+            error(EXIT_FAILURE, errno, "creat: %s", path);
+        close(fd);
+    }
+}
+
+static void
+make_image(const char *image, const char *root, size_t count)
+{
+    char command[PATH_MAX * 3];
+    size_t size_mb;
+
+    /* Small block groups, for the image to have enough of them to share
+     * between the threads.
+     */
+    size_mb = count * 512 / (1 << 20) + 64;
+    snprintf(command, sizeof(command),
+             "mke2fs -q -F -t ext4 -b 1024 -g 1024 -N %zu -d '%s' '%s' %zuM",
+             count + count / 64 + 1024, root, image, size_mb);
+    if (system(command))
+        error(EXIT_FAILURE, 0, "failed to run '%s'", command);
+}
+
+static int
+remove_cb(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void) sb;
+    (void) type;
+    (void) ftw;
+
+    return remove(path);
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec)
+         + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Bytes allocated with malloc, in every arena */
+static size_t
+heap_usage(void)
+{
+    struct mallinfo2 info = mallinfo2();
+
+    return info.uordblks + info.hblkhd;
+}
+
+static void
+bench(const char *image, size_t threads, bool quiet)
+{
+    struct ldiskfs_backend ldiskfs = {
+        .device = (char *)image,
+        .scan_threads = threads,
+    };
+    struct timespec start, end;
+    size_t heap;
+    double seconds;
+    errcode_t rc;
+    size_t count;
+
+    rc = ext2fs_open2(image, NULL, EXT2_FLAG_SOFTSUPP_FEATURES, 0, 0,
+                      unix_io_manager, &ldiskfs.fs);
+    if (rc)
+        error(EXIT_FAILURE, 0, "failed to open '%s': %s", image,
+              error_message(rc));
+
+    ldiskfs.inode_buffer_blocks = ldiskfs.fs->inode_blocks_per_group;
+    heap = heap_usage();
+    ldiskfs.dcache = rbh_dcache_new(ldiskfs.fs);
+    if (ldiskfs.dcache == NULL)
+        error(EXIT_FAILURE, errno, "rbh_dcache_new");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!scan_target(&ldiskfs))
+        error(EXIT_FAILURE, 0, "failed to scan '%s': %s", image,
+              rbh_backend_error);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    count = ldiskfs.dcache->count;
+    heap = heap_usage() - heap;
+    seconds = elapsed(&start, &end);
+    if (!quiet)
+        printf("%2zu threads: %zu inodes in %.3fs: %.0f inodes/s, "
+               "%.0f bytes/inode\n", threads, count, seconds, count / seconds,
+               (double)heap / count);
+
+    rbh_dcache_destroy(ldiskfs.dcache);
+    ext2fs_close(ldiskfs.fs);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char root[] = "/tmp/ldiskfs_scan.XXXXXX";
+    char image[sizeof(root) + 4];
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = 100000;
+    bool generated = false;
+    const char *path;
+
+    if (argc > 1)
+        count = strtoull(argv[1], NULL, 0);
+
+    if (argc > 2) {
+        path = argv[2];
+    } else {
+        if (mkdtemp(root) == NULL)
+            error(EXIT_FAILURE, errno, "mkdtemp");
+
+        snprintf(image, sizeof(image), "%s.img", root);
+        populate(root, count);
+        make_image(image, root, count);
+        nftw(root, remove_cb, 16, FTW_DEPTH | FTW_PHYS);
+        path = image;
+        generated = true;
+    }
+
+    /* warm up the page cache */
+    bench(path, 1, true);
+    for (size_t threads = 1; threads <= (size_t)online; threads *= 2)
+        bench(path, threads, false);
+
+    if (generated)
+        unlink(image);
+
+    return EXIT_SUCCESS;
+}
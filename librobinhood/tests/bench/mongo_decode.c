@@ -0,0 +1,205 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+/* Measure how many entries per second the mongo backend decodes from the BSON
+ * documents its cursors return.
+ *
+ * Two decoders are compared:
+ *   - "copy", which decodes a document on a fixed size buffer and deep copies
+ *     the result with rbh_fsentry_new() (what fsentry_from_bson() used to do);
+ *   - "in place", which is fsentry_from_bson().
+ *
+ * Usage: mongo_decode [ENTRY_COUNT [XATTR_COUNT]]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <error.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "robinhood/fsentry.h"
+#include "robinhood/statx.h"
+#include "robinhood/utils.h"
+
+#include "mongo.h"
+
+static bson_t *
+document_new(size_t index, size_t xattr_count)
+{
+    char name[32], path[64], key[32], value[32];
+    uint64_t parent_data[2] = { index / 64, ~(index / 64) };
+    uint64_t id_data[2] = { index, ~index };
+    const struct rbh_id parent = {
+        .data = (const char *)parent_data,
+        .size = sizeof(parent_data),
+    };
+    const struct rbh_id id = {
+        .data = (const char *)id_data,
+        .size = sizeof(id_data),
+    };
+    bson_t *document = bson_new();
+    bson_t namespace, xattrs, statx, timestamp;
+
+    snprintf(name, sizeof(name), "file-%zu", index);
+    snprintf(path, sizeof(path), "/dir-%zu/file-%zu", index / 64, index);
+
+    BSON_APPEND_UTF8(document, "form", "fsentry");
+    BSON_APPEND_RBH_ID(document, MFF_ID, &id);
+
+    BSON_APPEND_DOCUMENT_BEGIN(document, MFF_NAMESPACE, &namespace);
+    BSON_APPEND_RBH_ID(&namespace, MFF_PARENT_ID, &parent);
+    BSON_APPEND_UTF8(&namespace, MFF_NAME, name);
+    BSON_APPEND_DOCUMENT_BEGIN(&namespace, MFF_XATTRS, &xattrs);
+    BSON_APPEND_UTF8(&xattrs, "path", path);
+    bson_append_document_end(&namespace, &xattrs);
+    bson_append_document_end(document, &namespace);
+
+    BSON_APPEND_DOCUMENT_BEGIN(document, MFF_STATX, &statx);
+    BSON_APPEND_INT32(&statx, MFF_STATX_TYPE, S_IFREG);
+    BSON_APPEND_INT32(&statx, MFF_STATX_MODE, 0644);
+    BSON_APPEND_INT32(&statx, MFF_STATX_NLINK, 1);
+    BSON_APPEND_INT32(&statx, MFF_STATX_UID, 1000);
+    BSON_APPEND_INT32(&statx, MFF_STATX_GID, 1000);
+    BSON_APPEND_INT64(&statx, MFF_STATX_SIZE, index * 4096);
+    BSON_APPEND_INT64(&statx, MFF_STATX_BLOCKS, index * 8);
+    BSON_APPEND_DOCUMENT_BEGIN(&statx, MFF_STATX_MTIME, &timestamp);
+    BSON_APPEND_INT64(&timestamp, MFF_STATX_TIMESTAMP_SEC, 1700000000 + index);
+    BSON_APPEND_INT32(&timestamp, MFF_STATX_TIMESTAMP_NSEC, 0);
+    bson_append_document_end(&statx, &timestamp);
+    bson_append_document_end(document, &statx);
+
+    BSON_APPEND_DOCUMENT_BEGIN(document, MFF_XATTRS, &xattrs);
+    for (size_t i = 0; i < xattr_count; i++) {
+        snprintf(key, sizeof(key), "user.xattr-%zu", i);
+        snprintf(value, sizeof(value), "value-%zu", index + i);
+        if (i % 2)
+            BSON_APPEND_INT64(&xattrs, key, index + i);
+        else
+            BSON_APPEND_UTF8(&xattrs, key, value);
+    }
+    bson_append_document_end(document, &xattrs);
+
+    return document;
+}
+
+static struct rbh_fsentry *
+decode_copy(const bson_t *bson)
+{
+    struct rbh_fsentry fsentry = { 0 };
+    struct rbh_statx statxbuf;
+    size_t bufsize;
+    bson_iter_t iter;
+    char tmp[4096];
+    char *buffer;
+
+    buffer = tmp;
+    bufsize = sizeof(tmp);
+
+    if (!bson_iter_init(&iter, bson))
+        return NULL;
+
+    while (bson_iter_next(&iter)) {
+        const char *key = bson_iter_key(&iter);
+        bson_iter_t subiter;
+        bson_iter_t count;
+
+        if (strcmp(key, MFF_ID) == 0) {
+            if (!bson_iter_rbh_id(&iter, &fsentry.id))
+                return NULL;
+            fsentry.mask |= RBH_FP_ID;
+        } else if (strcmp(key, MFF_NAMESPACE) == 0) {
+            bson_iter_recurse(&iter, &subiter);
+            if (!bson_iter_namespace(&subiter, &fsentry, &buffer, &bufsize))
+                return NULL;
+        } else if (strcmp(key, MFF_STATX) == 0) {
+            bson_iter_recurse(&iter, &subiter);
+            if (!bson_iter_statx(&subiter, &statxbuf))
+                return NULL;
+            fsentry.mask |= RBH_FP_STATX;
+        } else if (strcmp(key, MFF_XATTRS) == 0) {
+            bson_iter_recurse(&iter, &subiter);
+            bson_iter_recurse(&iter, &count);
+            if (!bson_iter_rbh_value_map(&subiter, &fsentry.xattrs.inode,
+                                         bson_iter_count(&count), &buffer,
+                                         &bufsize))
+                return NULL;
+            fsentry.mask |= RBH_FP_INODE_XATTRS;
+        }
+    }
+
+    return rbh_fsentry_new(
+            fsentry.mask & RBH_FP_ID ? &fsentry.id : NULL,
+            fsentry.mask & RBH_FP_PARENT_ID ? &fsentry.parent_id : NULL,
+            fsentry.mask & RBH_FP_NAME ? fsentry.name : NULL,
+            fsentry.mask & RBH_FP_STATX ? &statxbuf : NULL,
+            fsentry.mask & RBH_FP_NAMESPACE_XATTRS ? &fsentry.xattrs.ns : NULL,
+            fsentry.mask & RBH_FP_INODE_XATTRS ? &fsentry.xattrs.inode : NULL,
+            NULL);
+}
+
+static double
+elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec)
+         + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+bench(const char *name, struct rbh_fsentry *(*decode)(const bson_t *bson),
+      bson_t **documents, size_t count)
+{
+    struct timespec start, end;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < count; i++) {
+        struct rbh_fsentry *fsentry = decode(documents[i]);
+
+        if (fsentry == NULL)
+            error(EXIT_FAILURE, errno, "%s: failed to decode entry %zu", name,
+                  i);
+        free(fsentry);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    seconds = elapsed(&start, &end);
+    printf("%-10s %zu entries in %.3fs: %.0f entries/s\n", name, count,
+           seconds, count / seconds);
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t xattr_count = 8;
+    size_t count = 1000000;
+    bson_t **documents;
+
+    if (argc > 1)
+        count = strtoull(argv[1], NULL, 0);
+    if (argc > 2)
+        xattr_count = strtoull(argv[2], NULL, 0);
+
+    documents = xmalloc(count * sizeof(*documents));
+    for (size_t i = 0; i < count; i++)
+        documents[i] = document_new(i, xattr_count);
+
+    bench("copy", decode_copy, documents, count);
+    bench("in place", fsentry_from_bson, documents, count);
+
+    for (size_t i = 0; i < count; i++)
+        bson_destroy(documents[i]);
+    free(documents);
+
+    return EXIT_SUCCESS;
+}
@@ -118,6 +118,19 @@ START_TEST(rbso_generic_deprecated)
 }
 END_TEST
 
+START_TEST(rbso_generic_update_stats)
+{
+    struct rbh_backend *backend = test_backend_new();
+    struct rbh_update_stats stats = { 0 };
+
+    ck_assert_int_eq(rbh_backend_set_option(backend, RBH_GBO_UPDATE_STATS,
+                                            &stats, sizeof(stats)), -1);
+    ck_assert_int_eq(errno, ENOTSUP);
+
+    rbh_backend_destroy(backend);
+}
+END_TEST
+
 /*----------------------------------------------------------------------------*
  |                             rbh_backend_update                             |
  *----------------------------------------------------------------------------*/
@@ -190,6 +203,7 @@ unit_suite(void)
     tcase_add_test(tests, rbgo_generic_deprecated);
     tcase_add_test(tests, rbso_wrong_option);
     tcase_add_test(tests, rbso_generic_deprecated);
+    tcase_add_test(tests, rbso_generic_update_stats);
 
     suite_add_tcase(suite, tests);
 
@@ -59,6 +59,32 @@ START_TEST(rhn_basic)
 
     rbh_hashmap_destroy(hashmap);
 }
+END_TEST
+
+    /*--------------------------------------------------------------------*
+     |                     rbh_hashmap_new_resizable                      |
+     *--------------------------------------------------------------------*/
+
+START_TEST(rhnr_zero)
+{
+    struct rbh_hashmap *hashmap;
+
+    errno = 0;
+    hashmap = rbh_hashmap_new_resizable(strequals, djb2, 0);
+    ck_assert_ptr_null(hashmap);
+    ck_assert_int_eq(errno, EINVAL);
+}
+END_TEST
+
+START_TEST(rhnr_basic)
+{
+    struct rbh_hashmap *hashmap;
+
+    hashmap = rbh_hashmap_new_resizable(strequals, djb2, 1);
+    ck_assert_ptr_nonnull(hashmap);
+
+    rbh_hashmap_destroy(hashmap);
+}
 END_TEST
 
     /*------------------------------------------------------------------*
@@ -121,6 +147,33 @@ START_TEST(rhs_full)
 
     rbh_hashmap_destroy(hashmap);
 }
+END_TEST
+
+START_TEST(rhs_grow)
+{
+    struct rbh_hashmap *hashmap;
+    const void *value;
+    int rc;
+
+    hashmap = rbh_hashmap_new_resizable(strequals, djb2, 1);
+    ck_assert_ptr_nonnull(hashmap);
+
+    rc = rbh_hashmap_set(hashmap, "abcdefg", "hijklmn");
+    ck_assert_int_eq(rc, 0);
+
+    rc = rbh_hashmap_set(hashmap, "opqrstu", "vwxyz01");
+    ck_assert_int_eq(rc, 0);
+
+    value = rbh_hashmap_get(hashmap, "abcdefg");
+    ck_assert_ptr_nonnull(value);
+    ck_assert_str_eq(value, "hijklmn");
+
+    value = rbh_hashmap_get(hashmap, "opqrstu");
+    ck_assert_ptr_nonnull(value);
+    ck_assert_str_eq(value, "vwxyz01");
+
+    rbh_hashmap_destroy(hashmap);
+}
 END_TEST
 
     /*--------------------------------------------------------------------*
@@ -245,10 +298,17 @@ unit_suite(void)
 
     suite_add_tcase(suite, tests);
 
+    tests = tcase_create("rbh_hashmap_new_resizable");
+    tcase_add_test(tests, rhnr_zero);
+    tcase_add_test(tests, rhnr_basic);
+
+    suite_add_tcase(suite, tests);
+
     tests = tcase_create("rbh_hashmap_set");
     tcase_add_test(tests, rhs_basic);
     tcase_add_test(tests, rhs_replace);
     tcase_add_test(tests, rhs_full);
+    tcase_add_test(tests, rhs_grow);
 
     suite_add_tcase(suite, tests);
 
@@ -341,6 +401,53 @@ START_TEST(fill_replace_and_empty)
 }
 END_TEST
 
+START_TEST(grow_and_empty)
+{
+    struct rbh_hashmap *hashmap;
+    static char keys[4096][8];
+
+    hashmap = rbh_hashmap_new_resizable(strequals, djb2, 16);
+    ck_assert_ptr_nonnull(hashmap);
+
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        int rc;
+
+        snprintf(keys[i], sizeof(keys[i]), "%zu", i);
+        rc = rbh_hashmap_set(hashmap, keys[i], keys[i]);
+        ck_assert_int_eq(rc, 0);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        const void *value = rbh_hashmap_get(hashmap, keys[i]);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_str_eq(value, keys[i]);
+    }
+
+    /* Pop every other key, and check the others can still be found */
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i += 2) {
+        const void *value = rbh_hashmap_pop(hashmap, keys[i]);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_str_eq(value, keys[i]);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        const void *value;
+
+        errno = 0;
+        value = rbh_hashmap_get(hashmap, keys[i]);
+        if (i % 2 == 0) {
+            ck_assert_ptr_null(value);
+            ck_assert_int_eq(errno, ENOENT);
+        } else {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_str_eq(value, keys[i]);
+        }
+    }
+
+    rbh_hashmap_destroy(hashmap);
+}
+END_TEST
+
 static Suite *
 integration_suite(void)
 {
@@ -351,6 +458,7 @@ integration_suite(void)
 
     tests = tcase_create("stress");
     tcase_add_test(tests, fill_replace_and_empty);
+    tcase_add_test(tests, grow_and_empty);
 
     suite_add_tcase(suite, tests);
 
@@ -0,0 +1,291 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "robinhood/backend.h"
+#include "robinhood/config.h"
+#include "robinhood/fsentry.h"
+#include "robinhood/fsevent.h"
+#include "robinhood/itertools.h"
+#include "robinhood/utils.h"
+
+#include "check-compat.h"
+
+#include "mongo.h"
+
+/*----------------------------------------------------------------------------*
+ |                            fsentry_from_bson()                             |
+ *----------------------------------------------------------------------------*/
+
+START_TEST(ffb_many_xattrs)
+{
+    struct rbh_fsentry *fsentry;
+    bson_t *document;
+    bson_t xattrs;
+    char key[16];
+
+    /* Null values are small in BSON, decoded they need more scratch than the
+     * first estimate
+     */
+    document = bson_new();
+    BSON_APPEND_DOCUMENT_BEGIN(document, MFF_XATTRS, &xattrs);
+    for (size_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "%zu", i);
+        BSON_APPEND_NULL(&xattrs, key);
+    }
+    bson_append_document_end(document, &xattrs);
+
+    fsentry = fsentry_from_bson(document);
+    ck_assert_ptr_nonnull(fsentry);
+    ck_assert_uint_eq(fsentry->mask, RBH_FP_INODE_XATTRS);
+    ck_assert_uint_eq(fsentry->xattrs.inode.count, 1000);
+    ck_assert_str_eq(fsentry->xattrs.inode.pairs[999].key, "999");
+
+    free(fsentry);
+    bson_destroy(document);
+}
+END_TEST
+
+START_TEST(ffb_malformed)
+{
+    struct rbh_fsentry *fsentry;
+    bson_t *document;
+    bson_t statx;
+
+    document = bson_new();
+    BSON_APPEND_DOCUMENT_BEGIN(document, MFF_STATX, &statx);
+    BSON_APPEND_UTF8(&statx, MFF_STATX_SIZE, "not a size");
+    bson_append_document_end(document, &statx);
+
+    /* As left over by an earlier call */
+    errno = ENOBUFS;
+    fsentry = fsentry_from_bson(document);
+    ck_assert_ptr_null(fsentry);
+    ck_assert_int_eq(errno, EINVAL);
+
+    bson_destroy(document);
+}
+END_TEST
+
+START_TEST(ffb_mistyped)
+{
+    struct rbh_fsentry *fsentry;
+    bson_t *document;
+
+    document = bson_new();
+    BSON_APPEND_INT32(document, MFF_NAMESPACE, 0);
+
+    errno = ENOBUFS;
+    fsentry = fsentry_from_bson(document);
+    ck_assert_ptr_null(fsentry);
+    ck_assert_int_eq(errno, EINVAL);
+
+    bson_destroy(document);
+}
+END_TEST
+
+/*----------------------------------------------------------------------------*
+ |                            RBH_GBO_UPDATE_STATS                            |
+ *----------------------------------------------------------------------------*/
+
+/* Not "test", which other tests may use concurrently */
+#define UPDATE_STATS_URI "rbh:mongo:check_mongo"
+#define ENTRY_COUNT 8
+
+static const struct rbh_value ONE = {
+    .type = RBH_VT_INT32,
+    .int32 = 1,
+};
+
+static const struct rbh_value_pair SET_ONE_PAIR = {
+    .key = "set",
+    .value = &ONE,
+};
+
+static const struct rbh_value SET_ONE = {
+    .type = RBH_VT_MAP,
+    .map = {
+        .pairs = &SET_ONE_PAIR,
+        .count = 1,
+    },
+};
+
+/* Mongo refuses to set both "a" and "a.b" in a single update */
+static const struct rbh_value_pair CONFLICTING_XATTRS[] = {
+    { .key = "a", .value = &SET_ONE },
+    { .key = "a.b", .value = &SET_ONE },
+};
+
+static struct rbh_backend *
+update_stats_backend(size_t bulk_writers)
+{
+    char path[] = "/tmp/check_mongo.XXXXXX";
+    struct rbh_backend *backend;
+    FILE *config;
+    int fd;
+
+    fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    config = fdopen(fd, "w");
+    ck_assert_ptr_nonnull(config);
+    fprintf(config, "mongo:\n    bulk_writers: !int32 %zu\n", bulk_writers);
+    ck_assert_int_eq(fclose(config), 0);
+
+    ck_assert_int_eq(rbh_config_load_from_path(path), 0);
+    backend = rbh_backend_from_uri(UPDATE_STATS_URI, false);
+    ck_assert_ptr_nonnull(backend);
+    unlink(path);
+
+    return backend;
+}
+
+static ssize_t
+update_array(struct rbh_backend *backend, struct rbh_fsevent *fsevents,
+             size_t count)
+{
+    struct rbh_iterator *iter;
+    int save_errno;
+    ssize_t rc;
+
+    iter = rbh_iter_array(fsevents, sizeof(*fsevents), count, NULL);
+    ck_assert_ptr_nonnull(iter);
+
+    rc = rbh_backend_update(backend, iter);
+    save_errno = errno;
+    rbh_iter_destroy(iter);
+    errno = save_errno;
+
+    return rc;
+}
+
+/* Upsert ENTRY_COUNT entries, and fail to set the xattrs of the first one.
+ *
+ * Unordered bulk operations may be executed in any order, only the totals
+ * are checked.
+ */
+static void
+update_partial_failure(size_t bulk_writers)
+{
+    struct rbh_fsevent fsevents[ENTRY_COUNT + 1];
+    struct rbh_statx statxs[ENTRY_COUNT];
+    struct rbh_update_stats stats;
+    size_t size = sizeof(stats);
+    struct rbh_backend *backend;
+    char ids[ENTRY_COUNT];
+
+    backend = update_stats_backend(bulk_writers);
+
+    for (size_t i = 0; i < ENTRY_COUNT; i++) {
+        ids[i] = 'a' + i;
+        fsevents[i] = (struct rbh_fsevent) {
+            .type = RBH_FET_DELETE,
+            .id = {
+                .data = &ids[i],
+                .size = 1,
+            },
+        };
+    }
+
+    /* Start from entries left over by no earlier run */
+    ck_assert_int_eq(update_array(backend, fsevents, ENTRY_COUNT),
+                     ENTRY_COUNT);
+
+    for (size_t i = 0; i < ENTRY_COUNT; i++) {
+        statxs[i] = (struct rbh_statx) {
+            .stx_mask = RBH_STATX_SIZE,
+            .stx_size = i,
+        };
+        fsevents[i].type = RBH_FET_UPSERT;
+        fsevents[i].upsert.statx = &statxs[i];
+    }
+
+    fsevents[ENTRY_COUNT] = (struct rbh_fsevent) {
+        .type = RBH_FET_XATTR,
+        .id = fsevents[0].id,
+        .xattrs = {
+            .pairs = CONFLICTING_XATTRS,
+            .count = ARRAY_SIZE(CONFLICTING_XATTRS),
+        },
+    };
+
+    ck_assert_int_eq(update_array(backend, fsevents, ARRAY_SIZE(fsevents)),
+                     -1);
+    ck_assert_int_eq(errno, RBH_BACKEND_ERROR);
+
+    ck_assert_int_eq(rbh_backend_get_option(backend, RBH_GBO_UPDATE_STATS,
+                                            &stats, &size), 0);
+    ck_assert_uint_eq(size, sizeof(stats));
+    ck_assert_int_eq(stats.inserted, 0);
+    ck_assert_int_eq(stats.upserted, ENTRY_COUNT);
+    ck_assert_int_eq(stats.matched, 0);
+    ck_assert_int_eq(stats.removed, 0);
+    ck_assert_uint_eq(stats.write_errors, 1);
+
+    rbh_backend_destroy(backend);
+    rbh_config_free();
+}
+
+START_TEST(us_partial_failure)
+{
+    update_partial_failure(1);
+}
+END_TEST
+
+START_TEST(us_partial_failure_bulk_writers)
+{
+    update_partial_failure(4);
+}
+END_TEST
+
+static Suite *
+unit_suite(void)
+{
+    Suite *suite;
+    TCase *tests;
+
+    suite = suite_create("mongo");
+
+    tests = tcase_create("fsentry_from_bson");
+    tcase_add_test(tests, ffb_many_xattrs);
+    tcase_add_test(tests, ffb_malformed);
+    tcase_add_test(tests, ffb_mistyped);
+
+    suite_add_tcase(suite, tests);
+
+    tests = tcase_create("update_stats");
+    tcase_add_test(tests, us_partial_failure);
+    tcase_add_test(tests, us_partial_failure_bulk_writers);
+
+    suite_add_tcase(suite, tests);
+
+    return suite;
+}
+
+int
+main(void)
+{
+    int number_failed;
+    Suite *suite;
+    SRunner *runner;
+
+    suite = unit_suite();
+    runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,167 @@
+#!/usr/bin/env bash
+
+# This file is part of RobinHood
+# Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/../../../utils/tests/framework.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+check_indexes()
+{
+    local indexes="$(do_db indexes "$testdb")"
+
+    for index in ns_parent_id ns_name ns_path entries_type entries_size \
+                 entries_mtime entries_fid entries_hsm_state; do
+        echo "$indexes" | grep -x "$index" ||
+            error "Index '$index' is missing"
+    done
+}
+
+test_indexes()
+{
+    touch file
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    check_indexes
+}
+
+test_path_column()
+{
+    touch file
+    mkdir dir
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    local output="$(rbh_find --verbose "rbh:$db:$testdb" -path "/dir")"
+
+    # The path is filtered on its generated column rather than on the json
+    # xattrs
+    echo "$output" | grep "ns.path" ||
+        error "'-path' should use the 'path' column"
+    echo "$output" | grep "json_each" &&
+        error "'-path' should not use 'json_each'"
+
+    rbh_find "rbh:$db:$testdb" -path "/dir" | difflines "/dir"
+}
+
+test_upgrade()
+{
+    touch file
+    mkdir dir
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+    do_db downgrade "$testdb"
+
+    rbh_find "rbh:$db:$testdb" &&
+        error "a 1.0 database should not be upgraded when read-only"
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    check_indexes
+    rbh_find "rbh:$db:$testdb" -path "/dir" | difflines "/dir"
+}
+
+test_journal_mode()
+{
+    touch file
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    local mode="$(do_db pragma "$testdb" journal_mode)"
+    if [[ "$mode" != wal ]]; then
+        error "journal mode should be 'wal', got '$mode'"
+    fi
+
+    do_db drop "$testdb"
+    cat > test_conf.yaml <<EOF
+sqlite:
+    journal_mode: delete
+    synchronous: full
+EOF
+
+    rbh_sync --config test_conf.yaml "rbh:posix:." "rbh:$db:$testdb"
+
+    mode="$(do_db pragma "$testdb" journal_mode)"
+    if [[ "$mode" != delete ]]; then
+        error "journal mode should be 'delete', got '$mode'"
+    fi
+
+    cat > test_conf.yaml <<EOF
+sqlite:
+    synchronous: sometimes
+EOF
+
+    rbh_sync --config test_conf.yaml "rbh:posix:." "rbh:$db:$testdb" &&
+        error "an invalid synchronous level should be rejected"
+
+    return 0
+}
+
+test_cached_statements()
+{
+    # Entries with different statx masks, symlinks and xattrs are each upserted
+    # with their own statement, which is reused within and across updates
+    mkdir dir
+    touch dir/file file
+    ln -s file link
+    setfattr -n user.a -v 1 file
+    setfattr -n user.b -v 2 dir/file
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    rbh_find "rbh:$db:$testdb" | sort |
+        difflines "/" "/dir" "/dir/file" "/file" "/link"
+    rbh_find "rbh:$db:$testdb" -type l | difflines "/link"
+    rbh_find "rbh:$db:$testdb" -xattr user.a | difflines "/file"
+    rbh_find "rbh:$db:$testdb" -xattr user.b | difflines "/dir/file"
+}
+
+test_branch()
+{
+    mkdir -p dir/sub/subsub other
+    touch dir/file dir/sub/file dir/sub/subsub/file other/file
+    ln other/file dir/sub/link
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    local output="$(rbh_find --verbose "rbh:$db:$testdb#dir" -type f)"
+
+    # The whole branch is fetched by one recursive query
+    echo "$output" | grep "with recursive" ||
+        error "the branch should be walked by a recursive query"
+
+    rbh_find "rbh:$db:$testdb#dir" | sort |
+        difflines "/dir" "/dir/file" "/dir/sub" "/dir/sub/file" \
+                  "/dir/sub/link" "/dir/sub/subsub" "/dir/sub/subsub/file"
+    rbh_find "rbh:$db:$testdb#dir/sub" -type f | sort |
+        difflines "/dir/sub/file" "/dir/sub/link" "/dir/sub/subsub/file"
+    rbh_find "rbh:$db:$testdb#dir/file" | difflines "/dir/file"
+
+    local count=$(rbh_find "rbh:$db:$testdb#dir" -limit 2 | wc -l)
+    if (( count != 2 )); then
+        error "Expected 2 entries, got $count"
+    fi
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+sqlite_only_test
+declare -a tests=(test_indexes test_path_column test_upgrade test_journal_mode
+                  test_cached_statements test_branch)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'"  EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
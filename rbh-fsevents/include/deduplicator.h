@@ -9,14 +9,58 @@
 #define DEDUPLICATOR_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <robinhood/iterator.h>
 #include <robinhood/log.h>
 
 #include "source.h"
 
+/**
+ * How long entries that keep receiving fsevents are held back in the
+ * deduplicator instead of being flushed with the rest of the batch.
+ *
+ * Only entries whose pending fsevents are all upserts or xattrs, and which
+ * received more than one fsevent, are held back. They are flushed as soon as
+ * they stop receiving fsevents for a whole batch, or when one of the limits
+ * below is reached.
+ */
+struct retention_policy {
+    /** Maximum time an entry is held back, in seconds, 0 for no limit */
+    time_t max_age;
+    /** Maximum number of flushes an entry is held back for, 0 for no limit */
+    size_t max_flushes;
+    /** Maximum number of entries held back at once, must be lower than the
+     *  batch size
+     */
+    size_t max_entries;
+};
+
+/**
+ * Create a deduplicator
+ *
+ * @param batch_size   the number of entries to deduplicate fsevents of before
+ *                     flushing them, 0 to disable the deduplication
+ * @param source       the source to read fsevents from
+ * @param nb_workers   the number of sub-batches to split a batch in
+ * @param retention    the retention policy of hot entries, NULL to flush every
+ *                     entry each time the batch is full
+ * @param flush_delay  the maximum time an fsevent waits to be flushed, in
+ *                     milliseconds, 0 to only flush full batches. It is only
+ *                     enforced while the source keeps returning fsevents, or
+ *                     NULL with errno set to ETIMEDOUT when it has nothing new
+ *                     yet.
+ * @param fsevents_md  where to count fsevents and deduplicated ones
+ *
+ * @return             an iterator over batches of fsevents, which returns
+ *                     NULL and sets errno to ETIMEDOUT if the source has
+ *                     nothing new yet and there is nothing to flush
+ */
 struct rbh_mut_iterator *
 deduplicator_new(size_t batch_size, struct source *source, size_t nb_workers,
+                 const struct retention_policy *retention,
+                 uint64_t flush_delay,
                  struct rbh_fsevents_metadata *fsevents_md);
 
 struct sub_batch {
@@ -31,6 +75,10 @@ struct batch {
     struct rbh_iterator *sub_batches;
     /** Number of sub-batch to enrich to ack this batch */
     size_t ack_required;
+    /** Position in the source of the oldest fsevent held back in the
+     *  deduplicator, 0 if there is none
+     */
+    uint64_t held_position;
 };
 
 #endif
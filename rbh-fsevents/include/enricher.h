@@ -18,7 +18,8 @@ struct enrich_iter_builder_operations {
     struct rbh_iterator *(*build_iter)(void *builder,
                                        struct rbh_iterator *fsevents,
                                        bool skip_error,
-                                       bool estale_logs);
+                                       bool estale_logs,
+                                       bool cache_fds);
     struct rbh_value_map *(*get_source_backends)(void *builder);
     void (*destroy)(void *builder);
 };
@@ -37,9 +38,11 @@ static inline struct rbh_iterator *
 build_enrich_iter(struct enrich_iter_builder *builder,
                   struct rbh_iterator *fsevents,
                   bool skip_error,
-                  bool estale_logs)
+                  bool estale_logs,
+                  bool cache_fds)
 {
-    return builder->ops->build_iter(builder, fsevents, skip_error, estale_logs);
+    return builder->ops->build_iter(builder, fsevents, skip_error, estale_logs,
+                                    cache_fds);
 }
 
 static inline struct rbh_value_map *
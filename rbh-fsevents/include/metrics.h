@@ -0,0 +1,216 @@
+/* This file is part of RobinHood 4
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FSEVENTS_METRICS_H
+#define RBH_FSEVENTS_METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <robinhood/iterator.h>
+
+#include "source.h"
+
+/**
+ * Live metrics of the stages of rbh-fsevents, written at intervals by a thread
+ * of their own.
+ *
+ * Unless noted otherwise, each counter is only ever written by one thread, and
+ * read by the thread writing the metrics. Updating one is a relaxed atomic
+ * load and store, the threads doing the actual work never take a lock nor
+ * contend with one another to do so.
+ */
+
+/**
+ * Bucket i counts the latencies in [2^(i - 1), 2^i) microseconds, the last
+ * bucket counts all the latencies above
+ */
+#define METRICS_BUCKETS 24
+
+struct metrics_histogram {
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+    /** The sum of the latencies counted, in nanoseconds */
+    _Atomic uint64_t total;
+};
+
+struct worker_metrics {
+    /** Sub-batches handed over to the worker, written by the producer */
+    _Atomic uint64_t queued;
+    /** Sub-batches handed over to the worker and processed since, written by
+     *  whichever worker processed them when workers steal work
+     */
+    _Atomic uint64_t processed;
+    /** Time to enrich each fsevent */
+    struct metrics_histogram enrich;
+    /** Time to update the destination with each sub-batch, without the time
+     *  spent enriching its fsevents
+     */
+    struct metrics_histogram update;
+};
+
+struct metrics {
+    /** Fsevents read from the source and deduplicated, written by the
+     *  producer
+     */
+    _Atomic uint64_t fsevents;
+    _Atomic uint64_t deduplicated;
+    /** Time to read and deduplicate each batch, written by the producer */
+    struct metrics_histogram batches;
+
+    struct source *source;
+    /** Allocated separately, for workers not to share cache lines */
+    struct worker_metrics **workers;
+    size_t worker_count;
+
+    /** The rest is only used to write the metrics */
+    FILE *file;
+    uint64_t interval;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+
+    /** What was already written the previous time */
+    struct timespec last_time;
+    uint64_t last_read;
+    uint64_t last_fsevents;
+    uint64_t last_deduplicated;
+    uint64_t last_batches[METRICS_BUCKETS];
+    uint64_t (*last_buckets)[2][METRICS_BUCKETS];
+};
+
+/**
+ * Add to a counter only one thread writes to
+ *
+ * @param counter       the counter
+ * @param value         the value to add
+ */
+static inline void
+metrics_add(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+        memory_order_relaxed
+        );
+}
+
+/**
+ * Set a counter only one thread writes to
+ *
+ * @param counter       the counter
+ * @param value         the new value of the counter
+ */
+static inline void
+metrics_set(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+/**
+ * Count a latency in a histogram only one thread writes to
+ *
+ * @param histogram     the histogram
+ * @param latency       the latency
+ */
+void
+metrics_histogram_add(struct metrics_histogram *histogram,
+                      struct timespec latency);
+
+/**
+ * Get an upper bound of a quantile of the latencies counted in buckets
+ *
+ * @param buckets       the number of latencies in each bucket
+ * @param quantile      the quantile, between 0 and 1
+ *
+ * @return              the upper bound of the bucket the quantile falls in, in
+ *                      microseconds, 0 if there is no latency to look at
+ */
+uint64_t
+metrics_quantile(const uint64_t buckets[METRICS_BUCKETS], double quantile);
+
+/**
+ * Create the metrics of a pipeline
+ *
+ * @param source        the source of the pipeline
+ * @param worker_count  the number of workers of the pipeline
+ *
+ * @return              a pointer to newly allocated metrics
+ */
+struct metrics *
+metrics_new(struct source *source, size_t worker_count);
+
+/**
+ * Free metrics
+ *
+ * @param metrics       the metrics to free, they must not be written anymore
+ */
+void
+metrics_destroy(struct metrics *metrics);
+
+/**
+ * Write what happened since the previous time the metrics were written, or
+ * since they were created
+ *
+ * @param metrics       the metrics
+ * @param file          where to write them
+ */
+void
+metrics_write(struct metrics *metrics, FILE *file);
+
+/**
+ * Write the metrics at intervals until metrics_stop() is called
+ *
+ * @param metrics       the metrics
+ * @param file          where to write them
+ * @param interval      how often to write them, in seconds
+ *
+ * @return              0 on success, -1 on error and errno is set
+ */
+int
+metrics_start(struct metrics *metrics, FILE *file, uint64_t interval);
+
+/**
+ * Write the metrics one last time, and stop writing them at intervals
+ *
+ * @param metrics       the metrics
+ */
+void
+metrics_stop(struct metrics *metrics);
+
+/**
+ * Write how many fsevents each stage processed per second overall
+ *
+ * The time a stage of the workers took is the time each of them spent on it on
+ * average, for the throughput of the stage to be the one of all the workers.
+ *
+ * @param metrics       the metrics
+ * @param file          where to write the throughputs
+ * @param elapsed       how long the whole pipeline ran
+ */
+void
+metrics_summary(struct metrics *metrics, FILE *file, struct timespec elapsed);
+
+/**
+ * Count the time spent getting each fsevent out of an iterator
+ *
+ * @param fsevents      the iterator, it is destroyed with the returned one
+ * @param histogram     where to count the time spent getting each fsevent
+ * @param elapsed       where to add the time spent getting all of them
+ *
+ * @return              an iterator that yields the same fsevents as
+ *                      \p fsevents
+ */
+struct rbh_iterator *
+metrics_iter_time(struct rbh_iterator *fsevents,
+                  struct metrics_histogram *histogram,
+                  struct timespec *elapsed);
+
+#endif
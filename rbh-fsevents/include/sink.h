@@ -76,4 +76,14 @@ sink_from_backend(struct rbh_backend *rbh_backend);
 struct sink *
 sink_from_file(FILE *file);
 
+/* Discards the fsevents */
+struct sink *
+sink_from_null(void);
+
+/* Tallies the fsevents by type, and writes the tallies of all the sinks to
+ * file once they are all destroyed
+ */
+struct sink *
+sink_from_count(FILE *file);
+
 #endif
@@ -8,6 +8,7 @@
 #ifndef RBH_FSEVENTS_SOURCE_H
 #define RBH_FSEVENTS_SOURCE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
@@ -17,6 +18,16 @@
 
 #include "sink.h"
 
+/** What a source reports of its progress in the live metrics */
+struct source_metrics {
+    /** Records read so far (cf. changelogs for Lustre) */
+    uint64_t read;
+    /** Whether the source acknowledges the records it read */
+    bool ack;
+    /** Records read but not acknowledged yet */
+    uint64_t ack_lag;
+};
+
 struct source {
     struct rbh_iterator fsevents;
     const char *name;
@@ -24,14 +35,30 @@ struct source {
     /** Callback to save all the information (cf. changelogs for Lustre) the
      * source has read to create a batch. The information saved will be used
      * by the ack_batch callback.
+     *
+     * If held_position is not 0, fsevents read from that position onwards
+     * are held back in the deduplicator and not part of any batch yet.
      */
-    void (*save_batch)(void *source, size_t ack_required, bool dedup);
+    void (*save_batch)(void *source, size_t ack_required, bool dedup,
+                       uint64_t held_position);
 
     /** Callback to acknowledge a batch to the source. It will be used to free
      *  the memory associated with this batch in the source (cf. ack the
      *  changelogs for Lustre).
      */
     void (*ack_batch)(void *source, uint64_t batch_id, struct sink *sink);
+
+    /** Callback to get the position in the source of the last fsevent read
+     *  (cf. changelog index for Lustre). Can be NULL if the source has no
+     *  notion of position.
+     */
+    uint64_t (*position)(void *source);
+
+    /** Callback to add the progress of the source to live metrics. It is
+     *  called from another thread than the one reading the source. Can be
+     *  NULL.
+     */
+    void (*metrics)(void *source, struct source_metrics *metrics);
 };
 
 struct source *
@@ -39,7 +66,8 @@ source_from_file(FILE *file);
 
 struct source *
 source_from_lustre_changelog(const char *username, const char *dump_file,
-                             uint64_t max_changelog,
+                             uint64_t max_changelog, bool changelog_statx,
+                             uint64_t follow,
                              struct rbh_fsevents_metadata *fsevents_md,
                              struct sink *sink);
 
@@ -15,8 +15,10 @@
 #include <assert.h>
 #include <errno.h>
 #include <error.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <robinhood/fsevent.h>
 
@@ -40,4 +42,14 @@ source_stack_alloc(const void *data, size_t size);
 void
 initialize_source_stack(size_t stack_size);
 
+/* The source stack is per thread, threads other than the main one must destroy
+ * their own.
+ */
+void
+destroy_source_stack(void);
+
+/* Convert a duration in milliseconds to a struct timespec */
+struct timespec
+ms2timespec(uint64_t milliseconds);
+
 #endif
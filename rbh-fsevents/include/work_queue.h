@@ -0,0 +1,133 @@
+/* This file is part of RobinHood 4
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FSEVENTS_WORK_QUEUE_H
+#define RBH_FSEVENTS_WORK_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * A set of bounded lock-free queues, one per shard, between a single producer
+ * and a pool of workers.
+ *
+ * Items of a shard are handed out in the order they were pushed, to one
+ * worker at a time: a worker that pops an item holds its shard until it
+ * releases it, and the other workers skip the shard in the meantime. As long
+ * as the producer always pushes the items concerning a given entry to the same
+ * shard, they are processed in order.
+ *
+ * Each worker has a few home shards it looks at first, and steals work from
+ * the other shards when its own are empty.
+ *
+ * Threads only ever take a lock to go to sleep, when there is nothing to pop
+ * or when the shard to push to is full.
+ */
+struct work_queue;
+
+/**
+ * Create a work queue
+ *
+ * @param shard_count   the number of shards
+ * @param capacity      the maximum number of items in each shard
+ * @param worker_count  the number of workers that will pop items
+ *
+ * @return              a pointer to a newly allocated work queue
+ */
+struct work_queue *
+work_queue_new(size_t shard_count, size_t capacity, size_t worker_count);
+
+/**
+ * Free a work queue
+ *
+ * @param queue         the work queue to free
+ * @param free_item     called on each item left in the queue, can be NULL
+ */
+void
+work_queue_destroy(struct work_queue *queue, void (*free_item)(void *item));
+
+/**
+ * Append an item to a shard, waiting for the shard not to be full
+ *
+ * Must only be called by the producer. Several threads can act as producers
+ * as long as no two of them push to the same shard.
+ *
+ * @param queue         the work queue
+ * @param shard         the shard to push \p item to
+ * @param item          the item to push
+ *
+ * @return              true on success, false if the queue was closed
+ */
+bool
+work_queue_push(struct work_queue *queue, size_t shard, void *item);
+
+/**
+ * Get the oldest item of a shard no other worker holds, waiting for one if
+ * necessary
+ *
+ * The shard of the item is held by the caller until work_queue_release() is
+ * called.
+ *
+ * @param queue         the work queue
+ * @param worker        the index of the calling worker
+ * @param shard         where to store the shard of the returned item
+ *
+ * @return              an item, or NULL if the queue was closed and there is
+ *                      nothing left to pop
+ */
+void *
+work_queue_pop(struct work_queue *queue, size_t worker, size_t *shard);
+
+/**
+ * Same as work_queue_pop(), giving up at a deadline
+ *
+ * @param queue         the work queue
+ * @param worker        the index of the calling worker
+ * @param shard         where to store the shard of the returned item
+ * @param deadline      when to give up waiting for an item, on the
+ *                      CLOCK_MONOTONIC clock, NULL to wait for as long as it
+ *                      takes
+ *
+ * @return              an item, or NULL and errno is set to ENODATA if the
+ *                      queue was closed and there is nothing left to pop, or
+ *                      to ETIMEDOUT if \p deadline passed first
+ */
+void *
+work_queue_timedpop(struct work_queue *queue, size_t worker, size_t *shard,
+                    const struct timespec *deadline);
+
+/**
+ * Allow other workers to pop items from a shard
+ *
+ * @param queue         the work queue
+ * @param shard         a shard returned by work_queue_pop()
+ */
+void
+work_queue_release(struct work_queue *queue, size_t shard);
+
+/**
+ * Stop accepting new items, and wake up every thread waiting on the queue
+ *
+ * Items already in the queue can still be popped.
+ *
+ * @param queue         the work queue to close
+ */
+void
+work_queue_close(struct work_queue *queue);
+
+/**
+ * Whether a work queue was closed
+ *
+ * @param queue         the work queue
+ *
+ * @return              true if work_queue_close() was called on \p queue
+ */
+bool
+work_queue_closed(struct work_queue *queue);
+
+#endif
@@ -15,11 +15,14 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <stdatomic.h>
@@ -35,14 +38,28 @@
 #include "enricher.h"
 #include "info.h"
 #include "log.h"
+#include "metrics.h"
 #include "source.h"
 #include "sink.h"
+#include "work_queue.h"
 
 struct deduplicator_options {
     size_t batch_size;
+    /* Only used if max_age or max_flushes is set */
+    struct retention_policy retention;
+    /* In milliseconds, only used in daemon mode */
+    uint64_t flush_delay;
 };
 
 static const size_t DEFAULT_BATCH_SIZE = 100;
+static const uint64_t DEFAULT_FLUSH_DELAY = 1000;
+static const uint64_t DEFAULT_LOG_INTERVAL = 60;
+static const uint64_t DEFAULT_STATS_INTERVAL = 10;
+/* In daemon mode, how long the source waits for new changelogs at most before
+ * letting the deduplicator and the producer check their deadlines, in
+ * milliseconds
+ */
+static const uint64_t FOLLOW_TIMEOUT = 100;
 static bool verbose = false;
 
 static void
@@ -59,17 +76,30 @@ usage(void)
         "                        '-' for stdin;\n"
         "                        a Source URI (eg. src:file:/path/to/test, \n"
         "                        src:lustre:lustre-MDT0000).\n"
+        "                        Several comma-separated MDTs are read\n"
+        "                        concurrently, and paths to files written with\n"
+        "                        --dump stand in for the MDTs they were read from.\n"
         "    DESTINATION     can be one of:\n"
         "                        '-' for stdout;\n"
-        "                        a RobinHood URI (eg. rbh:mongo:test).\n"
+        "                        a RobinHood URI (eg. rbh:mongo:test);\n"
+        "                        'null:' to discard the fsevents;\n"
+        "                        'count:' to print how many fsevents of each\n"
+        "                        type there were to stdout.\n"
         "\n"
         "Optional arguments:\n"
         "    --alias NAME    specify an alias for the operation.\n"
+        "    --benchmark     print how many fsevents each stage processed per second\n"
+        "                    once done\n"
         "    -b, --batch-size NUMBER\n"
         "                    the number of fsevents to keep in memory for deduplication\n"
         "                    default: %lu\n"
+        "    --changelog-statx\n"
+        "                    take the timestamps Lustre changelogs provide from them\n"
+        "                    instead of querying MOUNTPOINT for them\n"
         "    -c, --config PATH\n"
         "                    the path to a configuration file\n"
+        "    --daemon        keep running once the MDTs are drained, waiting for new\n"
+        "                    changelogs, until interrupted by SIGINT or SIGTERM\n"
         "    --dry-run       displays the command after alias management\n"
         "    -d, --dump PATH\n"
         "                    the path to a file where the changelogs should be dumped,\n"
@@ -77,20 +107,44 @@ usage(void)
         "    -e, --enrich MOUNTPOINT\n"
         "                    enrich changelog records by querying MOUNTPOINT as needed\n"
         "                    MOUNTPOINT is a RobinHood URI (eg. rbh:lustre:/mnt/lustre)\n"
+        "    --flush-delay MILLISECONDS\n"
+        "                    with --daemon, flush a batch that is not full once its\n"
+        "                    oldest fsevent has waited for that long\n"
+        "                    default: %lu\n"
         "    -h, --help      print this message and exit\n"
+        "    --hold-batches NUMBER\n"
+        "                    hold entries that keep receiving events back for at most\n"
+        "                    NUMBER batches instead of flushing them\n"
+        "    --hold-max NUMBER\n"
+        "                    the maximum number of entries held back at once\n"
+        "                    default: half the batch size\n"
+        "    --hold-time SECONDS\n"
+        "                    hold entries that keep receiving events back for at most\n"
+        "                    SECONDS instead of flushing them\n"
         "    -i, --index NUMBER\n"
         "                    the changelog index to start reading from instead of\n"
         "                    the one stored in the database\n"
         "    -l, --no-estale-logs\n"
         "                    do not print any log on ESTALE errors, quietly skip/quit instead\n"
+        "    --log-interval SECONDS\n"
+        "                    with --daemon, how often to write what was done since the\n"
+        "                    previous time to DESTINATION's logs\n"
+        "                    default: %lu\n"
         "    -m, --max NUMBER\n"
-        "                    Set a maximum number of changelog to read\n"
+        "                    Set a maximum number of changelog to read (per MDT)\n"
         "    -n, --no-skip   do not skip entries on error, stop instead\n"
         "    -r, --raw       do not enrich changelog records (default)\n"
+        "    --stats PATH    write live metrics of each stage to PATH at intervals, or\n"
+        "                    to stderr if PATH is '-'\n"
+        "    --stats-interval SECONDS\n"
+        "                    how often to write the live metrics\n"
+        "                    default: %lu\n"
         "    -v, --verbose   Set the verbose mode\n"
         "    --version       print RobinHood 4's version\n"
         "    -w, --nb-workers NUMBER\n"
         "                    number of workers to use to enrich and update the destination.\n"
+        "    --work-stealing let idle workers take work from busy ones instead of\n"
+        "                    waiting for the next batch\n"
         "\n"
         "Note that uploading raw records to a RobinHood backend will fail, they have to\n"
         "be enriched first.\n"
@@ -100,7 +154,8 @@ usage(void)
         "with whom the acknowledge should be done, i.e.\n"
         "'src:lustre:lustre-MDT0000?ack-user=cl1'.\n";
 
-    printf(message, program_invocation_short_name, DEFAULT_BATCH_SIZE);
+    printf(message, program_invocation_short_name, DEFAULT_BATCH_SIZE,
+           DEFAULT_FLUSH_DELAY, DEFAULT_LOG_INTERVAL, DEFAULT_STATS_INTERVAL);
 }
 
 static char *
@@ -148,6 +203,7 @@ static struct sink **sink;
 
 static struct source *
 source_from_uri(const char *uri, const char *dump_file, uint64_t max_changelog,
+                bool changelog_statx, uint64_t follow,
                 struct rbh_fsevents_metadata *fsevents_md)
 {
     struct source *source = NULL;
@@ -156,6 +212,8 @@ source_from_uri(const char *uri, const char *dump_file, uint64_t max_changelog,
     char *colon;
 
     (void) dump_file;
+    (void) changelog_statx;
+    (void) follow;
 
     raw_uri = rbh_raw_uri_from_string(uri);
     if (raw_uri == NULL)
@@ -184,8 +242,8 @@ source_from_uri(const char *uri, const char *dump_file, uint64_t max_changelog,
     } else if (strcmp(raw_uri->path, "lustre") == 0) {
 #ifdef HAVE_LUSTRE
         source = source_from_lustre_changelog(username, dump_file,
-                                              max_changelog, fsevents_md,
-                                              sink[0]);
+                                              max_changelog, changelog_statx,
+                                              follow, fsevents_md, sink[0]);
 #else
         free(raw_uri);
         error(EX_USAGE, EINVAL, "MDT source is not available");
@@ -204,6 +262,7 @@ source_from_uri(const char *uri, const char *dump_file, uint64_t max_changelog,
 
 static struct source *
 source_new(const char *arg, const char *dump_file, uint64_t max_changelog,
+           bool changelog_statx, uint64_t follow,
            struct rbh_fsevents_metadata *fsevents_md)
 {
     if (strcmp(arg, "-") == 0) {
@@ -213,7 +272,8 @@ source_new(const char *arg, const char *dump_file, uint64_t max_changelog,
     }
 
     if (rbh_is_uri(arg))
-        return source_from_uri(arg, dump_file, max_changelog, fsevents_md);
+        return source_from_uri(arg, dump_file, max_changelog, changelog_statx,
+                               follow, fsevents_md);
 
     error(EX_USAGE, EINVAL, "%s", arg);
     __builtin_unreachable();
@@ -245,6 +305,17 @@ sink_from_uri(const char *uri)
         return (void *) sink_from_backend(rbh_backend_from_uri(uri, false));
     }
 
+    /* To measure how fast fsevents are processed without a backend */
+    if (strcmp(raw_uri->scheme, "null") == 0) {
+        free(raw_uri);
+        return sink_from_null();
+    }
+
+    if (strcmp(raw_uri->scheme, "count") == 0) {
+        free(raw_uri);
+        return sink_from_count(stdout);
+    }
+
     free(raw_uri);
     error(EX_USAGE, 0, "%s: uri scheme not supported", uri);
     __builtin_unreachable();
@@ -266,6 +337,23 @@ sink_new(const char *arg)
 
 static size_t nb_workers = 1;
 
+/* In daemon mode, what was done is written to the destination's logs at
+ * intervals, each log covering what was done since the previous one as if
+ * rbh-fsevents had only run for that long.
+ */
+struct interval_log {
+    /* The workers each use their own sink, the producer needs another one */
+    struct sink *sink;
+    struct rbh_metadata *metadata;
+    /* In seconds */
+    uint64_t interval;
+    time_t next;
+    /* The counters as of the previous log */
+    struct rbh_fsevents_metadata logged;
+};
+
+static struct interval_log interval_log;
+
 static void __attribute__((destructor(101)))
 sink_exit(void)
 {
@@ -276,6 +364,45 @@ sink_exit(void)
         }
         free(sink);
     }
+
+    if (interval_log.sink)
+        sink_destroy(interval_log.sink);
+}
+
+static void
+insert_interval_log(void)
+{
+    struct rbh_fsevents_metadata *current;
+    struct rbh_fsevents_metadata *logged;
+    struct rbh_metadata metadata;
+    struct rbh_fsevents_metadata *md;
+
+    current = &interval_log.metadata->fsevents_md;
+    logged = &interval_log.logged;
+    metadata = *interval_log.metadata;
+    md = &metadata.fsevents_md;
+
+    metadata.common_md.end_time = time(NULL);
+    md->time_spent_read_and_dedup =
+        timespec_sub(current->time_spent_read_and_dedup,
+                     logged->time_spent_read_and_dedup);
+    md->time_spent_enrich_and_update =
+        timespec_sub(current->time_spent_enrich_and_update,
+                     logged->time_spent_enrich_and_update);
+    md->time_spent_waiting_changelogs =
+        timespec_sub(current->time_spent_waiting_changelogs,
+                     logged->time_spent_waiting_changelogs);
+    md->changelog_read -= logged->changelog_read;
+    md->enrich_skip_count -= logged->enrich_skip_count;
+    md->deduplicated_event_amount -= logged->deduplicated_event_amount;
+    md->event_amount -= logged->event_amount;
+    md->held_entry_amount -= logged->held_entry_amount;
+
+    insert_fsevents_log(interval_log.sink, &metadata);
+
+    interval_log.logged = *current;
+    interval_log.metadata->common_md.start_time = metadata.common_md.end_time;
+    interval_log.next = metadata.common_md.end_time + interval_log.interval;
 }
 
 static struct enrich_iter_builder *
@@ -343,27 +470,80 @@ static _Atomic _Bool should_stop;
 static bool done_producing = false;
 static bool skip_error = true;
 static bool estale_logs = true;
+static bool work_stealing = false;
+static bool daemon_mode = false;
+/* Only set with --stats */
+static struct metrics *metrics = NULL;
+/* Set when interrupted in daemon mode, to stop reading new fsevents */
+static volatile sig_atomic_t interrupted = 0;
+
+static void
+interrupt(int signum)
+{
+    (void) signum;
+    interrupted = 1;
+}
+
+/* When workers steal work from each other, the fsevents of a batch are split in
+ * more sub-batches than there are workers, for idle workers to have something
+ * to steal. All the fsevents of an entry still go to the same shard.
+ */
+static const size_t SHARDS_PER_WORKER = 4;
+/* The number of sub-batches waiting to be processed in each shard */
+static const size_t SHARD_CAPACITY = 4;
 
 struct rbh_node_iterator {
     uint64_t batch_id;
     struct rbh_iterator *enricher;
     struct rbh_list_node list;
+    /* The worker the iterator was handed over to, another one may steal it */
+    size_t worker;
 };
 
 /* Add an iterator to enrich to a consumer */
 static void
 add_iterators_to_consumer(struct rbh_list_node *list,
                           struct rbh_iterator *enricher,
-                          uint64_t batch_id)
+                          uint64_t batch_id, size_t worker)
 {
     struct rbh_node_iterator *new_node = xmalloc(sizeof(*new_node));
 
     new_node->enricher = enricher;
     new_node->batch_id = batch_id;
+    new_node->worker = worker;
 
     rbh_list_add_tail(list, &new_node->list);
 }
 
+/* Add an iterator to enrich to a shard of the work queue */
+static bool
+add_iterator_to_queue(struct work_queue *queue, size_t shard,
+                      struct rbh_iterator *enricher, uint64_t batch_id,
+                      size_t worker)
+{
+    struct rbh_node_iterator *new_node = xmalloc(sizeof(*new_node));
+
+    new_node->enricher = enricher;
+    new_node->batch_id = batch_id;
+    new_node->worker = worker;
+
+    if (work_queue_push(queue, shard, new_node))
+        return true;
+
+    rbh_iter_destroy(enricher);
+    free(new_node);
+    return false;
+}
+
+static void
+free_node(void *item)
+{
+    struct rbh_node_iterator *node = item;
+
+    rbh_iter_destroy(node->enricher);
+    free(node);
+}
+
 /* Retrieve an iterator from a consumer's list */
 static struct rbh_node_iterator *
 consumer_get_iterator(struct rbh_list_node *list)
@@ -385,7 +565,8 @@ signal_shutdown(pthread_cond_t *signal)
 }
 
 struct consumer_info {
-    struct timespec total_enrich;
+    /* Nanoseconds spent enriching and updating, only written by the worker */
+    _Atomic uint64_t total_enrich;
     struct rbh_list_node *list;
     pthread_mutex_t mutex_list;
     pthread_cond_t signal_list;
@@ -393,16 +574,99 @@ struct consumer_info {
     bool working;
     pthread_mutex_t *mutex_available_for_work;
     pthread_cond_t *signal_available_for_work;
+    /* Only set when workers steal work from each other */
+    struct work_queue *queue;
     int id;
 };
 
+/* Enrich and update the fsevents of a node, then free it */
+static int
+consume(struct consumer_info *cinfo, struct rbh_node_iterator *node)
+{
+    struct worker_metrics *worker = NULL;
+    struct timespec enrich = { 0 };
+    struct timespec start, end, elapsed;
+    int rc;
+
+    if (metrics) {
+        worker = metrics->workers[cinfo->id];
+        node->enricher = metrics_iter_time(node->enricher, &worker->enrich,
+                                           &enrich);
+    }
+
+    rc = clock_gettime(CLOCK_REALTIME, &start);
+    if (rc) {
+        fprintf(stderr,
+                "Enricher/update thread %d failed to get start time\n",
+                cinfo->id);
+        goto out;
+    }
+
+    rc = sink_process(cinfo->sink, node->enricher);
+    if (rc)
+        goto out;
+
+    rc = clock_gettime(CLOCK_REALTIME, &end);
+    if (rc) {
+        fprintf(stderr,
+                "Enricher/update thread %d failed to get end time\n",
+                cinfo->id);
+        goto out;
+    }
+
+    /* The producer reads it to write the logs in daemon mode, without
+     * contending for the list of the worker
+     */
+    elapsed = timespec_sub(end, start);
+    atomic_fetch_add_explicit(&cinfo->total_enrich,
+                              elapsed.tv_sec * 1000000000UL + elapsed.tv_nsec,
+                              memory_order_relaxed);
+
+    if (worker)
+        metrics_histogram_add(&worker->update,
+                              timespec_sub(timespec_sub(end, start), enrich));
+
+    if (source->ack_batch != NULL)
+        source->ack_batch(source, node->batch_id, cinfo->sink);
+
+out:
+    /* Several workers may process the iterators handed over to a worker */
+    if (metrics)
+        atomic_fetch_add_explicit(&metrics->workers[node->worker]->processed,
+                                  1, memory_order_relaxed);
+
+    rbh_iter_destroy(node->enricher);
+    free(node);
+
+    return rc;
+}
+
+static void
+consumer_exit(struct consumer_info *cinfo)
+{
+    if (verbose)
+        printf("Ending enricher/update thread: %d\n", cinfo->id);
+
+    if (errno == ENODATA)
+        return;
+
+    signal_shutdown(cinfo->signal_available_for_work);
+    if (cinfo->queue)
+        work_queue_close(cinfo->queue);
+
+    if (errno == 0)
+        fprintf(stderr, "Enricher/update thread %d: unexpected exit status 0\n",
+                cinfo->id);
+    else if (errno == RBH_BACKEND_ERROR)
+        fprintf(stderr, "Enricher/update thread %d: %s\n", cinfo->id,
+                rbh_backend_error);
+}
+
 /* Consumer loop */
 void *
 consumer_thread(void *arg) {
     struct consumer_info *cinfo = (struct consumer_info *) arg;
     struct rbh_node_iterator *node;
-    struct timespec start, end;
-    int rc;
 
     if (verbose)
         printf("Starting enricher/update thread: %d\n", cinfo->id);
@@ -427,56 +691,39 @@ consumer_thread(void *arg) {
         node = consumer_get_iterator(cinfo->list);
         pthread_mutex_unlock(&cinfo->mutex_list);
 
-        rc = clock_gettime(CLOCK_REALTIME, &start);
-        if (rc) {
-            fprintf(stderr,
-                    "Enricher/update thread %d failed to get start time\n",
-                    cinfo->id);
-            rbh_iter_destroy(node->enricher);
-            free(node);
-            break;
-        }
-
-        if (sink_process(cinfo->sink, node->enricher)) {
-            rbh_iter_destroy(node->enricher);
-            free(node);
+        if (consume(cinfo, node))
             break;
-        }
-
-        rc = clock_gettime(CLOCK_REALTIME, &end);
-        if (rc) {
-            fprintf(stderr,
-                    "Enricher/update thread %d failed to get end time\n",
-                    cinfo->id);
-            rbh_iter_destroy(node->enricher);
-            free(node);
-            break;
-        }
-
-        timespec_accumulate(&cinfo->total_enrich, start, end);
+    }
 
-        if (source->ack_batch != NULL)
-            source->ack_batch(source, node->batch_id, cinfo->sink);
+    consumer_exit(cinfo);
+    return NULL;
+}
 
-        rbh_iter_destroy(node->enricher);
-        free(node);
-    }
+/* Consumer loop, when workers steal work from each other */
+void *
+stealing_consumer_thread(void *arg) {
+    struct consumer_info *cinfo = (struct consumer_info *) arg;
+    struct rbh_node_iterator *node;
+    size_t shard;
+    int rc;
 
     if (verbose)
-        printf("Ending enricher/update thread: %d\n", cinfo->id);
-
-    if (errno == ENODATA)
-        return NULL;
+        printf("Starting enricher/update thread: %d\n", cinfo->id);
 
-    signal_shutdown(cinfo->signal_available_for_work);
+    while (!atomic_load(&should_stop)) {
+        node = work_queue_pop(cinfo->queue, cinfo->id, &shard);
+        if (node == NULL) {
+            errno = ENODATA;
+            break;
+        }
 
-    if (errno == 0)
-        fprintf(stderr, "Enricher/update thread %d: unexpected exit status 0\n",
-                cinfo->id);
-    else if (errno == RBH_BACKEND_ERROR)
-        fprintf(stderr, "Enricher/update thread %d: %s\n", cinfo->id,
-                rbh_backend_error);
+        rc = consume(cinfo, node);
+        work_queue_release(cinfo->queue, shard);
+        if (rc)
+            break;
+    }
 
+    consumer_exit(cinfo);
     return NULL;
 }
 
@@ -498,10 +745,24 @@ setup_producer_consumers(struct rbh_mut_iterator **deduplicator,
                          pthread_t **consumers, struct consumer_info **cinfos,
                          pthread_mutex_t *mutex_available_for_work,
                          pthread_cond_t *signal_available_for_work,
+                         struct work_queue **queue,
                          struct rbh_fsevents_metadata *fsevents_md)
 {
+    size_t shard_count = nb_workers;
+
+    if (work_stealing) {
+        shard_count = nb_workers * SHARDS_PER_WORKER;
+        *queue = work_queue_new(shard_count, SHARD_CAPACITY, nb_workers);
+    } else {
+        *queue = NULL;
+    }
+
     *deduplicator = deduplicator_new(dedup_opts->batch_size, source,
-                                     nb_workers, fsevents_md);
+                                     shard_count,
+                                     dedup_opts->retention.max_entries ?
+                                        &dedup_opts->retention : NULL,
+                                     daemon_mode ? dedup_opts->flush_delay : 0,
+                                     fsevents_md);
     if (deduplicator == NULL)
         error(EXIT_FAILURE, errno, "deduplicator_new");
 
@@ -513,24 +774,94 @@ setup_producer_consumers(struct rbh_mut_iterator **deduplicator,
     for (int i = 0; i < nb_workers; i++) {
         struct consumer_info *cinfo = &(*cinfos)[i];
 
-        memset(&cinfo->total_enrich, 0, sizeof(cinfo->total_enrich));
+        atomic_init(&cinfo->total_enrich, 0);
         pthread_mutex_init(&cinfo->mutex_list, NULL);
         pthread_cond_init(&cinfo->signal_list, NULL);
         cinfo->sink = sink[i];
         cinfo->working = false;
         cinfo->mutex_available_for_work = mutex_available_for_work;
         cinfo->signal_available_for_work = signal_available_for_work;
+        cinfo->queue = *queue;
         cinfo->id = i;
 
         cinfo->list = init_consumer_list();
         if (cinfo->list == NULL)
             error(EXIT_FAILURE, errno, "init_consumer_list");
 
-        if (pthread_create(&(*consumers)[i], NULL, consumer_thread, cinfo) != 0)
+        if (pthread_create(&(*consumers)[i], NULL,
+                           *queue ? stealing_consumer_thread : consumer_thread,
+                           cinfo) != 0)
             error(EXIT_FAILURE, errno, "Failed to create the thread %d", i);
     }
 }
 
+/* Time spent by all the workers enriching and updating so far */
+static struct timespec
+total_enrich_time(struct consumer_info *cinfos)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < nb_workers; i++)
+        total += atomic_load_explicit(&cinfos[i].total_enrich,
+                                      memory_order_relaxed);
+
+    return (struct timespec) {
+        .tv_sec = total / 1000000000UL,
+        .tv_nsec = total % 1000000000UL,
+    };
+}
+
+/* Get the next batch of fsevents. In daemon mode, wait for one for as long as
+ * it takes, writing the logs at intervals in the meantime.
+ */
+static struct rbh_mut_iterator *
+next_batch(struct rbh_mut_iterator *deduplicator, struct consumer_info *cinfos,
+           struct timespec *start, struct rbh_fsevents_metadata *fsevents_md)
+{
+    struct timespec batch_start, batch_end;
+    struct rbh_mut_iterator *batch;
+    struct timespec now;
+
+    while (true) {
+        if (interval_log.sink && time(NULL) >= interval_log.next) {
+            clock_gettime(CLOCK_REALTIME, &now);
+            timespec_accumulate(&fsevents_md->time_spent_read_and_dedup,
+                                *start, now);
+            *start = now;
+            fsevents_md->time_spent_enrich_and_update =
+                total_enrich_time(cinfos);
+            insert_interval_log();
+        }
+
+        /* Stop like the source was drained, fsevents not flushed yet are read
+         * again next time since their changelogs were not acknowledged.
+         */
+        if (interrupted || atomic_load(&should_stop)) {
+            errno = ENODATA;
+            return NULL;
+        }
+
+        if (metrics)
+            clock_gettime(CLOCK_MONOTONIC, &batch_start);
+
+        batch = rbh_mut_iter_next(deduplicator);
+
+        if (metrics) {
+            clock_gettime(CLOCK_MONOTONIC, &batch_end);
+            if (batch != NULL)
+                metrics_histogram_add(&metrics->batches,
+                                      timespec_sub(batch_end, batch_start));
+
+            metrics_set(&metrics->fsevents, fsevents_md->event_amount);
+            metrics_set(&metrics->deduplicated,
+                        fsevents_md->deduplicated_event_amount);
+        }
+
+        if (batch != NULL || errno != ETIMEDOUT)
+            return batch;
+    }
+}
+
 static bool
 consumer_available_for_work(struct consumer_info *cinfos)
 {
@@ -548,12 +879,14 @@ producer_thread(struct rbh_mut_iterator *deduplicator,
                 struct consumer_info *cinfos,
                 pthread_mutex_t *mutex_available_for_work,
                 pthread_cond_t *signal_available_for_work,
+                struct work_queue *queue,
                 struct rbh_fsevents_metadata *fsevents_md)
 {
     struct rbh_mut_iterator *batch = NULL;
     struct sub_batch *sub_batch;
     struct timespec start, end;
     uint64_t batch_id = 1;
+    size_t worker;
     int rc;
 
     rc = clock_gettime(CLOCK_REALTIME, &start);
@@ -563,16 +896,22 @@ producer_thread(struct rbh_mut_iterator *deduplicator,
         return rc;
     }
 
-    for (batch = rbh_mut_iter_next(deduplicator); batch != NULL;
-         batch = rbh_mut_iter_next(deduplicator)) {
+    for (batch = next_batch(deduplicator, cinfos, &start, fsevents_md);
+         batch != NULL;
+         batch = next_batch(deduplicator, cinfos, &start, fsevents_md)) {
 
-        pthread_mutex_lock(mutex_available_for_work);
-        while (!consumer_available_for_work(cinfos) &&
-               !atomic_load(&should_stop)) {
-            pthread_cond_wait(signal_available_for_work,
-                              mutex_available_for_work);
+        /* With a work queue, the producer only waits if the shard it pushes
+         * to is full.
+         */
+        if (queue == NULL) {
+            pthread_mutex_lock(mutex_available_for_work);
+            while (!consumer_available_for_work(cinfos) &&
+                   !atomic_load(&should_stop)) {
+                pthread_cond_wait(signal_available_for_work,
+                                  mutex_available_for_work);
+            }
+            pthread_mutex_unlock(mutex_available_for_work);
         }
-        pthread_mutex_unlock(mutex_available_for_work);
 
         for (sub_batch = rbh_mut_iter_next(batch); sub_batch != NULL;
              sub_batch = rbh_mut_iter_next(batch)) {
@@ -584,7 +923,9 @@ producer_thread(struct rbh_mut_iterator *deduplicator,
                 sub_batch->fsevents = build_enrich_iter(builder,
                                                         sub_batch->fsevents,
                                                         skip_error,
-                                                        estale_logs);
+                                                        estale_logs,
+                                                        /* cf. fd_cache.c */
+                                                        !work_stealing);
             else if (!allow_partials)
                 sub_batch->fsevents = iter_no_partial(sub_batch->fsevents);
 
@@ -595,9 +936,23 @@ producer_thread(struct rbh_mut_iterator *deduplicator,
                 return -1;
             }
 
+            /* The home shards of a worker are contiguous */
+            worker = queue != NULL ? sub_batch->index / SHARDS_PER_WORKER :
+                                     sub_batch->index;
+            if (metrics)
+                metrics_add(&metrics->workers[worker]->queued, 1);
+
+            if (queue != NULL) {
+                if (!add_iterator_to_queue(queue, sub_batch->index,
+                                           sub_batch->fsevents, batch_id,
+                                           worker))
+                    goto end;
+                continue;
+            }
+
             pthread_mutex_lock(&cinfos[sub_batch->index].mutex_list);
             add_iterators_to_consumer(cinfos[sub_batch->index].list,
-                                      sub_batch->fsevents, batch_id);
+                                      sub_batch->fsevents, batch_id, worker);
             pthread_cond_signal(&cinfos[sub_batch->index].signal_list);
             pthread_mutex_unlock(&cinfos[sub_batch->index].mutex_list);
         }
@@ -633,25 +988,33 @@ end:
 static void
 cleanup_producer_consumers(struct rbh_mut_iterator *deduplicator,
                            struct consumer_info *cinfos, pthread_t *consumers,
+                           struct work_queue *queue,
                            struct rbh_fsevents_metadata *fsevents_md)
 {
     int i;
 
+    if (queue)
+        work_queue_close(queue);
+
     /* Wake up the the consumers */
     for (i = 0; i < nb_workers; i++)
         pthread_cond_signal(&cinfos[i].signal_list);
 
-    for (i = 0; i < nb_workers; i++) {
+    for (i = 0; i < nb_workers; i++)
         pthread_join(consumers[i], NULL);
-        fsevents_md->time_spent_enrich_and_update =
-            timespec_add(fsevents_md->time_spent_enrich_and_update,
-                         cinfos->total_enrich);
+
+    fsevents_md->time_spent_enrich_and_update = total_enrich_time(cinfos);
+
+    for (i = 0; i < nb_workers; i++) {
         pthread_cond_destroy(&cinfos[i].signal_list);
         pthread_mutex_destroy(&cinfos[i].mutex_list);
         rbh_list_del(cinfos[i].list);
         free(cinfos[i].list);
     }
 
+    if (queue)
+        work_queue_destroy(queue, free_node);
+
     free(cinfos);
     free(consumers);
     rbh_mut_iter_destroy(deduplicator);
@@ -667,6 +1030,7 @@ feed(struct sink **sink, struct source *source,
     pthread_mutex_t mutex_available_for_work;
     pthread_cond_t signal_available_for_work;
     struct consumer_info *cinfos = NULL;
+    struct work_queue *queue = NULL;
     pthread_t *consumers = NULL;
     int rc = 0;
 
@@ -676,16 +1040,17 @@ feed(struct sink **sink, struct source *source,
     /* Setup the producer and consumers */
     setup_producer_consumers(&deduplicator, dedup_opts, &consumers, &cinfos,
                              &mutex_available_for_work,
-                             &signal_available_for_work,
+                             &signal_available_for_work, &queue,
                              fsevents_md);
 
     /* Launch the producer loop */
     rc = producer_thread(deduplicator, builder, allow_partials, cinfos,
                          &mutex_available_for_work, &signal_available_for_work,
-                         fsevents_md);
+                         queue, fsevents_md);
 
     /* Cleanup the producer and consumers */
-    cleanup_producer_consumers(deduplicator, cinfos, consumers, fsevents_md);
+    cleanup_producer_consumers(deduplicator, cinfos, consumers, queue,
+                               fsevents_md);
 
     pthread_cond_destroy(&signal_available_for_work);
     pthread_mutex_destroy(&mutex_available_for_work);
@@ -697,7 +1062,7 @@ feed(struct sink **sink, struct source *source,
     if (verbose) {
         double average =
             fsevents_md->time_spent_enrich_and_update.tv_sec +
-            fsevents_md->time_spent_enrich_and_update.tv_nsec / 1000000000;
+            fsevents_md->time_spent_enrich_and_update.tv_nsec / 1e9;
 
         average = average / nb_workers;
 
@@ -705,8 +1070,17 @@ feed(struct sink **sink, struct source *source,
                "%ld.%09ld seconds\n",
                fsevents_md->time_spent_read_and_dedup.tv_sec,
                fsevents_md->time_spent_read_and_dedup.tv_nsec);
+        printf("Of which waiting for the source to read changelogs:"
+               "%ld.%09ld seconds\n",
+               fsevents_md->time_spent_waiting_changelogs.tv_sec,
+               fsevents_md->time_spent_waiting_changelogs.tv_nsec);
         printf("Total time elapsed to enrich and update mongo (average between all workers):"
                "%.4f seconds\n", average);
+        printf("Events deduplicated: %zu out of %zu\n",
+               fsevents_md->deduplicated_event_amount,
+               fsevents_md->event_amount);
+        printf("Entries held back: %zu times, at most %zu at once\n",
+               fsevents_md->held_entry_amount, fsevents_md->held_entry_peak);
     }
 
     return rc;
@@ -716,16 +1090,31 @@ int
 main(int argc, char *argv[])
 {
     const struct option LONG_OPTIONS[] = {
+        {
+            .name = "benchmark",
+            .has_arg = no_argument,
+            .val = 'B',
+        },
         {
             .name = "batch-size",
             .has_arg = required_argument,
             .val = 'b',
         },
+        {
+            .name = "changelog-statx",
+            .has_arg = no_argument,
+            .val = 'C',
+        },
         {
             .name = "config",
             .has_arg = required_argument,
             .val = 'c',
         },
+        {
+            .name = "daemon",
+            .has_arg = no_argument,
+            .val = 'D',
+        },
         {
             .name = "dump",
             .has_arg = required_argument,
@@ -741,10 +1130,30 @@ main(int argc, char *argv[])
             .has_arg = required_argument,
             .val = 'e',
         },
+        {
+            .name = "flush-delay",
+            .has_arg = required_argument,
+            .val = 'F',
+        },
         {
             .name = "help",
             .val = 'h',
         },
+        {
+            .name = "hold-batches",
+            .has_arg = required_argument,
+            .val = 'H',
+        },
+        {
+            .name = "hold-max",
+            .has_arg = required_argument,
+            .val = 'M',
+        },
+        {
+            .name = "hold-time",
+            .has_arg = required_argument,
+            .val = 'T',
+        },
         {
             .name = "index",
             .has_arg = required_argument,
@@ -754,6 +1163,11 @@ main(int argc, char *argv[])
             .name = "no-estale-logs",
             .val = 'l',
         },
+        {
+            .name = "log-interval",
+            .has_arg = required_argument,
+            .val = 'L',
+        },
         {
             .name = "max",
             .has_arg = required_argument,
@@ -772,6 +1186,16 @@ main(int argc, char *argv[])
             .name = "raw",
             .val = 'r',
         },
+        {
+            .name = "stats",
+            .has_arg = required_argument,
+            .val = 'S',
+        },
+        {
+            .name = "stats-interval",
+            .has_arg = required_argument,
+            .val = 'I',
+        },
         {
             .name = "verbose",
             .has_arg = no_argument,
@@ -782,13 +1206,27 @@ main(int argc, char *argv[])
             .has_arg = no_argument,
             .val = 'z',
         },
+        {
+            .name = "work-stealing",
+            .has_arg = no_argument,
+            .val = 's',
+        },
         {}
     };
     struct deduplicator_options dedup_opts = {
         .batch_size = DEFAULT_BATCH_SIZE,
     };
     struct rbh_metadata metadata = { 0 };
+    uint64_t stats_interval = DEFAULT_STATS_INTERVAL;
+    uint64_t log_interval = DEFAULT_LOG_INTERVAL;
+    bool changelog_statx = false;
+    const char *stats_path = NULL;
+    struct timespec start, end;
+    FILE *stats_file = NULL;
+    bool benchmark = false;
     uint64_t max_changelog = 0;
+    uint64_t follow = 0;
+    uint64_t hold_time = 0;
     char *cmd_backend = NULL;
     char *dump_file = NULL;
     int rc;
@@ -815,9 +1253,18 @@ main(int argc, char *argv[])
         case 'c':
             /* already parsed */
             break;
+        case 'B':
+            benchmark = true;
+            break;
+        case 'C':
+            changelog_statx = true;
+            break;
         case 'd':
             dump_file = xstrdup(optarg);
             break;
+        case 'D':
+            daemon_mode = true;
+            break;
         case 'e':
             enrich_builder = enrich_iter_builder_from_uri(
                 optarg, &cmd_backend, &metadata.fsevents_md
@@ -825,9 +1272,26 @@ main(int argc, char *argv[])
             if (enrich_builder == NULL)
                 error(EXIT_FAILURE, errno, "invalid enrich URI '%s'", optarg);
             break;
+        case 'F':
+            if (str2uint64_t(optarg, &dedup_opts.flush_delay))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            break;
         case 'h':
             usage();
             return 0;
+        case 'H':
+            if (str2uint64_t(optarg, &dedup_opts.retention.max_flushes))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            break;
+        case 'M':
+            if (str2uint64_t(optarg, &dedup_opts.retention.max_entries))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            break;
+        case 'T':
+            if (str2uint64_t(optarg, &hold_time))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            dedup_opts.retention.max_age = hold_time;
+            break;
         case 'i':
             if (str2int64_t(optarg, &metadata.fsevents_md.start_index))
                 error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
@@ -838,6 +1302,10 @@ main(int argc, char *argv[])
         case 'l':
             estale_logs = false;
             break;
+        case 'L':
+            if (str2uint64_t(optarg, &log_interval))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            break;
         case 'm':
             if (str2uint64_t(optarg, &max_changelog))
                 error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
@@ -859,6 +1327,18 @@ main(int argc, char *argv[])
         case 'x':
             rbh_display_resolved_argv(NULL, &argc, &argv);
             return EXIT_SUCCESS;
+        case 's':
+            work_stealing = true;
+            break;
+        case 'S':
+            stats_path = optarg;
+            break;
+        case 'I':
+            if (str2uint64_t(optarg, &stats_interval))
+                error(EXIT_FAILURE, 0, "'%s' is not an integer", optarg);
+            if (stats_interval == 0)
+                error(EX_USAGE, 0, "the stats interval cannot be 0");
+            break;
         case 'v':
             verbose = true;
             break;
@@ -872,6 +1352,32 @@ main(int argc, char *argv[])
         }
     }
 
+    if (dedup_opts.retention.max_age || dedup_opts.retention.max_flushes) {
+        if (dedup_opts.retention.max_entries == 0)
+            dedup_opts.retention.max_entries = dedup_opts.batch_size / 2;
+
+        if (dedup_opts.retention.max_entries == 0 ||
+            dedup_opts.retention.max_entries >= dedup_opts.batch_size)
+            error(EX_USAGE, 0,
+                  "the number of entries held back must be lower than the batch size");
+    } else {
+        /* --hold-max alone does not hold anything back */
+        dedup_opts.retention.max_entries = 0;
+    }
+
+    if (daemon_mode) {
+        if (dedup_opts.flush_delay == 0)
+            dedup_opts.flush_delay = DEFAULT_FLUSH_DELAY;
+        if (log_interval == 0)
+            error(EX_USAGE, 0, "the log interval cannot be 0");
+
+        /* Wake up regularly to flush batches on time and to notice when
+         * interrupted, even when the MDTs are idle.
+         */
+        follow = dedup_opts.flush_delay < FOLLOW_TIMEOUT ?
+            dedup_opts.flush_delay : FOLLOW_TIMEOUT;
+    }
+
     if (argc - optind < 2)
         error(EX_USAGE, 0, "not enough arguments");
     if (argc - optind > 2)
@@ -888,8 +1394,8 @@ main(int argc, char *argv[])
     for (int i = 0; i < nb_workers; i++)
         sink[i] = sink_new(argv[optind]);
 
-    source = source_new(source_uri, dump_file, max_changelog,
-                        &metadata.fsevents_md);
+    source = source_new(source_uri, dump_file, max_changelog, changelog_statx,
+                        follow, &metadata.fsevents_md);
 
     if (enrich_builder) {
         if (insert_backend_source(cmd_backend, enrich_builder, sink[0]) &&
@@ -906,11 +1412,59 @@ main(int argc, char *argv[])
     }
 
     metadata.common_md.start_time = time(NULL);
+
+    if (daemon_mode) {
+        struct sigaction action = {
+            .sa_handler = interrupt,
+            .sa_flags = SA_RESTART,
+        };
+
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGINT, &action, NULL) ||
+            sigaction(SIGTERM, &action, NULL))
+            error(EXIT_FAILURE, errno, "sigaction");
+
+        interval_log.sink = sink_new(argv[optind]);
+        interval_log.metadata = &metadata;
+        interval_log.interval = log_interval;
+        interval_log.next = metadata.common_md.start_time + log_interval;
+    }
+
+    if (stats_path || benchmark)
+        metrics = metrics_new(source, nb_workers);
+
+    if (stats_path) {
+        /* The destination may be stdout */
+        stats_file = strcmp(stats_path, "-") ? fopen(stats_path, "a") : stderr;
+        if (stats_file == NULL)
+            error(EXIT_FAILURE, errno, "%s", stats_path);
+
+        if (metrics_start(metrics, stats_file, stats_interval))
+            error(EXIT_FAILURE, errno, "metrics_start");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
     rc = feed(sink, source, enrich_builder, strcmp(sink[0]->name, "backend"),
               &dedup_opts, &metadata.fsevents_md);
+    clock_gettime(CLOCK_MONOTONIC, &end);
     metadata.common_md.end_time = time(NULL);
 
-    insert_fsevents_log(sink[0], &metadata);
+    if (metrics) {
+        if (stats_file)
+            metrics_stop(metrics);
+        /* The destination may be stdout */
+        if (benchmark)
+            metrics_summary(metrics, stderr, timespec_sub(end, start));
+        metrics_destroy(metrics);
+        metrics = NULL;
+        if (stats_file && stats_file != stderr)
+            fclose(stats_file);
+    }
+
+    if (interval_log.sink)
+        insert_interval_log();
+    else
+        insert_fsevents_log(sink[0], &metadata);
 
     free((char *) metadata.fsevents_md.enrich_mountpoint);
     free((char *) metadata.fsevents_md.source_read);
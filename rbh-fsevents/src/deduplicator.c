@@ -11,6 +11,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <robinhood/itertools.h>
 #include <robinhood/fsevent.h>
@@ -20,6 +21,7 @@
 #include "deduplicator.h"
 #include "deduplicator/fsevent_pool.h"
 #include "deduplicator/hash.h"
+#include "utils.h"
 
 struct deduplicator {
     struct rbh_mut_iterator batches;
@@ -27,8 +29,41 @@ struct deduplicator {
     struct source *source;
     size_t nb_workers;
     struct rbh_fsevents_metadata *fsevents_md;
+    /* 0 if batches are only flushed once full */
+    uint64_t flush_delay;
+    /* When the pool is to be flushed, whether it is full or not */
+    struct timespec flush_deadline;
+    bool pending;
 };
 
+/* Start counting down to the next flush, if the pool was empty */
+static void
+flush_countdown(struct deduplicator *deduplicator)
+{
+    if (deduplicator->flush_delay == 0 || deduplicator->pending)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &deduplicator->flush_deadline);
+    deduplicator->flush_deadline =
+        timespec_add(deduplicator->flush_deadline,
+                     ms2timespec(deduplicator->flush_delay));
+    deduplicator->pending = true;
+}
+
+static bool
+flush_is_due(struct deduplicator *deduplicator)
+{
+    struct timespec now;
+
+    if (!deduplicator->pending)
+        return false;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec > deduplicator->flush_deadline.tv_sec ||
+        (now.tv_sec == deduplicator->flush_deadline.tv_sec &&
+         now.tv_nsec >= deduplicator->flush_deadline.tv_nsec);
+}
+
 /*----------------------------------------------------------------------------*
  |                                deduplicator                                |
  *----------------------------------------------------------------------------*/
@@ -40,7 +75,10 @@ deduplicator_iter_next(void *iterator)
     struct deduplicator *deduplicator = iterator;
     const struct rbh_fsevent *fsevent;
     struct rbh_iterator *sub_batches;
+    bool exhausted = false;
+    bool due = false;
     struct batch *batch;
+    size_t held;
     int rc = 0;
 
     do {
@@ -50,8 +88,18 @@ deduplicator_iter_next(void *iterator)
         } else {
             fsevent = rbh_iter_next(&deduplicator->source->fsevents);
             if (fsevent == NULL) {
-                if (errno == ENODATA)
+                if (errno == ENODATA) {
+                    exhausted = true;
+                    break;
+                }
+
+                /* The source has nothing new yet, flush what is pending if
+                 * it has been waiting for long enough.
+                 */
+                if (errno == ETIMEDOUT && flush_is_due(deduplicator)) {
+                    due = true;
                     break;
+                }
 
                 return NULL;
             }
@@ -77,20 +125,38 @@ deduplicator_iter_next(void *iterator)
         if (rc == POOL_INSERT_DEDUPLICATED_OK)
             deduplicator->fsevents_md->deduplicated_event_amount++;
 
+        flush_countdown(deduplicator);
+        if (flush_is_due(deduplicator)) {
+            due = true;
+            break;
+        }
+
     } while (errno == 0);
 
     /* The pool will be flushed whether the loop was stopped because
      * rbh_iter_next returned NULL or the pool is full and needs to
      * be flushed. In the first case, it means that not enough events
-     * were generated and we could not fill the pool completely.
+     * were generated and we could not fill the pool completely, and nothing
+     * is held back anymore.
+     *
+     * Entries held back are not kept past the flush delay either.
      */
-    batch = rbh_fsevent_pool_flush(deduplicator->pool);
+    batch = rbh_fsevent_pool_flush(deduplicator->pool, exhausted || due);
+    deduplicator->pending = false;
     if (batch == NULL)
         return NULL;
 
+    held = rbh_fsevent_pool_held(deduplicator->pool);
+    if (held > 0)
+        flush_countdown(deduplicator);
+    deduplicator->fsevents_md->held_entry_amount += held;
+    if (held > deduplicator->fsevents_md->held_entry_peak)
+        deduplicator->fsevents_md->held_entry_peak = held;
+
     if (deduplicator->source->save_batch != NULL)
         deduplicator->source->save_batch(deduplicator->source,
-                                         batch->ack_required, true);
+                                         batch->ack_required, true,
+                                         batch->held_position);
 
     sub_batches = batch->sub_batches;
     free(batch);
@@ -138,7 +204,7 @@ no_dedup_iter_next(void *iterator)
                                          deduplicator->nb_workers);
 
     if (deduplicator->source->save_batch != NULL)
-        deduplicator->source->save_batch(deduplicator->source, 1, false);
+        deduplicator->source->save_batch(deduplicator->source, 1, false, 0);
 
     return rbh_iter_array(sub_batch, sizeof(struct sub_batch), 1, free);
 }
@@ -158,6 +224,8 @@ static const struct rbh_mut_iterator NO_DEDUP_ITERATOR = {
 
 struct rbh_mut_iterator *
 deduplicator_new(size_t batch_size, struct source *source, size_t nb_workers,
+                 const struct retention_policy *retention,
+                 uint64_t flush_delay,
                  struct rbh_fsevents_metadata *fsevents_md)
 {
     struct deduplicator *deduplicator;
@@ -167,12 +235,14 @@ deduplicator_new(size_t batch_size, struct source *source, size_t nb_workers,
     deduplicator->source = source;
     deduplicator->nb_workers = nb_workers;
     deduplicator->fsevents_md = fsevents_md;
+    deduplicator->flush_delay = flush_delay;
+    deduplicator->pending = false;
     if (batch_size == 0) {
         deduplicator->batches = NO_DEDUP_ITERATOR;
     } else {
         deduplicator->batches = DEDUPLICATOR_ITERATOR;
         deduplicator->pool = rbh_fsevent_pool_new(batch_size, source,
-                                                  nb_workers);
+                                                  nb_workers, retention);
     }
 
     return &deduplicator->batches;
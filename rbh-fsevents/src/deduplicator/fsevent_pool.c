@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <time.h>
 
 struct rbh_fsevent_pool {
     size_t size; /* maximum number of ids allowed in the pool */
@@ -41,6 +42,10 @@ struct rbh_fsevent_pool {
     struct rbh_list_node free_ids; /* List of available struct rbh_id_node */
     struct rbh_list_node free_nodes; /* List of available struct rbh_list_node
                                       */
+    struct source *source; /* to get the position of the fsevents read */
+    bool retain; /* whether hot ids may be held back when flushing */
+    struct retention_policy retention;
+    size_t held; /* number of ids held back by the last flush */
 };
 
 struct rbh_list_node_wrapper {
@@ -53,9 +58,20 @@ struct rbh_fsevent_node {
     struct rbh_list_node link;
 };
 
+/* What the retention policy needs to know about an id */
+struct id_age {
+    uint64_t position; /* position in the source of the first fsevent */
+    size_t hits; /* number of fsevents received */
+    size_t holds; /* number of flushes the id was held back at */
+    time_t held_since; /* when the id was first held back */
+    bool touched; /* whether the id received a fsevent since the last flush */
+    bool hold; /* whether the id is to be held back by the current flush */
+};
+
 struct rbh_id_node {
     const struct rbh_id *id;
     struct rbh_list_node link;
+    struct id_age age;
 };
 
 static bool
@@ -78,7 +94,8 @@ fsevent_pool_hash_lu_id(const void *key)
 
 struct rbh_fsevent_pool *
 rbh_fsevent_pool_new(size_t batch_size, struct source *source,
-                     size_t nb_workers)
+                     size_t nb_workers,
+                     const struct retention_policy *retention)
 {
     struct rbh_fsevent_pool *pool;
     size_t (*hash_fn)(const void *);
@@ -97,8 +114,8 @@ rbh_fsevent_pool_new(size_t batch_size, struct source *source,
         pool->id2index = hash_id2index;
     }
 
-    pool->pool = rbh_hashmap_new(fsevent_pool_equals, hash_fn,
-                                 batch_size * 100 / 70);
+    pool->pool = rbh_hashmap_new_resizable(fsevent_pool_equals, hash_fn,
+                                           batch_size);
     if (!pool->pool) {
         int save_errno = errno;
 
@@ -122,6 +139,16 @@ rbh_fsevent_pool_new(size_t batch_size, struct source *source,
     rbh_list_init(&pool->free_nodes);
     rbh_list_init(&pool->free_fsevents);
 
+    pool->source = source;
+    pool->retain = retention != NULL && retention->max_entries > 0;
+    if (pool->retain) {
+        pool->retention = *retention;
+        /* Leave room for new ids after a flush */
+        if (pool->retention.max_entries >= batch_size)
+            pool->retention.max_entries = batch_size - 1;
+    }
+    pool->held = 0;
+
     return pool;
 }
 
@@ -285,6 +312,13 @@ rbh_fsevent_pool_insert_new_entry(struct rbh_fsevent_pool *pool,
 
     id_node->id = &node->fsevent.id;
 
+    id_node->age = (struct id_age) {
+        .position = pool->source->position ?
+            pool->source->position(pool->source) : 0,
+        .hits = 1,
+        .touched = true,
+    };
+
     rbh_list_add_tail(&pool->ids, &id_node->link);
 
     pool->count++;
@@ -683,7 +717,7 @@ dedup_upsert(const struct rbh_fsevent *event,
 
 static void
 remove_event_list(struct rbh_fsevent_pool *pool,
-                  const struct rbh_id *id)
+                  const struct rbh_id *id, struct id_age *age)
 {
     struct rbh_id_node *elem, *tmp;
 
@@ -694,6 +728,8 @@ remove_event_list(struct rbh_fsevent_pool *pool,
         if (rbh_id_equal(id, elem->id)) {
             // XXX we could keep a reference to this node in the
             // hash table's element
+            if (age)
+                *age = elem->age;
             rbh_list_del(&elem->link);
             break;
         }
@@ -707,6 +743,7 @@ dedup_unlink_event(struct rbh_fsevent_pool *pool, struct rbh_list_node *events,
     struct rbh_fsevent_node *link_fsevent = NULL;
     struct rbh_fsevent_node *node;
     struct rbh_id_node *id_node;
+    struct id_age age;
 
     rbh_list_foreach(events, node, link) {
         if (node->fsevent.type == RBH_FET_LINK &&
@@ -727,7 +764,7 @@ dedup_unlink_event(struct rbh_fsevent_pool *pool, struct rbh_list_node *events,
      * again with the next fsevent to be able to free the memory associated
      * with link_fsevent.
      */
-    remove_event_list(pool, &event->id);
+    remove_event_list(pool, &event->id, &age);
     if (!rbh_list_empty(events)) {
         node = rbh_list_first(events, struct rbh_fsevent_node, link);
         rbh_hashmap_set(pool->pool, &node->fsevent.id, events);
@@ -735,6 +772,7 @@ dedup_unlink_event(struct rbh_fsevent_pool *pool, struct rbh_list_node *events,
 
         id_node = id_node_alloc(pool);
         id_node->id = &node->fsevent.id;
+        id_node->age = age;
         rbh_list_add_tail(&pool->ids, &id_node->link);
 
         /* Free the memory associated with link_fsevent */
@@ -763,7 +801,7 @@ dedup_delete_event(struct rbh_fsevent_pool *pool, struct rbh_list_node *events,
     }
 
     if (!insert_delete) {
-        remove_event_list(pool, &event->id);
+        remove_event_list(pool, &event->id, NULL);
         rbh_list_foreach_safe(&del, elem, tmp, link) {
             fsevent_node_free(pool, elem);
         }
@@ -853,6 +891,8 @@ deduplicate_event(struct rbh_fsevent_pool *pool, struct rbh_list_node *events,
 
     id = id_list_find(pool, &event->id);
     move_list_node_at_tail(&pool->ids, &id->link);
+    id->age.hits++;
+    id->age.touched = true;
 
     switch (event->type) {
     case RBH_FET_UPSERT:
@@ -967,12 +1007,95 @@ free_events_list(struct rbh_list_node *list)
     free(list);
 }
 
+/* An id is held back if it keeps receiving fsevents which will be merged
+ * together, until it gets too old.
+ */
+static bool
+should_hold(struct rbh_fsevent_pool *pool, struct rbh_id_node *id,
+            time_t now)
+{
+    struct rbh_fsevent_node *node;
+    struct rbh_list_node *events;
+
+    if (!id->age.touched || id->age.hits < 2)
+        return false;
+
+    if (pool->retention.max_flushes &&
+        id->age.holds >= pool->retention.max_flushes)
+        return false;
+
+    if (pool->retention.max_age && id->age.holds &&
+        now - id->age.held_since >= pool->retention.max_age)
+        return false;
+
+    /* Holding back namespace changes would only delay them */
+    events = (void *)rbh_hashmap_get(pool->pool, id->id);
+    rbh_list_foreach(events, node, link) {
+        if (node->fsevent.type != RBH_FET_UPSERT &&
+            node->fsevent.type != RBH_FET_XATTR)
+            return false;
+    }
+
+    return true;
+}
+
+/* Mark the ids to hold back, and return how many they are */
+static size_t
+select_held_ids(struct rbh_fsevent_pool *pool)
+{
+    time_t now = time(NULL);
+    size_t candidates = 0;
+    struct rbh_id_node *id;
+    size_t excess;
+    size_t held;
+
+    rbh_list_foreach(&pool->ids, id, link) {
+        id->age.hold = should_hold(pool, id, now);
+        if (id->age.hold)
+            candidates++;
+    }
+
+    /* Always flush at least one id for the pool to make progress */
+    held = candidates;
+    if (held > pool->retention.max_entries)
+        held = pool->retention.max_entries;
+    if (held > pool->count - 1)
+        held = pool->count - 1;
+
+    /* The ids are ordered from the least recently updated one, flush the
+     * coldest candidates first.
+     */
+    excess = candidates - held;
+    rbh_list_foreach(&pool->ids, id, link) {
+        if (excess == 0)
+            break;
+
+        if (id->age.hold) {
+            id->age.hold = false;
+            excess--;
+        }
+    }
+
+    rbh_list_foreach(&pool->ids, id, link) {
+        if (!id->age.hold)
+            continue;
+
+        if (id->age.holds++ == 0)
+            id->age.held_since = now;
+        id->age.touched = false;
+    }
+
+    return held;
+}
+
 struct batch *
-rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool)
+rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool, bool all)
 {
     struct rbh_fsevent_node *elem, *tmp;
+    struct rbh_id_node *id, *next_id;
     struct rbh_list_node *events_copy;
     struct sub_batch *sub_batches;
+    uint64_t held_position = 0;
     struct sub_batch *iter_ptr;
     struct batch *batch;
     size_t size = 0;
@@ -983,29 +1106,39 @@ rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool)
         }
     }
 
+    pool->held = 0;
     if (pool->count == 0)
         return NULL;
 
-    while (pool->count > 0) {
-        struct rbh_list_node *first_events;
-        struct rbh_id_node *first_id;
+    if (pool->retain && !all)
+        pool->held = select_held_ids(pool);
+
+    rbh_list_foreach_safe(&pool->ids, id, next_id, link) {
+        struct rbh_list_node *id_events;
         struct rbh_list_node *events;
         size_t index;
 
-        first_id = rbh_list_first(&pool->ids, struct rbh_id_node, link);
-        first_events = (void *)rbh_hashmap_get(pool->pool, first_id->id);
-        assert(first_events);
+        if (pool->retain && !all && id->age.hold) {
+            if (id->age.position &&
+                (held_position == 0 || id->age.position < held_position))
+                held_position = id->age.position;
+            continue;
+        }
+
+        id_events = (void *)rbh_hashmap_get(pool->pool, id->id);
+        assert(id_events);
 
-        index = pool->id2index(first_id->id, pool->events_size);
+        index = pool->id2index(id->id, pool->events_size);
 
-        rbh_list_splice_tail(&pool->events[index], first_events);
+        rbh_list_splice_tail(&pool->events[index], id_events);
 
-        id_node_free(pool, first_id);
-        events = (void *)rbh_hashmap_pop(pool->pool, first_id->id);
+        id_node_free(pool, id);
+        events = (void *)rbh_hashmap_pop(pool->pool, id->id);
         event_list_free(pool, events);
         pool->count--;
     }
 
+    assert(pool->count == pool->held);
     pool->need_to_flush = false;
 
     /* Compute how many iterator we need to return */
@@ -1032,8 +1165,15 @@ rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool)
     }
 
     batch->ack_required = size;
+    batch->held_position = held_position;
     batch->sub_batches = rbh_iter_array(sub_batches, sizeof(struct sub_batch),
                                         size, free);
 
     return batch;
 }
+
+size_t
+rbh_fsevent_pool_held(struct rbh_fsevent_pool *pool)
+{
+    return pool->held;
+}
@@ -17,7 +17,8 @@ struct rbh_fsevent_pool;
 
 struct rbh_fsevent_pool *
 rbh_fsevent_pool_new(size_t batch_size, struct source *source,
-                     size_t nb_workers);
+                     size_t nb_workers,
+                     const struct retention_policy *retention);
 
 void
 rbh_fsevent_pool_destroy(struct rbh_fsevent_pool *pool);
@@ -34,7 +35,14 @@ enum fsevent_pool_push_res
 rbh_fsevent_pool_push(struct rbh_fsevent_pool *pool,
                       const struct rbh_fsevent *event);
 
+/* Flush the entries of the pool, except the ones the retention policy holds
+ * back, unless \p all is set.
+ */
 struct batch *
-rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool);
+rbh_fsevent_pool_flush(struct rbh_fsevent_pool *pool, bool all);
+
+/* Number of entries held back by the last flush */
+size_t
+rbh_fsevent_pool_held(struct rbh_fsevent_pool *pool);
 
 #endif
@@ -0,0 +1,196 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <robinhood/utils.h>
+
+#include "internals.h"
+
+/* Each worker has its own cache, which relies on the deduplicator handing the
+ * fsevents of an ID over to the same worker: nothing invalidates the entry of
+ * an ID another worker enriched since. The cache is thus not used when workers
+ * steal work from one another (cf. posix_iter_enrich()).
+ */
+static __thread struct rbh_list_node *lru;
+static __thread size_t lru_count;
+static __thread uint64_t generation = 1;
+
+static void
+fd_cache_entry_free(struct fd_cache_entry *entry)
+{
+    rbh_list_del(&entry->link);
+    lru_count--;
+    close(entry->fd);
+    free(entry->id);
+    free(entry);
+}
+
+struct fd_cache_entry *
+fd_cache_get(const struct rbh_id *id)
+{
+    struct fd_cache_entry *entry;
+
+    if (lru == NULL)
+        return NULL;
+
+    rbh_list_foreach(lru, entry, link) {
+        if (rbh_id_equal(id, entry->id)) {
+            rbh_list_del(&entry->link);
+            rbh_list_add(lru, &entry->link);
+            entry->generation = generation;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+struct fd_cache_entry *
+fd_cache_add(const struct rbh_id *id, int fd)
+{
+    struct fd_cache_entry *entry;
+
+    if (lru == NULL) {
+        lru = xmalloc(sizeof(*lru));
+        rbh_list_init(lru);
+    }
+
+    if (lru_count == FD_CACHE_SIZE)
+        fd_cache_entry_free(rbh_list_entry(lru->prev, struct fd_cache_entry,
+                                           link));
+
+    entry = xmalloc(sizeof(*entry));
+    entry->id = rbh_id_new(id->data, id->size);
+    if (entry->id == NULL)
+        error(EXIT_FAILURE, errno, "rbh_id_new in fd_cache_add");
+    entry->fd = fd;
+    entry->statx.stx_mask = 0;
+    entry->statx_time = (struct timespec){ 0 };
+    entry->statx_generation = 0;
+    entry->generation = generation;
+
+    rbh_list_add(lru, &entry->link);
+    lru_count++;
+
+    return entry;
+}
+
+void
+fd_cache_evict(const struct rbh_id *id)
+{
+    struct fd_cache_entry *entry;
+
+    if (lru == NULL)
+        return;
+
+    rbh_list_foreach(lru, entry, link) {
+        if (rbh_id_equal(id, entry->id)) {
+            fd_cache_entry_free(entry);
+            return;
+        }
+    }
+}
+
+int
+fd_cache_statx(struct fd_cache_entry *entry, uint32_t mask,
+               struct rbh_statx *statxbuf)
+{
+    static const int STATX_FLAGS = AT_EMPTY_PATH | AT_NO_AUTOMOUNT
+                                 | AT_SYMLINK_NOFOLLOW;
+    struct rbh_statx check;
+
+    if (entry == NULL || (entry->statx.stx_mask & mask) != mask ||
+        (entry->statx.stx_mask & RBH_STATX_CTIME) != RBH_STATX_CTIME) {
+        errno = ENODATA;
+        return -1;
+    }
+
+    /* Within a sub-batch, the statx is as recent as the fsevents enriched */
+    if (entry->statx_generation != generation) {
+        /* Reading an entry changes its atime, but not its ctime */
+        if (mask & RBH_STATX_ATIME) {
+            errno = ENODATA;
+            return -1;
+        }
+
+        /* Unlike the statx it would replace, this one does not force the
+         * filesystem to synchronize the whole inode.
+         */
+        if (rbh_statx(entry->fd, "", STATX_FLAGS,
+                      RBH_STATX_CTIME | RBH_STATX_NLINK, &check))
+            return -1;
+
+        if (check.stx_nlink == 0) {
+            errno = ESTALE;
+            return -1;
+        }
+
+        /* The ctime may only be stored to the second, a change made in the
+         * same second as the statx would then not change it.
+         */
+        if (entry->statx.stx_ctime.tv_sec >= entry->statx_time.tv_sec ||
+            check.stx_ctime.tv_sec != entry->statx.stx_ctime.tv_sec ||
+            check.stx_ctime.tv_nsec != entry->statx.stx_ctime.tv_nsec) {
+            errno = ENODATA;
+            return -1;
+        }
+
+        entry->statx_generation = generation;
+    }
+
+    *statxbuf = entry->statx;
+    return 0;
+}
+
+void
+fd_cache_set_statx(struct fd_cache_entry *entry,
+                   const struct rbh_statx *statxbuf,
+                   const struct timespec *retrieved)
+{
+    if (entry == NULL)
+        return;
+
+    entry->statx = *statxbuf;
+    entry->statx_time = *retrieved;
+    entry->statx_generation = generation;
+}
+
+struct rbh_statx *
+fd_cache_current_statx(struct fd_cache_entry *entry)
+{
+    if (entry == NULL || entry->statx_generation != generation ||
+        !(entry->statx.stx_mask & RBH_STATX_MODE))
+        return NULL;
+
+    return &entry->statx;
+}
+
+void
+fd_cache_end_generation(void)
+{
+    struct fd_cache_entry *entry, *tmp;
+
+    if (lru == NULL)
+        return;
+
+    /* Do not keep entries open for long if they are not enriched again */
+    rbh_list_foreach_safe(lru, entry, tmp, link) {
+        if (entry->generation + 1 < generation)
+            fd_cache_entry_free(entry);
+    }
+
+    generation++;
+}
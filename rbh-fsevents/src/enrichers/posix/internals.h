@@ -77,6 +77,70 @@ selinux_enrich_fsevent(struct enricher *enricher,
                        const struct rbh_fsevent *original);
 #endif
 
+/*----------------------------------------------------------------------------*
+ *                                  fd cache                                  *
+ *----------------------------------------------------------------------------*/
+
+/* Number of entries each worker keeps open once enriched */
+#define FD_CACHE_SIZE 64
+
+/** An entry recently enriched, most recently enriched entries first */
+struct fd_cache_entry {
+    struct rbh_list_node link;
+    struct rbh_id *id;
+    int fd;
+    /** Last statx forced on the entry, if stx_mask is not 0 */
+    struct rbh_statx statx;
+    /** When the statx was retrieved, by the coarse clock of the host */
+    struct timespec statx_time;
+    /** Sub-batch the statx was last retrieved or checked in */
+    uint64_t statx_generation;
+    /** Sub-batch the entry was last enriched in */
+    uint64_t generation;
+};
+
+/* Return the entry of \p id, NULL if it is not cached */
+struct fd_cache_entry *
+fd_cache_get(const struct rbh_id *id);
+
+/* Cache \p fd as the file descriptor of \p id, which the cache then owns */
+struct fd_cache_entry *
+fd_cache_add(const struct rbh_id *id, int fd);
+
+/* Close and forget the entry of \p id if it is cached */
+void
+fd_cache_evict(const struct rbh_id *id);
+
+/* Fill \p statxbuf with the statx of \p entry if it has the fields of \p mask
+ * and the entry did not change since it was retrieved, as far as its change
+ * time tells. Return 0 if \p statxbuf was filled, -1 otherwise and errno is
+ * set to ESTALE if the entry was unlinked, ENODATA if the cached statx cannot
+ * be trusted.
+ */
+int
+fd_cache_statx(struct fd_cache_entry *entry, uint32_t mask,
+               struct rbh_statx *statxbuf);
+
+/* Cache \p statxbuf as the statx of \p entry, retrieved no earlier than
+ * \p retrieved
+ */
+void
+fd_cache_set_statx(struct fd_cache_entry *entry,
+                   const struct rbh_statx *statxbuf,
+                   const struct timespec *retrieved);
+
+/* Return the statx of \p entry if it was retrieved or checked during this
+ * sub-batch, NULL otherwise
+ */
+struct rbh_statx *
+fd_cache_current_statx(struct fd_cache_entry *entry);
+
+/* Mark the end of a sub-batch, entries not enriched during this sub-batch or
+ * the previous one are closed.
+ */
+void
+fd_cache_end_generation(void);
+
 struct enricher {
     struct rbh_iterator iterator;
     struct rbh_backend *backend;
@@ -86,6 +150,8 @@ struct enricher {
     const char *mount_path;
 
     int fd;
+    /* The cache entry of fd, NULL if it is not cached yet */
+    struct fd_cache_entry *cached;
 
     struct rbh_value_pair *pairs;
     size_t pair_count;
@@ -96,6 +162,8 @@ struct enricher {
 
     bool skip_error;
     bool estale_logs;
+    /* Whether to keep the entries enriched open in the fd cache */
+    bool cache_fds;
     struct posix_enricher *extension_enrichers;
     size_t n_extensions;
 
@@ -120,7 +188,7 @@ int posix_enrich(struct enricher *enricher,
 struct rbh_iterator *
 posix_iter_enrich(struct enrich_iter_builder *builder,
                   struct rbh_iterator *fsevents, bool skip_error,
-                  bool estale_logs);
+                  bool estale_logs, bool cache_fds);
 
 void
 posix_enricher_iter_destroy(void *iterator);
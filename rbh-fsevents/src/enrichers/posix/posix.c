@@ -384,23 +384,60 @@ str2partial_field(const char *string)
     return PF_UNKNOWN;
 }
 
+/* Open the entry being enriched if it is not yet, and cache its fd */
 static int
-enrich_statx(struct rbh_statx *dest, const struct rbh_id *id, int mount_fd,
-             uint32_t mask, const struct rbh_statx *original,
+enricher_open(struct enricher *enricher, const struct rbh_id *id,
+              struct rbh_posix_enrich_ctx *ctx)
+{
+    if (rbh_posix_enrich_open_by_id(ctx, enricher->mount_fd, id))
+        return -1;
+
+    if (enricher->cache_fds && enricher->cached == NULL)
+        enricher->cached = fd_cache_add(id, *ctx->einfo.fd);
+
+    return 0;
+}
+
+static int
+enrich_statx(struct rbh_statx *dest, const struct rbh_id *id,
+             struct enricher *enricher, uint32_t mask,
+             const struct rbh_statx *original,
              struct rbh_posix_enrich_ctx *ctx)
 {
     static const int STATX_FLAGS = AT_STATX_FORCE_SYNC | AT_EMPTY_PATH
                                  | AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW;
     struct rbh_statx statxbuf;
+    struct timespec retrieved;
     int rc;
 
-    rc = rbh_posix_enrich_open_by_id(ctx, mount_fd, id);
+    rc = enricher_open(enricher, id, ctx);
     if (rc == -1)
         return rc;
 
-    rc = rbh_posix_enrich_statx(ctx, STATX_FLAGS, mask, &statxbuf);
-    if (rc == -1)
-        return rc;
+    rc = fd_cache_statx(enricher->cached, mask, &statxbuf);
+    if (rc == -1 && errno == ESTALE) {
+        /* The entry was unlinked since it was cached, open it by handle again
+         * for it to be skipped like any other stale entry.
+         */
+        fd_cache_evict(id);
+        enricher->cached = NULL;
+        *ctx->einfo.fd = 0;
+
+        if (enricher_open(enricher, id, ctx))
+            return -1;
+    }
+
+    if (rc == -1) {
+        /* The clock the kernel timestamps files with */
+        clock_gettime(CLOCK_REALTIME_COARSE, &retrieved);
+        /* Also retrieve the mode, extensions rely on it */
+        rc = rbh_statx(*ctx->einfo.fd, "", STATX_FLAGS, mask | RBH_STATX_MODE,
+                       &statxbuf);
+        if (rc == -1)
+            return rc;
+
+        fd_cache_set_statx(enricher->cached, &statxbuf, &retrieved);
+    }
 
     if (original) {
         *dest = *original;
@@ -457,8 +494,7 @@ static int
 enrich_xattrs(const struct rbh_value *xattrs_to_enrich,
               struct rbh_value_pair **pairs, size_t *pair_count,
               struct rbh_fsevent *enriched,
-              const struct rbh_id *id, int mount_fd,
-              struct enricher *enricher,
+              const struct rbh_id *id, struct enricher *enricher,
               struct rbh_posix_enrich_ctx *ctx)
 {
     char buffer[XATTR_VALUE_MAX_VFS_SIZE];
@@ -477,7 +513,7 @@ enrich_xattrs(const struct rbh_value *xattrs_to_enrich,
     xattrs_seq = xattrs_to_enrich->sequence.values;
     xattrs_count = xattrs_to_enrich->sequence.count;
 
-    rc = rbh_posix_enrich_open_by_id(ctx, mount_fd, id);
+    rc = enricher_open(enricher, id, ctx);
     if (rc)
         return rc;
 
@@ -519,11 +555,11 @@ enrich_xattrs(const struct rbh_value *xattrs_to_enrich,
 
 static int
 enrich_symlink(char symlink[SYMLINK_MAX_SIZE], const struct rbh_id *id,
-               int mount_fd, struct rbh_posix_enrich_ctx *ctx)
+               struct enricher *enricher, struct rbh_posix_enrich_ctx *ctx)
 {
     ssize_t rc;
 
-    rc = rbh_posix_enrich_open_by_id(ctx, mount_fd, id);
+    rc = enricher_open(enricher, id, ctx);
     if (rc)
         return rc;
 
@@ -544,7 +580,6 @@ posix_enrich(struct enricher *enricher,
              struct rbh_posix_enrich_ctx *ctx)
 {
     struct rbh_statx *statxbuf = &enricher->statx;
-    int mount_fd = enricher->mount_fd;
     char *symlink = enricher->symlink;
     struct enrich_request req = {0};
     uint32_t statx_mask;
@@ -572,7 +607,14 @@ posix_enrich(struct enricher *enricher,
         if (parse_statx_mask(&statx_mask, partial->value))
             return -1;
 
-        if (enrich_statx(statxbuf, &original->id, mount_fd, statx_mask,
+        /* The source already provided every field that changed. Extensions
+         * would need the entry itself to be looked at.
+         */
+        if (statx_mask == 0 && original->upsert.statx != NULL &&
+            enricher->n_extensions == 0)
+            return 0;
+
+        if (enrich_statx(statxbuf, &original->id, enricher, statx_mask,
                          original->upsert.statx, ctx))
             return -1;
 
@@ -587,7 +629,7 @@ posix_enrich(struct enricher *enricher,
         }
 
         if (enrich_xattrs(partial->value, pairs, pair_count, enriched,
-                          &original->id, mount_fd, enricher, ctx) == -1)
+                          &original->id, enricher, ctx) == -1)
             return -1;
 
         req.type = ET_XATTR;
@@ -599,7 +641,7 @@ posix_enrich(struct enricher *enricher,
             return -1;
         }
 
-        if (enrich_symlink(symlink, &original->id, mount_fd, ctx))
+        if (enrich_symlink(symlink, &original->id, enricher, ctx))
             return -1;
 
         enriched->upsert.symlink = symlink;
@@ -620,6 +662,8 @@ enrich(struct enricher *enricher, const struct rbh_fsevent *original)
     *enriched = *original;
     enriched->xattrs.count = 0;
     ctx.einfo.fd = &enricher->fd;
+    /* Share the statx an earlier fsevent of the entry retrieved */
+    ctx.einfo.statx = fd_cache_current_statx(enricher->cached);
 
     for (size_t i = 0; i < original->xattrs.count; i++) {
         const struct rbh_value_pair *pair = &original->xattrs.pairs[i];
@@ -673,28 +717,40 @@ posix_enricher_iter_next(void *iterator)
 skip:
     fsevent = rbh_iter_next(enricher->fsevents);
     if (fsevent == NULL) {
-        if (enricher->fd > 0) {
+        /* The fd is left open in the cache */
+        if (enricher->cached == NULL && enricher->fd > 0)
             close(enricher->fd);
-            enricher->fd = 0;
-        }
+        enricher->fd = 0;
+        enricher->cached = NULL;
         free(last_id);
         last_id = NULL;
         return NULL;
     }
 
-    if (last_id == NULL) {
-        last_id = rbh_id_new(fsevent->id.data, fsevent->id.size);
-    } else if (!rbh_id_equal(last_id, &fsevent->id)) {
+    if (last_id == NULL || !rbh_id_equal(last_id, &fsevent->id)) {
         free(last_id);
-        if (enricher->fd > 0) {
-            close(enricher->fd);
-            enricher->fd = 0;
-        }
         id = rbh_id_new(fsevent->id.data, fsevent->id.size);
         last_id = id;
+
+        if (enricher->cached == NULL && enricher->fd > 0)
+            close(enricher->fd);
+
+        enricher->cached = enricher->cache_fds ? fd_cache_get(&fsevent->id)
+                                               : NULL;
+        enricher->fd = enricher->cached ? enricher->cached->fd : 0;
+    }
+
+    if (fsevent->type == RBH_FET_DELETE && enricher->cached) {
+        fd_cache_evict(&fsevent->id);
+        enricher->cached = NULL;
+        enricher->fd = 0;
     }
 
     rc = enrich(enricher, fsevent);
+    /* Extensions may have opened the entry themselves */
+    if (enricher->cache_fds && enricher->cached == NULL && enricher->fd > 0)
+        enricher->cached = fd_cache_add(&fsevent->id, enricher->fd);
+
     if (rc) {
         if (!enricher->skip_error)
             return NULL;
@@ -723,6 +779,7 @@ posix_enricher_iter_destroy(void *iterator)
     struct enricher *enricher = iterator;
 
     rbh_iter_destroy(enricher->fsevents);
+    fd_cache_end_generation();
 
     if (xattrs_values) {
         rbh_sstack_destroy(xattrs_values);
@@ -834,7 +891,7 @@ setup_fsevent_enrichers(struct enricher *enricher, const char *type)
 struct rbh_iterator *
 posix_iter_enrich(struct enrich_iter_builder *builder,
                   struct rbh_iterator *fsevents, bool skip_error,
-                  bool estale_logs)
+                  bool estale_logs, bool cache_fds)
 {
     struct rbh_value_pair *pairs;
     struct enricher *enricher;
@@ -850,6 +907,7 @@ posix_iter_enrich(struct enrich_iter_builder *builder,
     enricher->backend = builder->backend;
     enricher->fsevents = fsevents;
     enricher->fd = 0;
+    enricher->cached = NULL;
     enricher->mount_fd = builder->mount_fd;
     enricher->mount_path = builder->mount_path;
     enricher->pairs = pairs;
@@ -857,6 +915,7 @@ posix_iter_enrich(struct enrich_iter_builder *builder,
     enricher->symlink = symlink;
     enricher->skip_error = skip_error;
     enricher->estale_logs = estale_logs;
+    enricher->cache_fds = cache_fds;
     enricher->fsevents_md = builder->fsevents_md;
     setup_fsevent_enrichers(enricher, builder->type);
 
@@ -934,11 +993,13 @@ static struct rbh_iterator *
 posix_enrich_iter_builder_build_iter(void *_builder,
                                      struct rbh_iterator *fsevents,
                                      bool skip_error,
-                                     bool estale_logs)
+                                     bool estale_logs,
+                                     bool cache_fds)
 {
     struct enrich_iter_builder *builder = _builder;
 
-    return posix_iter_enrich(builder, fsevents, skip_error, estale_logs);
+    return posix_iter_enrich(builder, fsevents, skip_error, estale_logs,
+                             cache_fds);
 }
 
 #define MIN_VALUES_SSTACK_ALLOC (1 << 6)
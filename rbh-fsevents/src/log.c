@@ -31,8 +31,8 @@ fsevents_metadata_value_map(struct rbh_metadata *metadata)
     struct rbh_value_map *value_map;
     struct rbh_value_pair *pairs;
     struct rbh_value *values;
-    int count_timespec = 4;
-    int count = 13;
+    int count_timespec = 6;
+    int count = 16;
 
     if (metadata_sstack == NULL)
         metadata_sstack = rbh_sstack_new(MIN_VALUES_SSTACK_ALLOC *
@@ -117,6 +117,27 @@ fsevents_metadata_value_map(struct rbh_metadata *metadata)
     pairs[count].value = &values[count];
     count++;
 
+    pairs_timespec[4].key = "tv_sec";
+    values_timespec[4].type = RBH_VT_UINT64;
+    values_timespec[4].uint64 =
+        metadata->fsevents_md.time_spent_waiting_changelogs.tv_sec;
+    pairs_timespec[4].value = &values_timespec[4];
+
+    pairs_timespec[5].key = "tv_nsec";
+    values_timespec[5].type = RBH_VT_UINT64;
+    values_timespec[5].uint64 =
+        metadata->fsevents_md.time_spent_waiting_changelogs.tv_nsec;
+    pairs_timespec[5].value = &values_timespec[5];
+
+    timespec_map[2].pairs = &pairs_timespec[4];
+    timespec_map[2].count = 2;
+
+    pairs[count].key = "time_wait_changelogs";
+    values[count].type = RBH_VT_MAP;
+    values[count].map = timespec_map[2];
+    pairs[count].value = &values[count];
+    count++;
+
     pairs[count].key = "changelog_read";
     values[count].type = RBH_VT_UINT64;
     values[count].uint64 = metadata->fsevents_md.changelog_read;
@@ -150,6 +171,18 @@ fsevents_metadata_value_map(struct rbh_metadata *metadata)
     pairs[count].value = &values[count];
     count++;
 
+    pairs[count].key = "held_entry_count";
+    values[count].type = RBH_VT_UINT64;
+    values[count].uint64 = metadata->fsevents_md.held_entry_amount;
+    pairs[count].value = &values[count];
+    count++;
+
+    pairs[count].key = "held_entry_peak";
+    values[count].type = RBH_VT_UINT64;
+    values[count].uint64 = metadata->fsevents_md.held_entry_peak;
+    pairs[count].value = &values[count];
+    count++;
+
     value_map->pairs = pairs;
     value_map->count = count;
 
@@ -159,7 +192,12 @@ fsevents_metadata_value_map(struct rbh_metadata *metadata)
 void
 insert_fsevents_log(struct sink *sink, struct rbh_metadata *metadata)
 {
-    if (!sink_insert_log(sink, fsevents_metadata_value_map(metadata)))
+    int rc;
+
+    rc = sink_insert_log(sink, fsevents_metadata_value_map(metadata));
+    /* In daemon mode, logs are inserted at intervals for as long as it runs */
+    rbh_sstack_clear(metadata_sstack);
+    if (!rc)
         return;
 
     switch (errno) {
@@ -0,0 +1,376 @@
+/* This file is part of RobinHood 4
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <robinhood/utils.h>
+
+#include "metrics.h"
+
+void
+metrics_histogram_add(struct metrics_histogram *histogram,
+                      struct timespec latency)
+{
+    uint64_t microseconds;
+    size_t bucket = 0;
+
+    if (latency.tv_sec >= 0) {
+        microseconds = latency.tv_sec * 1000000 + latency.tv_nsec / 1000;
+        if (microseconds > 0)
+            bucket = 64 - __builtin_clzll(microseconds);
+
+        metrics_add(&histogram->total,
+                    latency.tv_sec * 1000000000 + latency.tv_nsec);
+    }
+
+    if (bucket >= METRICS_BUCKETS)
+        bucket = METRICS_BUCKETS - 1;
+
+    metrics_add(&histogram->buckets[bucket], 1);
+}
+
+uint64_t
+metrics_quantile(const uint64_t buckets[METRICS_BUCKETS], double quantile)
+{
+    uint64_t total = 0;
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS; i++)
+        total += buckets[i];
+
+    if (total == 0)
+        return 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS - 1; i++) {
+        count += buckets[i];
+        if (count >= quantile * total)
+            return UINT64_C(1) << i;
+    }
+
+    /* All that is known of the last bucket is where it starts */
+    return UINT64_C(1) << (METRICS_BUCKETS - 2);
+}
+
+struct metrics *
+metrics_new(struct source *source, size_t worker_count)
+{
+    struct metrics *metrics;
+
+    metrics = xcalloc(1, sizeof(*metrics));
+    metrics->source = source;
+    metrics->worker_count = worker_count;
+    metrics->workers = xmalloc(worker_count * sizeof(*metrics->workers));
+    for (size_t i = 0; i < worker_count; i++)
+        metrics->workers[i] = xcalloc(1, sizeof(*metrics->workers[i]));
+
+    metrics->last_buckets = xcalloc(worker_count,
+                                    sizeof(*metrics->last_buckets));
+    clock_gettime(CLOCK_MONOTONIC, &metrics->last_time);
+
+    return metrics;
+}
+
+void
+metrics_destroy(struct metrics *metrics)
+{
+    for (size_t i = 0; i < metrics->worker_count; i++)
+        free(metrics->workers[i]);
+    free(metrics->workers);
+    free(metrics->last_buckets);
+    free(metrics);
+}
+
+/* Turn the buckets of a histogram into the latencies counted since the
+ * previous time, and remember the current ones for the next time
+ */
+static void
+histogram_since(struct metrics_histogram *histogram,
+                uint64_t last[METRICS_BUCKETS],
+                uint64_t buckets[METRICS_BUCKETS])
+{
+    for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+        uint64_t current = atomic_load_explicit(&histogram->buckets[i],
+                                                memory_order_relaxed);
+
+        buckets[i] = current - last[i];
+        last[i] = current;
+    }
+}
+
+static void
+write_histogram(FILE *file, const char *name,
+                const uint64_t buckets[METRICS_BUCKETS])
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS; i++)
+        count += buckets[i];
+
+    fprintf(file, " %s_count=%" PRIu64 " %s_p50_us=%" PRIu64
+            " %s_p90_us=%" PRIu64 " %s_p99_us=%" PRIu64,
+            name, count, name, metrics_quantile(buckets, 0.5),
+            name, metrics_quantile(buckets, 0.9),
+            name, metrics_quantile(buckets, 0.99));
+}
+
+void
+metrics_write(struct metrics *metrics, FILE *file)
+{
+    struct source_metrics source_metrics = { 0 };
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t fsevents, deduplicated;
+    struct timespec now, elapsed;
+    time_t timestamp = time(NULL);
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = timespec_sub(now, metrics->last_time);
+    seconds = elapsed.tv_sec + elapsed.tv_nsec / 1e9;
+    metrics->last_time = now;
+
+    fprintf(file, "time=%ld interval=%.3f", timestamp, seconds);
+
+    if (metrics->source->metrics) {
+        uint64_t read;
+
+        metrics->source->metrics(metrics->source, &source_metrics);
+        read = source_metrics.read - metrics->last_read;
+        metrics->last_read = source_metrics.read;
+
+        fprintf(file, " read=%" PRIu64 " read_per_second=%.1f", read,
+                seconds > 0 ? read / seconds : 0.);
+    }
+
+    fsevents = atomic_load_explicit(&metrics->fsevents, memory_order_relaxed);
+    deduplicated = atomic_load_explicit(&metrics->deduplicated,
+                                        memory_order_relaxed);
+    fprintf(file, " fsevents=%" PRIu64 " deduplicated=%" PRIu64
+            " dedup_ratio=%.3f", fsevents - metrics->last_fsevents,
+            deduplicated - metrics->last_deduplicated,
+            fsevents > metrics->last_fsevents ?
+                (double) (deduplicated - metrics->last_deduplicated) /
+                    (fsevents - metrics->last_fsevents) : 0.);
+    metrics->last_fsevents = fsevents;
+    metrics->last_deduplicated = deduplicated;
+
+    histogram_since(&metrics->batches, metrics->last_batches, buckets);
+    write_histogram(file, "batch", buckets);
+
+    if (source_metrics.ack)
+        fprintf(file, " ack_lag=%" PRIu64, source_metrics.ack_lag);
+
+    fprintf(file, "\n");
+
+    for (size_t i = 0; i < metrics->worker_count; i++) {
+        struct worker_metrics *worker = metrics->workers[i];
+        uint64_t processed;
+        uint64_t queued;
+
+        /* A sub-batch is counted as queued before it can be processed */
+        processed = atomic_load_explicit(&worker->processed,
+                                         memory_order_relaxed);
+        queued = atomic_load_explicit(&worker->queued, memory_order_relaxed);
+
+        fprintf(file, "time=%ld worker=%zu queue_depth=%" PRIu64, timestamp,
+                i, queued - processed);
+
+        histogram_since(&worker->enrich, metrics->last_buckets[i][0], buckets);
+        write_histogram(file, "enrich", buckets);
+        histogram_since(&worker->update, metrics->last_buckets[i][1], buckets);
+        write_histogram(file, "update", buckets);
+
+        fprintf(file, "\n");
+    }
+
+    fflush(file);
+}
+
+static uint64_t
+histogram_count(struct metrics_histogram *histogram)
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < METRICS_BUCKETS; i++)
+        count += atomic_load_explicit(&histogram->buckets[i],
+                                      memory_order_relaxed);
+
+    return count;
+}
+
+static void
+write_throughput(FILE *file, const char *stage, uint64_t fsevents,
+                 double seconds)
+{
+    fprintf(file, "%-16s %12" PRIu64 " %12.3f %14.1f\n", stage, fsevents,
+            seconds, seconds > 0 ? fsevents / seconds : 0.);
+}
+
+void
+metrics_summary(struct metrics *metrics, FILE *file, struct timespec elapsed)
+{
+    uint64_t enrich_time = 0, update_time = 0;
+    uint64_t fsevents, enriched = 0;
+
+    fsevents = atomic_load_explicit(&metrics->fsevents, memory_order_relaxed);
+
+    for (size_t i = 0; i < metrics->worker_count; i++) {
+        struct worker_metrics *worker = metrics->workers[i];
+
+        enriched += histogram_count(&worker->enrich);
+        enrich_time += atomic_load_explicit(&worker->enrich.total,
+                                            memory_order_relaxed);
+        update_time += atomic_load_explicit(&worker->update.total,
+                                            memory_order_relaxed);
+    }
+
+    fprintf(file, "%-16s %12s %12s %14s\n", "stage", "fsevents", "seconds",
+            "fsevents/s");
+    write_throughput(file, "read and dedup", fsevents,
+                     atomic_load_explicit(&metrics->batches.total,
+                                          memory_order_relaxed) / 1e9);
+    write_throughput(file, "enrich", enriched,
+                     enrich_time / 1e9 / metrics->worker_count);
+    write_throughput(file, "update", enriched,
+                     update_time / 1e9 / metrics->worker_count);
+    write_throughput(file, "total", fsevents,
+                     elapsed.tv_sec + elapsed.tv_nsec / 1e9);
+    fflush(file);
+}
+
+static void *
+metrics_thread(void *arg)
+{
+    struct metrics *metrics = arg;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    pthread_mutex_lock(&metrics->mutex);
+    while (metrics->running) {
+        deadline.tv_sec += metrics->interval;
+        while (metrics->running &&
+               pthread_cond_timedwait(&metrics->cond, &metrics->mutex,
+                                      &deadline) != ETIMEDOUT);
+
+        metrics_write(metrics, metrics->file);
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+
+    return NULL;
+}
+
+int
+metrics_start(struct metrics *metrics, FILE *file, uint64_t interval)
+{
+    pthread_condattr_t attr;
+    int rc;
+
+    metrics->file = file;
+    metrics->interval = interval;
+    metrics->running = true;
+
+    pthread_mutex_init(&metrics->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&metrics->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    rc = pthread_create(&metrics->thread, NULL, metrics_thread, metrics);
+    if (rc) {
+        pthread_cond_destroy(&metrics->cond);
+        pthread_mutex_destroy(&metrics->mutex);
+        errno = rc;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+metrics_stop(struct metrics *metrics)
+{
+    pthread_mutex_lock(&metrics->mutex);
+    metrics->running = false;
+    pthread_cond_signal(&metrics->cond);
+    pthread_mutex_unlock(&metrics->mutex);
+
+    pthread_join(metrics->thread, NULL);
+    pthread_cond_destroy(&metrics->cond);
+    pthread_mutex_destroy(&metrics->mutex);
+}
+
+/*----------------------------------------------------------------------------*
+ *                             metrics_iter_time                              *
+ *----------------------------------------------------------------------------*/
+
+struct timed_iterator {
+    struct rbh_iterator iterator;
+    struct rbh_iterator *fsevents;
+    struct metrics_histogram *histogram;
+    struct timespec *elapsed;
+};
+
+static const void *
+timed_iter_next(void *iterator)
+{
+    struct timed_iterator *timed = iterator;
+    const void *fsevent;
+    struct timespec start, end;
+    int save_errno;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fsevent = rbh_iter_next(timed->fsevents);
+    save_errno = errno;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (fsevent != NULL)
+        metrics_histogram_add(timed->histogram, timespec_sub(end, start));
+    timespec_accumulate(timed->elapsed, start, end);
+
+    errno = save_errno;
+    return fsevent;
+}
+
+static void
+timed_iter_destroy(void *iterator)
+{
+    struct timed_iterator *timed = iterator;
+
+    rbh_iter_destroy(timed->fsevents);
+    free(timed);
+}
+
+static const struct rbh_iterator_operations TIMED_ITER_OPS = {
+    .next = timed_iter_next,
+    .destroy = timed_iter_destroy,
+};
+
+static const struct rbh_iterator TIMED_ITERATOR = {
+    .ops = &TIMED_ITER_OPS,
+};
+
+struct rbh_iterator *
+metrics_iter_time(struct rbh_iterator *fsevents,
+                  struct metrics_histogram *histogram,
+                  struct timespec *elapsed)
+{
+    struct timed_iterator *timed;
+
+    timed = xmalloc(sizeof(*timed));
+    timed->iterator = TIMED_ITERATOR;
+    timed->fsevents = fsevents;
+    timed->histogram = histogram;
+    timed->elapsed = elapsed;
+
+    return &timed->iterator;
+}
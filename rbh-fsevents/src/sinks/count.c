@@ -0,0 +1,119 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "robinhood/fsevent.h"
+#include "robinhood/utils.h"
+
+#include "sink.h"
+
+#define FSEVENT_TYPE_COUNT (RBH_FET_XATTR + 1)
+
+static const char *FSEVENT_TYPE_NAMES[FSEVENT_TYPE_COUNT] = {
+    [RBH_FET_UPSERT] = "upsert",
+    [RBH_FET_LINK] = "link",
+    [RBH_FET_UNLINK] = "unlink",
+    [RBH_FET_PARTIAL_UNLINK] = "partial_unlink",
+    [RBH_FET_DELETE] = "delete",
+    [RBH_FET_XATTR] = "xattr",
+};
+
+struct count_sink {
+    struct sink sink;
+
+    uint64_t counts[FSEVENT_TYPE_COUNT];
+    FILE *file;
+};
+
+/* Each worker has a sink of its own, their tallies are added up and written
+ * once the last one is destroyed.
+ */
+static pthread_mutex_t totals_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t totals[FSEVENT_TYPE_COUNT];
+static size_t live_sinks;
+
+static int
+count_sink_process(void *_sink, struct rbh_iterator *fsevents)
+{
+    struct count_sink *sink = _sink;
+
+    while (true) {
+        const struct rbh_fsevent *fsevent;
+
+        fsevent = rbh_iter_next(fsevents);
+        if (fsevent == NULL)
+            break;
+
+        if (fsevent->type >= FSEVENT_TYPE_COUNT) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        sink->counts[fsevent->type]++;
+    }
+
+    return errno == ENODATA ? 0 : -1;
+}
+
+static void
+count_sink_destroy(void *_sink)
+{
+    struct count_sink *sink = _sink;
+    uint64_t total = 0;
+
+    pthread_mutex_lock(&totals_mutex);
+    for (size_t i = 0; i < FSEVENT_TYPE_COUNT; i++)
+        totals[i] += sink->counts[i];
+
+    if (--live_sinks == 0) {
+        for (size_t i = 0; i < FSEVENT_TYPE_COUNT; i++) {
+            fprintf(sink->file, "%s: %" PRIu64 "\n", FSEVENT_TYPE_NAMES[i],
+                    totals[i]);
+            total += totals[i];
+        }
+        fprintf(sink->file, "total: %" PRIu64 "\n", total);
+        fflush(sink->file);
+    }
+    pthread_mutex_unlock(&totals_mutex);
+
+    free(sink);
+}
+
+static const struct sink_operations COUNT_SINK_OPS = {
+    .process = count_sink_process,
+    .destroy = count_sink_destroy,
+};
+
+static const struct sink COUNT_SINK = {
+    .name = "count",
+    .ops = &COUNT_SINK_OPS,
+};
+
+struct sink *
+sink_from_count(FILE *file)
+{
+    struct count_sink *sink;
+
+    sink = xcalloc(1, sizeof(*sink));
+
+    sink->sink = COUNT_SINK;
+    sink->file = file;
+
+    pthread_mutex_lock(&totals_mutex);
+    live_sinks++;
+    pthread_mutex_unlock(&totals_mutex);
+
+    return &sink->sink;
+}
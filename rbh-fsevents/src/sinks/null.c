@@ -0,0 +1,53 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "robinhood/utils.h"
+
+#include "sink.h"
+
+static int
+null_sink_process(void *_sink, struct rbh_iterator *fsevents)
+{
+    /* The fsevents are still enriched as they are iterated over */
+    while (rbh_iter_next(fsevents) != NULL);
+
+    return errno == ENODATA ? 0 : -1;
+}
+
+static void
+null_sink_destroy(void *_sink)
+{
+    free(_sink);
+}
+
+static const struct sink_operations NULL_SINK_OPS = {
+    .process = null_sink_process,
+    .destroy = null_sink_destroy,
+};
+
+static const struct sink NULL_SINK = {
+    .name = "null",
+    .ops = &NULL_SINK_OPS,
+};
+
+struct sink *
+sink_from_null(void)
+{
+    struct sink *sink;
+
+    sink = xmalloc(sizeof(*sink));
+
+    *sink = NULL_SINK;
+    return sink;
+}
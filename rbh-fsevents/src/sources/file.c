@@ -97,6 +97,8 @@ static const struct source FILE_SOURCE = {
     },
     .save_batch = NULL,
     .ack_batch = NULL,
+    .position = NULL,
+    .metrics = NULL,
 };
 
 struct source *
@@ -29,7 +29,7 @@
  *  aren't done before acknowledging the changelog.
  */
 void lustre_changelog_save_batch(void *source, size_t ack_required,
-                                        bool dedup)
+                                 bool dedup, uint64_t held_position)
 {
     struct lustre_changelog_iterator *events;
     struct lustre_source *lustre = source;
@@ -68,6 +68,13 @@ void lustre_changelog_save_batch(void *source, size_t ack_required,
     else
         new_node->last_changelog_index = events->last_changelog_index;
 
+    /* Changelogs some fsevents of which are still held back in the
+     * deduplicator must not be acknowledged with this batch.
+     */
+    if (held_position != 0 &&
+        held_position - 1 < new_node->last_changelog_index)
+        new_node->last_changelog_index = held_position - 1;
+
     new_node->ack_required = ack_required;
 
     pthread_mutex_lock(&lustre->batch_lock);
@@ -79,7 +86,7 @@ void lustre_changelog_save_batch(void *source, size_t ack_required,
     events->curr_batch = new_node;
 }
 
-static int
+int
 lustre_changelog_set_last_read(void *iterator, uint64_t last_changelog_index,
                                struct sink *sink)
 {
@@ -155,12 +162,17 @@ void lustre_changelog_ack_batch(void *source, uint64_t batch_id,
          */
         if (elem->ack_required == 0 && can_clear) {
             rbh_list_del(&elem->link);
-            rc = llapi_changelog_clear(lustre->events.mdt_name,
+            /* Replayed changelogs are not the MDT's to clear anymore */
+            rc = lustre->events.replay ? 0 :
+                 llapi_changelog_clear(lustre->events.mdt_name,
                                        lustre->events.username,
                                        elem->last_changelog_index);
             if (rc < 0)
                 error(EXIT_FAILURE, errno, "llapi_changelog_clear");
 
+            atomic_store_explicit(&lustre->events.acknowledged_index,
+                                  elem->last_changelog_index,
+                                  memory_order_relaxed);
             rc = lustre_changelog_set_last_read(&lustre->events,
                                                 elem->last_changelog_index,
                                                 sink);
@@ -173,3 +185,193 @@ void lustre_changelog_ack_batch(void *source, uint64_t batch_id,
 
     pthread_mutex_unlock(&lustre->batch_lock);
 }
+
+uint64_t lustre_changelog_position(void *source)
+{
+    struct lustre_source *lustre = source;
+
+    return lustre->events.last_changelog_index;
+}
+
+static void
+changelog_iter_metrics(struct lustre_changelog_iterator *events,
+                       struct source_metrics *metrics)
+{
+    uint64_t received_index, acknowledged_index;
+
+    metrics->read += atomic_load_explicit(&events->received,
+                                          memory_order_relaxed);
+    if (events->username == NULL)
+        return;
+
+    received_index = atomic_load_explicit(&events->received_index,
+                                          memory_order_relaxed);
+    acknowledged_index = atomic_load_explicit(&events->acknowledged_index,
+                                              memory_order_relaxed);
+    metrics->ack = true;
+    if (received_index > acknowledged_index)
+        metrics->ack_lag += received_index - acknowledged_index;
+}
+
+void lustre_changelog_metrics(void *source, struct source_metrics *metrics)
+{
+    struct lustre_source *lustre = source;
+
+    changelog_iter_metrics(&lustre->events, metrics);
+}
+
+/** With several MDTs, the changelogs of each MDT are acknowledged the same way,
+ *  but a batch records the last changelog index of every MDT.
+ *
+ *  The fsevents of a changelog may be split between two batches, and the last
+ *  fsevent read by the deduplicator is not part of the batch. Only the
+ *  changelogs all the fsevents of which are in this batch or an older one are
+ *  saved with it.
+ *
+ *  Since the MDTs are read concurrently, the position of a fsevent in the
+ *  merged stream says nothing of its changelog index. A checkpoint of the
+ *  indexes is kept with each batch, so that when some fsevents are held back
+ *  in the deduplicator, the indexes can be rolled back to the last checkpoint
+ *  before the first of them.
+ */
+void lustre_mdts_save_batch(void *source, size_t ack_required, bool dedup,
+                            uint64_t held_position)
+{
+    struct lustre_mdts_source *mdts = source;
+    struct mdts_checkpoint *checkpoint = NULL;
+    struct mdts_checkpoint *new_checkpoint;
+    struct mdts_checkpoint *elem, *tmp;
+    struct mdts_batch_node *new_node;
+    size_t indexes_size;
+    bool read_ahead;
+
+    if (mdts->username == NULL)
+        return;
+
+    indexes_size = mdts->mdt_count * sizeof(uint64_t);
+    new_node = xmalloc(sizeof(*new_node) + indexes_size);
+    new_node->batch_id = mdts->batch_id;
+    new_node->ack_required = ack_required;
+
+    read_ahead = dedup && !mdts->empty && mdts->position > 0;
+    new_checkpoint = xmalloc(sizeof(*new_checkpoint) + indexes_size);
+    new_checkpoint->position = mdts->position - (read_ahead ? 1 : 0);
+
+    for (size_t i = 0; i < mdts->mdt_count; i++) {
+        struct lustre_mdt *mdt = &mdts->mdts[i];
+        uint64_t index = mdt->last_index;
+
+        if (index > 0 &&
+            (!mdt->last_complete || (read_ahead && i == mdts->current_mdt)))
+            index--;
+
+        new_checkpoint->last_changelog_indexes[i] = index;
+    }
+
+    if (held_position != 0) {
+        rbh_list_foreach(&mdts->checkpoints, elem, link) {
+            if (elem->position >= held_position)
+                break;
+            checkpoint = elem;
+        }
+    }
+
+    /* Checkpoints older than the one used will not be needed anymore */
+    if (held_position == 0 || checkpoint != NULL) {
+        rbh_list_foreach_safe(&mdts->checkpoints, elem, tmp, link) {
+            if (elem == checkpoint)
+                break;
+
+            rbh_list_del(&elem->link);
+            free(elem);
+        }
+    }
+
+    for (size_t i = 0; i < mdts->mdt_count; i++) {
+        struct lustre_mdt *mdt = &mdts->mdts[i];
+        uint64_t index = new_checkpoint->last_changelog_indexes[i];
+
+        if (held_position != 0 && checkpoint == NULL)
+            index = mdt->last_batch_index;
+        else if (held_position != 0 &&
+                 checkpoint->last_changelog_indexes[i] < index)
+            index = checkpoint->last_changelog_indexes[i];
+
+        if (index <= mdt->last_batch_index) {
+            new_node->last_changelog_indexes[i] = 0;
+        } else {
+            new_node->last_changelog_indexes[i] = index;
+            mdt->last_batch_index = index;
+        }
+    }
+
+    rbh_list_add_tail(&mdts->checkpoints, &new_checkpoint->link);
+
+    pthread_mutex_lock(&mdts->batch_lock);
+    rbh_list_add_tail(&mdts->batch_list, &new_node->link);
+    pthread_mutex_unlock(&mdts->batch_lock);
+
+    mdts->batch_id++;
+}
+
+void lustre_mdts_ack_batch(void *source, uint64_t batch_id, struct sink *sink)
+{
+    struct lustre_mdts_source *mdts = source;
+    struct mdts_batch_node *elem, *tmp;
+    bool can_clear = true;
+    int rc;
+
+    if (mdts->username == NULL)
+        return;
+
+    pthread_mutex_lock(&mdts->batch_lock);
+
+    /* Same as lustre_changelog_ack_batch(), for each MDT */
+    rbh_list_foreach_safe(&mdts->batch_list, elem, tmp, link) {
+        if (elem->ack_required > 0 && elem->batch_id < batch_id)
+            can_clear = false;
+
+        if (elem->batch_id > batch_id && elem->ack_required > 0)
+            break;
+
+        if (elem->batch_id == batch_id)
+            elem->ack_required--;
+
+        if (elem->ack_required > 0 || !can_clear)
+            continue;
+
+        rbh_list_del(&elem->link);
+        for (size_t i = 0; i < mdts->mdt_count; i++) {
+            struct lustre_changelog_iterator *events;
+            uint64_t index = elem->last_changelog_indexes[i];
+
+            if (index == 0)
+                continue;
+
+            events = &mdts->mdts[i].lustre->events;
+            rc = events->replay ? 0 :
+                 llapi_changelog_clear(events->mdt_name, events->username,
+                                       index);
+            if (rc < 0)
+                error(EXIT_FAILURE, errno, "llapi_changelog_clear");
+
+            atomic_store_explicit(&events->acknowledged_index, index,
+                                  memory_order_relaxed);
+            rc = lustre_changelog_set_last_read(events, index, sink);
+            if (rc < 0)
+                error(EXIT_FAILURE, -rc,
+                      "Failed to set last changelog read in info");
+        }
+        free(elem);
+    }
+
+    pthread_mutex_unlock(&mdts->batch_lock);
+}
+
+void lustre_mdts_metrics(void *source, struct source_metrics *metrics)
+{
+    struct lustre_mdts_source *mdts = source;
+
+    for (size_t i = 0; i < mdts->mdt_count; i++)
+        changelog_iter_metrics(&mdts->mdts[i].lustre->events, metrics);
+}
@@ -15,6 +15,7 @@
 #include <error.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <lustre/lustreapi.h>
 #include <linux/lustre/lustre_fid.h>
@@ -22,9 +23,14 @@
 #include <robinhood/utils.h>
 
 #include "lustre.h"
+#include "lustre_utils.h"
 
 #include "source.h"
 #include "utils.h"
+#include "work_queue.h"
+
+/* Number of changelogs received ahead of their conversion to fsevents */
+#define CHANGELOG_READ_AHEAD 4096
 
 static const struct rbh_iterator_operations LUSTRE_CHANGELOG_ITER_OPS = {
     .next = lustre_changelog_iter_next,
@@ -65,10 +71,53 @@ lustre_changelog_get_start_idx(struct lustre_changelog_iterator *events,
     return last_read->uint64;
 }
 
+FILE *
+lustre_open_dump_file(const char *dump_file)
+{
+    FILE *file;
+
+    if (dump_file == NULL)
+        return NULL;
+
+    if (strcmp(dump_file, "-") == 0)
+        return stdout;
+
+    file = fopen(dump_file, "a");
+    if (file == NULL)
+        error(EXIT_FAILURE, errno, "Failed to open the dump file");
+
+    return file;
+}
+
+int
+lustre_changelog_start(struct lustre_changelog_iterator *events,
+                       int64_t start_index)
+{
+    int rc;
+
+    rc = llapi_changelog_start(&events->reader,
+                               CHANGELOG_FLAG_JOBID |
+                               CHANGELOG_FLAG_EXTRA_FLAGS,
+                               events->mdt_name, start_index);
+    if (rc < 0)
+        return rc;
+
+    rc = llapi_changelog_set_xflags(events->reader,
+                                    CHANGELOG_EXTRA_FLAG_UIDGID |
+                                    CHANGELOG_EXTRA_FLAG_NID |
+                                    CHANGELOG_EXTRA_FLAG_OMODE |
+                                    CHANGELOG_EXTRA_FLAG_XATTR);
+    if (rc < 0)
+        llapi_changelog_fini(&events->reader);
+
+    return rc < 0 ? rc : 0;
+}
+
 static void
 lustre_changelog_iter_init(struct lustre_changelog_iterator *events,
-                           const char *username, const char *dump_file,
-                           uint64_t max_changelog,
+                           const char *username, FILE *dump_file,
+                           uint64_t max_changelog, bool changelog_statx,
+                           uint64_t follow,
                            struct rbh_fsevents_metadata *fsevents_md,
                            struct sink *sink)
 {
@@ -77,15 +126,36 @@ lustre_changelog_iter_init(struct lustre_changelog_iterator *events,
 
     events->fsevents_md = fsevents_md;
     events->max_changelog = max_changelog;
+    events->changelog_statx = changelog_statx;
+    events->follow = follow;
     events->fsevents_md->changelog_read = 0;
     events->sink = sink;
     events->empty = false;
+    events->reader = NULL;
+    events->replay = NULL;
+    atomic_init(&events->received, 0);
+    atomic_init(&events->received_index, 0);
+    atomic_init(&events->acknowledged_index, 0);
+
+    /* A path to a file written with --dump stands in for the MDT the
+     * changelogs in it were read from.
+     */
+    if (strchr(fsevents_md->source_read, '/')) {
+        events->replay = fopen(fsevents_md->source_read, "r");
+        if (events->replay == NULL)
+            error(EXIT_FAILURE, errno, "%s", fsevents_md->source_read);
+
+        events->mdt_name = changelog_replay_mdt_name(events->replay);
+        if (events->mdt_name == NULL)
+            error(EXIT_FAILURE, errno, "%s", fsevents_md->source_read);
+    } else {
+        events->mdt_name = xstrdup(fsevents_md->source_read);
+    }
 
     if (fsevents_md->start_index < 0) {
         uint64_t db_index = 0;
 
-        db_index = lustre_changelog_get_start_idx(events,
-                                                  fsevents_md->source_read);
+        db_index = lustre_changelog_get_start_idx(events, events->mdt_name);
         events->last_changelog_index = db_index;
         events->last_batch_changelog_index = db_index;
         fsevents_md->start_index = (db_index == 0 ? 0 : db_index + 1);
@@ -94,45 +164,36 @@ lustre_changelog_iter_init(struct lustre_changelog_iterator *events,
         events->last_batch_changelog_index = fsevents_md->start_index;
     }
 
-    rc = llapi_changelog_start(&events->reader,
-                               CHANGELOG_FLAG_JOBID |
-                               CHANGELOG_FLAG_EXTRA_FLAGS,
-                               fsevents_md->source_read,
-                               fsevents_md->start_index);
-    if (rc < 0)
-        error(EXIT_FAILURE, -rc, "llapi_changelog_start");
-
-    rc = llapi_changelog_set_xflags(events->reader,
-                                    CHANGELOG_EXTRA_FLAG_UIDGID |
-                                    CHANGELOG_EXTRA_FLAG_NID |
-                                    CHANGELOG_EXTRA_FLAG_OMODE |
-                                    CHANGELOG_EXTRA_FLAG_XATTR);
-    if (rc < 0)
-        error(EXIT_FAILURE, -rc, "llapi_changelog_set_xflags");
+    if (events->replay == NULL) {
+        rc = lustre_changelog_start(events, fsevents_md->start_index);
+        if (rc < 0)
+            error(EXIT_FAILURE, -rc, "failed to read the changelogs of %s",
+                  events->mdt_name);
+    }
 
     events->iterator = LUSTRE_CHANGELOG_ITERATOR;
     events->fsevents_iterator = NULL;
 
     events->username = xstrdup_safe(username);
-    events->mdt_name = xstrdup(fsevents_md->source_read);
 
-    for (mdtname_index =
-            fsevents_md->source_read + strlen(fsevents_md->source_read) - 1;
+    for (mdtname_index = events->mdt_name + strlen(events->mdt_name) - 1;
          isdigit(*mdtname_index); mdtname_index--);
 
     rc = str2int64_t(++mdtname_index, (int64_t *) &events->source_mdt_index);
     if (rc)
         error(EXIT_FAILURE, errno, "str2int64_t");
 
-    if (dump_file == NULL) {
-        events->dump_file = NULL;
-    } else if (strcmp(dump_file, "-") == 0) {
-        events->dump_file = stdout;
-    } else {
-        events->dump_file = fopen(dump_file, "a");
-        if (events->dump_file == NULL)
-            error(EXIT_FAILURE, errno, "Failed to open the dump file");
-    }
+    events->dump_file = dump_file;
+
+    /* Receive the changelogs on a thread of their own, so that converting
+     * them to fsevents and deduplicating those never waits for the MDT.
+     */
+    events->read_ahead = work_queue_new(1, CHANGELOG_READ_AHEAD, 1);
+    events->read_ahead_rc = 1;
+    rc = pthread_create(&events->read_ahead_thread, NULL,
+                        lustre_changelog_read_ahead, events);
+    if (rc)
+        error(EXIT_FAILURE, rc, "pthread_create");
 }
 
 static const void *
@@ -167,27 +228,51 @@ static const struct source LUSTRE_SOURCE = {
     },
     .save_batch = lustre_changelog_save_batch,
     .ack_batch = lustre_changelog_ack_batch,
+    .position = lustre_changelog_position,
+    .metrics = lustre_changelog_metrics,
 };
 
-struct source *
-source_from_lustre_changelog(const char *username, const char *dump_file,
-                             uint64_t max_changelog,
-                             struct rbh_fsevents_metadata *fsevents_md,
-                             struct sink *sink)
+struct lustre_source *
+lustre_source_new(const char *username, FILE *dump_file,
+                  uint64_t max_changelog, bool changelog_statx,
+                  uint64_t follow, struct rbh_fsevents_metadata *fsevents_md,
+                  struct sink *sink)
 {
     struct lustre_source *source;
 
     source = xmalloc(sizeof(*source));
 
     lustre_changelog_iter_init(&source->events, username, dump_file,
-                               max_changelog, fsevents_md, sink);
+                               max_changelog, changelog_statx, follow,
+                               fsevents_md, sink);
 
-    initialize_source_stack(sizeof(struct rbh_value_pair) * (1 << 7));
     source->batch_list = xmalloc(sizeof(*source->batch_list));
     rbh_list_init(source->batch_list);
     source->batch_id = 1;
     pthread_mutex_init(&source->batch_lock, NULL);
     source->source = LUSTRE_SOURCE;
 
+    return source;
+}
+
+struct source *
+source_from_lustre_changelog(const char *username, const char *dump_file,
+                             uint64_t max_changelog, bool changelog_statx,
+                             uint64_t follow,
+                             struct rbh_fsevents_metadata *fsevents_md,
+                             struct sink *sink)
+{
+    struct lustre_source *source;
+
+    if (strchr(fsevents_md->source_read, ','))
+        return source_from_lustre_mdts(username, dump_file, max_changelog,
+                                       changelog_statx, follow, fsevents_md,
+                                       sink);
+
+    source = lustre_source_new(username, lustre_open_dump_file(dump_file),
+                               max_changelog, changelog_statx, follow,
+                               fsevents_md, sink);
+    initialize_source_stack(sizeof(struct rbh_value_pair) * (1 << 7));
+
     return &source->source;
 }
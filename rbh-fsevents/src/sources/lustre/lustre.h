@@ -8,7 +8,9 @@
 #ifndef RBH_FSEVENTS_SOURCE_LUSTRE_H
 #define RBH_FSEVENTS_SOURCE_LUSTRE_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <pthread.h>
 
 #include <robinhood/list.h>
@@ -33,6 +35,13 @@ struct lustre_changelog_iterator {
     struct rbh_iterator iterator;
 
     void *reader;
+    /* A file written with --dump read instead of the MDT, NULL otherwise */
+    FILE *replay;
+    /* Changelogs received by the read-ahead thread, not converted yet */
+    struct work_queue *read_ahead;
+    pthread_t read_ahead_thread;
+    /* Why the read-ahead thread stopped, as returned by changelog_recv() */
+    int read_ahead_rc;
     struct sink *sink;
     struct rbh_iterator *fsevents_iterator;
 
@@ -42,8 +51,25 @@ struct lustre_changelog_iterator {
     uint64_t last_changelog_index;
     uint64_t last_batch_changelog_index;
     uint64_t max_changelog;
+    /* Take the statx fields a changelog provides from it instead of
+     * enriching them
+     */
+    bool changelog_statx;
+    /* Once the MDT is drained, wait for new changelogs instead of stopping,
+     * and give up after that many milliseconds for the caller to flush what
+     * it read so far. 0 to stop once the MDT is drained.
+     */
+    uint64_t follow;
     bool empty;
 
+    /* For the live metrics, the changelogs received by the read-ahead thread
+     * and the index of the last one, only written by that thread, and the
+     * index of the last changelog acknowledged
+     */
+    _Atomic uint64_t received;
+    _Atomic uint64_t received_index;
+    _Atomic uint64_t acknowledged_index;
+
     /* Only use without dedup, it's a reference to the current batch in the
      * list of batches saved to avoid iterating over the list each times.
      */
@@ -65,12 +91,139 @@ struct lustre_source {
     struct lustre_changelog_iterator events;
 };
 
+/** A fsevent read from one of the MDTs of a lustre_mdts_source */
+struct mdt_fsevent {
+    struct rbh_fsevent *fsevent;
+    uint64_t index;                /** Index of the changelog the fsevent
+                                    *  comes from
+                                    */
+    bool last;                     /** Whether it is the last fsevent of its
+                                    *  changelog
+                                    */
+};
+
+/** One of the MDTs read by a lustre_mdts_source */
+struct lustre_mdt {
+    struct lustre_mdts_source *mdts;
+    /** Only used by the reader thread once it is started */
+    struct lustre_source *lustre;
+    struct rbh_fsevents_metadata fsevents_md;
+    pthread_t reader;
+    /** errno of the reader thread if it failed, 0 otherwise */
+    int error;
+
+    /** Changelog of the last fsevent handed over to the deduplicator, and
+     *  whether that fsevent was the last one of the changelog
+     */
+    uint64_t last_index;
+    bool last_complete;
+    /** Last changelog index saved with a batch */
+    uint64_t last_batch_index;
+};
+
+/** Same as source_batch_node, with the last changelog index of each MDT, 0 if
+ *  there is nothing to acknowledge on that MDT
+ */
+struct mdts_batch_node {
+    struct rbh_list_node link;
+    uint64_t batch_id;
+    size_t ack_required;
+    uint64_t last_changelog_indexes[];
+};
+
+/** The last changelog index of each MDT complete once the fsevents up to
+ *  position were read
+ */
+struct mdts_checkpoint {
+    struct rbh_list_node link;
+    uint64_t position;
+    uint64_t last_changelog_indexes[];
+};
+
+/** Several MDTs read concurrently, each by its own thread, and merged into a
+ *  single stream of fsevents
+ */
+struct lustre_mdts_source {
+    struct source source;
+
+    struct lustre_mdt *mdts;
+    size_t mdt_count;
+    /** One shard per MDT, only pushed to by the reader thread of the MDT */
+    struct work_queue *queue;
+    /** Number of reader threads still running */
+    atomic_size_t running;
+
+    /** Last fsevent handed over, freed when the next one is */
+    struct mdt_fsevent *current;
+    size_t current_mdt;
+    /** Number of fsevents handed over so far */
+    uint64_t position;
+    bool empty;
+    /** Same as lustre_changelog_iterator.follow */
+    uint64_t follow;
+
+    char *username;
+    FILE *dump_file;
+    struct rbh_fsevents_metadata *fsevents_md;
+
+    /** List of all the batch sent to enrichment */
+    struct rbh_list_node batch_list;
+    pthread_mutex_t batch_lock;
+    /** Current batch id */
+    uint64_t batch_id;
+    /** Only used with held back fsevents, oldest first */
+    struct rbh_list_node checkpoints;
+};
+
+struct lustre_source *
+lustre_source_new(const char *username, FILE *dump_file,
+                  uint64_t max_changelog, bool changelog_statx,
+                  uint64_t follow, struct rbh_fsevents_metadata *fsevents_md,
+                  struct sink *sink);
+
+/* Start reading the changelogs of the MDT from start_index, returns 0 on
+ * success or a negative errno like llapi_changelog_start()
+ */
+int
+lustre_changelog_start(struct lustre_changelog_iterator *events,
+                       int64_t start_index);
+
+FILE *
+lustre_open_dump_file(const char *dump_file);
+
+struct source *
+source_from_lustre_mdts(const char *username, const char *dump_file,
+                        uint64_t max_changelog, bool changelog_statx,
+                        uint64_t follow,
+                        struct rbh_fsevents_metadata *fsevents_md,
+                        struct sink *sink);
+
+int
+lustre_changelog_set_last_read(void *iterator, uint64_t last_changelog_index,
+                               struct sink *sink);
+
 void lustre_changelog_save_batch(void *source, size_t ack_required,
-                                 bool dedup);
+                                 bool dedup, uint64_t held_position);
 
 void lustre_changelog_ack_batch(void *source, uint64_t batch_id,
                                 struct sink *sink);
 
+uint64_t lustre_changelog_position(void *source);
+
+void lustre_changelog_metrics(void *source, struct source_metrics *metrics);
+
+void lustre_mdts_save_batch(void *source, size_t ack_required, bool dedup,
+                            uint64_t held_position);
+
+void lustre_mdts_ack_batch(void *source, uint64_t batch_id, struct sink *sink);
+
+uint64_t lustre_mdts_position(void *source);
+
+void lustre_mdts_metrics(void *source, struct source_metrics *metrics);
+
+void *
+lustre_changelog_read_ahead(void *iterator);
+
 const void *
 lustre_changelog_iter_next(void *iterator);
 
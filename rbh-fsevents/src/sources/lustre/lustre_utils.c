@@ -395,6 +395,34 @@ dump_changelog(struct lustre_changelog_iterator *records,
         }
     }
 
+    /* The extra fields rbh-fsevents uses, for the dump to be replayed */
+    if (left > 0 && record->cr_flags & CLF_EXTRA_FLAGS) {
+        uint64_t extra_flags;
+
+        extra_flags = changelog_rec_extra_flags(record)->cr_extra_flags;
+        if (extra_flags & CLFE_UIDGID) {
+            struct changelog_ext_uidgid *uidgid;
+
+            uidgid = changelog_rec_uidgid(record);
+            len = snprintf(curr, left, " u=%llu:%llu",
+                           (unsigned long long) uidgid->cr_uid,
+                           (unsigned long long) uidgid->cr_gid);
+            curr += len;
+            left -= len;
+        }
+
+        if (left > 0 && extra_flags & CLFE_XATTR) {
+            struct changelog_ext_xattr *xattr;
+
+            xattr = changelog_rec_xattr(record);
+            if (xattr->cr_xattr[0] != '\0') {
+                len = snprintf(curr, left, " x=%s", xattr->cr_xattr);
+                curr += len;
+                left -= len;
+            }
+        }
+    }
+
     if (left <= 0)
         record_str[RBH_PATH_MAX - 1] = '\0';
 
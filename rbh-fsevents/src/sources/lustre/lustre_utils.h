@@ -76,4 +76,20 @@ void
 dump_changelog(struct lustre_changelog_iterator *records,
                struct changelog_rec *record);
 
+/* Return the name of the MDT the changelogs dumped in \p file were read from,
+ * NULL if there is none
+ */
+char *
+changelog_replay_mdt_name(FILE *file);
+
+/* Read the next changelog dumped in \p file whose index is at least \p start,
+ * the same way llapi_changelog_recv() would read it from an MDT.
+ *
+ * Returns 0 on success, 1 if there is nothing left to read, and a negative
+ * error code otherwise. The record must be freed with free().
+ */
+int
+changelog_replay_recv(FILE *file, int64_t start,
+                      struct changelog_rec **record);
+
 #endif
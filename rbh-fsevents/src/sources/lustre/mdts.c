@@ -0,0 +1,344 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+
+#include <robinhood/fsevent.h>
+#include <robinhood/utils.h>
+
+#include "lustre.h"
+
+#include "utils.h"
+#include "work_queue.h"
+
+/* Number of fsevents each reader thread can read ahead of the deduplicator */
+#define MDT_READ_AHEAD 1024
+
+static void
+mdt_fsevent_free(void *item)
+{
+    struct mdt_fsevent *mdt_fsevent = item;
+
+    free(mdt_fsevent->fsevent);
+    free(mdt_fsevent);
+}
+
+static struct mdt_fsevent *
+mdt_fsevent_new(const struct rbh_fsevent *fsevent, uint64_t index)
+{
+    struct mdt_fsevent *mdt_fsevent;
+
+    mdt_fsevent = xmalloc(sizeof(*mdt_fsevent));
+    /* The fsevent lives on the source stack of the reader thread, which is
+     * reused as soon as the next one is read.
+     */
+    mdt_fsevent->fsevent = rbh_fsevent_clone(fsevent);
+    mdt_fsevent->index = index;
+    mdt_fsevent->last = false;
+
+    return mdt_fsevent;
+}
+
+static void
+mdt_reader_stop(struct lustre_mdt *mdt)
+{
+    /* The last reader out lets the consumer know there is nothing left */
+    if (atomic_fetch_sub(&mdt->mdts->running, 1) == 1)
+        work_queue_close(mdt->mdts->queue);
+}
+
+static void *
+mdt_reader(void *arg)
+{
+    struct lustre_mdt *mdt = arg;
+    struct lustre_mdts_source *mdts = mdt->mdts;
+    struct lustre_changelog_iterator *events = &mdt->lustre->events;
+    size_t shard = mdt - mdts->mdts;
+    struct mdt_fsevent *pending = NULL;
+
+    initialize_source_stack(sizeof(struct rbh_value_pair) * (1 << 7));
+
+    while (true) {
+        const struct rbh_fsevent *fsevent;
+
+        fsevent = rbh_iter_next(&mdt->lustre->source.fsevents);
+        if (fsevent == NULL && errno == ETIMEDOUT) {
+            /* Nothing new on the MDT, so the changelog of the pending fsevent
+             * is complete, hand it over right away.
+             */
+            if (pending) {
+                pending->last = true;
+                if (!work_queue_push(mdts->queue, shard, pending)) {
+                    mdt_fsevent_free(pending);
+                    pending = NULL;
+                    break;
+                }
+                pending = NULL;
+            }
+
+            if (work_queue_closed(mdts->queue))
+                break;
+            continue;
+        }
+
+        if (fsevent == NULL) {
+            if (errno != ENODATA) {
+                mdt->error = errno;
+                work_queue_close(mdts->queue);
+                break;
+            }
+
+            if (pending) {
+                pending->last = true;
+                if (!work_queue_push(mdts->queue, shard, pending))
+                    mdt_fsevent_free(pending);
+                pending = NULL;
+            }
+            break;
+        }
+
+        /* A fsevent is only known to be the last one of its changelog once
+         * the first fsevent of the next changelog is read.
+         */
+        if (pending) {
+            pending->last = pending->index != events->last_changelog_index;
+            if (!work_queue_push(mdts->queue, shard, pending)) {
+                mdt_fsevent_free(pending);
+                pending = NULL;
+                break;
+            }
+        }
+
+        pending = mdt_fsevent_new(fsevent, events->last_changelog_index);
+    }
+
+    if (pending)
+        mdt_fsevent_free(pending);
+
+    destroy_source_stack();
+    mdt_reader_stop(mdt);
+
+    return NULL;
+}
+
+static void
+mdts_count_changelogs(struct lustre_mdts_source *mdts)
+{
+    mdts->fsevents_md->changelog_read = 0;
+    for (size_t i = 0; i < mdts->mdt_count; i++)
+        mdts->fsevents_md->changelog_read +=
+            mdts->mdts[i].fsevents_md.changelog_read;
+}
+
+static const void *
+mdts_iter_next(void *iterator)
+{
+    struct lustre_mdts_source *mdts = iterator;
+    struct timespec start, end, deadline;
+    struct lustre_mdt *mdt;
+    size_t shard;
+
+    if (mdts->current) {
+        mdt_fsevent_free(mdts->current);
+        mdts->current = NULL;
+    }
+
+    /* The consumer is the only worker of the queue, it does not need to hold
+     * the shard of the fsevent once it is popped.
+     */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (mdts->follow) {
+        deadline = timespec_add(start, ms2timespec(mdts->follow));
+        mdts->current = work_queue_timedpop(mdts->queue, 0, &shard, &deadline);
+    } else {
+        mdts->current = work_queue_pop(mdts->queue, 0, &shard);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timespec_accumulate(&mdts->fsevents_md->time_spent_waiting_changelogs,
+                        start, end);
+
+    if (mdts->current == NULL && mdts->follow && errno == ETIMEDOUT) {
+        /* Nothing new on any MDT yet */
+        mdts->empty = true;
+        mdts_count_changelogs(mdts);
+        errno = ETIMEDOUT;
+        return NULL;
+    }
+
+    if (mdts->current == NULL) {
+        mdts->empty = true;
+        mdts_count_changelogs(mdts);
+        errno = ENODATA;
+
+        for (size_t i = 0; i < mdts->mdt_count; i++) {
+            if (mdts->mdts[i].error && errno == ENODATA)
+                errno = mdts->mdts[i].error;
+        }
+
+        return NULL;
+    }
+    work_queue_release(mdts->queue, shard);
+
+    mdt = &mdts->mdts[shard];
+    mdt->last_index = mdts->current->index;
+    mdt->last_complete = mdts->current->last;
+    mdts->current_mdt = shard;
+    mdts->position++;
+    mdts->empty = false;
+
+    return mdts->current->fsevent;
+}
+
+static void
+mdts_iter_destroy(void *iterator)
+{
+    struct lustre_mdts_source *mdts = iterator;
+    struct mdts_checkpoint *checkpoint, *next_checkpoint;
+    struct mdts_batch_node *elem, *tmp;
+
+    /* Readers blocked on a full shard give up once the queue is closed */
+    work_queue_close(mdts->queue);
+    for (size_t i = 0; i < mdts->mdt_count; i++)
+        pthread_join(mdts->mdts[i].reader, NULL);
+
+    work_queue_destroy(mdts->queue, mdt_fsevent_free);
+    if (mdts->current)
+        mdt_fsevent_free(mdts->current);
+
+    for (size_t i = 0; i < mdts->mdt_count; i++) {
+        /* The dump file is shared by all the MDTs, it is closed below */
+        mdts->mdts[i].lustre->events.dump_file = NULL;
+        rbh_iter_destroy(&mdts->mdts[i].lustre->source.fsevents);
+        free((char *)mdts->mdts[i].fsevents_md.source_read);
+    }
+
+    if (mdts->dump_file != NULL && mdts->dump_file != stdout)
+        fclose(mdts->dump_file);
+
+    rbh_list_foreach_safe(&mdts->batch_list, elem, tmp, link)
+        free(elem);
+
+    rbh_list_foreach_safe(&mdts->checkpoints, checkpoint, next_checkpoint,
+                          link)
+        free(checkpoint);
+
+    pthread_mutex_destroy(&mdts->batch_lock);
+    free(mdts->username);
+    free(mdts->mdts);
+    free(mdts);
+}
+
+static const struct rbh_iterator_operations MDTS_ITER_OPS = {
+    .next = mdts_iter_next,
+    .destroy = mdts_iter_destroy,
+};
+
+static const struct source LUSTRE_MDTS_SOURCE = {
+    .name = "lustre",
+    .fsevents = {
+        .ops = &MDTS_ITER_OPS,
+    },
+    .save_batch = lustre_mdts_save_batch,
+    .ack_batch = lustre_mdts_ack_batch,
+    .position = lustre_mdts_position,
+    .metrics = lustre_mdts_metrics,
+};
+
+struct source *
+source_from_lustre_mdts(const char *username, const char *dump_file,
+                        uint64_t max_changelog, bool changelog_statx,
+                        uint64_t follow,
+                        struct rbh_fsevents_metadata *fsevents_md,
+                        struct sink *sink)
+{
+    struct lustre_mdts_source *mdts;
+    char *source_read;
+    char *saveptr;
+    size_t count;
+    char *mdt;
+    int rc;
+
+    if (fsevents_md->start_index >= 0)
+        error(EX_USAGE, 0, "--index cannot be used with several MDTs");
+
+    source_read = xstrdup(fsevents_md->source_read);
+    count = 1;
+    for (const char *c = source_read; *c; c++)
+        if (*c == ',')
+            count++;
+
+    mdts = xcalloc(1, sizeof(*mdts));
+    mdts->mdts = xcalloc(count, sizeof(*mdts->mdts));
+    mdts->username = xstrdup_safe(username);
+    mdts->dump_file = lustre_open_dump_file(dump_file);
+    mdts->fsevents_md = fsevents_md;
+    mdts->follow = follow;
+    mdts->source = LUSTRE_MDTS_SOURCE;
+    rbh_list_init(&mdts->batch_list);
+    rbh_list_init(&mdts->checkpoints);
+    pthread_mutex_init(&mdts->batch_lock, NULL);
+    mdts->batch_id = 1;
+
+    fsevents_md->start_index = -1;
+    for (mdt = strtok_r(source_read, ",", &saveptr); mdt != NULL;
+         mdt = strtok_r(NULL, ",", &saveptr)) {
+        struct lustre_mdt *lustre_mdt = &mdts->mdts[mdts->mdt_count++];
+        struct rbh_fsevents_metadata *mdt_md = &lustre_mdt->fsevents_md;
+        struct lustre_changelog_iterator *events;
+
+        /* Each MDT has its own start index and count of changelogs read */
+        *mdt_md = *fsevents_md;
+        mdt_md->source_read = xstrdup(mdt);
+        mdt_md->start_index = -1;
+
+        lustre_mdt->mdts = mdts;
+        lustre_mdt->lustre = lustre_source_new(username, mdts->dump_file,
+                                               max_changelog, changelog_statx,
+                                               follow, mdt_md, sink);
+        events = &lustre_mdt->lustre->events;
+        lustre_mdt->last_index = events->last_changelog_index;
+        lustre_mdt->last_batch_index = events->last_changelog_index;
+        lustre_mdt->last_complete = true;
+
+        if (fsevents_md->start_index < 0 ||
+            mdt_md->start_index < fsevents_md->start_index)
+            fsevents_md->start_index = mdt_md->start_index;
+    }
+    free(source_read);
+
+    if (mdts->mdt_count == 0)
+        error(EX_USAGE, 0, "no MDT to read changelogs from");
+
+    mdts->queue = work_queue_new(mdts->mdt_count, MDT_READ_AHEAD, 1);
+    atomic_init(&mdts->running, mdts->mdt_count);
+
+    for (size_t i = 0; i < mdts->mdt_count; i++) {
+        rc = pthread_create(&mdts->mdts[i].reader, NULL, mdt_reader,
+                            &mdts->mdts[i]);
+        if (rc)
+            error(EXIT_FAILURE, rc, "pthread_create");
+    }
+
+    return &mdts->source;
+}
+
+uint64_t
+lustre_mdts_position(void *source)
+{
+    struct lustre_mdts_source *mdts = source;
+
+    return mdts->position;
+}
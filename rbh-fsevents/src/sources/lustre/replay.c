@@ -0,0 +1,259 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <robinhood/utils.h>
+
+#include "lustre_utils.h"
+
+/* Changelogs read back from a dump have the same extensions as the ones
+ * llapi_changelog_recv() returns to rbh-fsevents. Only the fields written by
+ * dump_changelog() are set, the other ones are zeroed.
+ */
+#define REPLAY_FLAGS (CLF_VERSION | CLF_RENAME | CLF_JOBID | CLF_EXTRA_FLAGS)
+#define REPLAY_EXTRA_FLAGS (CLFE_UIDGID | CLFE_NID | CLFE_OPEN | CLFE_XATTR)
+
+char *
+changelog_replay_mdt_name(FILE *file)
+{
+    size_t size = 0;
+    char *line = NULL;
+    char *colon;
+    char *name;
+
+    if (getline(&line, &size, file) < 0) {
+        if (!ferror(file))
+            errno = ENODATA;
+        free(line);
+        return NULL;
+    }
+
+    colon = strchr(line, ':');
+    if (colon == NULL) {
+        free(line);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    name = xstrndup(line, colon - line);
+    free(line);
+    rewind(file);
+
+    return name;
+}
+
+/* Parse " <key>[<fid>]" at the start of \p string, return a pointer to what
+ * follows it, or NULL if \p string does not start with such a fid.
+ */
+static const char *
+parse_fid(const char *string, const char *key, struct lu_fid *fid)
+{
+    unsigned long long seq;
+    size_t keylen = strlen(key);
+    unsigned int oid;
+    unsigned int ver;
+    int length = -1;
+
+    if (string[0] != ' ' || strncmp(string + 1, key, keylen))
+        return NULL;
+
+    /* Do not expect "0x" prefixes, DFID prints a sequence of 0 as "0" */
+    string += 1 + keylen;
+    if (sscanf(string, "[%llx:%x:%x]%n", &seq, &oid, &ver, &length) < 3 ||
+        length < 0)
+        return NULL;
+
+    fid->f_seq = seq;
+    fid->f_oid = oid;
+    fid->f_ver = ver;
+
+    return string + length;
+}
+
+/* Return the end of the field starting at \p string, that is the start of the
+ * next field, or the end of the line.
+ */
+static const char *
+field_end(const char *string, const char * const *next_keys)
+{
+    const char *end = string + strlen(string);
+
+    for (; *next_keys; next_keys++) {
+        const char *next = strstr(string, *next_keys);
+
+        if (next && next < end)
+            end = next;
+    }
+
+    return end;
+}
+
+static int
+parse_changelog(const char *line, struct changelog_rec *record)
+{
+    static const char * const AFTER_NAME[] = {
+        " s=[", " J=", " u=", " x=", NULL
+    };
+    static const char * const AFTER_JOBID[] = { " u=", " x=", NULL };
+    unsigned long long index;
+    unsigned int flags;
+    unsigned int nsec;
+    unsigned int type;
+    unsigned int sec;
+    const char *next;
+    const char *end;
+    int length = -1;
+    char *name;
+
+    line = strchr(line, ':');
+    if (line == NULL)
+        return -EINVAL;
+    line++;
+
+    if (sscanf(line, " %llu %2u%n", &index, &type, &length) < 2 || length < 0)
+        return -EINVAL;
+
+    /* Skip the name of the type */
+    line += length;
+    line += strcspn(line, " ");
+
+    length = -1;
+    if (sscanf(line, " %u.%u 0x%x%n", &sec, &nsec, &flags, &length) < 3 ||
+        length < 0)
+        return -EINVAL;
+    line += length;
+
+    /* Skip the description of the HSM flags, they are part of flags */
+    if (*line == '(') {
+        line = strchr(line, ')');
+        if (line == NULL)
+            return -EINVAL;
+        line++;
+    }
+
+    record->cr_flags = REPLAY_FLAGS | (flags & CLF_FLAGMASK);
+    changelog_rec_extra_flags(record)->cr_extra_flags = REPLAY_EXTRA_FLAGS;
+    record->cr_index = index;
+    record->cr_type = type;
+    record->cr_time = ((uint64_t) sec << 30) | nsec;
+
+    line = parse_fid(line, "t=", &record->cr_tfid);
+    if (line == NULL)
+        return -EINVAL;
+
+    name = changelog_rec_name(record);
+    next = parse_fid(line, "p=", &record->cr_pfid);
+    if (next) {
+        line = next + 1;
+        end = field_end(line, AFTER_NAME);
+        if (end - line > NAME_MAX)
+            return -ENAMETOOLONG;
+
+        memcpy(name, line, end - line);
+        record->cr_namelen = end - line;
+        line = end;
+    }
+
+    next = parse_fid(line, "s=", &changelog_rec_rename(record)->cr_sfid);
+    if (next) {
+        line = parse_fid(next, "sp=", &changelog_rec_rename(record)->cr_spfid);
+        if (line == NULL)
+            return -EINVAL;
+
+        line++;
+        end = field_end(line, AFTER_NAME + 1);
+        if (end - line > NAME_MAX)
+            return -ENAMETOOLONG;
+
+        /* The source name follows the name, after its terminating null
+         * byte.
+         */
+        memcpy(name + record->cr_namelen + 1, line, end - line);
+        record->cr_namelen += 1 + end - line;
+        line = end;
+    }
+
+    if (strncmp(line, " J=", 3) == 0) {
+        line += 3;
+        end = field_end(line, AFTER_JOBID);
+        if (end - line >= LUSTRE_JOBID_SIZE)
+            return -EINVAL;
+
+        memcpy(changelog_rec_jobid(record)->cr_jobid, line, end - line);
+        line = end;
+    }
+
+    if (strncmp(line, " u=", 3) == 0) {
+        struct changelog_ext_uidgid *uidgid = changelog_rec_uidgid(record);
+        unsigned long long uid;
+        unsigned long long gid;
+
+        length = -1;
+        if (sscanf(line, " u=%llu:%llu%n", &uid, &gid, &length) < 2 ||
+            length < 0)
+            return -EINVAL;
+
+        uidgid->cr_uid = uid;
+        uidgid->cr_gid = gid;
+        line += length;
+    }
+
+    if (strncmp(line, " x=", 3) == 0) {
+        line += 3;
+        if (strlen(line) > XATTR_NAME_MAX)
+            return -EINVAL;
+
+        strcpy(changelog_rec_xattr(record)->cr_xattr, line);
+        line += strlen(line);
+    }
+
+    return *line == '\0' ? 0 : -EINVAL;
+}
+
+int
+changelog_replay_recv(FILE *file, int64_t start,
+                      struct changelog_rec **record)
+{
+    size_t size = 0;
+    char *line = NULL;
+    ssize_t length;
+    int rc;
+
+    while ((length = getline(&line, &size, file)) >= 0) {
+        if (length > 0 && line[length - 1] == '\n')
+            line[length - 1] = '\0';
+
+        *record = xcalloc(1, CR_MAXSIZE);
+        rc = parse_changelog(line, *record);
+        if (rc < 0) {
+            free(*record);
+            free(line);
+            return rc;
+        }
+
+        /* Like llapi_changelog_start(), start reading at index start */
+        if ((*record)->cr_index >= start) {
+            free(line);
+            return 0;
+        }
+
+        free(*record);
+    }
+
+    *record = NULL;
+    free(line);
+
+    return ferror(file) ? -EIO : 1;
+}
@@ -10,9 +10,12 @@
 #endif
 
 #include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <robinhood/itertools.h>
 #include <robinhood/statx.h>
+#include <robinhood/utils.h>
 
 #include <lustre/lustreapi.h>
 #include <linux/lustre/lustre_fid.h>
@@ -21,6 +24,7 @@
 #include "lustre_utils.h"
 
 #include "utils.h"
+#include "work_queue.h"
 
 static int
 build_statx_event(uint32_t statx_enrich_mask, struct rbh_fsevent *fsevent,
@@ -82,10 +86,42 @@ update_statx_without_uid_gid_event(struct changelog_rec *record,
     return 0;
 }
 
+/* Build a statx with the timestamps of \p mask set to the time of \p record,
+ * and the type set to \p type if \p mask has RBH_STATX_TYPE.
+ *
+ * Lustre only keeps timestamps to the second, the nanoseconds are left out.
+ */
+static struct rbh_statx *
+record_statx(struct changelog_rec *record, uint32_t mask, mode_t type)
+{
+    struct rbh_statx_timestamp timestamp = {
+        .tv_sec = cltime2sec(record->cr_time),
+        .tv_nsec = 0,
+    };
+    struct rbh_statx *rec_statx;
+
+    rec_statx = source_stack_alloc(NULL, sizeof(*rec_statx));
+    if (rec_statx == NULL)
+        return NULL;
+
+    rec_statx->stx_mask = mask;
+    rec_statx->stx_mode = mask & RBH_STATX_TYPE ? type : 0;
+    if (mask & RBH_STATX_ATIME)
+        rec_statx->stx_atime = timestamp;
+    if (mask & RBH_STATX_CTIME)
+        rec_statx->stx_ctime = timestamp;
+    if (mask & RBH_STATX_MTIME)
+        rec_statx->stx_mtime = timestamp;
+
+    return rec_statx;
+}
+
 static int
-update_parent_acmtime_event(struct lu_fid *parent_id,
+update_parent_acmtime_event(struct changelog_rec *record,
+                            struct lu_fid *parent_id, bool changelog_statx,
                             struct rbh_fsevent *fsevent)
 {
+    struct rbh_statx *rec_statx = NULL;
     uint32_t statx_enrich_mask;
     struct rbh_id *id;
 
@@ -99,7 +135,19 @@ update_parent_acmtime_event(struct lu_fid *parent_id,
     /* Also, retrieve the type because we need it when enriching the entry */
     statx_enrich_mask = RBH_STATX_TYPE | RBH_STATX_ATIME | RBH_STATX_CTIME |
                         RBH_STATX_MTIME;
-    if (build_statx_event(statx_enrich_mask, fsevent, NULL))
+
+    /* Adding or removing an entry sets the change and modification times of
+     * its parent to the time of the record, and does not access it.
+     */
+    if (changelog_statx) {
+        rec_statx = record_statx(record, RBH_STATX_TYPE | RBH_STATX_CTIME |
+                                         RBH_STATX_MTIME, S_IFDIR);
+        if (rec_statx == NULL)
+            return -1;
+        statx_enrich_mask = 0;
+    }
+
+    if (build_statx_event(statx_enrich_mask, fsevent, rec_statx))
         return -1;
 
     return 0;
@@ -154,6 +202,7 @@ fsevent_list_alloc(size_t n_events, struct rbh_id *id)
 
 static int
 build_create_inode_events(struct changelog_rec *record, struct rbh_id *id,
+                          bool changelog_statx,
                           struct rbh_iterator **fsevents_iterator)
 {
     struct rbh_fsevent *new_events;
@@ -176,7 +225,8 @@ build_create_inode_events(struct changelog_rec *record, struct rbh_id *id,
         return -1;
 
     /* Update the parent information after creating a new entry */
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[3]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[3]))
         return -1;
 
     if (update_parent_nb_children_event(&record->cr_pfid, 1, &new_events[4]))
@@ -190,16 +240,25 @@ build_create_inode_events(struct changelog_rec *record, struct rbh_id *id,
 
 static int
 build_setxattr_event(struct changelog_rec *record, struct rbh_id *id,
+                     bool changelog_statx,
                      struct rbh_iterator **fsevents_iterator)
 {
     char *xattr = changelog_rec_xattr(record)->cr_xattr;
+    struct rbh_statx *rec_statx = NULL;
     struct rbh_fsevent *new_events;
     uint32_t statx_enrich_mask = 0;
 
     new_events = fsevent_list_alloc(3, id);
 
     statx_enrich_mask = RBH_STATX_CTIME_SEC | RBH_STATX_CTIME_NSEC;
-    if (build_statx_event(statx_enrich_mask, &new_events[0], NULL))
+    if (changelog_statx) {
+        rec_statx = record_statx(record, statx_enrich_mask, 0);
+        if (rec_statx == NULL)
+            return -1;
+        statx_enrich_mask = 0;
+    }
+
+    if (build_statx_event(statx_enrich_mask, &new_events[0], rec_statx))
         return -1;
 
     new_events[1].type = RBH_FET_XATTR;
@@ -221,14 +280,27 @@ build_setxattr_event(struct changelog_rec *record, struct rbh_id *id,
 }
 
 static int
-build_statx_update_event(uint32_t statx_enrich_mask, struct rbh_id *id,
+build_statx_update_event(struct changelog_rec *record,
+                         uint32_t statx_enrich_mask, struct rbh_id *id,
+                         bool changelog_statx,
                          struct rbh_iterator **fsevents_iterator)
 {
+    struct rbh_statx *rec_statx = NULL;
     struct rbh_fsevent *new_events;
 
     new_events = fsevent_list_alloc(2, id);
 
-    if (build_statx_event(statx_enrich_mask, &new_events[0], NULL))
+    /* Only the time of the record changed for ATIME and CTIME records */
+    if (changelog_statx &&
+        (record->cr_type == CL_ATIME || record->cr_type == CL_CTIME)) {
+        rec_statx = record_statx(record, record->cr_type == CL_ATIME ?
+                                         RBH_STATX_ATIME : RBH_STATX_CTIME, 0);
+        if (rec_statx == NULL)
+            return -1;
+        statx_enrich_mask = 0;
+    }
+
+    if (build_statx_event(statx_enrich_mask, &new_events[0], rec_statx))
         return -1;
 
     new_events[1].type = RBH_FET_XATTR;
@@ -249,7 +321,7 @@ build_statx_update_event(uint32_t statx_enrich_mask, struct rbh_id *id,
  */
 static int
 build_softlink_events(struct changelog_rec *record, struct rbh_id *id,
-                      int32_t mdt_index,
+                      int32_t mdt_index, bool changelog_statx,
                       struct rbh_iterator **fsevents_iterator)
 {
     struct rbh_fsevent *new_events;
@@ -274,7 +346,8 @@ build_softlink_events(struct changelog_rec *record, struct rbh_id *id,
         return -1;
 
     /* Update the parent information after creating a new entry */
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[3]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[3]))
         return -1;
 
     if (update_parent_nb_children_event(&record->cr_pfid, 1, &new_events[4]))
@@ -294,7 +367,7 @@ build_softlink_events(struct changelog_rec *record, struct rbh_id *id,
 
 static int
 build_hardlink_or_mknod_events(struct changelog_rec *record, struct rbh_id *id,
-                               int32_t mdt_index,
+                               int32_t mdt_index, bool changelog_statx,
                                struct rbh_iterator **fsevents_iterator)
 {
     struct rbh_fsevent *new_events;
@@ -334,7 +407,8 @@ build_hardlink_or_mknod_events(struct changelog_rec *record, struct rbh_id *id,
         return -1;
 
     /* Update the parent information after creating a new entry */
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[i++]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[i++]))
         return -1;
 
     if (update_parent_nb_children_event(&record->cr_pfid, 1, &new_events[i]))
@@ -390,6 +464,7 @@ unlink_inode_event(struct lu_fid *parent_id, char *name, size_t namelen,
 
 static int
 build_unlink_or_rmdir_events(struct changelog_rec *record, struct rbh_id *id,
+                             bool changelog_statx,
                              struct rbh_iterator **fsevents_iterator)
 {
     bool last_copy = record->cr_flags & CLF_UNLINK_LAST;
@@ -403,7 +478,8 @@ build_unlink_or_rmdir_events(struct changelog_rec *record, struct rbh_id *id,
                            record->cr_time, last_copy_archived))
         return -1;
 
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[1]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[1]))
         return -1;
 
     if (update_parent_nb_children_event(&record->cr_pfid, -1, &new_events[2]))
@@ -430,6 +506,7 @@ build_unlink_or_rmdir_events(struct changelog_rec *record, struct rbh_id *id,
  */
 static int
 build_rename_events(struct changelog_rec *record, struct rbh_id *id,
+                    bool changelog_statx,
                     struct rbh_iterator **fsevents_iterator)
 {
     struct changelog_ext_rename *rename_log = changelog_rec_rename(record);
@@ -475,7 +552,8 @@ build_rename_events(struct changelog_rec *record, struct rbh_id *id,
     counter++;
 
     /* Update the parent information after creating a new entry */
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[counter]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[counter]))
         return -1;
 
     counter++;
@@ -495,8 +573,8 @@ build_rename_events(struct changelog_rec *record, struct rbh_id *id,
 
     counter++;
 
-    if (update_parent_acmtime_event(&rename_log->cr_spfid,
-                                    &new_events[counter]))
+    if (update_parent_acmtime_event(record, &rename_log->cr_spfid,
+                                    changelog_statx, &new_events[counter]))
         return -1;
 
     counter++;
@@ -653,6 +731,7 @@ build_resync_events(struct rbh_id *id, struct rbh_iterator **fsevents_iterator)
  */
 static int
 build_migrate_events(struct changelog_rec *record, struct rbh_id *id,
+                     bool changelog_statx,
                      struct rbh_iterator **fsevents_iterator)
 {
     struct changelog_ext_rename *migrate_log = changelog_rec_rename(record);
@@ -675,7 +754,8 @@ build_migrate_events(struct changelog_rec *record, struct rbh_id *id,
         return -1;
 
     /* Update the parent information after creating a new entry */
-    if (update_parent_acmtime_event(&record->cr_pfid, &new_events[2]))
+    if (update_parent_acmtime_event(record, &record->cr_pfid,
+                                    changelog_statx, &new_events[2]))
         return -1;
 
     new_events[3].id.data = migrated_id->data;
@@ -685,7 +765,8 @@ build_migrate_events(struct changelog_rec *record, struct rbh_id *id,
                            &new_events[3], 0, false))
         return -1;
 
-    if (update_parent_acmtime_event(&migrate_log->cr_spfid, &new_events[4]))
+    if (update_parent_acmtime_event(record, &migrate_log->cr_spfid,
+                                    changelog_statx, &new_events[4]))
         return -1;
 
     new_events[5].type = RBH_FET_XATTR;
@@ -700,6 +781,153 @@ build_migrate_events(struct changelog_rec *record, struct rbh_id *id,
     return 0;
 }
 
+static int
+changelog_recv(struct lustre_changelog_iterator *records,
+               struct changelog_rec **record)
+{
+    if (records->replay)
+        return changelog_replay_recv(records->replay,
+                                     records->fsevents_md->start_index,
+                                     record);
+
+    return llapi_changelog_recv(records->reader, record);
+}
+
+static void
+changelog_free(struct lustre_changelog_iterator *records,
+               struct changelog_rec **record)
+{
+    if (records->replay) {
+        free(*record);
+        *record = NULL;
+        return;
+    }
+
+    llapi_changelog_free(record);
+}
+
+/* How long to wait for new changelogs once the MDT is drained, doubled each
+ * time it still is, in milliseconds
+ */
+#define FOLLOW_BACKOFF_MIN 10
+#define FOLLOW_BACKOFF_MAX 1000
+
+/* Wait before looking for new changelogs, returns false if the iterator is
+ * being destroyed in the meantime
+ */
+static bool
+follow_backoff(struct lustre_changelog_iterator *records, uint64_t *backoff)
+{
+    struct timespec delay = ms2timespec(*backoff);
+
+    if (work_queue_closed(records->read_ahead))
+        return false;
+
+    nanosleep(&delay, NULL);
+    *backoff *= 2;
+    if (*backoff > FOLLOW_BACKOFF_MAX)
+        *backoff = FOLLOW_BACKOFF_MAX;
+
+    return !work_queue_closed(records->read_ahead);
+}
+
+void *
+lustre_changelog_read_ahead(void *iterator)
+{
+    struct lustre_changelog_iterator *records = iterator;
+    int64_t next_index = records->fsevents_md->start_index;
+    uint64_t backoff = FOLLOW_BACKOFF_MIN;
+    struct changelog_rec *record;
+    uint64_t count = 0;
+    int rc;
+
+    /* The changelogs past the maximum would never be converted */
+    while (records->max_changelog == 0 || count < records->max_changelog) {
+        rc = changelog_recv(records, &record);
+        if ((rc == 1 || rc == -EAGAIN) && records->follow &&
+            records->replay == NULL) {
+            if (!follow_backoff(records, &backoff))
+                break;
+
+            /* Once it reached the end of the changelogs, the reader has to be
+             * started again to see the ones written since.
+             */
+            if (rc == 1) {
+                llapi_changelog_fini(&records->reader);
+                rc = lustre_changelog_start(records, next_index);
+                if (rc < 0) {
+                    records->read_ahead_rc = rc;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (rc != 0) {
+            records->read_ahead_rc = rc;
+            break;
+        }
+
+        backoff = FOLLOW_BACKOFF_MIN;
+        next_index = record->cr_index + 1;
+
+        /* Nothing before the first changelog received is left to
+         * acknowledge, and nothing can be acknowledged before it is pushed.
+         */
+        if (count == 0)
+            atomic_store_explicit(&records->acknowledged_index,
+                                  record->cr_index - 1, memory_order_relaxed);
+        atomic_store_explicit(&records->received_index, record->cr_index,
+                              memory_order_relaxed);
+        atomic_store_explicit(&records->received, count + 1,
+                              memory_order_relaxed);
+
+        if (!work_queue_push(records->read_ahead, 0, record)) {
+            changelog_free(records, &record);
+            break;
+        }
+        count++;
+    }
+
+    work_queue_close(records->read_ahead);
+
+    return NULL;
+}
+
+/* Get the next changelog received by the read-ahead thread, with the same
+ * return values as llapi_changelog_recv(), or -ETIMEDOUT if the MDT is
+ * followed and nothing new was received in time.
+ */
+static int
+read_ahead_pop(struct lustre_changelog_iterator *records,
+               struct changelog_rec **record)
+{
+    struct timespec start, end, deadline;
+    size_t shard;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (records->follow) {
+        deadline = timespec_add(start, ms2timespec(records->follow));
+        *record = work_queue_timedpop(records->read_ahead, 0, &shard,
+                                      &deadline);
+    } else {
+        *record = work_queue_pop(records->read_ahead, 0, &shard);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timespec_accumulate(&records->fsevents_md->time_spent_waiting_changelogs,
+                        start, end);
+
+    if (*record == NULL && records->follow && errno == ETIMEDOUT)
+        return -ETIMEDOUT;
+
+    if (*record == NULL)
+        return records->read_ahead_rc;
+
+    work_queue_release(records->read_ahead, shard);
+
+    return 0;
+}
+
 const void *
 lustre_changelog_iter_next(void *iterator)
 {
@@ -734,8 +962,13 @@ lustre_changelog_iter_next(void *iterator)
     }
 
 retry:
-    rc = llapi_changelog_recv(records->reader, &record);
-    if (rc > 0 || rc == -EAGAIN) {
+    rc = read_ahead_pop(records, &record);
+    if (rc == -ETIMEDOUT) {
+        /* Nothing new yet, let the caller flush what it read so far */
+        records->empty = true;
+        errno = ETIMEDOUT;
+        return NULL;
+    } else if (rc > 0 || rc == -EAGAIN) {
         records->empty = true;
         errno = ENODATA;
         return NULL;
@@ -743,6 +976,7 @@ retry:
         errno = -rc;
         return NULL;
     }
+    records->empty = false;
 
     records->last_changelog_index = record->cr_index;
     records->fsevents_md->changelog_read++;
@@ -759,10 +993,12 @@ retry:
     switch (record->cr_type) {
     case CL_CREATE:
     case CL_MKDIR:
-        rc = build_create_inode_events(record, id, &records->fsevents_iterator);
+        rc = build_create_inode_events(record, id, records->changelog_statx,
+                                       &records->fsevents_iterator);
         break;
     case CL_SETXATTR:
-        rc = build_setxattr_event(record, id, &records->fsevents_iterator);
+        rc = build_setxattr_event(record, id, records->changelog_statx,
+                                  &records->fsevents_iterator);
         break;
     case CL_SETATTR:
         statx_enrich_mask = RBH_STATX_ALL;
@@ -777,26 +1013,31 @@ retry:
         /* fall through */
     case CL_ATIME:
         statx_enrich_mask |= RBH_STATX_ATIME_SEC | RBH_STATX_ATIME_NSEC;
-        rc = build_statx_update_event(statx_enrich_mask, id,
+        rc = build_statx_update_event(record, statx_enrich_mask, id,
+                                      records->changelog_statx,
                                       &records->fsevents_iterator);
         break;
     case CL_SOFTLINK:
         rc = build_softlink_events(record, id, records->source_mdt_index,
+                                   records->changelog_statx,
                                    &records->fsevents_iterator);
         break;
     case CL_HARDLINK:
     case CL_MKNOD:
         rc = build_hardlink_or_mknod_events(record, id,
                                             records->source_mdt_index,
+                                            records->changelog_statx,
                                             &records->fsevents_iterator);
         break;
     case CL_RMDIR:
     case CL_UNLINK:
         rc = build_unlink_or_rmdir_events(record, id,
+                                          records->changelog_statx,
                                           &records->fsevents_iterator);
         break;
     case CL_RENAME:
-        rc = build_rename_events(record, id, &records->fsevents_iterator);
+        rc = build_rename_events(record, id, records->changelog_statx,
+                                 &records->fsevents_iterator);
         break;
     case CL_HSM:
         rc = build_hsm_events(id, &records->fsevents_iterator);
@@ -805,7 +1046,8 @@ retry:
         statx_enrich_mask = RBH_STATX_CTIME_SEC | RBH_STATX_CTIME_NSEC |
                             RBH_STATX_MTIME_SEC | RBH_STATX_MTIME_NSEC |
                             RBH_STATX_SIZE | RBH_STATX_BLOCKS | RBH_STATX_TYPE;
-        rc = build_statx_update_event(statx_enrich_mask, id,
+        rc = build_statx_update_event(record, statx_enrich_mask, id,
+                                      records->changelog_statx,
                                       &records->fsevents_iterator);
         break;
     case CL_LAYOUT:
@@ -818,7 +1060,8 @@ retry:
         rc = build_resync_events(id, &records->fsevents_iterator);
         break;
     case CL_MIGRATE:
-        rc = build_migrate_events(record, id, &records->fsevents_iterator);
+        rc = build_migrate_events(record, id, records->changelog_statx,
+                                  &records->fsevents_iterator);
         break;
     default:
         /* These corespond to:
@@ -831,13 +1074,13 @@ retry:
          *
          * So we do not manage these events and skip to the next changelog.
          */
-        llapi_changelog_free(&record);
+        changelog_free(records, &record);
         goto retry;
     }
 
 end_event:
     save_errno = errno;
-    llapi_changelog_free(&record);
+    changelog_free(records, &record);
     errno = save_errno;
 
     if (rc != -1 && records->fsevents_iterator)
@@ -850,8 +1093,23 @@ void
 lustre_changelog_iter_destroy(void *iterator)
 {
     struct lustre_changelog_iterator *records = iterator;
+    struct changelog_rec *record;
+    size_t shard;
 
-    llapi_changelog_fini(&records->reader);
+    /* Wake up the read-ahead thread if it waits for room in the queue */
+    work_queue_close(records->read_ahead);
+    pthread_join(records->read_ahead_thread, NULL);
+
+    while ((record = work_queue_pop(records->read_ahead, 0, &shard))) {
+        work_queue_release(records->read_ahead, shard);
+        changelog_free(records, &record);
+    }
+    work_queue_destroy(records->read_ahead, NULL);
+
+    if (records->replay)
+        fclose(records->replay);
+    else
+        llapi_changelog_fini(&records->reader);
 
     if (records->fsevents_iterator)
         rbh_iter_destroy(records->fsevents_iterator);
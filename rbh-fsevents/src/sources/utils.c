@@ -26,11 +26,12 @@
 
 __thread struct rbh_sstack *source_stack;
 
-static void __attribute__((destructor))
+void __attribute__((destructor))
 destroy_source_stack(void)
 {
     if (source_stack)
         rbh_sstack_destroy(source_stack);
+    source_stack = NULL;
 }
 
 void
@@ -112,3 +113,14 @@ initialize_source_stack(size_t stack_size)
 {
     source_stack = rbh_sstack_new(stack_size);
 }
+
+struct timespec
+ms2timespec(uint64_t milliseconds)
+{
+    struct timespec timespec = {
+        .tv_sec = milliseconds / 1000,
+        .tv_nsec = (milliseconds % 1000) * 1000 * 1000,
+    };
+
+    return timespec;
+}
@@ -0,0 +1,372 @@
+/* This file is part of RobinHood 4
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <robinhood/utils.h>
+
+#include "work_queue.h"
+
+/* Threads that run out of things to do wait for the epoch of a parking to
+ * change. Notifying a parking is a couple of atomic operations, the mutex is
+ * only taken if a thread is actually waiting.
+ */
+struct parking {
+    atomic_uint epoch;
+    atomic_uint waiters;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void
+parking_init(struct parking *parking)
+{
+    pthread_condattr_t attr;
+
+    atomic_init(&parking->epoch, 0);
+    atomic_init(&parking->waiters, 0);
+    pthread_mutex_init(&parking->mutex, NULL);
+
+    /* Deadlines must not move with the wall clock */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&parking->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void
+parking_fini(struct parking *parking)
+{
+    pthread_cond_destroy(&parking->cond);
+    pthread_mutex_destroy(&parking->mutex);
+}
+
+/* To be called before checking one last time whether there is something to do,
+ * the returned epoch is then given to either parking_wait() or
+ * parking_cancel().
+ */
+static unsigned int
+parking_prepare(struct parking *parking)
+{
+    atomic_fetch_add(&parking->waiters, 1);
+    return atomic_load(&parking->epoch);
+}
+
+static void
+parking_cancel(struct parking *parking)
+{
+    atomic_fetch_sub(&parking->waiters, 1);
+}
+
+static void
+parking_wait(struct parking *parking, unsigned int epoch)
+{
+    pthread_mutex_lock(&parking->mutex);
+    while (atomic_load(&parking->epoch) == epoch)
+        pthread_cond_wait(&parking->cond, &parking->mutex);
+    pthread_mutex_unlock(&parking->mutex);
+
+    atomic_fetch_sub(&parking->waiters, 1);
+}
+
+/* Same as parking_wait(), returns false if deadline passed first */
+static bool
+parking_timedwait(struct parking *parking, unsigned int epoch,
+                  const struct timespec *deadline)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&parking->mutex);
+    while (atomic_load(&parking->epoch) == epoch && rc != ETIMEDOUT)
+        rc = pthread_cond_timedwait(&parking->cond, &parking->mutex,
+                                    deadline);
+    pthread_mutex_unlock(&parking->mutex);
+
+    atomic_fetch_sub(&parking->waiters, 1);
+
+    return rc != ETIMEDOUT;
+}
+
+static void
+parking_notify(struct parking *parking)
+{
+    atomic_fetch_add(&parking->epoch, 1);
+    if (atomic_load(&parking->waiters) == 0)
+        return;
+
+    pthread_mutex_lock(&parking->mutex);
+    pthread_cond_broadcast(&parking->cond);
+    pthread_mutex_unlock(&parking->mutex);
+}
+
+struct shard {
+    /* Only written by the worker holding the shard */
+    atomic_size_t head;
+    atomic_bool busy;
+    /* Only written by the producer, kept away from what the workers write */
+    _Alignas(64) atomic_size_t tail;
+    void **slots;
+};
+
+struct worker {
+    /* The home shards of the worker are [home, home + home_count) */
+    size_t home;
+    size_t home_count;
+    /* The home shard to look at first */
+    size_t cursor;
+};
+
+struct work_queue {
+    struct shard *shards;
+    size_t shard_count;
+    size_t capacity;
+    struct worker *workers;
+    size_t worker_count;
+    atomic_bool closed;
+    /* Waited on by the workers */
+    struct parking pushed;
+    /* Waited on by the producer */
+    struct parking popped;
+};
+
+struct work_queue *
+work_queue_new(size_t shard_count, size_t capacity, size_t worker_count)
+{
+    struct work_queue *queue;
+
+    assert(shard_count > 0 && capacity > 0 && worker_count > 0);
+
+    queue = xmalloc(sizeof(*queue));
+    queue->shards = xcalloc(shard_count, sizeof(*queue->shards));
+    queue->shard_count = shard_count;
+    queue->capacity = capacity;
+    queue->workers = xcalloc(worker_count, sizeof(*queue->workers));
+    queue->worker_count = worker_count;
+    atomic_init(&queue->closed, false);
+    parking_init(&queue->pushed);
+    parking_init(&queue->popped);
+
+    for (size_t i = 0; i < shard_count; i++) {
+        struct shard *shard = &queue->shards[i];
+
+        atomic_init(&shard->head, 0);
+        atomic_init(&shard->busy, false);
+        atomic_init(&shard->tail, 0);
+        shard->slots = xmalloc(capacity * sizeof(*shard->slots));
+    }
+
+    for (size_t i = 0; i < worker_count; i++) {
+        struct worker *worker = &queue->workers[i];
+
+        worker->home = i * shard_count / worker_count;
+        worker->home_count = (i + 1) * shard_count / worker_count
+                           - worker->home;
+        worker->cursor = 0;
+    }
+
+    return queue;
+}
+
+void
+work_queue_destroy(struct work_queue *queue, void (*free_item)(void *item))
+{
+    for (size_t i = 0; i < queue->shard_count; i++) {
+        struct shard *shard = &queue->shards[i];
+        size_t tail = atomic_load(&shard->tail);
+
+        for (size_t j = atomic_load(&shard->head); free_item && j < tail; j++)
+            free_item(shard->slots[j % queue->capacity]);
+
+        free(shard->slots);
+    }
+
+    parking_fini(&queue->popped);
+    parking_fini(&queue->pushed);
+    free(queue->workers);
+    free(queue->shards);
+    free(queue);
+}
+
+static bool
+shard_is_full(struct work_queue *queue, struct shard *shard, size_t tail)
+{
+    return tail - atomic_load_explicit(&shard->head, memory_order_acquire)
+        == queue->capacity;
+}
+
+bool
+work_queue_push(struct work_queue *queue, size_t index, void *item)
+{
+    struct shard *shard = &queue->shards[index];
+    size_t tail = atomic_load_explicit(&shard->tail, memory_order_relaxed);
+
+    while (shard_is_full(queue, shard, tail) && !atomic_load(&queue->closed)) {
+        unsigned int epoch = parking_prepare(&queue->popped);
+
+        if (!shard_is_full(queue, shard, tail) || atomic_load(&queue->closed)) {
+            parking_cancel(&queue->popped);
+            break;
+        }
+
+        parking_wait(&queue->popped, epoch);
+    }
+
+    if (atomic_load(&queue->closed))
+        return false;
+
+    shard->slots[tail % queue->capacity] = item;
+    atomic_store_explicit(&shard->tail, tail + 1, memory_order_release);
+    parking_notify(&queue->pushed);
+
+    return true;
+}
+
+static bool
+shard_is_empty(struct shard *shard)
+{
+    return atomic_load_explicit(&shard->head, memory_order_relaxed)
+        == atomic_load_explicit(&shard->tail, memory_order_acquire);
+}
+
+static void *
+shard_try_pop(struct work_queue *queue, struct shard *shard)
+{
+    size_t head;
+    void *item;
+
+    /* Avoid bouncing the cache line of busy shards and empty ones around */
+    if (atomic_load_explicit(&shard->busy, memory_order_relaxed) ||
+        shard_is_empty(shard))
+        return NULL;
+
+    if (atomic_exchange_explicit(&shard->busy, true, memory_order_acquire))
+        return NULL;
+
+    /* Another worker may have emptied the shard since it was checked */
+    if (shard_is_empty(shard)) {
+        atomic_store_explicit(&shard->busy, false, memory_order_release);
+        return NULL;
+    }
+
+    head = atomic_load_explicit(&shard->head, memory_order_relaxed);
+    item = shard->slots[head % queue->capacity];
+    atomic_store_explicit(&shard->head, head + 1, memory_order_release);
+    parking_notify(&queue->popped);
+
+    return item;
+}
+
+static void *
+try_pop(struct work_queue *queue, size_t index, size_t *shard)
+{
+    struct worker *worker = &queue->workers[index];
+    size_t others = queue->shard_count - worker->home_count;
+    void *item;
+
+    /* Home shards first, starting after the last one popped from so that none
+     * of them is starved...
+     */
+    for (size_t i = 0; i < worker->home_count; i++) {
+        size_t offset = (worker->cursor + i) % worker->home_count;
+
+        *shard = worker->home + offset;
+        item = shard_try_pop(queue, &queue->shards[*shard]);
+        if (item) {
+            worker->cursor = offset + 1;
+            return item;
+        }
+    }
+
+    /* ... then steal from the other workers, neighbours first */
+    for (size_t i = 0; i < others; i++) {
+        *shard = (worker->home + worker->home_count + i) % queue->shard_count;
+        item = shard_try_pop(queue, &queue->shards[*shard]);
+        if (item)
+            return item;
+    }
+
+    return NULL;
+}
+
+void *
+work_queue_pop(struct work_queue *queue, size_t worker, size_t *shard)
+{
+    return work_queue_timedpop(queue, worker, shard, NULL);
+}
+
+void *
+work_queue_timedpop(struct work_queue *queue, size_t worker, size_t *shard,
+                    const struct timespec *deadline)
+{
+    while (true) {
+        unsigned int epoch;
+        void *item;
+
+        item = try_pop(queue, worker, shard);
+        if (item)
+            return item;
+
+        epoch = parking_prepare(&queue->pushed);
+
+        item = try_pop(queue, worker, shard);
+        if (item) {
+            parking_cancel(&queue->pushed);
+            return item;
+        }
+
+        /* Items left in shards held by other workers are theirs to pop */
+        if (atomic_load(&queue->closed)) {
+            parking_cancel(&queue->pushed);
+            errno = ENODATA;
+            return NULL;
+        }
+
+        if (deadline == NULL) {
+            parking_wait(&queue->pushed, epoch);
+        } else if (!parking_timedwait(&queue->pushed, epoch, deadline)) {
+            item = try_pop(queue, worker, shard);
+            if (item == NULL)
+                errno = ETIMEDOUT;
+            return item;
+        }
+    }
+}
+
+void
+work_queue_release(struct work_queue *queue, size_t index)
+{
+    struct shard *shard = &queue->shards[index];
+
+    atomic_store_explicit(&shard->busy, false, memory_order_release);
+
+    /* Other workers may have gone to sleep while the shard was held */
+    if (!shard_is_empty(shard))
+        parking_notify(&queue->pushed);
+}
+
+void
+work_queue_close(struct work_queue *queue)
+{
+    atomic_store(&queue->closed, true);
+    parking_notify(&queue->pushed);
+    parking_notify(&queue->popped);
+}
+
+bool
+work_queue_closed(struct work_queue *queue)
+{
+    return atomic_load(&queue->closed);
+}
@@ -34,11 +34,42 @@ test_dump()
     diff <(echo "$output") $dump_file
 }
 
+test_changelog_statx()
+{
+    local dump_file="/tmp/dump_file"
+
+    # Changelogs are appended to the dump file
+    rm -f "$dump_file"
+
+    mkdir dir
+    touch dir/file
+    rm dir/file
+    touch dir/entry
+
+    rbh_fsevents --dump "$dump_file" --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT" "rbh:$db:$testdb"
+    local expected="$(rbh_find "rbh:$db:$testdb" | sort)"
+
+    do_db clear_entries "$testdb"
+
+    rbh_fsevents --changelog-statx --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$dump_file" "rbh:$db:$testdb"
+
+    diff <(echo "$expected") <(rbh_find "rbh:$db:$testdb" | sort)
+
+    # The times of the directory are the ones of the last changelog in it
+    local cltime=$(grep "CREAT" "$dump_file" | tail -n 1 | awk '{ print $4 }')
+    find_attribute '"statx.mtime.sec":NumberLong("'${cltime%.*}'")' \
+                   '"ns.name":"dir"'
+    find_attribute '"statx.ctime.sec":NumberLong("'${cltime%.*}'")' \
+                   '"ns.name":"dir"'
+}
+
 ################################################################################
 #                                     MAIN                                     #
 ################################################################################
 
-declare -a tests=(test_dump)
+declare -a tests=(test_dump test_changelog_statx)
 
 LUSTRE_DIR=/mnt/lustre/
 cd "$LUSTRE_DIR"
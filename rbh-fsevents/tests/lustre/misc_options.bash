@@ -65,11 +65,68 @@ no_estale_logs()
     return 0
 }
 
+daemon()
+{
+    "$__rbh_fsevents" --daemon --flush-delay 100 \
+        --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT?ack-user=$userid" "rbh:$db:$testdb" &
+    local pid=$!
+
+    touch entry
+    sleep 2
+
+    kill -0 $pid ||
+        error "fsevents in daemon mode should still be running"
+
+    local path="$(mountless_path "$PWD")"
+    rbh_find "rbh:$db:$testdb" -name entry | difflines "$path/entry"
+
+    # A batch that is not full is flushed as soon as its delay expires
+    mv entry renamed
+    sleep 2
+
+    rbh_find "rbh:$db:$testdb" -name renamed | difflines "$path/renamed"
+
+    kill -TERM $pid
+    wait $pid ||
+        error "fsevents in daemon mode should stop cleanly on SIGTERM"
+
+    if [[ -n "$(lfs changelog $LUSTRE_MDT)" ]]; then
+        error "Changelogs should have been acknowledged"
+    fi
+}
+
+benchmark()
+{
+    touch entry
+    mkdir dir
+    rm entry
+
+    rbh_fsevents src:lustre:"$LUSTRE_MDT" - > fsevents.yaml
+
+    rbh_fsevents src:file:fsevents.yaml count: > output.log ||
+        error "fsevents with a count destination should have succeeded"
+
+    grep "^total: [1-9]" output.log ||
+        error "fsevents with a count destination should have counted them"
+
+    rbh_fsevents --benchmark --nb-workers 2 --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:file:fsevents.yaml null: 2> output.log ||
+        error "fsevents with a null destination should have succeeded"
+
+    for stage in "read and dedup" enrich update total; do
+        grep "^$stage " output.log ||
+            error "fsevents with --benchmark should have timed '$stage'"
+    done
+
+    rm fsevents.yaml output.log
+}
+
 ################################################################################
 #                                     MAIN                                     #
 ################################################################################
 
-declare -a tests=(no_skip no_estale_logs)
+declare -a tests=(no_skip no_estale_logs daemon benchmark)
 
 LUSTRE_DIR=/mnt/lustre/
 cd "$LUSTRE_DIR"
@@ -0,0 +1,148 @@
+#!/usr/bin/env bash
+
+# This file is part of RobinHood
+# Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/../../../utils/tests/framework.bash
+. $test_dir/lustre_utils.bash
+
+difflines()
+{
+    diff -y - <([ $# -eq 0 ] && printf '' || printf '%s\n' "$@")
+}
+
+multi_mdt_setup()
+{
+    lustre_setup
+    clear_changelogs "$LUSTRE_MDT1" "$userid1"
+}
+
+multi_mdt_teardown()
+{
+    lustre_teardown
+    clear_changelogs "$LUSTRE_MDT1" "$userid1"
+    rm -f "$dump0" "$dump1"
+}
+
+create_entries()
+{
+    lfs mkdir --mdt-index 0 "mdt0"
+    touch "mdt0/entry"
+    lfs mkdir --mdt-index 1 "mdt1"
+    touch "mdt1/entry"
+    mv "mdt1/entry" "mdt1/renamed"
+}
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_multi_mdt()
+{
+    create_entries
+
+    local last_changelog=$(lfs changelog $LUSTRE_MDT | tail -n 1 |
+                           cut -d' ' -f1)
+    local last_changelog1=$(lfs changelog $LUSTRE_MDT1 | tail -n 1 |
+                            cut -d' ' -f1)
+
+    rbh_fsevents --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT,$LUSTRE_MDT1?ack-user=$userid" \
+        "rbh:$db:$testdb"
+
+    local path="$(mountless_path "$PWD")"
+    rbh_find "rbh:$db:$testdb" -name 'mdt*' -o -name entry -o -name renamed |
+        sort | difflines "$path/mdt0" "$path/mdt0/entry" "$path/mdt1" \
+                         "$path/mdt1/renamed"
+
+    local fsevents_source_idx=$(do_db fsevents "$testdb" "$LUSTRE_MDT")
+    local fsevents_source_idx1=$(do_db fsevents "$testdb" "$LUSTRE_MDT1")
+
+    if [[ $fsevents_source_idx != $last_changelog ]]; then
+        error "Fsevents source index for $LUSTRE_MDT should be" \
+              "$last_changelog, got $fsevents_source_idx"
+    fi
+
+    if [[ $fsevents_source_idx1 != $last_changelog1 ]]; then
+        error "Fsevents source index for $LUSTRE_MDT1 should be" \
+              "$last_changelog1, got $fsevents_source_idx1"
+    fi
+
+    # Everything was acknowledged on both MDTs
+    if [[ -n "$(lfs changelog $LUSTRE_MDT)" ||
+          -n "$(lfs changelog $LUSTRE_MDT1)" ]]; then
+        error "Changelogs should have been acknowledged on both MDTs"
+    fi
+}
+
+test_multi_mdt_index()
+{
+    touch entry
+
+    rbh_fsevents --index 1 --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT,$LUSTRE_MDT1" "rbh:$db:$testdb" &&
+        error "--index should not be accepted with several MDTs"
+
+    return 0
+}
+
+test_replay()
+{
+    create_entries
+
+    rbh_fsevents --dump "$dump0" --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT" "rbh:$db:$testdb"
+    rbh_fsevents --dump "$dump1" --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$LUSTRE_MDT1" "rbh:$db:$testdb"
+
+    local expected="$(rbh_find "rbh:$db:$testdb" | sort)"
+
+    do_db clear_entries "$testdb"
+
+    rbh_fsevents --enrich rbh:lustre:"$LUSTRE_DIR" \
+        src:lustre:"$dump0,$dump1" "rbh:$db:$testdb"
+
+    diff <(echo "$expected") <(rbh_find "rbh:$db:$testdb" | sort)
+
+    # The changelogs replayed are still on the MDTs
+    if [[ -z "$(lfs changelog $LUSTRE_MDT1)" ]]; then
+        error "Replayed changelogs should not have been acknowledged"
+    fi
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_multi_mdt test_multi_mdt_index test_replay)
+
+LUSTRE_DIR=/mnt/lustre/
+cd "$LUSTRE_DIR"
+
+LUSTRE_MDT=lustre-MDT0000
+LUSTRE_MDT1=lustre-MDT0001
+userid="$(start_changelogs "$LUSTRE_MDT")"
+userid1="$(start_changelogs "$LUSTRE_MDT1")"
+
+# The same user acknowledges the changelogs of every MDT
+if [[ "$userid" != "$userid1" ]]; then
+    stop_changelogs "$LUSTRE_MDT" "$userid"
+    stop_changelogs "$LUSTRE_MDT1" "$userid1"
+    exit 77
+fi
+
+dump0=/tmp/rbh-fsevents-MDT0000.dump
+dump1=/tmp/rbh-fsevents-MDT0001.dump
+
+tmpdir=$(mktemp --directory --tmpdir=$LUSTRE_DIR)
+trap -- "rm -rf '$tmpdir'; stop_changelogs '$LUSTRE_MDT' '$userid'; \
+         stop_changelogs '$LUSTRE_MDT1' '$userid1'" EXIT
+cd "$tmpdir"
+
+sub_setup=multi_mdt_setup
+sub_teardown=multi_mdt_teardown
+run_tests "${tests[@]}"
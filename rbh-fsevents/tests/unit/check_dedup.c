@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <sys/stat.h>
 
@@ -33,7 +34,7 @@ START_TEST(dedup_basic)
     fake_source = empty_source();
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -63,7 +64,7 @@ START_TEST(dedup_one_event)
     fake_source = event_list_source(&fake_event, 1);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -106,7 +107,7 @@ START_TEST(dedup_many_events)
     fake_source = event_list_source(fake_events, 5);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -156,7 +157,7 @@ START_TEST(dedup_no_dedup)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -202,7 +203,7 @@ START_TEST(dedup_link_unlink)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -238,7 +239,7 @@ START_TEST(dedup_link_unlink_same_entry_different_parents)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -288,7 +289,7 @@ START_TEST(dedup_create_delete)
     fake_source = event_list_source(fake_events, 4);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -324,7 +325,7 @@ START_TEST(dedup_last_unlink)
     fake_source = event_list_source(fake_events, 3);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -369,7 +370,7 @@ START_TEST(dedup_upsert_no_statx)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -427,7 +428,7 @@ START_TEST(dedup_upsert_statx)
     fake_source = event_list_source(fake_events, 4);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -487,7 +488,7 @@ START_TEST(dedup_upsert_statx_symlink)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -543,7 +544,7 @@ START_TEST(dedup_same_xattr)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -587,7 +588,7 @@ START_TEST(dedup_different_xattrs)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -648,7 +649,7 @@ START_TEST(dedup_same_xattr_different_values)
     fake_source = event_list_source(fake_events, 4);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -703,7 +704,7 @@ START_TEST(dedup_lustre_xattr)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -747,7 +748,7 @@ START_TEST(dedup_xattr_merge_lustre_with_xattr)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -802,7 +803,7 @@ START_TEST(dedup_xattr_merge_xattrs_with_lustre)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -852,7 +853,7 @@ START_TEST(dedup_xattr_merge_fid_with_lustre)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -904,7 +905,7 @@ START_TEST(dedup_xattr_merge_lustre_with_fid)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -950,7 +951,7 @@ START_TEST(dedup_xattr_merge_xattrs_with_fid)
     fake_source = event_list_source(fake_events, 2);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -998,7 +999,7 @@ START_TEST(dedup_xattr_merge_xattrs_fid_and_lustre)
     fake_source = event_list_source(fake_events, 3);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -1065,7 +1066,7 @@ START_TEST(dedup_check_flush_order)
     fake_source = event_list_source(fake_events, 6);
     ck_assert_ptr_nonnull(fake_source);
 
-    deduplicator = deduplicator_new(20, fake_source, 1, &fsevents_md);
+    deduplicator = deduplicator_new(20, fake_source, 1, NULL, 0, &fsevents_md);
     ck_assert_ptr_nonnull(deduplicator);
 
     events = rbh_mut_iter_next(deduplicator);
@@ -1099,6 +1100,269 @@ START_TEST(dedup_check_flush_order)
 }
 END_TEST
 
+START_TEST(dedup_retention_hot_id)
+{
+    const struct retention_policy retention = {
+        .max_flushes = 1,
+        .max_entries = 1,
+    };
+    struct rbh_fsevents_metadata fsevents_md = { 0 };
+    struct rbh_mut_iterator *deduplicator;
+    struct source *fake_source = NULL;
+    struct rbh_fsevent fake_events[4];
+    struct rbh_mut_iterator *events;
+    const struct rbh_fsevent *event;
+    struct sub_batch *sub_batch;
+    struct rbh_id *ids[3];
+
+    for (size_t i = 0; i < 3; i++)
+        ids[i] = fake_id();
+
+    fake_upsert(&fake_events[0], ids[0], RBH_STATX_MODE, NULL);
+    fake_upsert(&fake_events[1], ids[0], RBH_STATX_UID, NULL);
+    fake_upsert(&fake_events[2], ids[1], RBH_STATX_MODE, NULL);
+    fake_upsert(&fake_events[3], ids[2], RBH_STATX_MODE, NULL);
+
+    /* The pool is full once ids 0 and 1 are in it. Id 0 received 2 events, so
+     * it is held back for one flush while id 1 is flushed.
+     */
+    fake_source = event_list_source(fake_events, 4);
+    ck_assert_ptr_nonnull(fake_source);
+
+    deduplicator = deduplicator_new(2, fake_source, 1, &retention, 0,
+                                    &fsevents_md);
+    ck_assert_ptr_nonnull(deduplicator);
+
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_nonnull(events);
+
+    sub_batch = rbh_mut_iter_next(events);
+    ck_assert_ptr_nonnull(sub_batch);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[1], &event->id);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_null(event);
+    ck_assert_int_eq(errno, ENODATA);
+
+    rbh_iter_destroy(sub_batch->fsevents);
+    rbh_mut_iter_destroy(events);
+
+    ck_assert_uint_eq(fsevents_md.held_entry_amount, 1);
+    ck_assert_uint_eq(fsevents_md.held_entry_peak, 1);
+
+    /* The source is exhausted, nothing is held back anymore */
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_nonnull(events);
+
+    sub_batch = rbh_mut_iter_next(events);
+    ck_assert_ptr_nonnull(sub_batch);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[0], &event->id);
+    ck_assert_int_eq(event->xattrs.pairs[0].value->map.pairs[0].value->uint32,
+                     RBH_STATX_MODE | RBH_STATX_UID);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[2], &event->id);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_null(event);
+    ck_assert_int_eq(errno, ENODATA);
+
+    ck_assert_uint_eq(fsevents_md.held_entry_amount, 1);
+
+    for (size_t i = 0; i < 3; i++)
+        free(ids[i]);
+    rbh_iter_destroy(sub_batch->fsevents);
+    rbh_mut_iter_destroy(events);
+    rbh_mut_iter_destroy(deduplicator);
+    event_list_source_destroy(fake_source);
+}
+END_TEST
+
+START_TEST(dedup_retention_namespace)
+{
+    const struct retention_policy retention = {
+        .max_flushes = 1,
+        .max_entries = 1,
+    };
+    struct rbh_fsevents_metadata fsevents_md = { 0 };
+    struct rbh_mut_iterator *deduplicator;
+    struct source *fake_source = NULL;
+    struct rbh_fsevent fake_events[4];
+    struct rbh_mut_iterator *events;
+    const struct rbh_fsevent *event;
+    struct sub_batch *sub_batch;
+    struct rbh_id *parent;
+    struct rbh_id *ids[3];
+
+    parent = fake_id();
+    for (size_t i = 0; i < 3; i++)
+        ids[i] = fake_id();
+
+    fake_create(&fake_events[0], ids[0], parent);
+    fake_upsert(&fake_events[1], ids[0], RBH_STATX_UID, NULL);
+    fake_upsert(&fake_events[2], ids[1], RBH_STATX_MODE, NULL);
+    fake_upsert(&fake_events[3], ids[2], RBH_STATX_MODE, NULL);
+
+    /* Id 0 received 2 events, but one of them is a link: it is not held back
+     */
+    fake_source = event_list_source(fake_events, 4);
+    ck_assert_ptr_nonnull(fake_source);
+
+    deduplicator = deduplicator_new(2, fake_source, 1, &retention, 0,
+                                    &fsevents_md);
+    ck_assert_ptr_nonnull(deduplicator);
+
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_nonnull(events);
+
+    sub_batch = rbh_mut_iter_next(events);
+    ck_assert_ptr_nonnull(sub_batch);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[0], &event->id);
+    ck_assert_int_eq(event->type, RBH_FET_LINK);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[0], &event->id);
+    ck_assert_int_eq(event->type, RBH_FET_UPSERT);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_nonnull(event);
+    ck_assert_id_eq(ids[1], &event->id);
+
+    event = rbh_iter_next(sub_batch->fsevents);
+    ck_assert_ptr_null(event);
+    ck_assert_int_eq(errno, ENODATA);
+
+    ck_assert_uint_eq(fsevents_md.held_entry_amount, 0);
+
+    rbh_iter_destroy(sub_batch->fsevents);
+    rbh_mut_iter_destroy(events);
+
+    /* Drain the source, for the next tests to start from a clean state */
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_nonnull(events);
+    sub_batch = rbh_mut_iter_next(events);
+    ck_assert_ptr_nonnull(sub_batch);
+
+    free(parent);
+    for (size_t i = 0; i < 3; i++)
+        free(ids[i]);
+    rbh_iter_destroy(sub_batch->fsevents);
+    rbh_mut_iter_destroy(events);
+    rbh_mut_iter_destroy(deduplicator);
+    event_list_source_destroy(fake_source);
+}
+END_TEST
+
+/* A source that has nothing new for a while after each of its fsevents */
+struct idle_source {
+    struct source source;
+    struct rbh_fsevent *events;
+    size_t count;
+    size_t next;
+    bool idle;
+};
+
+static const void *
+idle_source_next(void *iterator)
+{
+    static const struct timespec IDLE = { .tv_nsec = 10 * 1000 * 1000 };
+    struct idle_source *source = iterator;
+
+    if (source->idle) {
+        source->idle = false;
+        nanosleep(&IDLE, NULL);
+        errno = ETIMEDOUT;
+        return NULL;
+    }
+
+    if (source->next == source->count) {
+        errno = ENODATA;
+        return NULL;
+    }
+
+    source->idle = true;
+    return &source->events[source->next++];
+}
+
+static const struct rbh_iterator_operations IDLE_SOURCE_OPS = {
+    .next = idle_source_next,
+};
+
+START_TEST(dedup_flush_delay)
+{
+    struct rbh_fsevents_metadata fsevents_md = { 0 };
+    struct idle_source source = {
+        .source = {
+            .name = "test-idle",
+            .fsevents = {
+                .ops = &IDLE_SOURCE_OPS,
+            },
+        },
+        .count = 2,
+        .idle = true,
+    };
+    struct rbh_mut_iterator *deduplicator;
+    struct rbh_fsevent fake_events[2];
+    struct rbh_mut_iterator *events;
+    const struct rbh_fsevent *event;
+    struct sub_batch *sub_batch;
+    struct rbh_id *ids[2];
+
+    for (size_t i = 0; i < 2; i++) {
+        ids[i] = fake_id();
+        fake_upsert(&fake_events[i], ids[i], RBH_STATX_MODE, NULL);
+    }
+    source.events = fake_events;
+
+    deduplicator = deduplicator_new(20, &source.source, 1, NULL, 1,
+                                    &fsevents_md);
+    ck_assert_ptr_nonnull(deduplicator);
+
+    /* Nothing to flush yet */
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_null(events);
+    ck_assert_int_eq(errno, ETIMEDOUT);
+
+    /* Each fsevent is flushed on its own, well before the batch is full */
+    for (size_t i = 0; i < 2; i++) {
+        events = rbh_mut_iter_next(deduplicator);
+        ck_assert_ptr_nonnull(events);
+
+        sub_batch = rbh_mut_iter_next(events);
+        ck_assert_ptr_nonnull(sub_batch);
+
+        event = rbh_iter_next(sub_batch->fsevents);
+        ck_assert_ptr_nonnull(event);
+        ck_assert_id_eq(ids[i], &event->id);
+
+        event = rbh_iter_next(sub_batch->fsevents);
+        ck_assert_ptr_null(event);
+
+        rbh_iter_destroy(sub_batch->fsevents);
+        rbh_mut_iter_destroy(events);
+    }
+
+    events = rbh_mut_iter_next(deduplicator);
+    ck_assert_ptr_null(events);
+    ck_assert_int_eq(errno, ENODATA);
+
+    for (size_t i = 0; i < 2; i++)
+        free(ids[i]);
+    rbh_mut_iter_destroy(deduplicator);
+}
+END_TEST
+
 static Suite *
 unit_suite(void)
 {
@@ -1130,6 +1394,9 @@ unit_suite(void)
     tcase_add_test(tests, dedup_xattr_merge_xattrs_with_fid);
     tcase_add_test(tests, dedup_xattr_merge_xattrs_fid_and_lustre);
     tcase_add_test(tests, dedup_check_flush_order);
+    tcase_add_test(tests, dedup_retention_hot_id);
+    tcase_add_test(tests, dedup_retention_namespace);
+    tcase_add_test(tests, dedup_flush_delay);
 
     suite_add_tcase(suite, tests);
 
@@ -0,0 +1,275 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "check-compat.h"
+
+#include "src/enrichers/posix/internals.h"
+
+#include <robinhood/statx.h>
+
+static const struct rbh_id *
+test_id(size_t value)
+{
+    static __thread size_t data;
+    static __thread struct rbh_id id;
+
+    data = value;
+    id.data = (const char *)&data;
+    id.size = sizeof(data);
+
+    return &id;
+}
+
+static bool
+fd_is_open(int fd)
+{
+    return fcntl(fd, F_GETFD) != -1 || errno != EBADF;
+}
+
+START_TEST(fdc_get_add)
+{
+    struct fd_cache_entry *entry;
+    int fd;
+
+    ck_assert_ptr_null(fd_cache_get(test_id(1)));
+
+    fd = open("/dev/null", O_RDONLY);
+    ck_assert_int_ge(fd, 0);
+
+    entry = fd_cache_add(test_id(1), fd);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_ptr_eq(fd_cache_get(test_id(1)), entry);
+    ck_assert_int_eq(fd_cache_get(test_id(1))->fd, fd);
+    ck_assert_ptr_null(fd_cache_get(test_id(2)));
+
+    fd_cache_evict(test_id(1));
+    ck_assert_ptr_null(fd_cache_get(test_id(1)));
+    ck_assert(!fd_is_open(fd));
+}
+END_TEST
+
+START_TEST(fdc_lru)
+{
+    int fds[FD_CACHE_SIZE + 1];
+
+    for (size_t i = 0; i < FD_CACHE_SIZE; i++) {
+        fds[i] = open("/dev/null", O_RDONLY);
+        fd_cache_add(test_id(i), fds[i]);
+    }
+
+    /* The first entry is now the most recently used one */
+    ck_assert_ptr_nonnull(fd_cache_get(test_id(0)));
+
+    fds[FD_CACHE_SIZE] = open("/dev/null", O_RDONLY);
+    fd_cache_add(test_id(FD_CACHE_SIZE), fds[FD_CACHE_SIZE]);
+
+    ck_assert_ptr_nonnull(fd_cache_get(test_id(0)));
+    ck_assert_ptr_null(fd_cache_get(test_id(1)));
+    ck_assert(!fd_is_open(fds[1]));
+
+    for (size_t i = 0; i <= FD_CACHE_SIZE; i++)
+        fd_cache_evict(test_id(i));
+}
+END_TEST
+
+START_TEST(fdc_generations)
+{
+    int fd;
+
+    fd = open("/dev/null", O_RDONLY);
+    fd_cache_add(test_id(1), fd);
+
+    /* Entries are kept open until the end of the next sub-batch */
+    fd_cache_end_generation();
+    ck_assert(fd_is_open(fd));
+    fd_cache_end_generation();
+    ck_assert(fd_is_open(fd));
+
+    fd_cache_end_generation();
+    ck_assert(!fd_is_open(fd));
+    ck_assert_ptr_null(fd_cache_get(test_id(1)));
+}
+END_TEST
+
+/* As if the statx of \p entry was retrieved a second after its last change */
+static void
+set_statx(struct fd_cache_entry *entry, int fd)
+{
+    struct rbh_statx statxbuf;
+    struct timespec retrieved;
+
+    ck_assert_int_eq(rbh_statx(fd, "", AT_EMPTY_PATH, RBH_STATX_ALL,
+                               &statxbuf), 0);
+    retrieved.tv_sec = statxbuf.stx_ctime.tv_sec + 1;
+    retrieved.tv_nsec = 0;
+    fd_cache_set_statx(entry, &statxbuf, &retrieved);
+}
+
+START_TEST(fdc_statx)
+{
+    char path[] = "/tmp/check_fd_cache.XXXXXX";
+    struct fd_cache_entry *entry;
+    struct rbh_statx statxbuf;
+    int fd;
+
+    fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+
+    entry = fd_cache_add(test_id(1), fd);
+    errno = 0;
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), -1);
+    ck_assert_int_eq(errno, ENODATA);
+    ck_assert_ptr_null(fd_cache_current_statx(entry));
+
+    set_statx(entry, fd);
+    ck_assert_ptr_nonnull(fd_cache_current_statx(entry));
+
+    /* The statx is checked again in the next sub-batch */
+    fd_cache_end_generation();
+    entry = fd_cache_get(test_id(1));
+    ck_assert_ptr_null(fd_cache_current_statx(entry));
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), 0);
+    ck_assert_ptr_nonnull(fd_cache_current_statx(entry));
+
+    /* Changing the entry changes its ctime, from the one of an older statx */
+    fd_cache_end_generation();
+    entry = fd_cache_get(test_id(1));
+    entry->statx.stx_ctime.tv_sec--;
+    entry->statx_time.tv_sec--;
+    errno = 0;
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), -1);
+    ck_assert_int_eq(errno, ENODATA);
+
+    set_statx(entry, fd);
+
+    /* Removing it is told apart */
+    fd_cache_end_generation();
+    entry = fd_cache_get(test_id(1));
+    ck_assert_int_eq(unlink(path), 0);
+    errno = 0;
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), -1);
+    ck_assert_int_eq(errno, ESTALE);
+
+    fd_cache_evict(test_id(1));
+}
+END_TEST
+
+START_TEST(fdc_statx_racy)
+{
+    char path[] = "/tmp/check_fd_cache.XXXXXX";
+    struct fd_cache_entry *entry;
+    struct rbh_statx statxbuf;
+    struct timespec retrieved;
+    int fd;
+
+    fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+
+    entry = fd_cache_add(test_id(1), fd);
+    ck_assert_int_eq(clock_gettime(CLOCK_REALTIME_COARSE, &retrieved), 0);
+    ck_assert_int_eq(rbh_statx(fd, "", AT_EMPTY_PATH, RBH_STATX_ALL,
+                               &statxbuf), 0);
+    fd_cache_set_statx(entry, &statxbuf, &retrieved);
+
+    /* Right after the statx, the ctime may well not change */
+    ck_assert_int_eq(write(fd, "x", 1), 1);
+
+    fd_cache_end_generation();
+    entry = fd_cache_get(test_id(1));
+    errno = 0;
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), -1);
+    ck_assert_int_eq(errno, ENODATA);
+
+    ck_assert_int_eq(unlink(path), 0);
+    fd_cache_evict(test_id(1));
+}
+END_TEST
+
+START_TEST(fdc_statx_atime)
+{
+    char path[] = "/tmp/check_fd_cache.XXXXXX";
+    struct fd_cache_entry *entry;
+    struct rbh_statx statxbuf;
+    char buffer;
+    int fd;
+
+    fd = mkstemp(path);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(write(fd, "x", 1), 1);
+
+    entry = fd_cache_add(test_id(1), fd);
+    set_statx(entry, fd);
+
+    /* Reading the entry changes its atime, but not its ctime */
+    ck_assert_int_eq(pread(fd, &buffer, 1, 0), 1);
+
+    fd_cache_end_generation();
+    entry = fd_cache_get(test_id(1));
+    errno = 0;
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_ATIME_SEC, &statxbuf),
+                     -1);
+    ck_assert_int_eq(errno, ENODATA);
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_SIZE, &statxbuf), 0);
+
+    /* Within the sub-batch the statx was retrieved in, it is recent enough */
+    set_statx(entry, fd);
+    ck_assert_int_eq(fd_cache_statx(entry, RBH_STATX_ATIME, &statxbuf), 0);
+
+    ck_assert_int_eq(unlink(path), 0);
+    fd_cache_evict(test_id(1));
+}
+END_TEST
+
+static Suite *
+unit_suite(void)
+{
+    Suite *suite;
+    TCase *tests;
+
+    suite = suite_create("fd cache");
+
+    tests = tcase_create("fd_cache");
+    tcase_add_test(tests, fdc_get_add);
+    tcase_add_test(tests, fdc_lru);
+    tcase_add_test(tests, fdc_generations);
+    tcase_add_test(tests, fdc_statx);
+    tcase_add_test(tests, fdc_statx_racy);
+    tcase_add_test(tests, fdc_statx_atime);
+
+    suite_add_tcase(suite, tests);
+
+    return suite;
+}
+
+int
+main(void)
+{
+    int number_failed;
+    Suite *suite;
+    SRunner *runner;
+
+    suite = unit_suite();
+    runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,235 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check-compat.h"
+
+#include "metrics.h"
+
+#include <robinhood/itertools.h>
+
+static uint64_t
+bucket_count(struct metrics_histogram *histogram, size_t bucket)
+{
+    return atomic_load(&histogram->buckets[bucket]);
+}
+
+START_TEST(metrics_buckets)
+{
+    struct metrics_histogram histogram = { 0 };
+
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_nsec = 500 });
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_nsec = 1000 });
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_nsec = 3000 });
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_sec = 1 });
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_sec = 3600 });
+    metrics_histogram_add(&histogram, (struct timespec){ .tv_sec = -1 });
+
+    ck_assert_uint_eq(bucket_count(&histogram, 0), 2);
+    ck_assert_uint_eq(bucket_count(&histogram, 1), 1);
+    ck_assert_uint_eq(bucket_count(&histogram, 2), 1);
+    /* 2^19 <= 1000000 < 2^20 */
+    ck_assert_uint_eq(bucket_count(&histogram, 20), 1);
+    ck_assert_uint_eq(bucket_count(&histogram, METRICS_BUCKETS - 1), 1);
+}
+END_TEST
+
+START_TEST(metrics_quantiles)
+{
+    uint64_t buckets[METRICS_BUCKETS] = { 0 };
+
+    ck_assert_uint_eq(metrics_quantile(buckets, 0.5), 0);
+
+    buckets[3] = 90;
+    buckets[10] = 9;
+    buckets[METRICS_BUCKETS - 1] = 1;
+
+    ck_assert_uint_eq(metrics_quantile(buckets, 0.5), 1 << 3);
+    ck_assert_uint_eq(metrics_quantile(buckets, 0.9), 1 << 3);
+    ck_assert_uint_eq(metrics_quantile(buckets, 0.99), 1 << 10);
+    ck_assert_uint_eq(metrics_quantile(buckets, 1),
+                      1 << (METRICS_BUCKETS - 2));
+}
+END_TEST
+
+struct fake_source {
+    struct source source;
+    struct source_metrics metrics;
+};
+
+static void
+fake_source_metrics(void *source, struct source_metrics *metrics)
+{
+    struct fake_source *fake = source;
+
+    *metrics = fake->metrics;
+}
+
+START_TEST(metrics_write_interval)
+{
+    struct fake_source source = {
+        .source = {
+            .metrics = fake_source_metrics,
+        },
+        .metrics = {
+            .read = 10,
+            .ack = true,
+            .ack_lag = 3,
+        },
+    };
+    struct metrics *metrics;
+    size_t size;
+    char *output;
+    FILE *file;
+
+    metrics = metrics_new(&source.source, 2);
+    metrics_set(&metrics->fsevents, 8);
+    metrics_set(&metrics->deduplicated, 2);
+    metrics_add(&metrics->workers[1]->queued, 3);
+    metrics_add(&metrics->workers[1]->processed, 1);
+    metrics_histogram_add(&metrics->workers[1]->enrich,
+                          (struct timespec){ .tv_nsec = 3000 });
+
+    file = open_memstream(&output, &size);
+    metrics_write(metrics, file);
+    fclose(file);
+
+    ck_assert_ptr_nonnull(strstr(output, " read=10 "));
+    ck_assert_ptr_nonnull(strstr(output,
+                                 " fsevents=8 deduplicated=2 dedup_ratio=0.250"));
+    ck_assert_ptr_nonnull(strstr(output, " ack_lag=3\n"));
+    ck_assert_ptr_nonnull(strstr(output, " worker=0 queue_depth=0 "));
+    ck_assert_ptr_nonnull(strstr(output, " worker=1 queue_depth=2 "));
+    ck_assert_ptr_nonnull(strstr(output, " enrich_count=1 enrich_p50_us=4 "));
+    free(output);
+
+    /* Only what happened since is written the next time */
+    source.metrics.read = 15;
+    metrics_set(&metrics->fsevents, 10);
+
+    file = open_memstream(&output, &size);
+    metrics_write(metrics, file);
+    fclose(file);
+
+    ck_assert_ptr_nonnull(strstr(output, " read=5 "));
+    ck_assert_ptr_nonnull(strstr(output,
+                                 " fsevents=2 deduplicated=0 dedup_ratio=0.000"));
+    ck_assert_ptr_nonnull(strstr(output, " enrich_count=0 "));
+    free(output);
+
+    metrics_destroy(metrics);
+}
+END_TEST
+
+START_TEST(metrics_timed_iterator)
+{
+    static const int VALUES[] = { 1, 2, 3 };
+    struct metrics_histogram histogram = { 0 };
+    struct timespec elapsed = { 0 };
+    struct rbh_iterator *iterator;
+    uint64_t count = 0;
+
+    iterator = rbh_iter_array(VALUES, sizeof(*VALUES), 3, NULL);
+    ck_assert_ptr_nonnull(iterator);
+    iterator = metrics_iter_time(iterator, &histogram, &elapsed);
+
+    for (size_t i = 0; i < 3; i++)
+        ck_assert_int_eq(*(const int *)rbh_iter_next(iterator), VALUES[i]);
+
+    errno = 0;
+    ck_assert_ptr_null(rbh_iter_next(iterator));
+    ck_assert_int_eq(errno, ENODATA);
+    rbh_iter_destroy(iterator);
+
+    /* The end of the iterator is not a latency */
+    for (size_t i = 0; i < METRICS_BUCKETS; i++)
+        count += bucket_count(&histogram, i);
+    ck_assert_uint_eq(count, 3);
+}
+END_TEST
+
+START_TEST(metrics_throughputs)
+{
+    struct metrics *metrics;
+    size_t size;
+    char *output;
+    FILE *file;
+
+    metrics = metrics_new(&(struct source){ 0 }, 2);
+    metrics_set(&metrics->fsevents, 100);
+    metrics_histogram_add(&metrics->batches, (struct timespec){ .tv_sec = 1 });
+    metrics_histogram_add(&metrics->batches, (struct timespec){ .tv_sec = 1 });
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; j < 50; j++)
+            metrics_histogram_add(&metrics->workers[i]->enrich,
+                                  (struct timespec){ .tv_nsec = 20000000 });
+        metrics_histogram_add(&metrics->workers[i]->update,
+                              (struct timespec){ .tv_nsec = 500000000 });
+    }
+
+    file = open_memstream(&output, &size);
+    metrics_summary(metrics, file, (struct timespec){ .tv_sec = 4 });
+    fclose(file);
+
+    /* The workers spent their time in parallel */
+    ck_assert_ptr_nonnull(strstr(output,
+        "read and dedup            100        2.000           50.0\n"));
+    ck_assert_ptr_nonnull(strstr(output,
+        "enrich                    100        1.000          100.0\n"));
+    ck_assert_ptr_nonnull(strstr(output,
+        "update                    100        0.500          200.0\n"));
+    ck_assert_ptr_nonnull(strstr(output,
+        "total                     100        4.000           25.0\n"));
+    free(output);
+
+    metrics_destroy(metrics);
+}
+END_TEST
+
+static Suite *
+unit_suite(void)
+{
+    Suite *suite;
+    TCase *tests;
+
+    suite = suite_create("metrics");
+
+    tests = tcase_create("metrics");
+    tcase_add_test(tests, metrics_buckets);
+    tcase_add_test(tests, metrics_quantiles);
+    tcase_add_test(tests, metrics_write_interval);
+    tcase_add_test(tests, metrics_timed_iterator);
+    tcase_add_test(tests, metrics_throughputs);
+
+    suite_add_tcase(suite, tests);
+
+    return suite;
+}
+
+int
+main(void)
+{
+    int number_failed;
+    Suite *suite;
+    SRunner *runner;
+
+    suite = unit_suite();
+    runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
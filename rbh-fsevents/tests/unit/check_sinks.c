@@ -0,0 +1,131 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check-compat.h"
+
+#include "sink.h"
+
+#include <robinhood/fsevent.h>
+#include <robinhood/itertools.h>
+
+static const struct rbh_fsevent FSEVENTS[] = {
+    { .type = RBH_FET_UPSERT },
+    { .type = RBH_FET_LINK },
+    { .type = RBH_FET_UPSERT },
+    { .type = RBH_FET_XATTR },
+    { .type = RBH_FET_DELETE },
+};
+
+static struct rbh_iterator *
+fsevents_iter(size_t count)
+{
+    struct rbh_iterator *fsevents;
+
+    fsevents = rbh_iter_array(FSEVENTS, sizeof(*FSEVENTS), count, NULL);
+    ck_assert_ptr_nonnull(fsevents);
+
+    return fsevents;
+}
+
+START_TEST(null_sink)
+{
+    struct rbh_iterator *fsevents = fsevents_iter(5);
+    struct sink *sink;
+
+    sink = sink_from_null();
+    ck_assert_str_eq(sink->name, "null");
+
+    ck_assert_int_eq(sink_process(sink, fsevents), 0);
+    /* The fsevents were all consumed */
+    errno = 0;
+    ck_assert_ptr_null(rbh_iter_next(fsevents));
+    ck_assert_int_eq(errno, ENODATA);
+
+    rbh_iter_destroy(fsevents);
+    sink_destroy(sink);
+}
+END_TEST
+
+START_TEST(count_sink)
+{
+    struct sink *sinks[2];
+    size_t size;
+    char *output;
+    FILE *file;
+
+    file = open_memstream(&output, &size);
+
+    /* Like two workers, each with a sink of its own */
+    for (size_t i = 0; i < 2; i++) {
+        struct rbh_iterator *fsevents = fsevents_iter(i == 0 ? 5 : 2);
+
+        sinks[i] = sink_from_count(file);
+        ck_assert_int_eq(sink_process(sinks[i], fsevents), 0);
+        rbh_iter_destroy(fsevents);
+    }
+
+    /* Nothing is written until the last sink is destroyed */
+    sink_destroy(sinks[0]);
+    fflush(file);
+    ck_assert_uint_eq(size, 0);
+
+    sink_destroy(sinks[1]);
+    fclose(file);
+
+    ck_assert_str_eq(output,
+                     "upsert: 3\n"
+                     "link: 2\n"
+                     "unlink: 0\n"
+                     "partial_unlink: 0\n"
+                     "delete: 1\n"
+                     "xattr: 1\n"
+                     "total: 7\n");
+    free(output);
+}
+END_TEST
+
+static Suite *
+unit_suite(void)
+{
+    Suite *suite;
+    TCase *tests;
+
+    suite = suite_create("sinks");
+
+    tests = tcase_create("sinks");
+    tcase_add_test(tests, null_sink);
+    tcase_add_test(tests, count_sink);
+
+    suite_add_tcase(suite, tests);
+
+    return suite;
+}
+
+int
+main(void)
+{
+    int number_failed;
+    Suite *suite;
+    SRunner *runner;
+
+    suite = unit_suite();
+    runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,296 @@
+/* This file is part of RobinHood
+ * Copyright (C) 2026 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "check-compat.h"
+
+#include "work_queue.h"
+
+#define ITEM(value) ((void *)(uintptr_t)(value))
+
+START_TEST(wq_fifo)
+{
+    struct work_queue *queue;
+    size_t shard;
+
+    queue = work_queue_new(1, 4, 1);
+    ck_assert_ptr_nonnull(queue);
+
+    for (size_t i = 1; i <= 4; i++)
+        ck_assert(work_queue_push(queue, 0, ITEM(i)));
+
+    for (size_t i = 1; i <= 4; i++) {
+        ck_assert_ptr_eq(work_queue_pop(queue, 0, &shard), ITEM(i));
+        ck_assert_uint_eq(shard, 0);
+        work_queue_release(queue, shard);
+    }
+
+    work_queue_destroy(queue, NULL);
+}
+END_TEST
+
+START_TEST(wq_home_first)
+{
+    struct work_queue *queue;
+    size_t shard;
+
+    /* worker 0 owns shards 0 and 1, worker 1 owns shards 2 and 3 */
+    queue = work_queue_new(4, 4, 2);
+
+    ck_assert(work_queue_push(queue, 0, ITEM(1)));
+    ck_assert(work_queue_push(queue, 3, ITEM(2)));
+
+    ck_assert_ptr_eq(work_queue_pop(queue, 1, &shard), ITEM(2));
+    ck_assert_uint_eq(shard, 3);
+    work_queue_release(queue, shard);
+
+    ck_assert_ptr_eq(work_queue_pop(queue, 0, &shard), ITEM(1));
+    ck_assert_uint_eq(shard, 0);
+    work_queue_release(queue, shard);
+
+    work_queue_destroy(queue, NULL);
+}
+END_TEST
+
+START_TEST(wq_steal)
+{
+    struct work_queue *queue;
+    size_t shard;
+
+    queue = work_queue_new(4, 4, 2);
+
+    ck_assert(work_queue_push(queue, 1, ITEM(1)));
+
+    ck_assert_ptr_eq(work_queue_pop(queue, 1, &shard), ITEM(1));
+    ck_assert_uint_eq(shard, 1);
+    work_queue_release(queue, shard);
+
+    work_queue_destroy(queue, NULL);
+}
+END_TEST
+
+START_TEST(wq_busy_shard)
+{
+    struct work_queue *queue;
+    size_t shard;
+
+    queue = work_queue_new(2, 4, 2);
+
+    ck_assert(work_queue_push(queue, 0, ITEM(1)));
+    ck_assert(work_queue_push(queue, 0, ITEM(2)));
+    ck_assert(work_queue_push(queue, 1, ITEM(3)));
+
+    ck_assert_ptr_eq(work_queue_pop(queue, 0, &shard), ITEM(1));
+    ck_assert_uint_eq(shard, 0);
+
+    /* shard 0 is held by worker 0, its second item must wait */
+    ck_assert_ptr_eq(work_queue_pop(queue, 1, &shard), ITEM(3));
+    ck_assert_uint_eq(shard, 1);
+    work_queue_release(queue, shard);
+
+    work_queue_close(queue);
+    ck_assert_ptr_null(work_queue_pop(queue, 1, &shard));
+
+    work_queue_release(queue, 0);
+    ck_assert_ptr_eq(work_queue_pop(queue, 1, &shard), ITEM(2));
+    ck_assert_uint_eq(shard, 0);
+    work_queue_release(queue, shard);
+
+    work_queue_destroy(queue, NULL);
+}
+END_TEST
+
+static size_t freed;
+
+static void
+count_free(void *item)
+{
+    (void) item;
+    freed++;
+}
+
+START_TEST(wq_close)
+{
+    struct work_queue *queue;
+
+    queue = work_queue_new(2, 1, 1);
+
+    ck_assert(work_queue_push(queue, 0, ITEM(1)));
+    ck_assert(work_queue_push(queue, 1, ITEM(2)));
+
+    work_queue_close(queue);
+    /* the shard is full, but the queue is closed: this must not block */
+    ck_assert(!work_queue_push(queue, 0, ITEM(3)));
+
+    freed = 0;
+    work_queue_destroy(queue, count_free);
+    ck_assert_uint_eq(freed, 2);
+}
+END_TEST
+
+START_TEST(wq_timedpop)
+{
+    struct work_queue *queue;
+    struct timespec deadline;
+    size_t shard;
+
+    queue = work_queue_new(1, 1, 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += 10 * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    errno = 0;
+    ck_assert_ptr_null(work_queue_timedpop(queue, 0, &shard, &deadline));
+    ck_assert_int_eq(errno, ETIMEDOUT);
+
+    /* Items already there are returned even past the deadline */
+    ck_assert(work_queue_push(queue, 0, ITEM(1)));
+    ck_assert_ptr_eq(work_queue_timedpop(queue, 0, &shard, &deadline),
+                     ITEM(1));
+    work_queue_release(queue, shard);
+
+    ck_assert(!work_queue_closed(queue));
+    work_queue_close(queue);
+    ck_assert(work_queue_closed(queue));
+
+    errno = 0;
+    ck_assert_ptr_null(work_queue_timedpop(queue, 0, &shard, &deadline));
+    ck_assert_int_eq(errno, ENODATA);
+
+    work_queue_destroy(queue, NULL);
+}
+END_TEST
+
+#define SHARD_COUNT 8
+#define WORKER_COUNT 4
+#define ITEM_COUNT 100000
+
+struct ordering {
+    struct work_queue *queue;
+    /* Last item popped from each shard */
+    size_t last[SHARD_COUNT];
+    /* Set if items of a shard were popped out of order */
+    bool unordered;
+};
+
+struct ordering_worker {
+    struct ordering *ordering;
+    size_t id;
+};
+
+static void *
+ordering_worker(void *arg)
+{
+    struct ordering_worker *worker = arg;
+    struct ordering *ordering = worker->ordering;
+    size_t shard;
+    void *item;
+
+    while ((item = work_queue_pop(ordering->queue, worker->id, &shard))) {
+        size_t value = (uintptr_t)item;
+
+        if (value % SHARD_COUNT != shard ||
+            value / SHARD_COUNT != ordering->last[shard] + 1)
+            ordering->unordered = true;
+        ordering->last[shard] = value / SHARD_COUNT;
+
+        work_queue_release(ordering->queue, shard);
+    }
+
+    return NULL;
+}
+
+START_TEST(wq_ordering)
+{
+    struct ordering_worker workers[WORKER_COUNT];
+    size_t pushed[SHARD_COUNT] = { 0 };
+    pthread_t threads[WORKER_COUNT];
+    struct ordering ordering = { 0 };
+
+    ordering.queue = work_queue_new(SHARD_COUNT, 4, WORKER_COUNT);
+
+    for (size_t i = 0; i < WORKER_COUNT; i++) {
+        workers[i].ordering = &ordering;
+        workers[i].id = i;
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, ordering_worker,
+                                        &workers[i]), 0);
+    }
+
+    /* Half the items go to the same shard, for the other workers to steal
+     * from it.
+     */
+    for (size_t i = 0; i < ITEM_COUNT; i++) {
+        size_t shard = i % 2 ? 0 : (i / 2) % SHARD_COUNT;
+
+        pushed[shard]++;
+        ck_assert(work_queue_push(ordering.queue, shard,
+                                  ITEM(pushed[shard] * SHARD_COUNT + shard)));
+    }
+
+    work_queue_close(ordering.queue);
+    for (size_t i = 0; i < WORKER_COUNT; i++)
+        pthread_join(threads[i], NULL);
+
+    ck_assert(!ordering.unordered);
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+        ck_assert_uint_eq(ordering.last[i], pushed[i]);
+
+    work_queue_destroy(ordering.queue, NULL);
+}
+END_TEST
+
+static Suite *
+unit_suite(void)
+{
+    Suite *suite;
+    TCase *tests;
+
+    suite = suite_create("work queue");
+
+    tests = tcase_create("work_queue");
+    tcase_add_test(tests, wq_fifo);
+    tcase_add_test(tests, wq_home_first);
+    tcase_add_test(tests, wq_steal);
+    tcase_add_test(tests, wq_busy_shard);
+    tcase_add_test(tests, wq_close);
+    tcase_add_test(tests, wq_timedpop);
+    tcase_add_test(tests, wq_ordering);
+
+    suite_add_tcase(suite, tests);
+
+    return suite;
+}
+
+int
+main(void)
+{
+    int number_failed;
+    Suite *suite;
+    SRunner *runner;
+
+    suite = unit_suite();
+    runner = srunner_create(suite);
+
+    srunner_run_all(runner, CK_NORMAL);
+    number_failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -78,9 +78,13 @@ help()
         "                           given backend\n"
         "    -d, --last-sync-start-date\n"
         "                           Show the starting date of the last rbh-sync\n"
+        "    -i, --index-sizes      Show the size of each index of a given\n"
+        "                           backend\n"
         "    -m, --mountpoint       Show the mountpoint used as source for\n"
         "                           the last rbh-sync\n"
         "    -s, --size             Show the size of entries collection\n"
+        "    --create-indexes       Create the indexes the backend relies on\n"
+        "                           to answer queries efficiently\n"
         "    --version              print RobinHood 4's version\n"
         "\n"
         "A robinhood URI is built as follows:\n"
@@ -143,10 +147,18 @@ main(int _argc, char **_argv)
             .name = "count",
             .val = 'c',
         },
+        {
+            .name = "create-indexes",
+            .val = 'I',
+        },
         {
             .name = "last-sync-start-date",
             .val = 'd',
         },
+        {
+            .name = "index-sizes",
+            .val = 'i',
+        },
         {
             .name = "list",
             .val = 'l'
@@ -163,6 +175,7 @@ main(int _argc, char **_argv)
     };
     const struct rbh_backend_plugin *plugin;
     struct rbh_backend *from = NULL;
+    bool create_indexes = false;
     int flags = 0, option;
     const char *name;
     int nb_cli_args;
@@ -181,7 +194,7 @@ main(int _argc, char **_argv)
         argv = &_argv[nb_cli_args];
     }
 
-    while ((option = getopt_long(argc, argv, "abBcdhlms", LONG_OPTIONS,
+    while ((option = getopt_long(argc, argv, "abBcdhilms", LONG_OPTIONS,
                                  NULL)) != -1) {
         switch (option) {
         case 'a':
@@ -202,6 +215,12 @@ main(int _argc, char **_argv)
         case 'h':
             help();
             return 0;
+        case 'i':
+            flags |= RBH_INFO_INDEX_SIZES;
+            break;
+        case 'I':
+            create_indexes = true;
+            break;
         case 'l':
             list_plugins_and_extensions();
             return 0;
@@ -230,7 +249,7 @@ main(int _argc, char **_argv)
         goto end;
     }
 
-    from = rbh_backend_from_uri(argv[0], true);
+    from = rbh_backend_from_uri(argv[0], !create_indexes);
     name = from->name;
     plugin = rbh_backend_plugin_import(name);
 
@@ -240,6 +259,20 @@ main(int _argc, char **_argv)
         goto end;
     }
 
+    if (create_indexes) {
+        if (rbh_backend_set_option(from, RBH_GBO_INDEXES, &create_indexes,
+                                   sizeof(create_indexes))) {
+            fprintf(stderr, "Failed to create indexes: %s\n",
+                    errno == RBH_BACKEND_ERROR ? rbh_backend_error :
+                                                 strerror(errno));
+            rc = 1;
+            goto end;
+        }
+
+        if (!flags)
+            goto end;
+    }
+
     if (flags)
         rc = print_info_fields(from, flags);
     else
@@ -105,6 +105,32 @@ _get_string_value(const struct rbh_value *value, const char *header)
     printf("%s: %s\n", header, value->string);
 }
 
+static void
+_get_index_sizes(const struct rbh_value *value, const char *header)
+{
+    assert(value->type == RBH_VT_MAP);
+
+    if (value->map.count == 0) {
+        printf("%s: no index found\n", header);
+        return;
+    }
+
+    printf("%s:\n", header);
+    for (size_t i = 0; i < value->map.count; i++) {
+        const struct rbh_value_pair *pair = &value->map.pairs[i];
+        char buffer[32];
+
+        if (pair->value->type == RBH_VT_INT32)
+            size_printer(buffer, sizeof(buffer), pair->value->int32);
+        else if (pair->value->type == RBH_VT_INT64)
+            size_printer(buffer, sizeof(buffer), pair->value->int64);
+        else
+            continue;
+
+        printf(" - %s: %s\n", pair->key, buffer);
+    }
+}
+
 static void
 _get_last_sync_start_date(const struct rbh_value *value, const char *header)
 {
@@ -149,6 +175,13 @@ static struct rbh_info_fields INFO_FIELDS[] = {
         "last_sync_start_date",
         _get_last_sync_start_date
     },
+    {
+        RBH_INFO_INDEX_SIZES,
+        "-i: print the size of each index of the mirror",
+        "Index sizes",
+        "index_sizes",
+        _get_index_sizes
+    },
     {
         RBH_INFO_MOUNTPOINT,
         "-m: print info about the mountpoint of the last rbh-sync",
@@ -192,7 +225,7 @@ void
 info_translate(const struct rbh_backend_plugin *plugin)
 {
     size_t field_count = sizeof(INFO_FIELDS) / sizeof(INFO_FIELDS[0]);
-    const uint8_t info = plugin->info;
+    const uint64_t info = plugin->info;
 
     if (!info) {
         printf("Currently no info available for plugin '%s'\n",
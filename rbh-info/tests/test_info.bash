@@ -131,13 +131,57 @@ test_last_sync_start_date()
         error "last_sync_start_date should have been retrieved"
 }
 
+test_create_indexes()
+{
+    mongo_only_test
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    local indexes="$(do_db indexes "$testdb")"
+    if echo "$indexes" | grep "ns.parent_1"; then
+        error "No index should have been created by rbh-sync"
+    fi
+
+    rbh_info "rbh:$db:$testdb" --create-indexes ||
+        error "Failed to create indexes"
+
+    indexes="$(do_db indexes "$testdb")"
+    for index in ns.parent_1 ns.name_1 ns.xattrs.path_1 statx.type_1 \
+                 statx.size_1 statx.uid_1 statx.mtime.sec_1 \
+                 ns.xattrs.rm_time_1; do
+        echo "$indexes" | grep -x "$index" ||
+            error "Index '$index' should have been created"
+    done
+
+    # Creating the indexes again is a no-op
+    rbh_info "rbh:$db:$testdb" --create-indexes ||
+        error "Failed to create indexes a second time"
+}
+
+test_index_sizes()
+{
+    mongo_only_test
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    local output="$(rbh_info "rbh:$db:$testdb" --create-indexes -i)"
+
+    echo "$output" | grep "Index sizes" ||
+        error "Index sizes should have been retrieved"
+    echo "$output" | grep "_id_" ||
+        error "The size of the '_id_' index should have been retrieved"
+    echo "$output" | grep "ns.parent_1" ||
+        error "The size of the 'ns.parent_1' index should have been retrieved"
+}
+
 ################################################################################
 #                                     MAIN                                     #
 ################################################################################
 
 declare -a tests=(test_all test_collection_size test_collection_count
                   test_collection_avg_obj_size test_collection_mountpoint
-                  test_command_backend test_last_sync_start_date)
+                  test_command_backend test_last_sync_start_date
+                  test_create_indexes test_index_sizes)
 
 tmpdir=$(mktemp --directory)
 trap -- "rm -rf '$tmpdir'" EXIT
@@ -14,10 +14,13 @@ enum fsevents_log_value {
     DEDUPLICATION_RATIO,
     ENRICH_MOUNTPOINT,
     ENRICH_SKIP_COUNT,
+    HELD_ENTRY_COUNT,
+    HELD_ENTRY_PEAK,
     SOURCE_READ,
     START_INDEX,
     TIME_READ_DEDUP,
     TIME_ENRICH_UPDATE,
+    TIME_WAIT_CHANGELOGS,
     WORKER_COUNT,
 };
 
@@ -45,6 +48,17 @@ key2fsevents_log_value(const char *key)
         if (key[7] == 's' && !strcmp(&key[8], "kip_count"))
             return ENRICH_SKIP_COUNT;
 
+        break;
+    case 'h':
+        if (strncmp(&key[1], "eld_entry_", 10))
+            break;
+
+        if (key[11] == 'c' && !strcmp(&key[12], "ount"))
+            return HELD_ENTRY_COUNT;
+
+        if (key[11] == 'p' && !strcmp(&key[12], "eak"))
+            return HELD_ENTRY_PEAK;
+
         break;
     case 's':
         if (key[1] == 'o' && !strcmp(&key[2], "urce_read"))
@@ -64,6 +78,9 @@ key2fsevents_log_value(const char *key)
         if (key[5] == 'e' && !strcmp(&key[6], "nrich_update"))
             return TIME_ENRICH_UPDATE;
 
+        if (key[5] == 'w' && !strcmp(&key[6], "ait_changelogs"))
+            return TIME_WAIT_CHANGELOGS;
+
         break;
     case 'w':
         if (!strcmp(&key[1], "orker_count"))
@@ -85,6 +102,10 @@ static const struct formatted_log_value fsevents_log_value[] = {
                               .print_log_value = print_value },
     [ENRICH_SKIP_COUNT] =   { .header = "Number of skipped entries in enrichment",
                               .print_log_value = print_value },
+    [HELD_ENTRY_COUNT] =    { .header = "Number of times entries were held back for deduplication",
+                              .print_log_value = print_value },
+    [HELD_ENTRY_PEAK] =     { .header = "Maximum number of entries held back at once",
+                              .print_log_value = print_value },
     [SOURCE_READ] =         { .header = "Source of the events",
                               .print_log_value = print_value },
     [START_INDEX] =         { .header = "Starting index for reading changelogs",
@@ -93,6 +114,8 @@ static const struct formatted_log_value fsevents_log_value[] = {
                               .print_log_value = print_timespec },
     [TIME_ENRICH_UPDATE] =  { .header = "Time spent enriching/updating mirror (on average between all workers)",
                               .print_log_value = print_timespec },
+    [TIME_WAIT_CHANGELOGS] = { .header = "Time spent waiting for changelogs to be read",
+                              .print_log_value = print_timespec },
     [WORKER_COUNT] =        { .header = "Number of parallel workers used",
                               .print_log_value = print_value },
 };
@@ -56,11 +56,20 @@ check_log_result()
     echo "$output" | grep "enriching/updating" > /dev/null ||
         error "time_enrich_update should have been retrieved, got '$output'"
 
+    echo "$output" | grep "waiting for changelogs" > /dev/null ||
+        error "time_wait_changelogs should have been retrieved, got '$output'"
+
     echo "$output" | grep "skipped" > /dev/null ||
         error "enrich_skip_count should have been retrieved, got '$output'"
 
     echo "$output" | grep "Ratio" > /dev/null ||
         error "deduplication_ratio should have been retrieved, got '$output'"
+
+    echo "$output" | grep "entries were held back" > /dev/null ||
+        error "held_entry_count should have been retrieved, got '$output'"
+
+    echo "$output" | grep "entries held back at once" > /dev/null ||
+        error "held_entry_peak should have been retrieved, got '$output'"
 }
 
 test_N_logs()
@@ -28,14 +28,15 @@ test_count()
     rbh_report "rbh:$db:$testdb" --csv --group-by "statx.type" \
                                    --output "count()" |
         difflines "directory: 27" "file: 26"
+
+    rbh_report "rbh:$db:$testdb" --csv --output "count()" -name missing |
+        difflines
 }
 
 ################################################################################
 #                                     MAIN                                     #
 ################################################################################
 
-mongo_only_test
-
 declare -a tests=(test_count)
 
 tmpdir=$(mktemp --directory)
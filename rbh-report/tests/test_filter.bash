@@ -82,8 +82,6 @@ test_filter_to_complete()
 #                                     MAIN                                     #
 ################################################################################
 
-mongo_only_test
-
 declare -a tests=(test_filter_type test_filter_size test_filter_to_complete)
 
 tmpdir=$(mktemp --directory)
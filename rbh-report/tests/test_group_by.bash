@@ -96,8 +96,23 @@ test_multi_group_by()
                   "$fake_user_id,file: $fake_user_file_size"
 }
 
+test_group_by_xattr()
+{
+    mkdir empty_dir full_dir
+    touch file full_dir/{1..3}
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    # Only directories have a number of children
+    rbh_report "rbh:$db:$testdb" --csv --group-by "xattrs.nb_children.value" \
+                                   --output "count()" |
+        difflines "0: 1" "3: 2"
+}
+
 test_group_by_invalid_value()
 {
+    mongo_only_test
+
     mkdir first_dir
     mkdir second_dir
     truncate --size 1M first_dir/first_file
@@ -142,10 +157,8 @@ test_group_by_invalid_value()
 #                                     MAIN                                     #
 ################################################################################
 
-mongo_only_test
-
 declare -a tests=(test_group_by_type test_group_by_user test_multi_group_by
-                  test_group_by_invalid_value)
+                  test_group_by_xattr test_group_by_invalid_value)
 
 tmpdir=$(mktemp --directory)
 test_user="$(get_test_user "$(basename "$0")")"
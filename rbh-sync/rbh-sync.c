@@ -13,10 +13,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sysexits.h>
 
+#include <sys/stat.h>
+
 #include <robinhood/alias.h>
 #include <robinhood/config.h>
+#include <robinhood/hashmap.h>
 #include <robinhood/itertools.h>
 #include <robinhood/log.h>
 #include <robinhood/plugins/backend.h>
@@ -79,6 +83,10 @@ destroy_chunks(void)
 
 static bool one = false;
 static bool skip_error = true;
+static bool incremental = false;
+static bool fresh_load = false;
+static size_t nb_updaters = 0;
+static const char *dest_uri;
 
 /*----------------------------------------------------------------------------*
  |                                   sync()                                   |
@@ -275,6 +283,338 @@ mut_iter_one(void *element)
     return &one->iterator;
 }
 
+    /*--------------------------------------------------------------------*
+     |                            incremental                             |
+     *--------------------------------------------------------------------*/
+
+/* In incremental mode, the directories DEST already holds are loaded before
+ * SOURCE is read. A directory is deemed unchanged if it is still linked at the
+ * same place, and if both its ctime and its mtime are the ones recorded in
+ * DEST, and older than the start of the last synchronization.
+ *
+ * Unchanged directories are not re-upserted, and neither are the entries they
+ * contain that were not changed since the last synchronization. Only their
+ * sync_time is refreshed, for `rbh-gc --sync-time` not to deem them stale.
+ *
+ * Entries the last synchronization skipped on error may lie in directories
+ * that did not change since, which DEST cannot tell: a full synchronization is
+ * run instead if the last one skipped any entry.
+ */
+
+struct mirror_directory {
+    struct rbh_fsentry *fsentry;
+    int64_t nb_children;
+    bool unchanged;
+};
+
+static struct {
+    struct rbh_hashmap *map;
+    struct mirror_directory *directories;
+    size_t count;
+    int64_t last_sync_start;
+    size_t skipped;
+} mirror;
+
+static void __attribute__((destructor))
+destroy_mirror(void)
+{
+    if (mirror.map)
+        rbh_hashmap_destroy(mirror.map);
+
+    for (size_t i = 0; i < mirror.count; i++)
+        free(mirror.directories[i].fsentry);
+    free(mirror.directories);
+}
+
+static bool
+mirror_equals(const void *first, const void *second)
+{
+    return rbh_id_equal(first, second);
+}
+
+static size_t
+hash_id(const void *key)
+{
+    const struct rbh_id *id = key;
+    size_t hash = 5381;
+
+    for (size_t i = 0; i < id->size; i++)
+        hash = hash * 33 + (unsigned char)id->data[i];
+
+    return hash;
+}
+
+static int64_t
+nb_children_from_xattrs(const struct rbh_value_map *xattrs)
+{
+    const struct rbh_value *nb_children;
+    const struct rbh_value *value;
+
+    nb_children = rbh_map_find(xattrs, "nb_children");
+    if (nb_children == NULL || nb_children->type != RBH_VT_MAP)
+        return -1;
+
+    value = rbh_map_find(&nb_children->map, "value");
+    if (value == NULL)
+        return -1;
+
+    switch (value->type) {
+    case RBH_VT_INT32:
+        return value->int32;
+    case RBH_VT_INT64:
+        return value->int64;
+    default:
+        return -1;
+    }
+}
+
+static const struct rbh_value *
+path_from_fsentry(const struct rbh_fsentry *fsentry)
+{
+    if (!(fsentry->mask & RBH_FP_NAMESPACE_XATTRS))
+        return NULL;
+
+    return rbh_map_find(&fsentry->xattrs.ns, "path");
+}
+
+static bool
+get_last_sync_start(int64_t *start)
+{
+    const struct rbh_value_map *info;
+    const struct rbh_value *value;
+
+    info = rbh_backend_get_info(to, RBH_INFO_LAST_SYNC_START_DATE);
+    if (info == NULL)
+        return false;
+
+    value = rbh_map_find(info, "last_sync_start_date");
+    if (value == NULL || value->type != RBH_VT_INT64)
+        return false;
+
+    *start = value->int64;
+    return true;
+}
+
+/* Whether the last synchronization skipped entries, or it cannot be told */
+static bool
+last_sync_skipped_entries(void)
+{
+    const struct rbh_log_options OPTIONS = {
+        .type = RBH_SYNC_LOG,
+        .count = 1,
+        .ascending = false,
+    };
+    const struct rbh_value *skipped;
+    const struct rbh_value *sync;
+    struct rbh_value_map *logs;
+
+    logs = rbh_backend_get_logs(to, OPTIONS);
+    if (logs == NULL || logs->count == 0)
+        return true;
+
+    sync = logs->pairs[0].value;
+    if (sync == NULL || sync->type != RBH_VT_MAP)
+        return true;
+
+    skipped = rbh_map_find(&sync->map, "skipped_entries");
+    return skipped == NULL || skipped->type != RBH_VT_INT64 ||
+           skipped->int64 != 0;
+}
+
+static const struct rbh_filter ISDIR_FILTER = {
+    .op = RBH_FOP_EQUAL,
+    .compare = {
+        .field = {
+            .fsentry = RBH_FP_STATX,
+            .statx = RBH_STATX_TYPE,
+        },
+        .value = {
+            .type = RBH_VT_INT32,
+            .int32 = S_IFDIR,
+        },
+    },
+};
+
+/* Only what directory_is_unchanged() and fsentry_is_unchanged() look at */
+static const struct rbh_value_pair MIRROR_NS_XATTRS[] = {
+    { .key = "path" },
+};
+
+static const struct rbh_value_pair MIRROR_INODE_XATTRS[] = {
+    { .key = "nb_children" },
+};
+
+static void
+load_mirror(void)
+{
+    const struct rbh_filter_options OPTIONS = { 0 };
+    const struct rbh_filter_output OUTPUT = {
+        .type = RBH_FOT_PROJECTION,
+        .projection = {
+            .fsentry_mask = RBH_FP_ID | RBH_FP_PARENT_ID | RBH_FP_NAME
+                          | RBH_FP_STATX | RBH_FP_INODE_XATTRS
+                          | RBH_FP_NAMESPACE_XATTRS,
+            .statx_mask = RBH_STATX_TYPE | RBH_STATX_CTIME | RBH_STATX_MTIME,
+            .xattrs = {
+                .ns = {
+                    .pairs = MIRROR_NS_XATTRS,
+                    .count = ARRAY_SIZE(MIRROR_NS_XATTRS),
+                },
+                .inode = {
+                    .pairs = MIRROR_INODE_XATTRS,
+                    .count = ARRAY_SIZE(MIRROR_INODE_XATTRS),
+                },
+            },
+        },
+    };
+    struct rbh_mut_iterator *directories;
+    struct rbh_fsentry *fsentry;
+    size_t capacity = 1 << 10;
+
+    if (!get_last_sync_start(&mirror.last_sync_start)) {
+        fprintf(stderr, "no previous synchronization found in DEST, "
+                        "running a full synchronization\n");
+        return;
+    }
+
+    if (last_sync_skipped_entries()) {
+        fprintf(stderr, "the last synchronization of DEST skipped entries, "
+                        "running a full synchronization\n");
+        return;
+    }
+
+    directories = rbh_backend_filter(to, &ISDIR_FILTER, &OPTIONS, &OUTPUT,
+                                     NULL);
+    if (directories == NULL)
+        error(EXIT_FAILURE, errno, "while listing DEST's directories");
+
+    mirror.directories = xmalloc(capacity * sizeof(*mirror.directories));
+    while ((fsentry = rbh_mut_iter_next(directories)) != NULL) {
+        struct mirror_directory *directory;
+
+        if (mirror.count == capacity) {
+            capacity *= 2;
+            mirror.directories = xreallocarray(mirror.directories, capacity,
+                                               sizeof(*mirror.directories));
+        }
+
+        directory = &mirror.directories[mirror.count++];
+        directory->fsentry = fsentry;
+        directory->nb_children = fsentry->mask & RBH_FP_INODE_XATTRS ?
+            nb_children_from_xattrs(&fsentry->xattrs.inode) : -1;
+        directory->unchanged = false;
+    }
+
+    if (errno != ENODATA)
+        error(EXIT_FAILURE, errno, "while listing DEST's directories");
+    rbh_mut_iter_destroy(directories);
+
+    /* The array does not move anymore, its elements can be referenced */
+    mirror.map = rbh_hashmap_new_resizable(mirror_equals, hash_id,
+                                           mirror.count ? : 1);
+    if (mirror.map == NULL)
+        error(EXIT_FAILURE, errno, "rbh_hashmap_new_resizable");
+
+    for (size_t i = 0; i < mirror.count; i++) {
+        struct mirror_directory *directory = &mirror.directories[i];
+
+        if (rbh_hashmap_set(mirror.map, &directory->fsentry->id, directory))
+            error(EXIT_FAILURE, errno, "rbh_hashmap_set");
+    }
+}
+
+static bool
+statx_timestamp_equal(const struct rbh_statx_timestamp *first,
+                      const struct rbh_statx_timestamp *second)
+{
+    return first->tv_sec == second->tv_sec && first->tv_nsec == second->tv_nsec;
+}
+
+static bool
+directory_is_unchanged(const struct rbh_fsentry *fsentry,
+                       const struct rbh_fsentry *mirrored)
+{
+    const struct rbh_statx *statx = mirrored->statx;
+    const struct rbh_value *source_path;
+    const struct rbh_value *mirror_path;
+
+    if (!(mirrored->mask & RBH_FP_STATX) ||
+        (statx->stx_mask & (RBH_STATX_CTIME | RBH_STATX_MTIME)) !=
+            (RBH_STATX_CTIME | RBH_STATX_MTIME))
+        return false;
+
+    /* Changes made during the last synchronization may have been missed */
+    if (statx->stx_ctime.tv_sec >= mirror.last_sync_start ||
+        statx->stx_mtime.tv_sec >= mirror.last_sync_start)
+        return false;
+
+    if (!statx_timestamp_equal(&statx->stx_ctime, &fsentry->statx->stx_ctime) ||
+        !statx_timestamp_equal(&statx->stx_mtime, &fsentry->statx->stx_mtime))
+        return false;
+
+    /* A directory keeps its ctime when one of its ancestors is renamed, but
+     * the path of every entry below it changes.
+     */
+    if ((fsentry->mask & RBH_FP_PARENT_ID) !=
+        (mirrored->mask & RBH_FP_PARENT_ID))
+        return false;
+    if ((fsentry->mask & RBH_FP_PARENT_ID) &&
+        !rbh_id_equal(&fsentry->parent_id, &mirrored->parent_id))
+        return false;
+    if ((fsentry->mask & RBH_FP_NAME) && (mirrored->mask & RBH_FP_NAME) &&
+        strcmp(fsentry->name, mirrored->name))
+        return false;
+
+    source_path = path_from_fsentry(fsentry);
+    mirror_path = path_from_fsentry(mirrored);
+    if (source_path == NULL || mirror_path == NULL)
+        return source_path == mirror_path;
+
+    return source_path->type == RBH_VT_STRING &&
+           mirror_path->type == RBH_VT_STRING &&
+           strcmp(source_path->string, mirror_path->string) == 0;
+}
+
+/* Whether \p fsentry can be left out of an incremental synchronization */
+static bool
+fsentry_is_unchanged(const struct rbh_fsentry *fsentry)
+{
+    const uint32_t TIMES = RBH_STATX_TYPE | RBH_STATX_CTIME | RBH_STATX_MTIME;
+    struct mirror_directory *directory;
+
+    if (!(fsentry->mask & RBH_FP_STATX)) {
+        /* Fsentries that only update the number of children of a directory */
+        if (!(fsentry->mask & RBH_FP_INODE_XATTRS))
+            return false;
+
+        directory = (void *)rbh_hashmap_get(mirror.map, &fsentry->id);
+        return directory && directory->unchanged &&
+               directory->nb_children ==
+                   nb_children_from_xattrs(&fsentry->xattrs.inode);
+    }
+
+    if ((fsentry->statx->stx_mask & TIMES) != TIMES)
+        return false;
+
+    if (S_ISDIR(fsentry->statx->stx_mode)) {
+        directory = (void *)rbh_hashmap_get(mirror.map, &fsentry->id);
+        if (directory == NULL)
+            return false;
+
+        directory->unchanged = directory_is_unchanged(fsentry,
+                                                      directory->fsentry);
+        return directory->unchanged;
+    }
+
+    if (!(fsentry->mask & RBH_FP_PARENT_ID) ||
+        fsentry->statx->stx_ctime.tv_sec >= mirror.last_sync_start)
+        return false;
+
+    /* Entries only need to be looked at again if their parent changed */
+    directory = (void *)rbh_hashmap_get(mirror.map, &fsentry->parent_id);
+    return directory && directory->unchanged;
+}
+
     /*--------------------------------------------------------------------*
      |                           iter_convert()                           |
      *--------------------------------------------------------------------*/
@@ -293,14 +633,30 @@ struct convert_iterator {
     const struct rbh_fsentry *fsentry;
     struct rbh_fsevent fsevent;
     struct rbh_statx statx;
+    /* The xattr of an unchanged entry's sync_time fsevent */
+    struct rbh_value_pair sync_time;
     struct {
         bool upsert:1;
         bool inode_xattr:1;
         bool link:1;
         bool ns_xattr:1;
+        bool sync_time:1;
     } todo;
 };
 
+/* The sync_time of \p fsentry, if it can be refreshed on its own */
+static const struct rbh_value *
+sync_time_from_fsentry(const struct rbh_fsentry *fsentry)
+{
+    const uint32_t NAMESPACE = RBH_FP_PARENT_ID | RBH_FP_NAME
+                             | RBH_FP_NAMESPACE_XATTRS;
+
+    if ((fsentry->mask & NAMESPACE) != NAMESPACE)
+        return NULL;
+
+    return rbh_map_find(&fsentry->xattrs.ns, "sync_time");
+}
+
 /* Advance a convert_iterator to its next fsentry */
 static int
 _convert_iter_next(struct convert_iterator *convert,
@@ -340,6 +696,18 @@ next:
         if (!has.id)
             goto next;
 
+        if (mirror.map != NULL && fsentry_is_unchanged(fsentry)) {
+            mirror.skipped++;
+            if (!needs.ns_xattrs || sync_time_from_fsentry(fsentry) == NULL)
+                goto next;
+
+            convert->fsentry = fsentry;
+            convert->todo.upsert = convert->todo.inode_xattr = false;
+            convert->todo.link = convert->todo.ns_xattr = false;
+            convert->todo.sync_time = true;
+            return 0;
+        }
+
         /* What kind of fsevent should this fsentry be converted into? */
         upsert = needs.id;
         inode_xattr = !upsert && needs.inode_xattrs && has.inode_xattrs;
@@ -353,6 +721,7 @@ next:
     convert->todo.inode_xattr = inode_xattr;
     convert->todo.link = link;
     convert->todo.ns_xattr = ns_xattr;
+    convert->todo.sync_time = false;
     return 0;
 }
 
@@ -487,6 +856,34 @@ ns_xattr_from_fsentry(struct rbh_fsevent *fsevent,
     return fsevent;
 }
 
+static struct rbh_fsevent *
+sync_time_from_unchanged_fsentry(struct rbh_fsevent *fsevent,
+                                 struct rbh_value_pair *sync_time,
+                                 const struct rbh_fsentry *fsentry)
+{
+    fsevent->type = RBH_FET_XATTR;
+    assert(fsentry->mask & RBH_FP_ID);
+    fsevent->id = fsentry->id;
+    fsevent->ns.parent_id = &fsentry->parent_id;
+    fsevent->ns.name = fsentry->name;
+
+    sync_time->key = "sync_time";
+    sync_time->value = sync_time_from_fsentry(fsentry);
+    fsevent->xattrs.pairs = sync_time;
+    fsevent->xattrs.count = 1;
+
+    if (stack == NULL)
+        stack = rbh_sstack_new(MIN_VALUES_SSTACK_ALLOC *
+                               (sizeof(struct rbh_value)));
+
+    rbh_sstack_clear(stack);
+    if (convert_xattrs_with_operation(fsevent->xattrs.pairs,
+                                      fsevent->xattrs.count, "set", stack))
+        return NULL;
+
+    return fsevent;
+}
+
 static const void *
 convert_iter_next(void *iterator)
 {
@@ -514,6 +911,13 @@ convert_iter_next(void *iterator)
         return ns_xattr_from_fsentry(&convert->fsevent, convert->fsentry);
     }
 
+    if (convert->todo.sync_time) {
+        convert->todo.sync_time = false;
+        return sync_time_from_unchanged_fsentry(&convert->fsevent,
+                                                &convert->sync_time,
+                                                convert->fsentry);
+    }
+
     if (_convert_iter_next(convert, convert->projection))
         return NULL;
 
@@ -551,10 +955,339 @@ iter_convert(struct rbh_iterator *fsentries,
     convert->fsentry = NULL;
     convert->todo.upsert = convert->todo.link = false;
     convert->todo.inode_xattr = convert->todo.ns_xattr = false;
+    convert->todo.sync_time = false;
 
     return &convert->iterator;
 }
 
+    /*--------------------------------------------------------------------*
+     |                             pipeline                               |
+     *--------------------------------------------------------------------*/
+
+/* In pipelined mode, SOURCE is read on the main thread, which clones the
+ * fsevents it converts into batches and hands them to updater threads. Each
+ * updater applies batches with its own handle on DEST, which means reading
+ * SOURCE and updating DEST overlap.
+ *
+ * An fsentry is not always converted into consecutive fsevents: the number of
+ * children of a directory is only known once they were all read, and a
+ * hardlinked inode is linked again wherever it is found. Every fsevent of an
+ * ID is thus handed to the same updater, through a bounded queue of its own,
+ * for DEST to see them in the order SOURCE produced them.
+ */
+
+struct fsevent_batch {
+    struct rbh_fsevent **clones;
+    struct rbh_fsevent *fsevents;
+    size_t count;
+    size_t capacity;
+};
+
+/* Batches queued for an updater, on top of the one it is applying */
+#define UPDATER_QUEUE_SIZE 2
+
+struct updater {
+    struct pipeline *pipeline;
+    struct rbh_backend *backend;
+    pthread_t thread;
+    pthread_cond_t not_empty;
+    struct fsevent_batch *batches[UPDATER_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    /* The batch the main thread is filling for this updater */
+    struct fsevent_batch *filling;
+    struct timespec stall;
+    size_t batch_count;
+};
+
+struct pipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    struct updater *updaters;
+    bool done;
+    int error;
+    char backend_error[sizeof(rbh_backend_error)];
+    struct timespec stall;
+};
+
+static struct fsevent_batch *
+fsevent_batch_new(void)
+{
+    struct fsevent_batch *batch;
+
+    batch = xmalloc(sizeof(*batch));
+    batch->capacity = RBH_ITER_CHUNK_SIZE;
+    batch->clones = xmalloc(batch->capacity * sizeof(*batch->clones));
+    batch->fsevents = NULL;
+    batch->count = 0;
+
+    return batch;
+}
+
+static void
+fsevent_batch_add(struct fsevent_batch *batch, const struct rbh_fsevent *fsevent)
+{
+    if (batch->count == batch->capacity) {
+        batch->capacity *= 2;
+        batch->clones = xreallocarray(batch->clones, batch->capacity,
+                                      sizeof(*batch->clones));
+    }
+
+    batch->clones[batch->count++] = rbh_fsevent_clone(fsevent);
+}
+
+static void
+fsevent_batch_destroy(struct fsevent_batch *batch)
+{
+    for (size_t i = 0; i < batch->count; i++)
+        free(batch->clones[i]);
+
+    free(batch->fsevents);
+    free(batch->clones);
+    free(batch);
+}
+
+static struct rbh_iterator *
+fsevent_batch_iter(struct fsevent_batch *batch)
+{
+    /* Clones carry their data with them, shallow copies are enough */
+    batch->fsevents = xmalloc(batch->count * sizeof(*batch->fsevents));
+    for (size_t i = 0; i < batch->count; i++)
+        batch->fsevents[i] = *batch->clones[i];
+
+    return rbh_iter_array(batch->fsevents, sizeof(*batch->fsevents),
+                          batch->count, NULL);
+}
+
+static void
+pipeline_fail(struct pipeline *pipeline, int error)
+{
+    pthread_mutex_lock(&pipeline->lock);
+    if (pipeline->error == 0) {
+        pipeline->error = error;
+        if (error == RBH_BACKEND_ERROR)
+            strcpy(pipeline->backend_error, rbh_backend_error);
+    }
+    pthread_cond_broadcast(&pipeline->not_full);
+    for (size_t i = 0; i < nb_updaters; i++)
+        pthread_cond_signal(&pipeline->updaters[i].not_empty);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+static void
+timed_wait(pthread_cond_t *cond, pthread_mutex_t *lock, struct timespec *stall)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_cond_wait(cond, lock);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timespec_accumulate(stall, start, end);
+}
+
+/* Returns false if the pipeline failed and \p batch was not queued */
+static bool
+pipeline_push(struct updater *updater, struct fsevent_batch *batch)
+{
+    struct pipeline *pipeline = updater->pipeline;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (updater->count == UPDATER_QUEUE_SIZE && pipeline->error == 0)
+        timed_wait(&pipeline->not_full, &pipeline->lock, &pipeline->stall);
+
+    if (pipeline->error) {
+        pthread_mutex_unlock(&pipeline->lock);
+        fsevent_batch_destroy(batch);
+        return false;
+    }
+
+    updater->batches[(updater->head + updater->count) % UPDATER_QUEUE_SIZE] =
+        batch;
+    updater->count++;
+    pthread_cond_signal(&updater->not_empty);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return true;
+}
+
+static struct fsevent_batch *
+pipeline_pop(struct updater *updater)
+{
+    struct pipeline *pipeline = updater->pipeline;
+    struct fsevent_batch *batch = NULL;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (updater->count == 0 && !pipeline->done && pipeline->error == 0)
+        timed_wait(&updater->not_empty, &pipeline->lock, &updater->stall);
+
+    if (updater->count > 0 && pipeline->error == 0) {
+        batch = updater->batches[updater->head];
+        updater->head = (updater->head + 1) % UPDATER_QUEUE_SIZE;
+        updater->count--;
+        pthread_cond_signal(&pipeline->not_full);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return batch;
+}
+
+static void *
+updater_thread(void *arg)
+{
+    struct updater *updater = arg;
+    struct pipeline *pipeline = updater->pipeline;
+    struct fsevent_batch *batch;
+
+    while ((batch = pipeline_pop(updater)) != NULL) {
+        struct rbh_iterator *fsevents = fsevent_batch_iter(batch);
+        int save_errno;
+        ssize_t count;
+
+        count = rbh_backend_update(updater->backend, fsevents);
+        save_errno = errno;
+        rbh_iter_destroy(fsevents);
+        fsevent_batch_destroy(batch);
+        if (count < 0) {
+            pipeline_fail(pipeline, save_errno);
+            return NULL;
+        }
+        updater->batch_count++;
+    }
+
+    if (pipeline->error == 0 && rbh_backend_update(updater->backend, NULL) < 0)
+        pipeline_fail(pipeline, errno);
+
+    return NULL;
+}
+
+/* Returns whether \p backend is empty and may insert entries without looking
+ * for them first
+ */
+static bool
+enable_fresh_load(struct rbh_backend *backend)
+{
+    const bool enable = true;
+
+    return rbh_backend_set_option(backend, RBH_GBO_FRESH_LOAD, &enable,
+                                  sizeof(enable)) == 0;
+}
+
+static void
+print_stall(const char *stage, struct timespec stall)
+{
+    fprintf(stderr, "%s stalled for %ld.%03lds\n", stage, stall.tv_sec,
+            stall.tv_nsec / 1000000);
+}
+
+static void
+sync_pipelined(struct rbh_iterator *fsevents)
+{
+    struct pipeline pipeline = {};
+    const struct rbh_fsevent *fsevent;
+    struct updater *updaters;
+    int save_errno;
+
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.not_full, NULL);
+
+    updaters = xcalloc(nb_updaters, sizeof(*updaters));
+    pipeline.updaters = updaters;
+    for (size_t i = 0; i < nb_updaters; i++) {
+        updaters[i].pipeline = &pipeline;
+        pthread_cond_init(&updaters[i].not_empty, NULL);
+        updaters[i].filling = fsevent_batch_new();
+        /* Each updater needs its own connection to DEST */
+        updaters[i].backend = i == 0 ? to : rbh_backend_from_uri(dest_uri,
+                                                                 false);
+        if (i > 0 && fresh_load)
+            enable_fresh_load(updaters[i].backend);
+    }
+
+    for (size_t i = 0; i < nb_updaters; i++) {
+        errno = pthread_create(&updaters[i].thread, NULL, updater_thread,
+                               &updaters[i]);
+        if (errno)
+            error(EXIT_FAILURE, errno, "pthread_create");
+    }
+
+    while ((fsevent = rbh_iter_next(fsevents)) != NULL) {
+        struct updater *updater = &updaters[hash_id(&fsevent->id)
+                                            % nb_updaters];
+        struct fsevent_batch *batch = updater->filling;
+
+        /* Keep the consecutive fsevents of an fsentry in the same batch */
+        if (batch->count >= RBH_ITER_CHUNK_SIZE &&
+            !rbh_id_equal(&fsevent->id, &batch->clones[batch->count - 1]->id)) {
+            updater->filling = NULL;
+            if (!pipeline_push(updater, batch))
+                break;
+            batch = updater->filling = fsevent_batch_new();
+        }
+        fsevent_batch_add(batch, fsevent);
+    }
+    save_errno = errno;
+
+    if (fsevent == NULL && save_errno != ENODATA)
+        pipeline_fail(&pipeline, save_errno);
+
+    /* After an error, pipeline_push() destroys what it is handed */
+    for (size_t i = 0; i < nb_updaters; i++) {
+        struct fsevent_batch *batch = updaters[i].filling;
+
+        if (batch == NULL)
+            continue;
+
+        if (batch->count > 0)
+            pipeline_push(&updaters[i], batch);
+        else
+            fsevent_batch_destroy(batch);
+    }
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.done = true;
+    for (size_t i = 0; i < nb_updaters; i++)
+        pthread_cond_signal(&updaters[i].not_empty);
+    pthread_mutex_unlock(&pipeline.lock);
+
+    for (size_t i = 0; i < nb_updaters; i++)
+        pthread_join(updaters[i].thread, NULL);
+
+    print_stall("source", pipeline.stall);
+    for (size_t i = 0; i < nb_updaters; i++) {
+        char stage[32];
+
+        snprintf(stage, sizeof(stage), "updater %zu (%zu batches)", i,
+                 updaters[i].batch_count);
+        print_stall(stage, updaters[i].stall);
+        if (i > 0)
+            rbh_backend_destroy(updaters[i].backend);
+
+        /* Batches left behind after an error */
+        for (size_t j = 0; j < updaters[i].count; j++) {
+            size_t index = (updaters[i].head + j) % UPDATER_QUEUE_SIZE;
+
+            fsevent_batch_destroy(updaters[i].batches[index]);
+        }
+        pthread_cond_destroy(&updaters[i].not_empty);
+    }
+
+    free(updaters);
+    pthread_cond_destroy(&pipeline.not_full);
+    pthread_mutex_destroy(&pipeline.lock);
+    rbh_iter_destroy(fsevents);
+
+    switch (pipeline.error) {
+    case 0:
+        break;
+    case RBH_BACKEND_ERROR:
+        error(EXIT_FAILURE, 0, "%s", pipeline.backend_error);
+        __builtin_unreachable();
+    default:
+        error(EXIT_FAILURE, pipeline.error,
+              "while synchronizing SOURCE's entries");
+    }
+}
+
 static void
 sync(const struct rbh_filter_projection *projection,
      struct rbh_metadata *metadata)
@@ -577,6 +1310,13 @@ sync(const struct rbh_filter_projection *projection,
     metadata->sync_md.converted_entries = 0;
     metadata->sync_md.skipped_entries = 0;
 
+    if (incremental && !one)
+        load_mirror();
+
+    /* DEST is only empty the first time it is synchronized */
+    if (!one)
+        fresh_load = enable_fresh_load(to);
+
     if (one) {
         struct rbh_fsentry *root;
 
@@ -601,6 +1341,11 @@ sync(const struct rbh_filter_projection *projection,
     /* Convert all this information into fsevents */
     fsevents = iter_convert(fsentries, projection);
 
+    if (nb_updaters > 0) {
+        sync_pipelined(fsevents);
+        return;
+    }
+
     /* XXX: the mongo backend tries to process all the fsevents at once in a
      *      single bulk operation, but a bulk operation is limited in size.
      *
@@ -737,9 +1482,13 @@ usage(void)
         "    -f, --field [+-]FIELD  select, add or remove a FIELD to synchronize\n"
         "                           (can be specified multiple times)\n"
         "    -h, --help             show this message and exit\n"
+        "    -i, --incremental      do not update the entries of DEST that did not\n"
+        "                           change since the last synchronization\n"
         "    -n, --no-skip          do not skip errors when synchronizing backends,\n"
         "                           instead stop on the first error.\n"
         "    -o, --one              only consider the root of SOURCE\n"
+        "    -u, --updaters N       read SOURCE while N threads update DEST, each\n"
+        "                           with its own connection\n"
         "    --version              print RobinHood 4's version\n"
         "\n"
         "Capability arguments:\n"
@@ -791,6 +1540,10 @@ main(int argc, char *argv[])
             .name = "help",
             .val = 'h',
         },
+        {
+            .name = "incremental",
+            .val = 'i',
+        },
         {
             .name = "list-capabilities",
             .val = 'l',
@@ -803,6 +1556,11 @@ main(int argc, char *argv[])
             .name = "one",
             .val = 'o',
         },
+        {
+            .name = "updaters",
+            .has_arg = required_argument,
+            .val = 'u',
+        },
         {
             .name = "dry-run",
             .val = 'd',
@@ -819,6 +1577,7 @@ main(int argc, char *argv[])
         .statx_mask = RBH_STATX_ALL & ~RBH_STATX_MNT_ID,
     };
     struct rbh_metadata metadata = { 0 };
+    uint64_t updaters;
     char *cmd_backend;
     int rc;
     char c;
@@ -832,7 +1591,7 @@ main(int argc, char *argv[])
     rbh_apply_aliases(&argc, &argv);
 
     /* Parse the command line */
-    while ((c = getopt_long(argc, argv, "c:f:hl:on:dz", LONG_OPTIONS,
+    while ((c = getopt_long(argc, argv, "c:f:hil:on:u:dz", LONG_OPTIONS,
                             NULL)) != -1) {
         switch (c) {
         case 'c':
@@ -855,6 +1614,9 @@ main(int argc, char *argv[])
         case 'h':
             usage();
             return 0;
+        case 'i':
+            incremental = true;
+            break;
         case 'l':
             list_capabilities(optarg);
             return EXIT_SUCCESS;
@@ -864,6 +1626,12 @@ main(int argc, char *argv[])
         case 'n':
             skip_error = false;
             break;
+        case 'u':
+            if (str2uint64_t(optarg, &updaters) || updaters == 0 ||
+                updaters > 1024)
+                error(EX_USAGE, 0, "invalid number of updaters: '%s'", optarg);
+            nb_updaters = updaters;
+            break;
         case 'd':
             rbh_display_resolved_argv(NULL, &argc, &argv);
             return EXIT_SUCCESS;
@@ -893,6 +1661,14 @@ main(int argc, char *argv[])
                                        &cmd_backend);
     /* Parse DEST */
     to = rbh_backend_from_uri(argv[1], false);
+    dest_uri = argv[1];
+
+    /* SQLite serializes writers, more updaters would only wait on each other */
+    if (to->id == RBH_BI_SQLITE && nb_updaters > 1) {
+        fprintf(stderr, "%s only allows one writer at a time, using a single "
+                        "updater\n", to->name);
+        nb_updaters = 1;
+    }
 
     sync_source(cmd_backend);
     free(cmd_backend);
@@ -902,6 +1678,10 @@ main(int argc, char *argv[])
     sync(&projection, &metadata);
     metadata.common_md.end_time = time(NULL);
 
+    if (mirror.map != NULL)
+        fprintf(stderr, "%zu unchanged entries were not upserted\n",
+                mirror.skipped);
+
     insert_sync_log(to, &metadata);
 
     free(metadata.sync_md.source_mountpoint);
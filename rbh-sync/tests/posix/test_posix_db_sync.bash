@@ -79,6 +79,31 @@ test_sync_xattrs()
                    '"xattrs.user.c" : { $exists : true }'
 }
 
+test_sync_fresh_load_xattrs()
+{
+    truncate -s 1k "file"
+    setfattr -n user.b -v 1 "file"
+    setfattr -n user.a.x -v 2 "file"
+    setfattr -n user.c -v 3 "file"
+    setfattr -n user.a.y.z -v 4 "file"
+
+    # The first synchronization inserts the entries, the second one updates
+    # them, both must lay their xattrs out the same way
+    for i in 1 2; do
+        rbh_sync_posix "." "rbh:$db:$testdb"
+
+        for xattr in user.b user.a.x user.c user.a.y.z; do
+            find_attribute '"ns.xattrs.path":"/file"' \
+                           '"xattrs.'$xattr'" : { $exists : true }'
+        done
+
+        local count=$(count_documents)
+        if [[ $count != 2 ]]; then
+            error "Expected 2 entries, found $count"
+        fi
+    done
+}
+
 test_sync_subdir()
 {
     mkdir "dir"
@@ -586,20 +611,190 @@ test_nb_children_two_sync()
         '"xattrs.nb_children.value": 0'
 }
 
+test_sync_parallel()
+{
+    mkdir -p {1..9}/{1..9}
+    touch {1..9}/{1..9}/file
+
+    # The parallel iterator walks with threads, not MPI ranks: under mpirun,
+    # every rank would walk the whole tree, so always run a single process.
+    "$__rbh_sync" "rbh:posix-parallel:." "rbh:$db:$testdb"
+    for i in $(find *); do
+        find_attribute '"ns.xattrs.path":"/'$i'"'
+    done
+
+    find_attribute '"ns.xattrs.path": "/"' '"xattrs.nb_children.value": 9'
+    find_attribute '"ns.xattrs.path": "/1"' '"xattrs.nb_children.value": 9'
+    find_attribute '"ns.xattrs.path": "/1/1"' '"xattrs.nb_children.value": 1'
+
+    local count=$(count_documents)
+    local expected=$(find . | wc -l)
+    if [[ $count != $expected ]]; then
+        error "Expected $expected entries, found $count"
+    fi
+}
+
+test_sync_pipelined()
+{
+    mkdir -p {1..9}/{1..9}
+    touch {1..9}/{1..9}/file
+
+    rbh_sync --updaters 3 "rbh:posix:." "rbh:$db:$testdb"
+    for i in $(find *); do
+        find_attribute '"ns.xattrs.path":"/'$i'"'
+    done
+
+    find_attribute '"ns.xattrs.path": "/"' '"xattrs.nb_children.value": 9'
+
+    local count=$(count_documents)
+    local expected=$(find . | wc -l)
+    if [[ $count != $expected ]]; then
+        error "Expected $expected entries, found $count"
+    fi
+}
+
+test_sync_pipelined_order()
+{
+    mkdir -p {1..9}/{1..9}
+    touch file
+    for i in {1..9}; do
+        ln file $i/link
+    done
+
+    # The number of children of a directory and the links of an inode are
+    # fsevents of their own, they must not be overtaken by earlier ones
+    for i in 1 2; do
+        rbh_sync --updaters 4 "rbh:posix:." "rbh:$db:$testdb"
+
+        for j in {1..9}; do
+            find_attribute '"ns.xattrs.path":"/'$j'"' \
+                           '"xattrs.nb_children.value": 10'
+            find_attribute '"ns.xattrs.path":"/'$j'/link"'
+            find_attribute '"ns.xattrs.path":"/'$j'/1"' \
+                           '"xattrs.nb_children.value": 0'
+        done
+        find_attribute '"ns.xattrs.path":"/"' '"xattrs.nb_children.value": 10'
+        find_attribute '"ns.xattrs.path":"/file"'
+
+        local count=$(count_documents)
+        local expected=$(( $(find . | wc -l) - 9 ))
+        if [[ $count != $expected ]]; then
+            error "Expected $expected entries, found $count"
+        fi
+    done
+}
+
+test_sync_hardlinks()
+{
+    mkdir dir
+    touch file
+    ln file dir/link
+
+    # The first synchronization inserts entries, the second one updates them
+    for i in 1 2; do
+        rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+        find_attribute '"ns.xattrs.path":"/file"'
+        find_attribute '"ns.xattrs.path":"/dir/link"'
+
+        local count=$(count_documents)
+        if [[ $count != 3 ]]; then
+            error "Expected 3 entries, found $count"
+        fi
+    done
+}
+
+test_sync_incremental()
+{
+    mongo_only_test
+
+    mkdir cold hot
+    touch cold/file hot/file
+    # Make sure the entries are older than the start of the first sync
+    sleep 1
+
+    rbh_sync "rbh:posix:." "rbh:$db:$testdb"
+
+    # Tamper with the mirror to tell which entries get updated again
+    do_db update $testdb "/cold/file" '"statx.uid": -1'
+    do_db update $testdb "/hot/file" '"statx.uid": -1'
+    touch hot/new
+    # For the sync_time of the first synchronization to be older than start
+    sleep 1
+    local start=$(date +%s)
+
+    rbh_sync --incremental "rbh:posix:." "rbh:$db:$testdb"
+
+    # Unchanged entries still get their sync_time refreshed
+    rbh_gc -d -s $start "rbh:$db:$testdb" |
+        difflines "0 element total to delete"
+
+    find_attribute '"ns.xattrs.path":"/cold/file"' '"statx.uid": -1'
+    find_attribute '"ns.xattrs.path":"/hot/file"' '"statx.uid": '$(id -u)
+    find_attribute '"ns.xattrs.path":"/hot/new"'
+    find_attribute '"ns.xattrs.path": "/hot"' '"xattrs.nb_children.value": 2'
+
+    local count=$(count_documents)
+    local expected=$(find . | wc -l)
+    if [[ $count != $expected ]]; then
+        error "Expected $expected entries, found $count"
+    fi
+}
+
+test_sync_bulk_writers()
+{
+    mongo_only_test
+
+    local conf_file="conf"
+
+    cat > $conf_file << EOF
+---
+mongo:
+    bulk_writers: !int32 4
+---
+EOF
+
+    mkdir -p {1..9}/{1..9}
+    touch {1..9}/{1..9}/file
+    ln 1/1/file link
+
+    # The first synchronization is a fresh load, only the second one goes
+    # through the bulk writers
+    for i in 1 2; do
+        rbh_sync --config $conf_file "rbh:posix:." "rbh:$db:$testdb"
+        for entry in $(find *); do
+            find_attribute '"ns.xattrs.path":"/'$entry'"'
+        done
+
+        find_attribute '"ns.xattrs.path": "/"' '"xattrs.nb_children.value": 11'
+
+        local count=$(count_documents)
+        local expected=$(( $(find . | wc -l) - 1 ))
+        if [[ $count != $expected ]]; then
+            error "Expected $expected entries, found $count"
+        fi
+    done
+}
+
 ################################################################################
 #                                     MAIN                                     #
 ################################################################################
 
 declare -a tests=(test_sync_2_files test_sync_size test_sync_3_files
-                  test_sync_xattrs test_sync_subdir test_sync_large_tree
-                  test_sync_one_one_file test_sync_one test_sync_one_two_files
+                  test_sync_xattrs test_sync_fresh_load_xattrs
+                  test_sync_subdir test_sync_large_tree test_sync_one_one_file
+                  test_sync_one test_sync_one_two_files
                   test_sync_symbolic_link test_sync_socket test_sync_fifo
                   test_sync_branch test_continue_sync_on_error
                   test_stop_sync_on_error test_config test_sync_number_children
-                  test_nb_children_two_sync)
+                  test_nb_children_two_sync test_sync_hardlinks
+                  test_sync_incremental test_sync_bulk_writers
+                  test_sync_parallel)
 
 if [[ $WITH_MPI == true ]]; then
     tests+=(test_sync_large_path test_sync_dir_delete_while_mfu_walk)
+else
+    tests+=(test_sync_pipelined test_sync_pipelined_order)
 fi
 
 tmpdir=$(mktemp --directory)
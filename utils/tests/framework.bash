@@ -309,6 +309,17 @@ mongo_only_test()
     fi
 }
 
+sqlite_only_test()
+{
+    if [[ $db != sqlite ]]; then
+        if (( $# != 0 )); then
+            skip "$@"
+        else
+            skip "this can only works with sqlite"
+        fi
+    fi
+}
+
 db=${RBH_TEST_DB:-mongo}
 if "$WITH_MPI"; then
     # SQLite does not support concurrent writers so skip tests.